@@ -109,18 +109,18 @@ void app::PopulateCommandList()
 	unsigned int constantBufferIndex = c_numDrawCalls * (m_frameIndex % FrameCount);
 
 	// Set the per-frame constants
-	ConstantBuffer cbParameters{};
+	ConstantBuffer cbParameters;
 
 	// Shaders compiled with default row-major matrices
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(m_worldMatrix));
-	XMStoreFloat4x4(&cbParameters.viewMatrix, XMMatrixTranspose(m_viewMatrix));
-	XMStoreFloat4x4(&cbParameters.projectionMatrix, XMMatrixTranspose(m_projectionMatrix));
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(m_worldMatrix));
+	XMStoreFloat4x4(&cbParameters.Field<ViewMatrix>(), XMMatrixTranspose(m_viewMatrix));
+	XMStoreFloat4x4(&cbParameters.Field<ProjectionMatrix>(), XMMatrixTranspose(m_projectionMatrix));
 
 	// Set the constants for the first draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+	UploadCopy(m_mappedConstantData + ConstantBuffer::PlacementSize * constantBufferIndex, cbParameters.GetData(), ConstantBuffer::Size);
 
 	// Bind the constants to the shader
-	auto baseGpuAddress = m_constantDataGpuAddr + sizeof(PaddedConstantBuffer) * constantBufferIndex;
+	auto baseGpuAddress = m_constantDataGpuAddr + ConstantBuffer::PlacementSize * constantBufferIndex;
 	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
 
 	// Indicate that the back buffer will be used as a render target.
@@ -142,7 +142,7 @@ void app::PopulateCommandList()
 
 	// Draw the cube
 	m_commandList->DrawIndexedInstanced(36, 1, 0, 0, 0);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
+	baseGpuAddress += ConstantBuffer::PlacementSize;
 	++constantBufferIndex;
 
 	// Draw the quads
@@ -158,18 +158,18 @@ void app::PopulateCommandList()
 		XMMATRIX translateMatrix = XMMatrixTranslation( (-1.f + m * 2), 1.f, -3.0f - (m * 2));
 
 		// Update world matrix and output color.
-		XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(rotationMatrix * (scaleMatrix * translateMatrix)));
-		cbParameters.outputColor = (m == 0) ? XMFLOAT4(1.f, 0.f, 0.f, .4f) : XMFLOAT4(1.f, 1.f, 1.f, .3f);
+		XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(rotationMatrix * (scaleMatrix * translateMatrix)));
+		cbParameters.Field<OutputColor>() = (m == 0) ? XMFLOAT4(1.f, 0.f, 0.f, .4f) : XMFLOAT4(1.f, 1.f, 1.f, .3f);
 
 		// Set the constants for the draw call
-		memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+		UploadCopy(m_mappedConstantData + ConstantBuffer::PlacementSize * constantBufferIndex, cbParameters.GetData(), ConstantBuffer::Size);
 
 		// Bind the constants to the shader
 		m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
 
 		// Draw a quad
 		m_commandList->DrawIndexedInstanced(6, 1, 0, 0, 0);	
-		baseGpuAddress += sizeof(PaddedConstantBuffer);
+		baseGpuAddress += ConstantBuffer::PlacementSize;
 		++constantBufferIndex;
 	}
 
@@ -340,7 +340,7 @@ void app::LoadAssets()
 	// Create the constant buffer memory and map the resource
 	{
 		const D3D12_HEAP_PROPERTIES uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		size_t cbSize = c_numDrawCalls * FrameCount * sizeof(PaddedConstantBuffer);
+		size_t cbSize = c_numDrawCalls * FrameCount * ConstantBuffer::PlacementSize;
 
 		const D3D12_RESOURCE_DESC constantBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(cbSize);
 		ThrowIfFailed(m_device->CreateCommittedResource(
@@ -352,6 +352,7 @@ void app::LoadAssets()
 			IID_PPV_ARGS(m_perFrameConstants.ReleaseAndGetAddressOf())
 		));
 		ThrowIfFailed(m_perFrameConstants->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedConstantData)));
+		RegisterWriteCombined(m_mappedConstantData, cbSize);	// Mapped, and registered, for the life of the app.
 
 		// GPU virtual address of the resource
 		m_constantDataGpuAddr = m_perFrameConstants->GetGPUVirtualAddress();
@@ -467,7 +468,7 @@ void app::LoadAssets()
 		UINT8* pVertexDataBegin = nullptr;
 		CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
 		ThrowIfFailed(m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, cubeVertices, sizeof(cubeVertices));
+		UploadCopy(pVertexDataBegin, cubeVertices, sizeof(cubeVertices));
 		m_vertexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view.
@@ -523,7 +524,7 @@ void app::LoadAssets()
 
 		// Copy the cube data to the vertex buffer.
 		ThrowIfFailed(m_indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, cubeIndices, sizeof(cubeIndices));
+		UploadCopy(pVertexDataBegin, cubeIndices, sizeof(cubeIndices));
 		m_indexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view.
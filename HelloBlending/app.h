@@ -1,6 +1,8 @@
 #pragma once
 
 #include "IApp.h"
+#include "CbufferLayout.h"
+#include "UploadCopy.h"
 
 using namespace DirectX;
 
@@ -45,25 +47,16 @@ private:
 		XMFLOAT4 color;
 	};
 
-	struct ConstantBuffer {
-		XMFLOAT4X4 worldMatrix;
-		XMFLOAT4X4 viewMatrix;
-		XMFLOAT4X4 projectionMatrix;
-		XMFLOAT4 outputColor;
-	};
-	
-	// We'll allocate space for several of these and they will need to be padded for alignment.
-	static_assert(sizeof(ConstantBuffer) == 208);
-
-	// 208 < D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
-	// Create a union with the correct size and enough room for one ConstantBuffer
-	union PaddedConstantBuffer {
-		ConstantBuffer constants;
-		uint8_t bytes[D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT];
-	};
+	// cbuffer in shaders.hlsl, field by field and in the same order. The offsets and the
+	// size follow the HLSL packing rules, see CbufferLayout.h.
+	struct WorldMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ViewMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ProjectionMatrix : CbufferField<XMFLOAT4X4> {};
+	struct OutputColor : CbufferField<XMFLOAT4> {};
+	using ConstantBuffer = CbufferStruct<WorldMatrix, ViewMatrix, ProjectionMatrix, OutputColor>;
 
-	// Check the exact size of the PaddedConstantBuffer to make sure it will align properly
-	static_assert(sizeof(PaddedConstantBuffer) == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT * 1);
+	// Each draw call gets its own constant buffer placement.
+	static_assert(ConstantBuffer::PlacementSize == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
@@ -88,7 +81,7 @@ private:
 	D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 	D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
 	D3D12_GPU_VIRTUAL_ADDRESS m_constantDataGpuAddr;
-	PaddedConstantBuffer* m_mappedConstantData;
+	UINT8* m_mappedConstantData;
 	UINT m_rtvDescriptorSize;
 
 	// Synchronization objects.
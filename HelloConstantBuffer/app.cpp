@@ -9,7 +9,10 @@ platform plat;
 app::app(UINT width, UINT height, std::wstring name, HINSTANCE hInstance, int nCmdShow) 
 	: IApp(width, height, name), m_width(width), m_height(height),
 	m_frameIndex(0),
+	m_fenceEvent(nullptr),
+	m_frameRing(FrameCount),
 	m_pCbvDataBegin(nullptr),
+	m_cbvDescriptorSize(0),
 	m_viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
 	m_scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
 	m_rtvDescriptorSize(0)
@@ -50,13 +53,15 @@ void app::OnUpdate()
 	const float translationSpeed = 0.015f;
 	const float offsetBounds = 1.25;
 
-	m_constantBufferData.Offset.x += translationSpeed;
-	if (m_constantBufferData.Offset.x > offsetBounds)
+	XMFLOAT4& offset = m_constantBufferData.Field<Offset>();
+	offset.x += translationSpeed;
+	if (offset.x > offsetBounds)
 	{
-		m_constantBufferData.Offset.x = -offsetBounds;
+		offset.x = -offsetBounds;
 	}
 
-	memcpy(m_pCbvDataBegin, &m_constantBufferData, sizeof(m_constantBufferData));
+	// Write this frame's copy; the GPU may still be reading the previous frame's.
+	UploadCopy(m_pCbvDataBegin + m_frameRing.GetCurrentIndex() * SceneConstantBuffer::PlacementSize, m_constantBufferData.GetData(), SceneConstantBuffer::Size);
 }
 void app::OnRender() 
 {
@@ -70,23 +75,29 @@ void app::OnRender()
 	// Present the frame.
 	ThrowIfFailed(m_swapChain->Present(1, 0));
 
-	WaitForPreviousFrame();
+	MoveToNextFrame();
 }
 void app::OnDestroy() 
 {
+	// Ensure that the GPU is no longer referencing resources that are about to be
+	// cleaned up by the destructor.
+	WaitForGpu();
 
+	CloseHandle(m_fenceEvent);
 }
 void app::PopulateCommandList() 
 {
 	// Command list allocators can only be reset when the associated 
 	// command lists have finished execution on the GPU; apps should use 
-	// fences to determine GPU execution progress.
-	ThrowIfFailed(m_commandAllocator->Reset());
+	// fences to determine GPU execution progress. MoveToNextFrame() waited for
+	// the frame that last used this allocator.
+	ID3D12CommandAllocator* pCommandAllocator = m_commandAllocators[m_frameRing.GetCurrentIndex()].Get();
+	ThrowIfFailed(pCommandAllocator->Reset());
 
 	// However, when ExecuteCommandList() is called on a particular command 
 	// list, that command list can then be reset at any time and must be before 
 	// re-recording.
-	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
+	ThrowIfFailed(m_commandList->Reset(pCommandAllocator, m_pipelineState.Get()));
 
 	// Set necessary state.
 	m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
@@ -94,7 +105,8 @@ void app::PopulateCommandList()
 	ID3D12DescriptorHeap* ppHeaps[] = { m_cbvHeap.Get() };
 	m_commandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
 
-	m_commandList->SetGraphicsRootDescriptorTable(0, m_cbvHeap->GetGPUDescriptorHandleForHeapStart());
+	CD3DX12_GPU_DESCRIPTOR_HANDLE cbvHandle(m_cbvHeap->GetGPUDescriptorHandleForHeapStart(), m_frameRing.GetCurrentIndex(), m_cbvDescriptorSize);
+	m_commandList->SetGraphicsRootDescriptorTable(0, cbvHandle);
 	m_commandList->RSSetViewports(1, &m_viewport);
 	m_commandList->RSSetScissorRects(1, &m_scissorRect);
 
@@ -117,26 +129,32 @@ void app::PopulateCommandList()
 	ThrowIfFailed(m_commandList->Close());
 }
 
-void app::WaitForPreviousFrame() 
+void app::MoveToNextFrame() 
 {
-	// WAITING FOR THE FRAME TO COMPLETE BEFORE CONTINUING IS NOT BEST PRACTICE.
-	// This is code implemented as such for simplicity. The D3D12HelloFrameBuffering
-	// sample illustrates how to use fences for efficient resource usage and to
-	// maximize GPU utilization.
-
-	// Signal and increment the fence value.
-	const UINT64 fence = m_fenceValue;
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fence));
-	m_fenceValue++;
-
-	// Wait until the previous frame is finished.
-	if (m_fence->GetCompletedValue() < fence) 
+	// Mark the end of this frame; the fence reaches the value once the GPU has executed it.
+	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_frameRing.EndFrame()));
+
+	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+
+	// Only block if the GPU still executes the frame that last used the next allocator
+	// and constant buffer. The frame submitted just now keeps running while we record the next one.
+	WaitForFenceValue(m_frameRing.GetReuseFenceValue());
+}
+
+void app::WaitForGpu() 
+{
+	const UINT64 fenceValue = m_frameRing.Flush();
+	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fenceValue));
+	WaitForFenceValue(fenceValue);
+}
+
+void app::WaitForFenceValue(UINT64 fenceValue) 
+{
+	if (m_fence->GetCompletedValue() < fenceValue)
 	{
-		ThrowIfFailed(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
+		ThrowIfFailed(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent));
 		WaitForSingleObject(m_fenceEvent, INFINITE);
 	}
-
-	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 }
 
 void app::LoadPipeline() {
@@ -235,26 +253,28 @@ void app::LoadPipeline() {
 		// Flags indicate that this descriptor heap can be bound to the pipeline 
 		// and that descriptors contained in it can be referenced by a root table.
 		D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc = {};
-		cbvHeapDesc.NumDescriptors = 1;
+		cbvHeapDesc.NumDescriptors = FrameCount;
 		cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 		cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 		ThrowIfFailed(m_device->CreateDescriptorHeap(&cbvHeapDesc, IID_PPV_ARGS(&m_cbvHeap)));
+
+		m_cbvDescriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 	}
 
 	// Create frame resources
 	{
 		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
 
-		// Create a RTV for each frame.
+		// Create a RTV and a command allocator for each frame.
 		for (UINT n = 0; n < FrameCount; n++)
 		{
 			ThrowIfFailed(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])));
 			m_device->CreateRenderTargetView(m_renderTargets[n].Get(), nullptr, rtvHandle);
 			rtvHandle.Offset(1, m_rtvDescriptorSize);
+
+			ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocators[n])));
 		}
 	}
-
-	ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)));
 }
 
 void app::LoadAssets() {
@@ -330,7 +350,7 @@ void app::LoadAssets() {
 	}
 
 	// Create the command list.
-	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList)));
+	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocators[m_frameRing.GetCurrentIndex()].Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList)));
 
 	// Command lists are created in the recording state, but there is nothing
 	// to record yet. The main loop expects it to be closed, so close it now.
@@ -363,7 +383,7 @@ void app::LoadAssets() {
 		UINT8* pVertexDataBegin;
 		CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
 		ThrowIfFailed(m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, triangleVertices, sizeof(triangleVertices));
+		UploadCopy(pVertexDataBegin, triangleVertices, sizeof(triangleVertices));
 		m_vertexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view.
@@ -374,34 +394,43 @@ void app::LoadAssets() {
 
 	// Create constant view 
 	{
-		const UINT constantBufferSize = sizeof(SceneConstantBuffer); // CB size is required to be 256-byte aligned
+		const UINT constantBufferSize = static_cast<UINT>(SceneConstantBuffer::PlacementSize); // CB size is required to be 256-byte aligned
 
+		// One copy per frame, so the CPU can update the next frame's while the GPU reads the current one.
 		ThrowIfFailed(m_device->CreateCommittedResource(
 			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
 			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(constantBufferSize),
+			&CD3DX12_RESOURCE_DESC::Buffer(FrameCount * constantBufferSize),
 			D3D12_RESOURCE_STATE_GENERIC_READ,
 			nullptr,
 			IID_PPV_ARGS(&m_constantBuffer)
 		));
 
-		// Describe and create a constant buffer view
-		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-		cbvDesc.BufferLocation = m_constantBuffer->GetGPUVirtualAddress();
-		cbvDesc.SizeInBytes = constantBufferSize;
-		m_device->CreateConstantBufferView(&cbvDesc, m_cbvHeap->GetCPUDescriptorHandleForHeapStart());
+		// Describe and create a constant buffer view for each frame
+		CD3DX12_CPU_DESCRIPTOR_HANDLE cbvHandle(m_cbvHeap->GetCPUDescriptorHandleForHeapStart());
+		for (UINT n = 0; n < FrameCount; n++)
+		{
+			D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+			cbvDesc.BufferLocation = m_constantBuffer->GetGPUVirtualAddress() + n * constantBufferSize;
+			cbvDesc.SizeInBytes = constantBufferSize;
+			m_device->CreateConstantBufferView(&cbvDesc, cbvHandle);
+			cbvHandle.Offset(1, m_cbvDescriptorSize);
+		}
 
 		// Map and initialize the constant buffer. We don't unmap this until the app closes
 		// Keeping things mapped for the lifetime of the resource is okay.
 		CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU
 		ThrowIfFailed(m_constantBuffer->Map(0, &readRange, reinterpret_cast<void**>(&m_pCbvDataBegin)));
-		memcpy(m_pCbvDataBegin, &m_constantBufferData, sizeof(m_constantBufferData));
+		RegisterWriteCombined(m_pCbvDataBegin, FrameCount * constantBufferSize);
+		for (UINT n = 0; n < FrameCount; n++)
+		{
+			UploadCopy(m_pCbvDataBegin + n * constantBufferSize, m_constantBufferData.GetData(), SceneConstantBuffer::Size);
+		}
 	}
 
 	{
 		// Create synchronization objects and wait until assets have been uploaded to the GPU.
 		ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-		m_fenceValue = 1;
 
 		// Create an event handle to use for frame synchronization.
 		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
@@ -413,7 +442,7 @@ void app::LoadAssets() {
 		// Wait for the command list to execute; we are reusing the same command 
 		// list in our main loop but for now, we just want to wait for setup to 
 		// complete before continuing.
-		WaitForPreviousFrame();
+		WaitForGpu();
 	}
 }
 
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "IApp.h"
+#include "UploadCopy.h"
+#include "FrameRing.h"
+#include "CbufferLayout.h"
 
 using namespace DirectX;
 
@@ -28,6 +31,7 @@ public:
 	void OnKeyUp(UINT8 key) override;
 
 private:
+	// Both the number of back buffers and of frames the CPU may record ahead of the GPU.
 	static const UINT FrameCount = 2;
 
 	struct Vertex
@@ -36,12 +40,10 @@ private:
 		XMFLOAT4 color;
 	};
 
-	struct SceneConstantBuffer 
-	{
-		DirectX::XMFLOAT4 Offset;
-		float padding[60];
-	};
-	static_assert((sizeof(SceneConstantBuffer) % 256) == 0, "Constant Buffer size must be 256-byte aligned");
+	// cbuffer in shaders.hlsl, field by field and in the same order. The offsets and the
+	// size follow the HLSL packing rules, see CbufferLayout.h.
+	struct Offset : CbufferField<XMFLOAT4> {};
+	using SceneConstantBuffer = CbufferStruct<Offset>;
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
@@ -49,7 +51,7 @@ private:
 	ComPtr<IDXGISwapChain4> m_swapChain;
 	ComPtr<ID3D12Device> m_device;
 	ComPtr<ID3D12Resource> m_renderTargets[FrameCount];
-	ComPtr<ID3D12CommandAllocator> m_commandAllocator;
+	ComPtr<ID3D12CommandAllocator> m_commandAllocators[FrameCount];
 	ComPtr<ID3D12CommandQueue> m_commandQueue;
 	ComPtr<ID3D12RootSignature> m_rootSignature;
 	ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
@@ -63,16 +65,19 @@ private:
 	D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 	ComPtr<ID3D12Resource2> m_constantBuffer;
 	SceneConstantBuffer m_constantBufferData;
-	UINT8* m_pCbvDataBegin;
+	UINT8* m_pCbvDataBegin;		// One SceneConstantBuffer per frame, each with its CBV in m_cbvHeap
+	UINT m_cbvDescriptorSize;
 
 	// Synchronization objects.
 	UINT m_frameIndex;
 	HANDLE m_fenceEvent;
 	ComPtr<ID3D12Fence> m_fence;
-	UINT64 m_fenceValue;
+	FrameRing m_frameRing;
 
 	void PopulateCommandList();
-	void WaitForPreviousFrame();
+	void MoveToNextFrame();
+	void WaitForGpu();
+	void WaitForFenceValue(UINT64 fenceValue);
 	void LoadPipeline();
 	void LoadAssets();
 
@@ -12,7 +12,6 @@
 cbuffer SceneConstantBuffer : register(b0)
 {
 	float4 offset;
-	float4 padding[15];
 };
 
 struct PSInput
@@ -0,0 +1,63 @@
+#include "SimdLevel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_LEVEL_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define SIMD_LEVEL_NEON 1
+#endif
+
+const char* SimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::SSE: return "sse";
+	case SimdLevel::AVX2: return "avx2";
+	case SimdLevel::NEON: return "neon";
+	default: return "scalar";
+	}
+}
+
+SimdLevel DetectSimdLevel()
+{
+#if defined(SIMD_LEVEL_X86)
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	// The OS has to save the upper halves of the YMM registers for AVX to be usable.
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5))
+		{
+			return SimdLevel::AVX2;
+		}
+	}
+	return SimdLevel::SSE;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return SimdLevel::AVX2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return SimdLevel::SSE;
+	}
+	return SimdLevel::Scalar;
+#endif
+#elif defined(SIMD_LEVEL_NEON)
+	return SimdLevel::NEON;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IApp.h"
+#include "UploadCopy.h"
 
 using namespace DirectX;
 
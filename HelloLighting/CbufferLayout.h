@@ -0,0 +1,191 @@
+#pragma once
+
+// HLSL constant buffer layouts computed at compile time.
+//
+// A cbuffer is declared once, as a list of field tags, in the same order as in the
+// shader:
+//
+//     struct CameraWPos : CbufferField<XMFLOAT3> {};
+//     struct DeltaTime : CbufferField<float> {};
+//     using Constants = CbufferStruct<CameraWPos, DeltaTime>;
+//
+//     Constants constants;
+//     constants.Field<DeltaTime>() = 1.f / 60.f;
+//
+// Offsets follow the HLSL packing rules rather than the C++ ones: fields are packed into
+// 16-byte registers, a field never straddles two registers, and matrices and arrays start
+// a register of their own. CbufferStruct keeps its fields at those offsets in a byte block
+// of exactly Size bytes, so it can be copied to the GPU as is. PlacementSize is the stride
+// of consecutive blocks in a buffer bound through constant buffer views.
+//
+// Field types only matter through their size, so DirectXMath's XMFLOAT* types and the
+// hlsl:: stand-ins below are interchangeable. Supported are scalars and vectors (up to
+// 16 bytes), matrices with whole rows of 16 bytes (float4x4, float3x4) and arrays of
+// 16-byte-multiple elements; anything else fails to compile. No Windows dependency.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace hlsl
+{
+	struct float2 { float x, y; };
+	struct float3 { float x, y, z; };
+	struct float4 { float x, y, z, w; };
+	struct float4x4 { float m[4][4]; };
+}
+
+template<typename T>
+struct CbufferField
+{
+	using Type = T;
+};
+
+namespace CbufferPacking
+{
+	constexpr size_t RegisterSize = 16;
+	constexpr size_t PlacementAlignment = 256;	// D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
+
+	constexpr size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	template<typename T>
+	struct Traits
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "cbuffer fields are copied to the GPU byte for byte");
+		static_assert(sizeof(T) % 4 == 0, "HLSL components are 4 bytes");
+		static_assert(sizeof(T) <= RegisterSize || sizeof(T) % RegisterSize == 0,
+			"Types over 16 bytes must be made of whole registers, e.g. float4x4 rather than float3x3");
+
+		static constexpr size_t size = sizeof(T);
+		static constexpr bool startsRegister = sizeof(T) > RegisterSize;
+	};
+
+	template<typename T, size_t N>
+	struct Traits<T[N]>
+	{
+		static_assert(sizeof(T) % RegisterSize == 0, "HLSL puts every array element in a register of its own; use 16-byte elements");
+
+		static constexpr size_t size = sizeof(T) * N;
+		static constexpr bool startsRegister = true;
+	};
+
+	// Where a field of the given size goes when the previous one ended at offset.
+	constexpr size_t Place(size_t offset, size_t size, bool startsRegister)
+	{
+		return (startsRegister || offset % RegisterSize + size > RegisterSize) ? AlignUp(offset, RegisterSize) : offset;
+	}
+
+	// Offsets of the fields in order, plus where the last one ends.
+	template<typename... Types>
+	constexpr std::array<size_t, sizeof...(Types) + 1> ComputeOffsets()
+	{
+		std::array<size_t, sizeof...(Types) + 1> offsets = {};
+		const size_t sizes[] = { Traits<Types>::size... };
+		const bool startsRegister[] = { Traits<Types>::startsRegister... };
+
+		size_t offset = 0;
+		for (size_t i = 0; i < sizeof...(Types); i++)
+		{
+			offsets[i] = Place(offset, sizes[i], startsRegister[i]);
+			offset = offsets[i] + sizes[i];
+		}
+		offsets[sizeof...(Types)] = offset;
+		return offsets;
+	}
+}
+
+template<typename... Fields>
+class CbufferStruct
+{
+	static constexpr size_t FieldCount = sizeof...(Fields);
+
+	static constexpr std::array<size_t, FieldCount + 1> Offsets = CbufferPacking::ComputeOffsets<typename Fields::Type...>();
+
+	template<typename Tag>
+	static constexpr size_t IndexOf()
+	{
+		const bool matches[] = { std::is_same<Tag, Fields>::value... };
+		size_t index = FieldCount;
+		for (size_t i = 0; i < FieldCount; i++)
+		{
+			if (matches[i])
+			{
+				index = i;
+			}
+		}
+		return index;
+	}
+
+	template<typename Tag>
+	static constexpr size_t CountOf()
+	{
+		return (0 + ... + (std::is_same<Tag, Fields>::value ? 1 : 0));
+	}
+
+public:
+	static_assert(FieldCount > 0, "A cbuffer needs at least one field");
+
+	// Size of the cbuffer as the shader sees it, a whole number of registers.
+	static constexpr size_t Size = CbufferPacking::AlignUp(Offsets[FieldCount], CbufferPacking::RegisterSize);
+
+	// Room one block takes when blocks are bound one after another through constant buffer views.
+	static constexpr size_t PlacementSize = CbufferPacking::AlignUp(Size, CbufferPacking::PlacementAlignment);
+
+	template<typename Tag>
+	static constexpr size_t OffsetOf()
+	{
+		static_assert(CountOf<Tag>() == 1, "Every field must appear exactly once in the cbuffer");
+		return Offsets[IndexOf<Tag>()];
+	}
+
+	CbufferStruct() : m_bytes{} {}
+
+	template<typename Tag>
+	typename Tag::Type& Field()
+	{
+		return *reinterpret_cast<typename Tag::Type*>(m_bytes + OffsetOf<Tag>());
+	}
+
+	template<typename Tag>
+	const typename Tag::Type& Field() const
+	{
+		return *reinterpret_cast<const typename Tag::Type*>(m_bytes + OffsetOf<Tag>());
+	}
+
+	const void* GetData() const { return m_bytes; }
+
+private:
+	alignas(CbufferPacking::RegisterSize) unsigned char m_bytes[Size];
+};
+
+// The packing rules, checked wherever this header compiles.
+namespace CbufferLayoutChecks
+{
+	struct A : CbufferField<float> {};
+	struct B : CbufferField<hlsl::float3> {};
+	struct C : CbufferField<hlsl::float2> {};
+	struct D : CbufferField<hlsl::float4x4> {};
+	struct E : CbufferField<hlsl::float4[2]> {};
+	struct F : CbufferField<float> {};
+
+	// A float3 and a float share a register in either order, a float3 after a float2 does not fit.
+	using Packed = CbufferStruct<B, A>;
+	static_assert(Packed::OffsetOf<A>() == 12 && Packed::Size == 16, "float3 + float share a register");
+	using PackedReversed = CbufferStruct<A, B>;
+	static_assert(PackedReversed::OffsetOf<B>() == 4 && PackedReversed::Size == 16, "float + float3 share a register");
+	using Split = CbufferStruct<C, B>;
+	static_assert(Split::OffsetOf<B>() == 16 && Split::Size == 32, "float3 does not straddle registers");
+
+	// Scalars fill the rest of a float2's register.
+	using Pairs = CbufferStruct<C, A, F>;
+	static_assert(Pairs::OffsetOf<A>() == 8 && Pairs::OffsetOf<F>() == 12 && Pairs::Size == 16, "scalars fill a float2's register");
+
+	// Matrices and arrays start a register of their own.
+	using Aligned = CbufferStruct<A, D, F, E>;
+	static_assert(Aligned::OffsetOf<D>() == 16 && Aligned::OffsetOf<F>() == 80 && Aligned::OffsetOf<E>() == 96, "matrices and arrays start a register");
+	static_assert(Aligned::Size == 128 && Aligned::PlacementSize == 256 && sizeof(Aligned) == Aligned::Size, "blocks are exactly Size bytes");
+}
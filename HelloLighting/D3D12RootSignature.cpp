@@ -0,0 +1,34 @@
+#include "stdafx.h"
+#include "D3D12RootSignature.h"
+#include "DXSampleHelper.h"
+
+#include <vector>
+
+Microsoft::WRL::ComPtr<ID3D12RootSignature> CreateRootSignature(ID3D12Device* pDevice, const RootSignatureBuilder& builder,
+	D3D_ROOT_SIGNATURE_VERSION highestVersion, D3D12_ROOT_SIGNATURE_FLAGS flags)
+{
+	std::vector<CD3DX12_ROOT_PARAMETER1> rp(builder.GetParameterCount());
+	for (UINT i = 0; i < builder.GetParameterCount(); i++)
+	{
+		const ConstantsParameter& parameter = builder.GetParameter(i);
+		if (parameter.binding == ConstantsBinding::RootConstants)
+		{
+			rp[i].InitAsConstants(parameter.num32BitValues, parameter.shaderRegister, parameter.registerSpace);
+		}
+		else
+		{
+			rp[i].InitAsConstantBufferView(parameter.shaderRegister, parameter.registerSpace);
+		}
+	}
+
+	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc{};
+	rootSignatureDesc.Init_1_1(static_cast<UINT>(rp.size()), rp.data(), 0, nullptr, flags);
+
+	Microsoft::WRL::ComPtr<ID3D10Blob> signature;
+	Microsoft::WRL::ComPtr<ID3D10Blob> error;
+	ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, highestVersion, &signature, &error));
+
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
+	ThrowIfFailed(pDevice->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&rootSignature)));
+	return rootSignature;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Root signature with the parameters a RootSignatureBuilder declared, in the same order:
+// root constants or a root constant buffer view per block of constants.
+
+#include "RootSignatureBuilder.h"
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+Microsoft::WRL::ComPtr<ID3D12RootSignature> CreateRootSignature(ID3D12Device* pDevice, const RootSignatureBuilder& builder,
+	D3D_ROOT_SIGNATURE_VERSION highestVersion, D3D12_ROOT_SIGNATURE_FLAGS flags);
@@ -0,0 +1,114 @@
+#pragma once
+
+// Root parameters for blocks of shader constants, each bound the cheapest way its size allows.
+//
+// A block declared with AddConstants() becomes root constants when it takes at most
+// MaxRootConstantValues DWORDs: SetGraphicsRoot32BitConstants() writes the values straight
+// into the root arguments, with no upload allocation and no 256-byte slot. Larger blocks,
+// or blocks that no longer fit the 64-DWORD root signature budget, fall back to a root
+// constant buffer view. The shader declares either one as a cbuffer at the same register,
+// so the choice never shows in HLSL.
+//
+// Parameters are numbered in declaration order. CreateRootSignature() in
+// D3D12RootSignature.h turns the result into an ID3D12RootSignature. No Windows
+// dependency, so VerifyRootSignatureBuilder() runs anywhere.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class ConstantsBinding
+{
+	RootConstants,
+	RootConstantBufferView
+};
+
+struct ConstantsParameter
+{
+	ConstantsBinding binding;
+	uint32_t shaderRegister;
+	uint32_t registerSpace;
+	uint32_t num32BitValues;	// Size of the block, rounded up to DWORDs
+};
+
+class RootSignatureBuilder
+{
+public:
+	static constexpr uint32_t MaxRootConstantValues = 16;
+	static constexpr uint32_t MaxCost = 64;					// DWORDs a root signature may take
+	static constexpr uint32_t RootDescriptorCost = 2;
+
+	// Declare the cbuffer at register b<shaderRegister> holding size bytes and return its root parameter index.
+	uint32_t AddConstants(uint32_t shaderRegister, size_t size, uint32_t registerSpace = 0)
+	{
+		ConstantsParameter parameter;
+		parameter.shaderRegister = shaderRegister;
+		parameter.registerSpace = registerSpace;
+		parameter.num32BitValues = static_cast<uint32_t>((size + 3) / 4);
+
+		const bool fits = parameter.num32BitValues <= MaxRootConstantValues && GetCost() + parameter.num32BitValues <= MaxCost;
+		parameter.binding = fits ? ConstantsBinding::RootConstants : ConstantsBinding::RootConstantBufferView;
+
+		m_parameters.push_back(parameter);
+		return static_cast<uint32_t>(m_parameters.size() - 1);
+	}
+
+	// Same for a CbufferStruct.
+	template<typename Constants>
+	uint32_t AddConstants(uint32_t shaderRegister, uint32_t registerSpace = 0)
+	{
+		return AddConstants(shaderRegister, Constants::Size, registerSpace);
+	}
+
+	uint32_t GetParameterCount() const { return static_cast<uint32_t>(m_parameters.size()); }
+	const ConstantsParameter& GetParameter(uint32_t index) const { return m_parameters[index]; }
+
+	// DWORDs the root arguments take so far.
+	uint32_t GetCost() const
+	{
+		uint32_t cost = 0;
+		for (const ConstantsParameter& parameter : m_parameters)
+		{
+			cost += parameter.binding == ConstantsBinding::RootConstants ? parameter.num32BitValues : RootDescriptorCost;
+		}
+		return cost;
+	}
+
+private:
+	std::vector<ConstantsParameter> m_parameters;
+};
+
+// Check the binding chosen for payloads around the 16-DWORD limit, and the fall back to
+// views once root constants would overflow the root signature budget.
+inline bool VerifyRootSignatureBuilder()
+{
+	RootSignatureBuilder builder;
+
+	// HelloLighting: a 192-byte pass block and a 64-byte object block.
+	const uint32_t pass = builder.AddConstants(0, 192);
+	const uint32_t object = builder.AddConstants(1, 64);
+	if (pass != 0 || object != 1 ||
+		builder.GetParameter(pass).binding != ConstantsBinding::RootConstantBufferView ||
+		builder.GetParameter(object).binding != ConstantsBinding::RootConstants ||
+		builder.GetParameter(object).num32BitValues != 16 || builder.GetParameter(object).shaderRegister != 1 ||
+		builder.GetCost() != RootSignatureBuilder::RootDescriptorCost + 16)
+	{
+		return false;
+	}
+
+	// One DWORD over the limit, and a size that is not a whole number of DWORDs.
+	if (builder.GetParameter(builder.AddConstants(2, 68)).binding != ConstantsBinding::RootConstantBufferView ||
+		builder.GetParameter(builder.AddConstants(3, 6)).num32BitValues != 2)
+	{
+		return false;
+	}
+
+	// Cost is now 2 + 16 + 2 + 2 = 22: two more full blocks fit, the third one does not.
+	const uint32_t second = builder.AddConstants(4, 64);
+	const uint32_t third = builder.AddConstants(5, 64);
+	const uint32_t fourth = builder.AddConstants(6, 64);
+	return builder.GetParameter(second).binding == ConstantsBinding::RootConstants &&
+		builder.GetParameter(third).binding == ConstantsBinding::RootConstants &&
+		builder.GetParameter(fourth).binding == ConstantsBinding::RootConstantBufferView &&
+		builder.GetCost() == 56 && builder.GetParameterCount() == 7;
+}
@@ -0,0 +1,171 @@
+#include "TimelineFence.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+void TimelineFence::OnComplete(uint64_t value, Callback callback)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_callbackMutex);
+		m_callbacks.push_back({ value, m_nextSequence++, std::move(callback) });
+	}
+
+	// Runs it now if the value was already reached, after any earlier due callbacks.
+	Poll();
+}
+
+size_t TimelineFence::Poll()
+{
+	std::lock_guard<std::recursive_mutex> pollLock(m_pollMutex);
+
+	const uint64_t completedValue = GetCompletedValue();
+	std::vector<PendingCallback> due;
+	{
+		std::lock_guard<std::mutex> lock(m_callbackMutex);
+		auto firstDue = std::stable_partition(m_callbacks.begin(), m_callbacks.end(),
+			[completedValue](const PendingCallback& pending) { return pending.value > completedValue; });
+		due.assign(std::make_move_iterator(firstDue), std::make_move_iterator(m_callbacks.end()));
+		m_callbacks.erase(firstDue, m_callbacks.end());
+	}
+
+	std::sort(due.begin(), due.end(), [](const PendingCallback& a, const PendingCallback& b)
+	{
+		return a.value != b.value ? a.value < b.value : a.sequence < b.sequence;
+	});
+
+	// Outside of the callback lock, so a callback may register another one.
+	for (PendingCallback& pending : due)
+	{
+		pending.callback();
+	}
+	return due.size();
+}
+
+size_t TimelineFence::GetPendingCallbackCount() const
+{
+	std::lock_guard<std::mutex> lock(m_callbackMutex);
+	return m_callbacks.size();
+}
+
+CpuTimelineFence::CpuTimelineFence(uint64_t initialValue) :
+	m_value(initialValue)
+{
+}
+
+void CpuTimelineFence::Signal(uint64_t value)
+{
+	{
+		// Under the lock so a waiter cannot miss the notification between its check and its sleep.
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (value <= m_value.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+		m_value.store(value, std::memory_order_release);
+	}
+	m_condition.notify_all();
+
+	Poll();
+}
+
+void CpuTimelineFence::WaitCPU(uint64_t value)
+{
+	if (!IsComplete(value))
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this, value] { return IsComplete(value); });
+	}
+
+	Poll();
+}
+
+bool StressTimelineFence(uint32_t frameCount, uint32_t framesInFlight)
+{
+	if (framesInFlight == 0)
+	{
+		return false;
+	}
+
+	CpuTimelineFence fence;
+
+	// What each slot holds: the frame that last wrote it. The "GPU" checks it still reads
+	// its own frame's data for as long as it executes it.
+	std::unique_ptr<std::atomic<uint64_t>[]> slotFrames(new std::atomic<uint64_t>[framesInFlight]);
+	std::vector<uint64_t> slotFenceValues(framesInFlight, 0);
+	for (uint32_t slot = 0; slot < framesInFlight; slot++)
+	{
+		slotFrames[slot].store(0);
+	}
+
+	std::atomic<uint64_t> submitted(0);
+	std::atomic<uint32_t> errors(0);
+
+	// Frames execute in submission order, each spinning for a pseudo-random while so the
+	// CPU sometimes runs ahead and sometimes waits.
+	std::thread gpu([&]
+	{
+		uint32_t random = 0x2545F491u;
+		for (uint64_t frame = 1; frame <= frameCount; frame++)
+		{
+			while (submitted.load(std::memory_order_acquire) < frame)
+			{
+				std::this_thread::yield();
+			}
+
+			const uint32_t slot = static_cast<uint32_t>(frame % framesInFlight);
+			if (slotFrames[slot].load(std::memory_order_acquire) != frame)
+			{
+				errors++;
+			}
+
+			random ^= random << 13;
+			random ^= random >> 17;
+			random ^= random << 5;
+			for (uint32_t spin = random % 64; spin > 0; spin--)
+			{
+				std::this_thread::yield();
+			}
+
+			if (slotFrames[slot].load(std::memory_order_acquire) != frame)
+			{
+				errors++;
+			}
+			fence.Signal(frame);
+		}
+	});
+
+	uint64_t lastCallbackFrame = 0;
+	for (uint64_t frame = 1; frame <= frameCount; frame++)
+	{
+		const uint32_t slot = static_cast<uint32_t>(frame % framesInFlight);
+
+		// Reuse the slot once the frame that wrote it last is done.
+		fence.WaitCPU(slotFenceValues[slot]);
+		if (!fence.IsComplete(slotFenceValues[slot]))
+		{
+			errors++;
+		}
+
+		slotFrames[slot].store(frame, std::memory_order_release);
+		slotFenceValues[slot] = frame;
+
+		// Callbacks run under the fence's poll lock, which orders the accesses to lastCallbackFrame.
+		fence.OnComplete(frame, [&lastCallbackFrame, &errors, frame]
+		{
+			if (lastCallbackFrame + 1 != frame)
+			{
+				errors++;
+			}
+			lastCallbackFrame = frame;
+		});
+
+		submitted.store(frame, std::memory_order_release);
+	}
+
+	fence.WaitCPU(frameCount);
+	gpu.join();
+	fence.Poll();
+
+	return errors.load() == 0 && lastCallbackFrame == frameCount && fence.GetPendingCallbackCount() == 0;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+// Linear allocator over one persistently mapped upload buffer, used as a ring.
+//
+// Each allocation is bumped off the head at its own alignment (256 bytes for constant
+// buffer views, 16 for vertices) and comes back as a CPU pointer to write through and the
+// GPU virtual address to bind. Memory is handed back a whole frame at a time: EndFrame()
+// tags everything allocated since the previous call with the fence value the frame
+// signals, and Reclaim() releases the frames the fence has passed. There is no fixed
+// number of slots, so a frame may issue as many draws as fit in the buffer.
+//
+// An allocation never straddles the end of the buffer; the remainder is skipped and the
+// allocation starts over at offset 0. No Windows dependency, so VerifyUploadRing() runs
+// anywhere.
+//
+// The ring also counts the bytes each frame asks for, alignment padding excluded, as a
+// measure of how much data the CPU writes for the GPU per frame.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+struct UploadAllocation
+{
+	uint8_t* cpuAddress;
+	uint64_t gpuAddress;
+	uint64_t offset;		// From the start of the buffer
+	uint64_t size;
+};
+
+class UploadRing
+{
+public:
+	static constexpr uint64_t ConstantBufferAlignment = 256;	// D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
+	static constexpr uint64_t VertexAlignment = 16;
+
+	// The base addresses must be aligned to the largest alignment asked for; buffers
+	// are placed at 64 KB.
+	UploadRing(void* pCpuBase, uint64_t gpuBase, uint64_t capacity) :
+		m_pCpuBase(static_cast<uint8_t*>(pCpuBase)),
+		m_gpuBase(gpuBase),
+		m_capacity(capacity),
+		m_head(0),
+		m_tail(0),
+		m_frameBegin(0),
+		m_frameUploadBytes(0),
+		m_lastFrameUploadBytes(0)
+	{
+	}
+
+	uint64_t GetCapacity() const { return m_capacity; }
+
+	// Bytes held by the frame being recorded and the frames the GPU may still read,
+	// including what was skipped at the end of the buffer.
+	uint64_t GetUsedBytes() const { return m_head - m_tail; }
+	uint64_t GetFrameBytes() const { return m_head - m_frameBegin; }
+
+	// Bytes allocated by the frame being recorded and by the frame EndFrame() closed last.
+	uint64_t GetFrameUploadBytes() const { return m_frameUploadBytes; }
+	uint64_t GetLastFrameUploadBytes() const { return m_lastFrameUploadBytes; }
+
+	// alignment must be a power of two. Returns false if the allocation would reach into
+	// a frame the GPU has not finished with; Reclaim() once the fence moved on and retry.
+	bool TryAllocate(uint64_t size, uint64_t alignment, UploadAllocation& allocation)
+	{
+		// Nothing in use: start over at the beginning of the buffer.
+		if (m_head == m_tail)
+		{
+			m_head = m_tail = m_frameBegin = (m_head + m_capacity - 1) / m_capacity * m_capacity;
+		}
+
+		// m_head and m_tail count bytes ever allocated; the offset in the buffer wraps.
+		uint64_t begin = (m_head + alignment - 1) & ~(alignment - 1);
+		if (begin % m_capacity + size > m_capacity)
+		{
+			begin = (begin / m_capacity + 1) * m_capacity;
+		}
+		if (size > m_capacity || begin + size - m_tail > m_capacity)
+		{
+			return false;
+		}
+
+		m_head = begin + size;
+		m_frameUploadBytes += size;
+
+		allocation.offset = begin % m_capacity;
+		allocation.size = size;
+		allocation.cpuAddress = m_pCpuBase + allocation.offset;
+		allocation.gpuAddress = m_gpuBase + allocation.offset;
+		return true;
+	}
+
+	bool TryPush(const void* pData, uint64_t size, uint64_t alignment, UploadAllocation& allocation)
+	{
+		if (!TryAllocate(size, alignment, allocation))
+		{
+			return false;
+		}
+		memcpy(allocation.cpuAddress, pData, static_cast<size_t>(size));
+		return true;
+	}
+
+	// Close the frame being recorded. Its memory is released once the fence reaches fenceValue.
+	void EndFrame(uint64_t fenceValue)
+	{
+		if (m_head != m_frameBegin)
+		{
+			m_frames.push_back({ fenceValue, m_head });
+		}
+		m_frameBegin = m_head;
+		m_lastFrameUploadBytes = m_frameUploadBytes;
+		m_frameUploadBytes = 0;
+	}
+
+	// Release every frame whose fence value completedFenceValue has reached.
+	void Reclaim(uint64_t completedFenceValue)
+	{
+		while (!m_frames.empty() && m_frames.front().fenceValue <= completedFenceValue)
+		{
+			m_tail = m_frames.front().end;
+			m_frames.pop_front();
+		}
+	}
+
+	// Fence value to wait for to free the oldest frame still holding memory, 0 if there is none.
+	uint64_t GetOldestFenceValue() const
+	{
+		return m_frames.empty() ? 0 : m_frames.front().fenceValue;
+	}
+
+private:
+	struct PendingFrame
+	{
+		uint64_t fenceValue;
+		uint64_t end;
+	};
+
+	uint8_t* m_pCpuBase;
+	uint64_t m_gpuBase;
+	uint64_t m_capacity;
+	uint64_t m_head;
+	uint64_t m_tail;
+	uint64_t m_frameBegin;
+	uint64_t m_frameUploadBytes;
+	uint64_t m_lastFrameUploadBytes;
+	std::deque<PendingFrame> m_frames;
+};
+
+// Push frames of mixed constant and vertex allocations through a small ring while a
+// simulated GPU completes each frame gpuLag frames after it was closed. Returns false if
+// an allocation is misaligned, straddles the end of the buffer, overlaps memory of a frame
+// the GPU has not completed, if the ring refuses a frame it had room for, or if it counts
+// the bytes of a frame wrong.
+inline bool VerifyUploadRing()
+{
+	const uint64_t capacity = 16 * 1024;
+	std::vector<uint8_t> buffer(capacity);
+	const uint64_t gpuBase = 0x10000;
+
+	for (uint32_t gpuLag = 0; gpuLag < 3; gpuLag++)
+	{
+		UploadRing ring(buffer.data(), gpuBase, capacity);
+
+		// Owner of every byte: the fence value of the frame that wrote it, 0 if free.
+		std::vector<uint64_t> owners(capacity, 0);
+		uint64_t completedFenceValue = 0;
+		uint32_t seed = 1;
+
+		for (uint64_t fenceValue = 1; fenceValue <= 200; fenceValue++)
+		{
+			ring.Reclaim(completedFenceValue);
+
+			const uint32_t drawCount = 1 + fenceValue % 13;
+			uint64_t frameUploadBytes = 0;
+			for (uint32_t draw = 0; draw < drawCount; draw++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const bool constants = (seed >> 16) % 3 != 0;
+				const uint64_t alignment = constants ? UploadRing::ConstantBufferAlignment : UploadRing::VertexAlignment;
+				const uint64_t size = constants ? 240 + (seed >> 8) % 80 : 12 * (1 + (seed >> 4) % 40);
+
+				UploadAllocation allocation;
+				while (!ring.TryAllocate(size, alignment, allocation))
+				{
+					// Out of room: wait for the oldest frame like the app does.
+					if (ring.GetOldestFenceValue() == 0)
+					{
+						return false;
+					}
+					completedFenceValue = ring.GetOldestFenceValue();
+					ring.Reclaim(completedFenceValue);
+				}
+
+				if (allocation.offset % alignment != 0 || allocation.offset + size > capacity ||
+					allocation.cpuAddress != buffer.data() + allocation.offset || allocation.gpuAddress != gpuBase + allocation.offset)
+				{
+					return false;
+				}
+				for (uint64_t i = allocation.offset; i < allocation.offset + size; i++)
+				{
+					if (owners[i] > completedFenceValue)
+					{
+						return false;
+					}
+					owners[i] = fenceValue;
+				}
+				frameUploadBytes += size;
+			}
+
+			if (ring.GetFrameUploadBytes() != frameUploadBytes)
+			{
+				return false;
+			}
+			ring.EndFrame(fenceValue);
+			if (ring.GetLastFrameUploadBytes() != frameUploadBytes || ring.GetFrameUploadBytes() != 0)
+			{
+				return false;
+			}
+			if (fenceValue > gpuLag)
+			{
+				completedFenceValue = (std::max)(completedFenceValue, fenceValue - gpuLag);
+			}
+		}
+
+		// Once the GPU is idle, the whole buffer is free again.
+		ring.Reclaim(~0ull);
+		UploadAllocation allocation;
+		if (ring.GetUsedBytes() != 0 || !ring.TryAllocate(capacity, UploadRing::ConstantBufferAlignment, allocation))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
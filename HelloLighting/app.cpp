@@ -3,16 +3,27 @@
 #include "app.h"
 #include "platform_win32.h"
 #include "DXSampleHelper.h"
+#include "D3D12RootSignature.h"
 
 platform plat;
 
+// Shaders take world matrices as float4x3: the columns of the row-major matrix, without the last one.
+static void StoreAffineMatrix(XMFLOAT4 (&columns)[3], FXMMATRIX matrix)
+{
+	const XMMATRIX transposed = XMMatrixTranspose(matrix);
+	XMStoreFloat4(&columns[0], transposed.r[0]);
+	XMStoreFloat4(&columns[1], transposed.r[1]);
+	XMStoreFloat4(&columns[2], transposed.r[2]);
+}
+
 app::app(UINT width, UINT height, std::wstring name, HINSTANCE hInstance, int nCmdShow)
 	: IApp(width, height, name), m_width(width), m_height(height),
 	m_viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
 	m_scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
-	m_constantDataGPUAddr(0),
-	m_mappedConstantData(nullptr),
+	m_passConstantsRootParameter(0),
+	m_objectConstantsRootParameter(0),
 	m_rtvDescriptorSize(0),
+	m_reportedUploadBytes(0),
 	m_frameIndex(0),
 	m_fenceValues{},
 	m_curRotationAngleRad(0.f)
@@ -120,31 +131,27 @@ void app::PopulateCommandList()
 	m_commandList->RSSetViewports(1, &m_viewport);
 	m_commandList->RSSetScissorRects(1, &m_scissorRect);
 
-	// Index into the available constant buffers based on the number
-	// of draw calls. We've allocated enough for a known number of
-	// draw calls per frame times the number of back buffers
-	unsigned int constantBufferIndex = c_numDrawCalls * (m_frameIndex % FrameCount);
-
-	// Set the per-frame constants
-	ConstantBuffer cbParameters{};
+	// Set the per-frame constants, shared by every draw
+	PassConstants passParameters;
 
 	// Shaders compiled with default row-major matrices
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(m_worldMatrix));
-	XMStoreFloat4x4(&cbParameters.viewMatrix, XMMatrixTranspose(m_viewMatrix));
-	XMStoreFloat4x4(&cbParameters.projectionMatrix, XMMatrixTranspose(m_projectionMatrix));
-
-	XMStoreFloat4(&cbParameters.lightDir[0], m_lightDirs[0]);
-	XMStoreFloat4(&cbParameters.lightDir[1], m_lightDirs[1]);
-	XMStoreFloat4(&cbParameters.lightColors[0], m_lightColors[0]);
-	XMStoreFloat4(&cbParameters.lightColors[1], m_lightColors[1]);
-	XMStoreFloat4(&cbParameters.outputColor, m_outputColor);
-
-	// Set the constants for the first draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
-
-	// Bind the constants to the shader
-	auto baseGpuAddr = m_constantDataGPUAddr + sizeof(PaddedConstantBuffer) * constantBufferIndex;
-	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddr);
+	XMStoreFloat4x4(&passParameters.Field<ViewMatrix>(), XMMatrixTranspose(m_viewMatrix));
+	XMStoreFloat4x4(&passParameters.Field<ProjectionMatrix>(), XMMatrixTranspose(m_projectionMatrix));
+
+	XMStoreFloat4(&passParameters.Field<LightDirs>()[0], m_lightDirs[0]);
+	XMStoreFloat4(&passParameters.Field<LightDirs>()[1], m_lightDirs[1]);
+	XMStoreFloat4(&passParameters.Field<LightColors>()[0], m_lightColors[0]);
+	XMStoreFloat4(&passParameters.Field<LightColors>()[1], m_lightColors[1]);
+
+	SetGraphicsConstants(m_passConstantsRootParameter, passParameters);
+
+	ObjectConstants cbParameters;
+
+	StoreAffineMatrix(cbParameters.Field<WorldMatrix>(), m_worldMatrix);
+	XMStoreFloat4(&cbParameters.Field<OutputColor>(), m_outputColor);
+
+	// Set the constants for the first draw call and bind them to the shader
+	SetGraphicsConstants(m_objectConstantsRootParameter, cbParameters);
 	
 	// Indicate that the back buffer will be used as a render target.
 	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
@@ -166,8 +173,6 @@ void app::PopulateCommandList()
 
 	// Draw the Lambert lit cube
 	m_commandList->DrawIndexedInstanced(36, 1, 0, 0, 0);
-	baseGpuAddr += sizeof(PaddedConstantBuffer);
-	++constantBufferIndex;
 
 	// Render each light
 	m_commandList->SetPipelineState(m_solidColorPipelineState.Get());
@@ -179,19 +184,14 @@ void app::PopulateCommandList()
 		lightMatrix = lightScaleMatrix * lightMatrix;
 
 		// Update the world variable to reflect the current light
-		XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(lightMatrix));
-		cbParameters.outputColor = cbParameters.lightColors[m];
-
-		// Set the constants for the draw call
-		memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+		StoreAffineMatrix(cbParameters.Field<WorldMatrix>(), lightMatrix);
+		XMStoreFloat4(&cbParameters.Field<OutputColor>(), m_lightColors[m]);
 
-		// Bind the constants to the shader
-		m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddr);
+		// Set the constants for the draw call and bind them to the shader
+		SetGraphicsConstants(m_objectConstantsRootParameter, cbParameters);
 
 		// Draw the second cube
 		m_commandList->DrawIndexedInstanced(36, 1, 0, 0, 0);
-		baseGpuAddr += sizeof(PaddedConstantBuffer);
-		++constantBufferIndex;
 	}
 
 	// Indicate that the back buffer will now be used to present.
@@ -340,10 +340,11 @@ void app::LoadAssets()
 		featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
 	}
 
-	// Create a root signature with one constant buffer view.
+	// Create a root signature with the pass and the object constants, each either in root
+	// constants or behind a constant buffer view depending on its size.
 	{
-		CD3DX12_ROOT_PARAMETER1 rp[1]{};
-		rp[0].InitAsConstantBufferView(0, 0);
+		m_passConstantsRootParameter = m_rootSignatureBuilder.AddConstants<PassConstants>(0);
+		m_objectConstantsRootParameter = m_rootSignatureBuilder.AddConstants<ObjectConstants>(1);
 
 		// Allow input layout and deny uneccessary access to certain pipeline stages.
 		D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags =
@@ -352,33 +353,28 @@ void app::LoadAssets()
 			D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
 			D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
 
-		CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc{};
-		rootSignatureDesc.Init_1_1(_countof(rp), rp, 0, nullptr, rootSignatureFlags);
-
-		ComPtr<ID3D10Blob> signature;
-		ComPtr<ID3D10Blob> error;
-		ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, featureData.HighestVersion, &signature, &error));
-		ThrowIfFailed(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_rootSignature)));
+		m_rootSignature = CreateRootSignature(m_device.Get(), m_rootSignatureBuilder, featureData.HighestVersion, rootSignatureFlags);
 	}
 
-	// Create the constant buffer memory and map the resource
+	// Create the upload ring and leave it mapped; the constants of every draw are allocated from it.
 	{
 		const D3D12_HEAP_PROPERTIES uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		size_t cbSize = c_numDrawCalls * FrameCount * sizeof(PaddedConstantBuffer);
 
-		const D3D12_RESOURCE_DESC constantBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(cbSize);
+		const D3D12_RESOURCE_DESC uploadBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(c_uploadRingSize);
 		ThrowIfFailed(m_device->CreateCommittedResource(
 			&uploadHeapProperties,
 			D3D12_HEAP_FLAG_NONE,
-			&constantBufferDesc,
+			&uploadBufferDesc,
 			D3D12_RESOURCE_STATE_GENERIC_READ,
 			nullptr,
-			IID_PPV_ARGS(m_perFrameConstants.ReleaseAndGetAddressOf())
+			IID_PPV_ARGS(m_uploadBuffer.ReleaseAndGetAddressOf())
 		));
-		ThrowIfFailed(m_perFrameConstants->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedConstantData)));
 
-		// GPU virtual address of the resource
-		m_constantDataGPUAddr = m_perFrameConstants->GetGPUVirtualAddress();
+		void* pUploadData = nullptr;
+		CD3DX12_RANGE readRange(0, 0);	// We do not intend to read from this resource on the CPU.
+		ThrowIfFailed(m_uploadBuffer->Map(0, &readRange, &pUploadData));
+		RegisterWriteCombined(pUploadData, static_cast<size_t>(c_uploadRingSize));	// Mapped, and registered, for the life of the app.
+		m_uploadRing = std::make_unique<UploadRing>(pUploadData, m_uploadBuffer->GetGPUVirtualAddress(), c_uploadRingSize);
 	}
 
 	// Create the pipeline state objects, which includes compiling and loading shaders.
@@ -506,7 +502,7 @@ void app::LoadAssets()
 		UINT8* pVertexDataBegin = nullptr;
 		CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
 		ThrowIfFailed(m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, cubeVertices, sizeof(cubeVertices));
+		UploadCopy(pVertexDataBegin, cubeVertices, sizeof(cubeVertices));
 		m_vertexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view.
@@ -554,7 +550,7 @@ void app::LoadAssets()
 		));
 
 		ThrowIfFailed(m_indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, indices, sizeof(indices));
+		UploadCopy(pVertexDataBegin, indices, sizeof(indices));
 		m_indexBuffer->Unmap(0, nullptr);
 
 		m_indexBufferView.BufferLocation = m_indexBuffer->GetGPUVirtualAddress();
@@ -564,16 +560,9 @@ void app::LoadAssets()
 
 	// Create synchronization objects and wait until assets have been uploaded to the GPU.
 	{
-		ThrowIfFailed(m_device->CreateFence(m_fenceValues[m_frameIndex], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+		m_fence = std::make_unique<D3D12TimelineFence>(m_device.Get(), m_commandQueue.Get(), m_fenceValues[m_frameIndex]);
 		m_fenceValues[m_frameIndex]++;
 
-		// Create an event handle to use for frame synchronization.
-		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-		if (m_fenceEvent == nullptr)
-		{
-			ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
-		}
-
 		// Wait for the command list to execute; we are reusing the same command 
 		// list in our main loop but for now, we just want to wait for setup to 
 		// complete before continuing.
@@ -594,31 +583,84 @@ void app::MoveToNextFrame()
 {
 	// Schedule a Signal command in the queue.
 	const UINT64 currentFenceValue = m_fenceValues[m_frameIndex];
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), currentFenceValue));
+	m_fence->Signal(currentFenceValue);
+	m_uploadRing->EndFrame(currentFenceValue);
+
+	// Report the constant data a frame uploads whenever it changes.
+	const UINT64 uploadBytes = m_uploadRing->GetLastFrameUploadBytes();
+	if (uploadBytes != m_reportedUploadBytes)
+	{
+		wchar_t text[64];
+		swprintf_s(text, L"Upload: %llu bytes per frame\n", uploadBytes);
+		OutputDebugStringW(text);
+		m_reportedUploadBytes = uploadBytes;
+	}
 
 	// Update the frame index.
 	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 
 	// If the next frame is not ready to be rendered yet, wait until it is ready.
-	if (m_fence->GetCompletedValue() < m_fenceValues[m_frameIndex])
-	{
-		ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex], m_fenceEvent));
-		WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
-	}
+	m_fence->WaitCPU(m_fenceValues[m_frameIndex]);
 
 	// Set the fence value for the next frame.
 	m_fenceValues[m_frameIndex] = currentFenceValue + 1;
+
+	// Everything the completed frames uploaded can be overwritten.
+	m_uploadRing->Reclaim(m_fence->GetCompletedValue());
 }
 
 void app::WaitForGPU() 
 {
 	// Schedule a Signal command in the queue.
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_fenceValues[m_frameIndex]));
+	m_fence->Signal(m_fenceValues[m_frameIndex]);
 
 	// Wait until the fence has been processed.
-	ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex], m_fenceEvent));
-	WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+	m_fence->WaitCPU(m_fenceValues[m_frameIndex]);
 
 	// Increment the fence value for the current frame.
 	m_fenceValues[m_frameIndex]++;
+	m_uploadRing->Reclaim(m_fence->GetCompletedValue());
+}
+
+UploadAllocation app::AllocateUpload(UINT64 size, UINT64 alignment)
+{
+	UploadAllocation allocation;
+	while (!m_uploadRing->TryAllocate(size, alignment, allocation))
+	{
+		// The frames still in flight hold the rest of the ring; wait for the oldest one.
+		const UINT64 fenceValue = m_uploadRing->GetOldestFenceValue();
+		if (fenceValue == 0)
+		{
+			// A single frame needs more than c_uploadRingSize.
+			throw std::exception();
+		}
+
+		m_fence->WaitCPU(fenceValue);
+		m_uploadRing->Reclaim(m_fence->GetCompletedValue());
+	}
+	return allocation;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS app::UploadConstants(const void* pData, UINT64 size)
+{
+	const UploadAllocation allocation = AllocateUpload(size, UploadRing::ConstantBufferAlignment);
+	UploadCopy(allocation.cpuAddress, pData, static_cast<size_t>(size));
+	return allocation.gpuAddress;
+}
+
+void app::SetGraphicsConstants(UINT rootParameterIndex, const void* pData, UINT64 size)
+{
+	const ConstantsParameter& parameter = m_rootSignatureBuilder.GetParameter(rootParameterIndex);
+	if (parameter.binding == ConstantsBinding::RootConstants)
+	{
+		if (size > parameter.num32BitValues * 4ull)
+		{
+			throw std::exception();
+		}
+		m_commandList->SetGraphicsRoot32BitConstants(rootParameterIndex, static_cast<UINT>((size + 3) / 4), pData, 0);
+	}
+	else
+	{
+		m_commandList->SetGraphicsRootConstantBufferView(rootParameterIndex, UploadConstants(pData, size));
+	}
 }
\ No newline at end of file
@@ -1,6 +1,13 @@
 #pragma once
 
 #include "IApp.h"
+#include "UploadRing.h"
+#include "CbufferLayout.h"
+#include "UploadCopy.h"
+#include "D3D12TimelineFence.h"
+#include "RootSignatureBuilder.h"
+
+#include <memory>
 
 using namespace DirectX;
 
@@ -44,27 +51,21 @@ private:
 		XMFLOAT3 normal;
 	};
 
-	struct ConstantBuffer {
-		XMFLOAT4X4 worldMatrix;
-		XMFLOAT4X4 viewMatrix;
-		XMFLOAT4X4 projectionMatrix;
-		XMFLOAT4 lightDir[2];
-		XMFLOAT4 lightColors[2];
-		XMFLOAT4 outputColor;
-	};
-
-	// We'll allocate space for several of these and they will need to be padded for alignment.
-	static_assert(sizeof(ConstantBuffer) == 272);
-
-	// D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT < 272 < 2 * D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
-	// Create a union with the correct size and enough room for one ConstantBuffer
-	union PaddedConstantBuffer {
-		ConstantBuffer constants;
-		uint8_t bytes[2 * D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT];
-	};
-
-	// Check the exact size of the PaddedConstantBuffer to make sure it will align properly
-	static_assert(sizeof(PaddedConstantBuffer) == (2 * D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT));
+	// cbuffer PassConstants in shaders.hlsl: camera and lights, uploaded once per frame.
+	struct ViewMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ProjectionMatrix : CbufferField<XMFLOAT4X4> {};
+	struct LightDirs : CbufferField<XMFLOAT4[2]> {};
+	struct LightColors : CbufferField<XMFLOAT4[2]> {};
+	using PassConstants = CbufferStruct<ViewMatrix, ProjectionMatrix, LightDirs, LightColors>;
+	static_assert(PassConstants::Size == 192);
+
+	// cbuffer ObjectConstants in shaders.hlsl: set for every draw. World matrices here are
+	// affine, so only their first three columns are sent (float4x3), which brings the
+	// block down to the 16 DWORDs that fit in root constants.
+	struct WorldMatrix : CbufferField<XMFLOAT4[3]> {};
+	struct OutputColor : CbufferField<XMFLOAT4> {};
+	using ObjectConstants = CbufferStruct<WorldMatrix, OutputColor>;
+	static_assert(ObjectConstants::Size == RootSignatureBuilder::MaxRootConstantValues * 4);
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
@@ -76,6 +77,9 @@ private:
 	ComPtr<ID3D12CommandAllocator> m_commandAllocators[FrameCount];
 	ComPtr<ID3D12CommandQueue> m_commandQueue;
 	ComPtr<ID3D12RootSignature> m_rootSignature;
+	RootSignatureBuilder m_rootSignatureBuilder;
+	UINT m_passConstantsRootParameter;
+	UINT m_objectConstantsRootParameter;
 	ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
 	ComPtr<ID3D12DescriptorHeap> m_dsvHeap;
 	ComPtr<ID3D12PipelineState> m_lambertPipelineState;
@@ -85,27 +89,26 @@ private:
 	// App resources.
 	ComPtr<ID3D12Resource> m_vertexBuffer;
 	ComPtr<ID3D12Resource> m_indexBuffer;
-	ComPtr<ID3D12Resource> m_perFrameConstants;
 	D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 	D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
-	D3D12_GPU_VIRTUAL_ADDRESS m_constantDataGPUAddr;
-	PaddedConstantBuffer* m_mappedConstantData;
 	UINT m_rtvDescriptorSize;
 
+	// Per-frame upload memory: one persistently mapped buffer that every frame allocates
+	// its constants from, released a frame at a time as the fence passes it.
+	static const UINT64 c_uploadRingSize = 1024 * 1024;
+	ComPtr<ID3D12Resource> m_uploadBuffer;
+	std::unique_ptr<UploadRing> m_uploadRing;
+	UINT64 m_reportedUploadBytes;
+
 	// Synchronization objects.
 	UINT m_frameIndex;
-	HANDLE m_fenceEvent;
-	ComPtr<ID3D12Fence> m_fence;
+	std::unique_ptr<D3D12TimelineFence> m_fence;
 	UINT64 m_fenceValues[FrameCount];
 
 	// Scene constants, updated per-frame
 	float m_curRotationAngleRad;
 
-	// In this simple sample, we know that there are three draw calls
-	// and we will update the scene constants for each draw call.
-	static const unsigned int c_numDrawCalls = 3;
-
-	// These computed values will be loaded into a ConstantBuffer
+	// These computed values will be loaded into PassConstants and ObjectConstants
 	// during Render
 	XMMATRIX m_worldMatrix;
 	XMMATRIX m_viewMatrix;
@@ -120,6 +123,20 @@ private:
 	void MoveToNextFrame();
 	void WaitForGPU();
 
+	// Allocate from m_uploadRing, waiting for the GPU to release older frames if it is full.
+	UploadAllocation AllocateUpload(UINT64 size, UINT64 alignment);
+	D3D12_GPU_VIRTUAL_ADDRESS UploadConstants(const void* pData, UINT64 size);
+
+	// Bind a cbuffer block the way m_rootSignatureBuilder chose for the root parameter:
+	// as root constants, or uploaded to m_uploadRing behind a root constant buffer view.
+	void SetGraphicsConstants(UINT rootParameterIndex, const void* pData, UINT64 size);
+
+	template<typename Constants>
+	void SetGraphicsConstants(UINT rootParameterIndex, const Constants& constants)
+	{
+		SetGraphicsConstants(rootParameterIndex, constants.GetData(), Constants::Size);
+	}
+
 	inline std::wstring GetAssetFullPath(LPCWSTR assetName) {
 		return m_assetsPath + assetName;
 	}
@@ -9,13 +9,18 @@
 //--------------------------------------------------------------------------------------
 // Constant Buffer Variables
 //--------------------------------------------------------------------------------------
-cbuffer Constants : register(b0)
+cbuffer PassConstants : register(b0)
 {
-	float4x4 mWorld;
 	float4x4 mView;
 	float4x4 mProjection;
 	float4 lightDir[2];
 	float4 lightColor[2];
+};
+
+// 16 DWORDs, so it goes in root constants; see RootSignatureBuilder.h
+cbuffer ObjectConstants : register(b1)
+{
+	float4x3 mWorld;		// Affine, the last column is always (0, 0, 0, 1)
 	float4 outputColor;
 };
 
@@ -41,7 +46,7 @@ struct PS_INPUT
 PS_INPUT TriangleVS(VS_INPUT input)
 {
 	PS_INPUT output = (PS_INPUT) 0;
-	output.Pos = mul(input.Pos, mWorld);
+	output.Pos = float4(mul(input.Pos, mWorld), 1.f);
 	output.Pos = mul(output.Pos, mView);
 	output.Pos = mul(output.Pos, mProjection);
 	output.Normal = mul(input.Normal, ((float3x3) mWorld));
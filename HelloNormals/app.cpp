@@ -115,7 +115,7 @@ void app::PopulateCommandList()
 	unsigned int constantBufferIndex = c_numDrawCalls * (m_frameIndex % FrameCount);
 
 	// Bind the constants to the shader
-	auto baseGpuAddress = m_constantDataGpuAddr + sizeof(PaddedConstantBuffer) * constantBufferIndex;
+	auto baseGpuAddress = m_constantDataGpuAddr + ConstantBuffer::PlacementSize * constantBufferIndex;
 	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
 
 	// Indicate that the back buffer will be used as a render target.
@@ -137,23 +137,23 @@ void app::PopulateCommandList()
 	m_commandList->IASetIndexBuffer(&m_indexBufferView);
 
 	// Set the per-frame constants
-	ConstantBuffer cbParameters{};
+	ConstantBuffer cbParameters;
 
 	// Shaders compiled with default row-major matrices
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(m_worldMatrix));
-	XMStoreFloat4x4(&cbParameters.viewMatrix, XMMatrixTranspose(m_viewMatrix));
-	XMStoreFloat4x4(&cbParameters.projectionMatrix, XMMatrixTranspose(m_projectionMatrix));
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(m_worldMatrix));
+	XMStoreFloat4x4(&cbParameters.Field<ViewMatrix>(), XMMatrixTranspose(m_viewMatrix));
+	XMStoreFloat4x4(&cbParameters.Field<ProjectionMatrix>(), XMMatrixTranspose(m_projectionMatrix));
 
-	XMStoreFloat4(&cbParameters.lightDir, m_lightDir);
-	XMStoreFloat4(&cbParameters.lightColor, m_lightColor);
-	XMStoreFloat4(&cbParameters.outputColor, m_outputColor);
+	XMStoreFloat4(&cbParameters.Field<LightDir>(), m_lightDir);
+	XMStoreFloat4(&cbParameters.Field<LightColor>(), m_lightColor);
+	XMStoreFloat4(&cbParameters.Field<OutputColor>(), m_outputColor);
 
 	// Set the constants for the first draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+	UploadCopy(m_mappedConstantData + ConstantBuffer::PlacementSize * constantBufferIndex, cbParameters.GetData(), ConstantBuffer::Size);
 
 	// Draw the Lambert lit sphere
 	m_commandList->DrawIndexedInstanced((UINT)sphereIndices.size(), 1, 0, 0, 0);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
+	baseGpuAddress += ConstantBuffer::PlacementSize;
 	++constantBufferIndex;
 
 	// Set the PSO for drawing normals with a solid color
@@ -161,13 +161,13 @@ void app::PopulateCommandList()
 
 	// Set yellow as solid color
 	m_outputColor = XMVectorSet(1, 1, 0, 0);
-	XMStoreFloat4(&cbParameters.outputColor, m_outputColor);
+	XMStoreFloat4(&cbParameters.Field<OutputColor>(), m_outputColor);
 
 	// Set the constants for the second draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+	UploadCopy(m_mappedConstantData + ConstantBuffer::PlacementSize * constantBufferIndex, cbParameters.GetData(), ConstantBuffer::Size);
 
 	// Bind the constants to the shader
-	baseGpuAddress = m_constantDataGpuAddr + sizeof(PaddedConstantBuffer) * constantBufferIndex;
+	baseGpuAddress = m_constantDataGpuAddr + ConstantBuffer::PlacementSize * constantBufferIndex;
 	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
 
 	// Draw the normals of the sphere with the help of the GS.
@@ -337,7 +337,7 @@ void app::LoadAssets() {
 	// Create the constant buffer memory and map the resource
 	{
 		const D3D12_HEAP_PROPERTIES uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		size_t cbSize = c_numDrawCalls * FrameCount * sizeof(PaddedConstantBuffer);
+		size_t cbSize = c_numDrawCalls * FrameCount * ConstantBuffer::PlacementSize;
 
 		const D3D12_RESOURCE_DESC constantBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(cbSize);
 		ThrowIfFailed(m_device->CreateCommittedResource(
@@ -349,6 +349,7 @@ void app::LoadAssets() {
 			IID_PPV_ARGS(m_perFrameConstants.ReleaseAndGetAddressOf())
 		));
 		ThrowIfFailed(m_perFrameConstants->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedConstantData)));
+		RegisterWriteCombined(m_mappedConstantData, cbSize);	// Mapped, and registered, for the life of the app.
 	
 		m_constantDataGpuAddr = m_perFrameConstants->GetGPUVirtualAddress();
 	}
@@ -432,7 +433,7 @@ void app::LoadAssets() {
 		UINT8* pVertexDataBegin = nullptr;
 		CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
 		ThrowIfFailed(m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, sphereVertices.data(), sphereVertices.size() * sizeof(Vertex));
+		UploadCopy(pVertexDataBegin, sphereVertices.data(), sphereVertices.size() * sizeof(Vertex));
 		m_vertexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view.
@@ -450,7 +451,7 @@ void app::LoadAssets() {
 		));
 
 		ThrowIfFailed(m_indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, sphereIndices.data(), sphereIndices.size() * sizeof(UINT16));
+		UploadCopy(pVertexDataBegin, sphereIndices.data(), sphereIndices.size() * sizeof(UINT16));
 		m_indexBuffer->Unmap(0, nullptr);
 
 		m_indexBufferView.BufferLocation = m_indexBuffer->GetGPUVirtualAddress();
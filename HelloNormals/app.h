@@ -1,6 +1,8 @@
 #pragma once
 
 #include "IApp.h"
+#include "CbufferLayout.h"
+#include "UploadCopy.h"
 #include <vector>
 
 using namespace DirectX;
@@ -45,22 +47,18 @@ private:
 		XMFLOAT3 normal;
 	};
 
-	struct ConstantBuffer
-	{
-		XMFLOAT4X4 worldMatrix;
-		XMFLOAT4X4 viewMatrix;
-		XMFLOAT4X4 projectionMatrix;
-		XMFLOAT4 lightDir;
-		XMFLOAT4 lightColor;
-		XMFLOAT4 outputColor;
-	};
-	static_assert(sizeof(ConstantBuffer) == 240);
+	// cbuffer in shaders.hlsl, field by field and in the same order. The offsets and the
+	// size follow the HLSL packing rules, see CbufferLayout.h.
+	struct WorldMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ViewMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ProjectionMatrix : CbufferField<XMFLOAT4X4> {};
+	struct LightDir : CbufferField<XMFLOAT4> {};
+	struct LightColor : CbufferField<XMFLOAT4> {};
+	struct OutputColor : CbufferField<XMFLOAT4> {};
+	using ConstantBuffer = CbufferStruct<WorldMatrix, ViewMatrix, ProjectionMatrix, LightDir, LightColor, OutputColor>;
 
-	union PaddedConstantBuffer {
-		ConstantBuffer constant;
-		uint8_t bytes[D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT];
-	};
-	static_assert(sizeof(PaddedConstantBuffer) == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	// Each draw call gets its own constant buffer placement.
+	static_assert(ConstantBuffer::PlacementSize == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
@@ -85,7 +83,7 @@ private:
 	D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 	D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
 	D3D12_GPU_VIRTUAL_ADDRESS m_constantDataGpuAddr;
-	PaddedConstantBuffer* m_mappedConstantData;
+	UINT8* m_mappedConstantData;
 	UINT m_rtvDescriptorSize;
 
 	// Synchronization objects.
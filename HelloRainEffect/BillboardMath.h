@@ -0,0 +1,183 @@
+#pragma once
+
+// CPU reference of the rain quad expansion done on the GPU, used to check that the
+// vertex shader path (MainVSBillboard) builds the same corners as the geometry shader
+// path (MainGS). Only the world-space part is mirrored: view and projection are applied
+// identically by both shaders afterwards. VerifyBillboardExpansion() also checks the shape
+// of the quads, including particles right below the camera. No Windows dependency.
+
+#include "ParticleSimulator.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct BillboardFloat3
+{
+	float x, y, z;
+};
+
+// Row-vector times row-major matrix, as mul(float4(p, 1.0f), mWorld) with the transposed
+// matrices the app uploads.
+inline BillboardFloat3 BillboardTransformPoint(const float world[4][4], const float p[3])
+{
+	BillboardFloat3 r;
+	r.x = p[0] * world[0][0] + p[1] * world[1][0] + p[2] * world[2][0] + world[3][0];
+	r.y = p[0] * world[0][1] + p[1] * world[1][1] + p[2] * world[2][1] + world[3][1];
+	r.z = p[0] * world[0][2] + p[1] * world[1][2] + p[2] * world[2][2] + world[3][2];
+	return r;
+}
+
+// Squared length under which the front vector counts as zero: the particle is directly
+// below or above the camera.
+constexpr float c_billboardMinFrontLengthSq = 1e-6f;
+
+// Left direction of the quad: cross(up, normalize(front projected on the xz-plane)), with
+// the quad facing -z when that projection vanishes, as BillboardLeft in shaders.hlsl.
+inline BillboardFloat3 BillboardLeft(const BillboardFloat3& positionW, const float cameraWPos[3])
+{
+	float fx = cameraWPos[0] - positionW.x;
+	float fz = cameraWPos[2] - positionW.z;
+	const float lengthSq = fx * fx + fz * fz;
+	if (lengthSq > c_billboardMinFrontLengthSq)
+	{
+		const float invLength = 1.f / std::sqrt(lengthSq);
+		fx *= invLength;
+		fz *= invLength;
+	}
+	else
+	{
+		fx = 0.f;
+		fz = -1.f;
+	}
+
+	// cross((0, 1, 0), (fx, 0, fz))
+	return BillboardFloat3{ fz, 0.f, -fx };
+}
+
+// MainGS: the four corners in the order they are appended to the triangle strip.
+inline void ExpandBillboardGS(const float world[4][4], const float cameraWPos[3], const ParticleVertex& particle, BillboardFloat3 corners[4])
+{
+	const BillboardFloat3 positionW = BillboardTransformPoint(world, particle.position);
+	const BillboardFloat3 left = BillboardLeft(positionW, cameraWPos);
+	const float hw = 0.5f * particle.size[0];
+	const float hh = 0.5f * particle.size[1];
+
+	const float sides[4] = { 1.f, 1.f, -1.f, -1.f };	// Left, Left, Right, Right
+	const float ups[4] = { -1.f, 1.f, -1.f, 1.f };		// Bottom, Top, Bottom, Top
+	for (int i = 0; i < 4; i++)
+	{
+		corners[i].x = positionW.x + sides[i] * hw * left.x;
+		corners[i].y = positionW.y + sides[i] * hw * left.y + ups[i] * hh;
+		corners[i].z = positionW.z + sides[i] * hw * left.z;
+	}
+}
+
+// MainVSBillboard: one corner per SV_VertexID, the sides and heights derived from its bits.
+inline BillboardFloat3 ExpandBillboardVS(const float world[4][4], const float cameraWPos[3], const ParticleVertex& particle, uint32_t vertexID)
+{
+	const BillboardFloat3 positionW = BillboardTransformPoint(world, particle.position);
+	const BillboardFloat3 left = BillboardLeft(positionW, cameraWPos);
+
+	const float side = (vertexID & 2) ? -1.f : 1.f;
+	const float up = (vertexID & 1) ? 1.f : -1.f;
+	const float hw = side * 0.5f * particle.size[0];
+	const float hh = up * 0.5f * particle.size[1];
+
+	return BillboardFloat3{ positionW.x + hw * left.x, positionW.y + hw * left.y + hh, positionW.z + hw * left.z };
+}
+
+// Largest distance between the corners of both paths over the given particles.
+inline float CompareBillboardExpansion(const float world[4][4], const float cameraWPos[3], const ParticleVertex* particles, size_t count)
+{
+	float maxDeviation = 0.f;
+	for (size_t i = 0; i < count; i++)
+	{
+		BillboardFloat3 gsCorners[4];
+		ExpandBillboardGS(world, cameraWPos, particles[i], gsCorners);
+
+		for (uint32_t v = 0; v < 4; v++)
+		{
+			const BillboardFloat3 vsCorner = ExpandBillboardVS(world, cameraWPos, particles[i], v);
+			const float dx = std::fabs(vsCorner.x - gsCorners[v].x);
+			const float dy = std::fabs(vsCorner.y - gsCorners[v].y);
+			const float dz = std::fabs(vsCorner.z - gsCorners[v].z);
+			maxDeviation = std::fmax(maxDeviation, std::fmax(dx, std::fmax(dy, dz)));
+		}
+	}
+	return maxDeviation;
+}
+
+// Check the quads themselves rather than one path against the other: over the
+// HelloRainEffect grid seen from its camera, plus particles directly below the camera
+// and at its position, every corner must be finite, the horizontal edge must be
+// size[0] long and face the camera, and the vertical edge must be size[1] long. Also
+// compares both paths over the grid. Returns false on the first quad that fails.
+inline bool VerifyBillboardExpansion()
+{
+	const float world[4][4] = { { 1.f, 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f, 0.f }, { 0.f, 0.f, 0.f, 1.f } };
+	const float cameraWPos[3] = { 0.f, 50.f, -50.f };
+	const float tolerance = 1e-4f;
+
+	std::vector<ParticleVertex> particles;
+	for (int i = 0; i < 81; i++)
+	{
+		ParticleVertex particle = {};
+		particle.position[0] = i % 9 * 5.f - 20.f;
+		particle.position[2] = i / 9 * 5.f - 20.f;
+		particle.size[0] = .05f;
+		particle.size[1] = 5.f;
+		particles.push_back(particle);
+	}
+	if (CompareBillboardExpansion(world, cameraWPos, particles.data(), particles.size()) > tolerance)
+	{
+		return false;
+	}
+
+	// Below the camera and at the camera, where the front vector vanishes.
+	for (float y : { 0.f, 50.f })
+	{
+		ParticleVertex particle = {};
+		particle.position[0] = cameraWPos[0];
+		particle.position[1] = y;
+		particle.position[2] = cameraWPos[2];
+		particle.size[0] = .05f;
+		particle.size[1] = 5.f;
+		particles.push_back(particle);
+	}
+
+	for (const ParticleVertex& particle : particles)
+	{
+		BillboardFloat3 corners[4];
+		ExpandBillboardGS(world, cameraWPos, particle, corners);
+		for (const BillboardFloat3& corner : corners)
+		{
+			if (!std::isfinite(corner.x) || !std::isfinite(corner.y) || !std::isfinite(corner.z))
+			{
+				return false;
+			}
+		}
+
+		// Left-Bottom to Right-Bottom, and Left-Bottom to Left-Top.
+		const BillboardFloat3 across = { corners[0].x - corners[2].x, corners[0].y - corners[2].y, corners[0].z - corners[2].z };
+		const BillboardFloat3 upward = { corners[1].x - corners[0].x, corners[1].y - corners[0].y, corners[1].z - corners[0].z };
+		const float width = std::sqrt(across.x * across.x + across.z * across.z);
+		if (std::fabs(width - particle.size[0]) > tolerance || std::fabs(across.y) > tolerance ||
+			std::fabs(upward.x) > tolerance || std::fabs(upward.z) > tolerance || std::fabs(upward.y - particle.size[1]) > tolerance)
+		{
+			return false;
+		}
+
+		// The quad is perpendicular to the direction to the camera, or faces -z right below it.
+		const float fx = cameraWPos[0] - particle.position[0];
+		const float fz = cameraWPos[2] - particle.position[2];
+		const float frontLengthSq = fx * fx + fz * fz;
+		const float facing = frontLengthSq > c_billboardMinFrontLengthSq ? (across.x * fx + across.z * fz) / std::sqrt(frontLengthSq) : across.z;
+		if (std::fabs(facing) > tolerance)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
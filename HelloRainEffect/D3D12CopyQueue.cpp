@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "D3D12CopyQueue.h"
+#include "DXSampleHelper.h"
+#include "UploadCopy.h"
+
+#include <exception>
+
+D3D12CopyQueue::D3D12CopyQueue(ID3D12Device* pDevice, uint64_t stagingCapacity) :
+	m_device(pDevice),
+	m_pStagingData(nullptr),
+	m_stagingCapacity(stagingCapacity),
+	m_lastFenceValue(0)
+{
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	ThrowIfFailed(pDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_queue)));
+
+	m_fence = std::make_unique<D3D12TimelineFence>(pDevice, m_queue.Get());
+
+	ThrowIfFailed(pDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(stagingCapacity),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_stagingBuffer)
+	));
+
+	CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
+	ThrowIfFailed(m_stagingBuffer->Map(0, &readRange, reinterpret_cast<void**>(&m_pStagingData)));
+	RegisterWriteCombined(m_pStagingData, static_cast<size_t>(stagingCapacity));
+
+	// Command lists are created in the recording state; the first batch resets it with
+	// this allocator, which nothing uses yet.
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> allocator;
+	ThrowIfFailed(pDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&allocator)));
+	ThrowIfFailed(pDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, allocator.Get(), nullptr, IID_PPV_ARGS(&m_commandList)));
+	ThrowIfFailed(m_commandList->Close());
+	m_allocators.push_back({ 0, allocator });
+}
+
+D3D12CopyQueue::~D3D12CopyQueue()
+{
+	// The copy engine may still read the staging buffer.
+	m_fence->WaitCPU(m_lastFenceValue);
+
+	UnregisterWriteCombined(m_pStagingData);
+	m_stagingBuffer->Unmap(0, nullptr);
+}
+
+void D3D12CopyQueue::CopyBuffer(void* pDestination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size)
+{
+	if (!m_recordingAllocator)
+	{
+		// Recycle the oldest allocator if its batch is done, batches complete in order.
+		if (!m_allocators.empty() && m_fence->IsComplete(m_allocators.front().fenceValue))
+		{
+			m_recordingAllocator = m_allocators.front().allocator;
+			m_allocators.pop_front();
+			ThrowIfFailed(m_recordingAllocator->Reset());
+		}
+		else
+		{
+			ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&m_recordingAllocator)));
+		}
+		ThrowIfFailed(m_commandList->Reset(m_recordingAllocator.Get(), nullptr));
+	}
+
+	m_commandList->CopyBufferRegion(static_cast<ID3D12Resource*>(pDestination), destinationOffset, m_stagingBuffer.Get(), stagingOffset, size);
+}
+
+void D3D12CopyQueue::Execute(uint64_t fenceValue)
+{
+	if (m_recordingAllocator)
+	{
+		ThrowIfFailed(m_commandList->Close());
+		ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+		m_queue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+
+		m_allocators.push_back({ fenceValue, m_recordingAllocator });
+		m_recordingAllocator.Reset();
+	}
+
+	m_fence->Signal(fenceValue);
+	m_lastFenceValue = fenceValue;
+}
+
+void D3D12CopyQueue::WaitGPU(ID3D12CommandQueue* pQueue, uint64_t fenceValue) const
+{
+	// Waiting for a value nothing will signal would hang pQueue for good.
+	if (fenceValue > m_lastFenceValue)
+	{
+		throw std::exception();
+	}
+	ThrowIfFailed(pQueue->Wait(m_fence->Get(), fenceValue));
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// CopyQueue on a D3D12_COMMAND_LIST_TYPE_COPY queue of its own, so uploads run on the
+// copy engine alongside the graphics work. Staging memory is one persistently mapped
+// upload buffer, registered as write-combined. Each batch records a command list of
+// CopyBufferRegion() calls from it; allocators are recycled once the fence has passed
+// the batch that last used them.
+
+#include "UploadService.h"
+#include "D3D12TimelineFence.h"
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <deque>
+#include <memory>
+
+class D3D12CopyQueue : public CopyQueue
+{
+public:
+	D3D12CopyQueue(ID3D12Device* pDevice, uint64_t stagingCapacity);
+	~D3D12CopyQueue() override;
+
+	D3D12CopyQueue(const D3D12CopyQueue&) = delete;
+	D3D12CopyQueue& operator=(const D3D12CopyQueue&) = delete;
+
+	uint8_t* GetStagingData() override { return m_pStagingData; }
+	uint64_t GetStagingCapacity() const override { return m_stagingCapacity; }
+
+	// pDestination is the ID3D12Resource of a buffer in the COMMON state.
+	void CopyBuffer(void* pDestination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size) override;
+	void Execute(uint64_t fenceValue) override;
+	TimelineFence& GetFence() override { return *m_fence; }
+
+	// Have pQueue wait on the GPU, without blocking the CPU, until the copies up to
+	// fenceValue are done. fenceValue must have been submitted already.
+	void WaitGPU(ID3D12CommandQueue* pQueue, uint64_t fenceValue) const;
+
+private:
+	struct PendingAllocator
+	{
+		uint64_t fenceValue;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> allocator;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_queue;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_commandList;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_stagingBuffer;
+	uint8_t* m_pStagingData;
+	uint64_t m_stagingCapacity;
+	std::unique_ptr<D3D12TimelineFence> m_fence;
+	uint64_t m_lastFenceValue;
+
+	// Allocators of submitted batches, the oldest first, and the one of the batch being
+	// recorded, null between batches.
+	std::deque<PendingAllocator> m_allocators;
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_recordingAllocator;
+};
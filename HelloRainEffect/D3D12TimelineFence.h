@@ -0,0 +1,32 @@
+#pragma once
+
+// TimelineFence backed by an ID3D12Fence: Signal() is queued on a command queue, so
+// the fence reaches the value when the GPU gets past everything submitted before it.
+// Callbacks registered with OnComplete() run when WaitCPU() or Poll() notices them
+// due, so the owner should poll once per frame.
+
+#include "TimelineFence.h"
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+class D3D12TimelineFence : public TimelineFence
+{
+public:
+	D3D12TimelineFence(ID3D12Device* pDevice, ID3D12CommandQueue* pQueue, uint64_t initialValue = 0);
+	~D3D12TimelineFence() override;
+
+	D3D12TimelineFence(const D3D12TimelineFence&) = delete;
+	D3D12TimelineFence& operator=(const D3D12TimelineFence&) = delete;
+
+	void Signal(uint64_t value) override;
+	uint64_t GetCompletedValue() const override { return m_fence->GetCompletedValue(); }
+	void WaitCPU(uint64_t value) override;
+
+	ID3D12Fence* Get() const { return m_fence.Get(); }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Fence> m_fence;
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_queue;
+	HANDLE m_event;
+};
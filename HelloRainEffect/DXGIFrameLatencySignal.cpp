@@ -0,0 +1,30 @@
+#include "stdafx.h"
+#include "DXGIFrameLatencySignal.h"
+#include "DXSampleHelper.h"
+
+DXGIFrameLatencySignal::DXGIFrameLatencySignal(IDXGISwapChain2* pSwapChain, UINT maxFrameLatency) :
+	m_waitableObject(nullptr)
+{
+	ThrowIfFailed(pSwapChain->SetMaximumFrameLatency(maxFrameLatency));
+
+	m_waitableObject = pSwapChain->GetFrameLatencyWaitableObject();
+	if (m_waitableObject == nullptr)
+	{
+		ThrowIfFailed(E_FAIL);
+	}
+}
+
+DXGIFrameLatencySignal::~DXGIFrameLatencySignal()
+{
+	if (m_waitableObject)
+	{
+		CloseHandle(m_waitableObject);
+	}
+}
+
+bool DXGIFrameLatencySignal::Wait(int64_t timeout)
+{
+	// Round up so a sub-millisecond timeout still waits.
+	const DWORD timeoutMs = static_cast<DWORD>((timeout + 999999) / 1000000);
+	return WaitForSingleObjectEx(m_waitableObject, timeoutMs, TRUE) == WAIT_OBJECT_0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// FrameLatencySignal over a swap chain created with
+// DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT. The waitable object is signaled
+// each time the display queue drops below the swap chain's maximum frame latency.
+
+#include "FramePacer.h"
+
+#include <dxgi1_3.h>
+
+class DXGIFrameLatencySignal : public FrameLatencySignal
+{
+public:
+	// Applies maxFrameLatency to the swap chain and takes ownership of its waitable object.
+	DXGIFrameLatencySignal(IDXGISwapChain2* pSwapChain, UINT maxFrameLatency);
+	~DXGIFrameLatencySignal() override;
+
+	DXGIFrameLatencySignal(const DXGIFrameLatencySignal&) = delete;
+	DXGIFrameLatencySignal& operator=(const DXGIFrameLatencySignal&) = delete;
+
+	bool Wait(int64_t timeout) override;
+
+	// For waiting on it along with other objects, e.g. with MsgWaitForMultipleObjects.
+	HANDLE GetHandle() const { return m_waitableObject; }
+
+private:
+	HANDLE m_waitableObject;
+};
@@ -0,0 +1,43 @@
+#include "stdafx.h"
+#include "FrameContext.h"
+#include "DXSampleHelper.h"
+
+#include <algorithm>
+
+FrameContextRing::FrameContextRing() :
+	m_current(0),
+	m_nextFenceValue(1)
+{
+}
+
+void FrameContextRing::Create(ID3D12Device* pDevice, UINT frameCount)
+{
+	m_frames.resize((std::min)((std::max)(frameCount, 1u), MaxFrameCount));
+	for (UINT n = 0; n < GetFrameCount(); n++)
+	{
+		ThrowIfFailed(pDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_frames[n].commandAllocator)));
+		m_frames[n].fenceValue = 0;
+		m_frames[n].index = n;
+	}
+	m_current = 0;
+}
+
+void FrameContextRing::MoveToNextFrame(TimelineFence& fence)
+{
+	// Fence values are handed out in submission order, so a single counter serves every context.
+	m_frames[m_current].fenceValue = m_nextFenceValue++;
+	fence.Signal(m_frames[m_current].fenceValue);
+
+	m_current = (m_current + 1) % GetFrameCount();
+
+	// Wait until the frame that last used this context is finished. This also runs the
+	// fence callbacks that became due, once per frame.
+	fence.WaitCPU(m_frames[m_current].fenceValue);
+}
+
+void FrameContextRing::WaitForGpu(TimelineFence& fence)
+{
+	const UINT64 fenceValue = m_nextFenceValue++;
+	fence.Signal(fenceValue);
+	fence.WaitCPU(fenceValue);
+}
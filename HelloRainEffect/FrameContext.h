@@ -0,0 +1,56 @@
+#pragma once
+
+// Per-frame resources of the frames the CPU may queue ahead of the GPU.
+//
+// The number of frames in flight is independent of the swap chain's buffer count:
+// the back buffer to render into is picked by the swap chain, the frame context
+// round-robin. Each context owns the command allocator its frame records with,
+// the fence value its frame signals and its slice of the per-frame upload buffers.
+// More frames in flight trade input latency for throughput when the CPU or the
+// GPU hiccups.
+
+#include "TimelineFence.h"
+
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <vector>
+
+struct FrameContext
+{
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> commandAllocator;
+	UINT64 fenceValue;	// Signalled once the GPU is done with the frame, 0 before first use
+	UINT index;			// Which slice of the per-frame upload buffers the frame writes
+
+	// Start of this frame's range in a buffer holding one slice per frame in flight.
+	UINT64 UploadOffset(UINT64 sliceSize) const { return index * sliceSize; }
+};
+
+class FrameContextRing
+{
+public:
+	static constexpr UINT MaxFrameCount = 4;
+
+	FrameContextRing();
+
+	// Creates frameCount contexts, clamped to [1, MaxFrameCount]. The fence must start at 0.
+	void Create(ID3D12Device* pDevice, UINT frameCount);
+
+	UINT GetFrameCount() const { return static_cast<UINT>(m_frames.size()); }
+	UINT GetCurrentIndex() const { return m_current; }
+	FrameContext& GetCurrent() { return m_frames[m_current]; }
+
+	// Value the current frame's commands will signal when MoveToNextFrame() submits them.
+	UINT64 GetCurrentFenceValue() const { return m_nextFenceValue; }
+
+	// Signal the end of the current frame, move to the next context and block until the
+	// GPU has finished the frame that used it last.
+	void MoveToNextFrame(TimelineFence& fence);
+
+	// Block until the GPU has finished everything submitted so far.
+	void WaitForGpu(TimelineFence& fence);
+
+private:
+	std::vector<FrameContext> m_frames;
+	UINT m_current;
+	UINT64 m_nextFenceValue;
+};
@@ -0,0 +1,237 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+
+int64_t SteadyFrameClock::Now() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FramePacer::FramePacer(const FrameClock& clock, FrameLatencySignal* pSignal, const FramePacerDesc& desc) :
+	m_clock(clock),
+	m_pSignal(pSignal),
+	m_desc(desc),
+	m_history(HistorySize, FrameTimestamps{}),
+	m_current{},
+	m_frameCount(0),
+	m_timeouts(0)
+{
+}
+
+void FramePacer::BeginFrame()
+{
+	m_current = {};
+	m_current.frame = m_frameCount;
+	m_current.begin = m_clock.Now();
+
+	if (m_desc.mode == FramePacingMode::WaitBeforeInput && m_pSignal)
+	{
+		if (!m_pSignal->Wait(m_desc.waitTimeout))
+		{
+			m_timeouts++;
+		}
+	}
+
+	m_current.inputSample = m_clock.Now();
+}
+
+void FramePacer::BeginFrame(int64_t waitBegin)
+{
+	m_current = {};
+	m_current.frame = m_frameCount;
+	m_current.begin = waitBegin;
+	m_current.inputSample = m_clock.Now();
+}
+
+void FramePacer::MarkSubmit()
+{
+	m_current.submit = m_clock.Now();
+}
+
+void FramePacer::MarkPresent()
+{
+	m_current.present = m_clock.Now();
+	m_history[m_frameCount % HistorySize] = m_current;
+	m_frameCount++;
+}
+
+FramePacer::Stats FramePacer::GetStats() const
+{
+	Stats stats = {};
+	stats.timeouts = m_timeouts;
+
+	const uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(m_frameCount, HistorySize));
+	if (count == 0)
+	{
+		return stats;
+	}
+
+	int64_t wait = 0, inputToSubmit = 0, inputToPresent = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const FrameTimestamps& frame = m_history[(m_frameCount - count + i) % HistorySize];
+		wait += frame.inputSample - frame.begin;
+		inputToSubmit += frame.submit - frame.inputSample;
+		inputToPresent += frame.present - frame.inputSample;
+	}
+
+	const FrameTimestamps& first = m_history[(m_frameCount - count) % HistorySize];
+	const double nsToMs = 1e-6;
+	stats.frames = count;
+	stats.waitMs = wait * nsToMs / count;
+	stats.inputToSubmitMs = inputToSubmit * nsToMs / count;
+	stats.inputToPresentMs = inputToPresent * nsToMs / count;
+	stats.frameMs = count > 1 ? (GetLastFrame().inputSample - first.inputSample) * nsToMs / (count - 1) : 0.;
+	return stats;
+}
+
+namespace
+{
+	// Display that scans out one queued frame per refresh. Its latency signal fires while
+	// fewer than maxFrameLatency frames wait for scan-out, and Present() blocks while
+	// presentQueueLimit frames do, like DXGI's default of 3.
+	class SimulatedDisplay : public FrameLatencySignal
+	{
+	public:
+		SimulatedDisplay(ManualFrameClock& clock, int64_t refreshInterval, uint32_t maxFrameLatency, uint32_t presentQueueLimit) :
+			m_clock(clock),
+			m_refreshInterval(refreshInterval),
+			m_maxFrameLatency(maxFrameLatency),
+			m_presentQueueLimit(presentQueueLimit)
+		{
+		}
+
+		bool Wait(int64_t timeout) override
+		{
+			Retire();
+			if (m_queue.size() < m_maxFrameLatency)
+			{
+				return true;
+			}
+
+			// Room appears when the frame that leaves maxFrameLatency - 1 behind it is shown.
+			const int64_t readyTime = m_queue[m_queue.size() - m_maxFrameLatency];
+			if (readyTime - m_clock.Now() > timeout)
+			{
+				m_clock.Advance(timeout);
+				return false;
+			}
+			m_clock.AdvanceTo(readyTime);
+			Retire();
+			return true;
+		}
+
+		// Returns when the frame will be shown.
+		int64_t Present()
+		{
+			Retire();
+			if (m_queue.size() >= m_presentQueueLimit)
+			{
+				m_clock.AdvanceTo(m_queue[m_queue.size() - m_presentQueueLimit]);
+				Retire();
+			}
+
+			int64_t displayTime = (m_clock.Now() / m_refreshInterval + 1) * m_refreshInterval;
+			if (!m_queue.empty())
+			{
+				displayTime = std::max(displayTime, m_queue.back() + m_refreshInterval);
+			}
+			m_queue.push_back(displayTime);
+			return displayTime;
+		}
+
+	private:
+		void Retire()
+		{
+			while (!m_queue.empty() && m_queue.front() <= m_clock.Now())
+			{
+				m_queue.pop_front();
+			}
+		}
+
+		ManualFrameClock& m_clock;
+		int64_t m_refreshInterval;
+		uint32_t m_maxFrameLatency;
+		uint32_t m_presentQueueLimit;
+		std::deque<int64_t> m_queue;	// Scan-out times of the frames waiting for it, ascending
+	};
+
+	struct PacingResult
+	{
+		double frameMs;
+		double inputToDisplayMs;	// Input sample to scan-out, averaged after the warm-up
+		FramePacer::Stats stats;
+	};
+
+	PacingResult SimulatePacing(FramePacingMode mode, uint32_t maxFrameLatency, int64_t refreshInterval, int64_t cpuTime, int64_t gpuTime)
+	{
+		const uint32_t frameCount = 240;
+		const uint32_t warmupFrames = 16;
+
+		ManualFrameClock clock;
+		SimulatedDisplay display(clock, refreshInterval, maxFrameLatency, 3);
+
+		FramePacerDesc desc;
+		desc.mode = mode;
+		desc.maxFrameLatency = maxFrameLatency;
+		FramePacer pacer(clock, &display, desc);
+
+		int64_t inputToDisplay = 0;
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			pacer.BeginFrame();
+			clock.Advance(cpuTime);
+			pacer.MarkSubmit();
+			clock.Advance(gpuTime);
+			const int64_t displayTime = display.Present();
+			pacer.MarkPresent();
+
+			if (frame >= warmupFrames)
+			{
+				inputToDisplay += displayTime - pacer.GetLastFrame().inputSample;
+			}
+		}
+
+		PacingResult result;
+		result.stats = pacer.GetStats();
+		result.frameMs = result.stats.frameMs;
+		result.inputToDisplayMs = inputToDisplay * 1e-6 / (frameCount - warmupFrames);
+		return result;
+	}
+}
+
+bool VerifyFramePacer()
+{
+	const int64_t refresh = 16666667;
+	const double refreshMs = refresh * 1e-6;
+
+	for (int64_t cpuTime : { 2000000ll, 6000000ll, 12000000ll })
+	{
+		const PacingResult waited = SimulatePacing(FramePacingMode::WaitBeforeInput, 1, refresh, cpuTime, 1000000);
+		const PacingResult blocked = SimulatePacing(FramePacingMode::BlockInPresent, 1, refresh, cpuTime, 1000000);
+
+		// Both keep up with the display...
+		if (std::abs(waited.frameMs - refreshMs) > .01 * refreshMs || std::abs(blocked.frameMs - refreshMs) > .01 * refreshMs)
+		{
+			return false;
+		}
+
+		// ...but only waiting before input keeps the queue from adding latency.
+		if (waited.inputToDisplayMs > 2. * refreshMs || blocked.inputToDisplayMs < 2.5 * refreshMs)
+		{
+			return false;
+		}
+		if (waited.stats.timeouts != 0 || waited.stats.inputToPresentMs >= blocked.stats.inputToPresentMs)
+		{
+			return false;
+		}
+	}
+
+	// A deeper queue trades latency for slack.
+	const PacingResult shallow = SimulatePacing(FramePacingMode::WaitBeforeInput, 1, refresh, 4000000, 1000000);
+	const PacingResult deep = SimulatePacing(FramePacingMode::WaitBeforeInput, 2, refresh, 4000000, 1000000);
+	return deep.inputToDisplayMs > shallow.inputToDisplayMs;
+}
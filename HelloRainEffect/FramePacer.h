@@ -0,0 +1,126 @@
+#pragma once
+
+// Frame pacing: when the CPU starts a frame and how many frames may queue up for display.
+//
+// Presenting with a full display queue blocks inside Present(), after the frame's input
+// was sampled, so every queued frame adds a refresh of input latency. With a frame
+// latency waitable swap chain the pacer instead waits at the start of the frame, before
+// input is sampled, and SetMaximumFrameLatency bounds the queue.
+//
+// The policy only sees a FrameClock and a FrameLatencySignal, so it runs deterministically
+// against a manual clock and a simulated display, see VerifyFramePacer(). The DXGI side
+// lives in DXGIFrameLatencySignal.h. No Windows dependency.
+
+#include <cstdint>
+#include <vector>
+
+// Source of time for the pacer, in nanoseconds.
+class FrameClock
+{
+public:
+	virtual ~FrameClock() = default;
+	virtual int64_t Now() const = 0;
+};
+
+class SteadyFrameClock : public FrameClock
+{
+public:
+	int64_t Now() const override;
+};
+
+// Clock that only moves when told to, for simulations.
+class ManualFrameClock : public FrameClock
+{
+public:
+	int64_t Now() const override { return m_now; }
+	void Advance(int64_t duration) { m_now += duration; }
+	void AdvanceTo(int64_t time) { m_now = time > m_now ? time : m_now; }
+
+private:
+	int64_t m_now = 0;
+};
+
+// Tells the pacer the display queue has room for another frame: the swap chain's frame
+// latency waitable object, or a simulated display.
+class FrameLatencySignal
+{
+public:
+	virtual ~FrameLatencySignal() = default;
+
+	// Returns false if the timeout expired first.
+	virtual bool Wait(int64_t timeout) = 0;
+};
+
+enum class FramePacingMode
+{
+	WaitBeforeInput,	// Block on the latency signal at the start of the frame
+	BlockInPresent		// Never wait; Present() blocks once the display queue is full
+};
+
+struct FramePacerDesc
+{
+	FramePacingMode mode = FramePacingMode::WaitBeforeInput;
+	uint32_t maxFrameLatency = 1;			// Frames queued for display, passed to SetMaximumFrameLatency
+	int64_t waitTimeout = 100000000;		// A signal that never comes (e.g. occluded window) must not hang the loop
+};
+
+struct FrameTimestamps
+{
+	uint64_t frame;
+	int64_t begin;			// BeginFrame() was called
+	int64_t inputSample;	// The wait is over; input and simulation state are sampled from here
+	int64_t submit;			// Command lists submitted
+	int64_t present;		// Present() returned
+};
+
+class FramePacer
+{
+public:
+	static constexpr uint32_t HistorySize = 128;
+
+	// pSignal may be null, e.g. in BlockInPresent mode.
+	FramePacer(const FrameClock& clock, FrameLatencySignal* pSignal, const FramePacerDesc& desc);
+
+	const FramePacerDesc& GetDesc() const { return m_desc; }
+
+	// Wait until the display queue has room (in WaitBeforeInput mode), then stamp the
+	// input sample. Call before reading input and stepping the simulation.
+	void BeginFrame();
+
+	// Same, for loops that already waited for the latency signal themselves (e.g. together
+	// with the message queue, see GameLoop) starting at waitBegin.
+	void BeginFrame(int64_t waitBegin);
+	void MarkSubmit();
+	void MarkPresent();
+
+	// Timestamps of the newest frame that went through MarkPresent().
+	const FrameTimestamps& GetLastFrame() const { return m_history[(m_frameCount + HistorySize - 1) % HistorySize]; }
+	uint64_t GetFrameCount() const { return m_frameCount; }
+
+	// Averages over the frames in the history, in milliseconds.
+	struct Stats
+	{
+		uint32_t frames;
+		uint32_t timeouts;			// Waits that gave up since the start
+		double waitMs;				// begin -> inputSample
+		double inputToSubmitMs;
+		double inputToPresentMs;
+		double frameMs;				// inputSample -> next frame's inputSample
+	};
+	Stats GetStats() const;
+
+private:
+	const FrameClock& m_clock;
+	FrameLatencySignal* m_pSignal;
+	FramePacerDesc m_desc;
+
+	std::vector<FrameTimestamps> m_history;
+	FrameTimestamps m_current;
+	uint64_t m_frameCount;
+	uint32_t m_timeouts;
+};
+
+// Pace frames against a simulated 60 Hz display in both modes and check the outcome:
+// waiting before input keeps input-to-display latency within about one refresh at a
+// queue depth of 1, while blocking in Present() lets it grow with the queue.
+bool VerifyFramePacer();
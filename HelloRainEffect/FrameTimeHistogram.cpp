@@ -0,0 +1,258 @@
+#include "FrameTimeHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	// Index of the highest set bit of a non-zero value.
+	uint32_t HighestBitIndex(uint64_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<uint32_t>(index);
+#else
+		return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+	}
+}
+
+FrameTimeHistogram::FrameTimeHistogram(int64_t highestTrackableValue, int significantDigits) :
+	m_count(0),
+	m_min(std::numeric_limits<int64_t>::max()),
+	m_max(0),
+	m_sum(0)
+{
+	significantDigits = std::min(std::max(significantDigits, 1), 5);
+	m_highestTrackableValue = std::max<int64_t>(highestTrackableValue, 2);
+
+	// Sub-buckets needed to tell apart every value up to 2 * 10^digits at unit resolution.
+	int64_t largestValueWithSingleUnitResolution = 2;
+	for (int i = 0; i < significantDigits; i++)
+	{
+		largestValueWithSingleUnitResolution *= 10;
+	}
+	uint32_t subBucketCountMagnitude = 0;
+	while ((int64_t(1) << subBucketCountMagnitude) < largestValueWithSingleUnitResolution)
+	{
+		subBucketCountMagnitude++;
+	}
+	m_subBucketHalfCountMagnitude = subBucketCountMagnitude - 1;
+	m_subBucketHalfCount = 1u << m_subBucketHalfCountMagnitude;
+	m_subBucketMask = (int64_t(1) << subBucketCountMagnitude) - 1;
+
+	// Each bucket doubles the range covered by the previous ones.
+	uint32_t bucketCount = 1;
+	int64_t trackableValue = m_subBucketMask;
+	while (trackableValue < m_highestTrackableValue)
+	{
+		if (trackableValue > std::numeric_limits<int64_t>::max() / 2)
+		{
+			bucketCount++;
+			break;
+		}
+		trackableValue = (trackableValue << 1) | 1;
+		bucketCount++;
+	}
+
+	m_counts.assign(static_cast<size_t>(bucketCount + 1) * m_subBucketHalfCount, 0);
+}
+
+void FrameTimeHistogram::Record(int64_t value)
+{
+	value = std::min(std::max<int64_t>(value, 0), m_highestTrackableValue);
+
+	m_counts[GetCountsIndex(value)]++;
+	m_count++;
+	m_min = std::min(m_min, value);
+	m_max = std::max(m_max, value);
+	m_sum += value;
+}
+
+void FrameTimeHistogram::Reset()
+{
+	std::fill(m_counts.begin(), m_counts.end(), 0);
+	m_count = 0;
+	m_min = std::numeric_limits<int64_t>::max();
+	m_max = 0;
+	m_sum = 0;
+}
+
+uint32_t FrameTimeHistogram::GetCountsIndex(int64_t value) const
+{
+	const uint32_t bucketIndex = HighestBitIndex(static_cast<uint64_t>(value | m_subBucketMask)) - m_subBucketHalfCountMagnitude;
+	const uint32_t subBucketIndex = static_cast<uint32_t>(value >> bucketIndex);
+	return ((bucketIndex + 1) << m_subBucketHalfCountMagnitude) + (subBucketIndex - m_subBucketHalfCount);
+}
+
+int64_t FrameTimeHistogram::GetValueFromIndex(uint32_t index) const
+{
+	int32_t bucketIndex = static_cast<int32_t>(index >> m_subBucketHalfCountMagnitude) - 1;
+	int64_t subBucketIndex = (index & (m_subBucketHalfCount - 1)) + m_subBucketHalfCount;
+	if (bucketIndex < 0)
+	{
+		subBucketIndex -= m_subBucketHalfCount;
+		bucketIndex = 0;
+	}
+	return subBucketIndex << bucketIndex;
+}
+
+int64_t FrameTimeHistogram::GetLowestEquivalentValue(int64_t value) const
+{
+	return GetValueFromIndex(GetCountsIndex(std::min(std::max<int64_t>(value, 0), m_highestTrackableValue)));
+}
+
+int64_t FrameTimeHistogram::GetHighestEquivalentValue(int64_t value) const
+{
+	value = std::min(std::max<int64_t>(value, 0), m_highestTrackableValue);
+	const uint32_t bucketIndex = HighestBitIndex(static_cast<uint64_t>(value | m_subBucketMask)) - m_subBucketHalfCountMagnitude;
+	return GetLowestEquivalentValue(value) + (int64_t(1) << bucketIndex) - 1;
+}
+
+int64_t FrameTimeHistogram::GetValueAtPercentile(double percentile) const
+{
+	if (m_count == 0)
+	{
+		return 0;
+	}
+
+	percentile = std::min(std::max(percentile, 0.), 100.);
+	const uint64_t countAtPercentile = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(percentile / 100. * m_count)), 1);
+
+	uint64_t total = 0;
+	for (uint32_t index = 0; index < m_counts.size(); index++)
+	{
+		total += m_counts[index];
+		if (total >= countAtPercentile)
+		{
+			// Report the top of the sub-bucket, but never past what was actually recorded.
+			const int64_t value = GetHighestEquivalentValue(GetValueFromIndex(index));
+			return std::min(std::max(value, m_min), m_max);
+		}
+	}
+	return m_max;
+}
+
+std::string FormatFrameTimeReport(const FrameTimeHistogram& histogram)
+{
+	const double nsToMs = 1e-6;
+	char report[512];
+	snprintf(report, sizeof(report),
+		"frames %llu\n"
+		"min    %.3f ms\n"
+		"mean   %.3f ms\n"
+		"p50    %.3f ms\n"
+		"p90    %.3f ms\n"
+		"p99    %.3f ms\n"
+		"p99.9  %.3f ms\n"
+		"max    %.3f ms\n",
+		static_cast<unsigned long long>(histogram.GetCount()),
+		histogram.GetMin() * nsToMs,
+		histogram.GetMean() * nsToMs,
+		histogram.GetValueAtPercentile(50.) * nsToMs,
+		histogram.GetValueAtPercentile(90.) * nsToMs,
+		histogram.GetValueAtPercentile(99.) * nsToMs,
+		histogram.GetValueAtPercentile(99.9) * nsToMs,
+		histogram.GetMax() * nsToMs);
+	return report;
+}
+
+namespace
+{
+	bool CheckAgainstExact(const std::vector<int64_t>& samples)
+	{
+		FrameTimeHistogram histogram;
+		int64_t sum = 0;
+		for (int64_t sample : samples)
+		{
+			histogram.Record(sample);
+			sum += sample;
+		}
+
+		std::vector<int64_t> sorted = samples;
+		std::sort(sorted.begin(), sorted.end());
+
+		if (histogram.GetCount() != sorted.size() || histogram.GetMin() != sorted.front() || histogram.GetMax() != sorted.back() ||
+			std::abs(histogram.GetMean() - static_cast<double>(sum) / sorted.size()) > 1e-6 * histogram.GetMean())
+		{
+			return false;
+		}
+
+		for (double percentile : { 0., 50., 90., 99., 99.9, 100. })
+		{
+			// Nearest rank.
+			const size_t rank = std::max<size_t>(static_cast<size_t>(std::ceil(percentile / 100. * sorted.size())), 1);
+			const int64_t exact = sorted[rank - 1];
+			const int64_t value = histogram.GetValueAtPercentile(percentile);
+
+			// Three significant digits: within a sub-bucket of 1/1024 of the value.
+			if (value < exact || value - exact > exact / 1024 + 1)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+bool VerifyFrameTimeHistogram()
+{
+	std::mt19937_64 rng(12345);
+	const size_t sampleCount = 100000;
+	std::vector<int64_t> samples(sampleCount);
+
+	// Steady frames with some noise.
+	std::uniform_int_distribution<int64_t> steady(4000000, 20000000);
+	for (int64_t& sample : samples)
+	{
+		sample = steady(rng);
+	}
+	if (!CheckAgainstExact(samples))
+	{
+		return false;
+	}
+
+	// Vsync-locked frames with rare hitches: p99.9 must see them although the mean barely moves.
+	std::uniform_real_distribution<double> unit(0., 1.);
+	for (int64_t& sample : samples)
+	{
+		const double roll = unit(rng);
+		sample = roll < .995 ? 16666667 + static_cast<int64_t>(roll * 100000) : 50000000 + static_cast<int64_t>(unit(rng) * 50000000);
+	}
+	if (!CheckAgainstExact(samples))
+	{
+		return false;
+	}
+
+	// Uncapped frames spread over five orders of magnitude.
+	for (int64_t& sample : samples)
+	{
+		sample = static_cast<int64_t>(std::pow(10., 4. + 5. * unit(rng)));
+	}
+	if (!CheckAgainstExact(samples))
+	{
+		return false;
+	}
+
+	// Out of range values are clamped rather than dropped.
+	FrameTimeHistogram histogram(1000000000);
+	histogram.Record(-5);
+	histogram.Record(5000000000ll);
+	if (histogram.GetCount() != 2 || histogram.GetMin() != 0 || histogram.GetMax() != 1000000000 ||
+		histogram.GetValueAtPercentile(100.) != 1000000000)
+	{
+		return false;
+	}
+
+	histogram.Reset();
+	return histogram.GetCount() == 0 && histogram.GetValueAtPercentile(50.) == 0 &&
+		FormatFrameTimeReport(histogram).find("p99.9") != std::string::npos;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// Frame time histogram with a fixed relative precision over a wide range, in the style of
+// HdrHistogram: values are grouped in power-of-two buckets, each split into enough linear
+// sub-buckets to keep the given number of significant decimal digits. Recording is a
+// couple of shifts and an increment into storage allocated up front, so it can run every
+// frame. No Windows dependency.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class FrameTimeHistogram
+{
+public:
+	// Values are in nanoseconds; larger ones than highestTrackableValue are counted as it.
+	explicit FrameTimeHistogram(int64_t highestTrackableValue = 60000000000ll, int significantDigits = 3);
+
+	void Record(int64_t value);
+	void Reset();
+
+	uint64_t GetCount() const { return m_count; }
+	int64_t GetMin() const { return m_count ? m_min : 0; }
+	int64_t GetMax() const { return m_max; }
+	double GetMean() const { return m_count ? static_cast<double>(m_sum) / m_count : 0.; }
+
+	// Smallest recorded value that percentile percent of the samples are at or below, to
+	// within the histogram's precision. percentile is in [0, 100].
+	int64_t GetValueAtPercentile(double percentile) const;
+
+	// Values that land in the same sub-bucket as value are indistinguishable from it.
+	int64_t GetLowestEquivalentValue(int64_t value) const;
+	int64_t GetHighestEquivalentValue(int64_t value) const;
+
+private:
+	uint32_t GetCountsIndex(int64_t value) const;
+	int64_t GetValueFromIndex(uint32_t index) const;
+
+	uint32_t m_subBucketHalfCountMagnitude;
+	uint32_t m_subBucketHalfCount;
+	int64_t m_subBucketMask;
+	int64_t m_highestTrackableValue;
+	std::vector<uint64_t> m_counts;
+
+	uint64_t m_count;
+	int64_t m_min;
+	int64_t m_max;
+	int64_t m_sum;
+};
+
+// Human-readable summary in milliseconds: count, min, mean, p50, p90, p99, p99.9 and max.
+std::string FormatFrameTimeReport(const FrameTimeHistogram& histogram);
+
+// Compare the histogram's percentiles with exact ones on a few frame time distributions.
+bool VerifyFrameTimeHistogram();
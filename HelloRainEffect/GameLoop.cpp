@@ -0,0 +1,321 @@
+#include "GameLoop.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+GameLoop::GameLoop(LoopPlatform& platform, const FrameClock& clock, PresentStateMachine& presentState, FrameFunc frame, ProbeFunc probe, const GameLoopDesc& desc) :
+	m_platform(platform),
+	m_clock(clock),
+	m_presentState(presentState),
+	m_frame(std::move(frame)),
+	m_probe(std::move(probe)),
+	m_desc(desc),
+	m_frameReady(false),
+	m_idleNotified(false),
+	m_waitBegin(-1),
+	m_stats{}
+{
+}
+
+bool GameLoop::RunOnce()
+{
+	m_stats.iterations++;
+
+	if (!m_platform.PumpMessages())
+	{
+		return false;
+	}
+	UpdateIdle();
+
+	const int64_t now = m_clock.Now();
+	if (m_waitBegin < 0)
+	{
+		m_waitBegin = now;
+	}
+
+	if (IsIdle())
+	{
+		int64_t timeout = m_desc.idleTimeout;
+		if (m_presentState.GetState() == PresentState::Occluded)
+		{
+			if (m_presentState.ShouldProbe(now))
+			{
+				m_stats.probes++;
+				m_presentState.OnProbe(!m_probe(), m_clock.Now());
+				UpdateIdle();
+				return true;
+			}
+			timeout = m_presentState.GetNextProbeTime() - now;
+		}
+
+		// A signal that fires meanwhile is kept for the first frame after waking up.
+		m_stats.idleWaits++;
+		if (m_platform.Wait(m_platform.HasFrameSignal() && !m_frameReady, timeout) == LoopWake::FrameSignal)
+		{
+			m_frameReady = true;
+		}
+		return true;
+	}
+
+	if (m_platform.HasFrameSignal() && !m_frameReady)
+	{
+		// Whatever woke us up, go around once more: the messages that came in meanwhile are
+		// drained and the window state is checked again right before the frame starts.
+		switch (m_platform.Wait(true, m_desc.frameTimeout))
+		{
+		case LoopWake::Message:
+			// The frame signal is still pending.
+			break;
+
+		case LoopWake::Timeout:
+			// A signal that never comes must not stall the app.
+			m_stats.frameTimeouts++;
+			m_frameReady = true;
+			break;
+
+		case LoopWake::FrameSignal:
+			m_frameReady = true;
+			break;
+		}
+		return true;
+	}
+
+	RunFrame();
+	return true;
+}
+
+void GameLoop::RunFrame()
+{
+	const int64_t waitBegin = m_waitBegin;
+	m_waitBegin = -1;
+	m_frameReady = false;
+
+	const bool visible = m_frame(waitBegin);
+	m_stats.frames++;
+
+	m_presentState.OnPresent(!visible, m_clock.Now());
+	UpdateIdle();
+}
+
+void GameLoop::UpdateIdle()
+{
+	const bool idle = IsIdle();
+	if (idle == m_idleNotified)
+	{
+		return;
+	}
+	m_idleNotified = idle;
+
+	// The time spent hidden is not a wait for the next frame.
+	m_waitBegin = -1;
+
+	if (m_idle)
+	{
+		m_idle(idle);
+	}
+}
+
+namespace
+{
+	// Win32 stand-in: messages arrive at scripted times, the window is minimized over a
+	// scripted interval (reported like WM_SIZE, when the messages are pumped), and the
+	// frame signal behaves like a swap chain with a maximum frame latency of 1 on a display
+	// refreshing every refreshInterval.
+	class ScriptedPlatform : public LoopPlatform
+	{
+	public:
+		ScriptedPlatform(ManualFrameClock& clock, PresentStateMachine& presentState, int64_t refreshInterval) :
+			m_clock(clock),
+			m_presentState(presentState),
+			m_refreshInterval(refreshInterval),
+			m_signalTime(0),
+			m_nextMessage(0),
+			m_minimizedBegin(0),
+			m_minimizedEnd(0),
+			m_minimized(false),
+			m_quitTime(std::numeric_limits<int64_t>::max())
+		{
+		}
+
+		std::vector<int64_t> messages;
+
+		void SetMinimized(int64_t begin, int64_t end)
+		{
+			m_minimizedBegin = begin;
+			m_minimizedEnd = end;
+			messages.push_back(begin);
+			messages.push_back(end);
+			std::sort(messages.begin(), messages.end());
+		}
+		void SetQuitTime(int64_t time) { m_quitTime = time; }
+
+		bool PumpMessages() override
+		{
+			while (m_nextMessage < messages.size() && messages[m_nextMessage] <= m_clock.Now())
+			{
+				m_nextMessage++;
+			}
+
+			const bool minimized = IsMinimized();
+			if (minimized != m_minimized)
+			{
+				m_minimized = minimized;
+				if (minimized)
+				{
+					m_presentState.OnMinimized(m_clock.Now());
+				}
+				else
+				{
+					m_presentState.OnRestored(m_clock.Now());
+				}
+			}
+			return m_clock.Now() < m_quitTime;
+		}
+
+		bool HasFrameSignal() const override { return true; }
+
+		LoopWake Wait(bool includeFrameSignal, int64_t timeout) override
+		{
+			const int64_t now = m_clock.Now();
+			const int64_t messageTime = m_nextMessage < messages.size() ? messages[m_nextMessage] : std::numeric_limits<int64_t>::max();
+			const int64_t signalTime = includeFrameSignal ? m_signalTime : std::numeric_limits<int64_t>::max();
+			const int64_t timeoutTime = now + timeout;
+
+			if (messageTime <= std::min(signalTime, timeoutTime))
+			{
+				m_clock.AdvanceTo(messageTime);
+				return LoopWake::Message;
+			}
+			if (signalTime <= timeoutTime)
+			{
+				m_clock.AdvanceTo(signalTime);
+				m_signalTime = std::numeric_limits<int64_t>::max();
+				return LoopWake::FrameSignal;
+			}
+			m_clock.AdvanceTo(timeoutTime);
+			return LoopWake::Timeout;
+		}
+
+		// The frame is shown at the next refresh, which is also when the queue has room again.
+		void Present()
+		{
+			m_signalTime = (m_clock.Now() / m_refreshInterval + 1) * m_refreshInterval;
+		}
+
+		bool IsMinimized() const
+		{
+			return m_clock.Now() >= m_minimizedBegin && m_clock.Now() < m_minimizedEnd;
+		}
+
+		bool HasUndeliveredMessages() const
+		{
+			return m_nextMessage < messages.size() && messages[m_nextMessage] <= m_clock.Now();
+		}
+
+	private:
+		ManualFrameClock& m_clock;
+		PresentStateMachine& m_presentState;
+		int64_t m_refreshInterval;
+		int64_t m_signalTime;
+		size_t m_nextMessage;
+		int64_t m_minimizedBegin;
+		int64_t m_minimizedEnd;
+		bool m_minimized;
+		int64_t m_quitTime;
+	};
+}
+
+bool VerifyGameLoop()
+{
+	const int64_t ms = 1000000;
+	const int64_t refresh = 16666667;
+	const int64_t probeInterval = 250 * ms;
+
+	// 0-1s visible, 1-1.5s minimized, 1.5-2.5s occluded, 2.5-3s visible again.
+	const int64_t minimizedBegin = 1000 * ms, minimizedEnd = 1500 * ms;
+	const int64_t occludedBegin = 1500 * ms, occludedEnd = 2500 * ms;
+	const int64_t quitTime = 3000 * ms;
+
+	ManualFrameClock clock;
+	PresentStateMachine presentState(probeInterval);
+	ScriptedPlatform platform(clock, presentState, refresh);
+	for (int64_t time = 3 * ms; time < quitTime; time += 7 * ms)
+	{
+		platform.messages.push_back(time);
+	}
+	platform.SetMinimized(minimizedBegin, minimizedEnd);
+	platform.SetQuitTime(quitTime);
+
+	const auto isOccluded = [&]() { return clock.Now() >= occludedBegin && clock.Now() < occludedEnd; };
+
+	std::vector<int64_t> frameTimes, probeTimes, resumeTimes;
+	std::vector<bool> idleChanges;
+	bool drained = true, waitedBeforeFrame = true, resumedCleanly = true;
+	GameLoop loop(platform, clock, presentState, [&](int64_t waitBegin)
+	{
+		drained = drained && !platform.HasUndeliveredMessages() && !platform.IsMinimized();
+		waitedBeforeFrame = waitedBeforeFrame && waitBegin <= clock.Now();
+		resumedCleanly = resumedCleanly && (resumeTimes.empty() || waitBegin >= resumeTimes.back());
+		frameTimes.push_back(clock.Now());
+
+		clock.Advance(3 * ms);
+		platform.Present();
+		return !isOccluded();
+	},
+	[&]()
+	{
+		probeTimes.push_back(clock.Now());
+		return !isOccluded();
+	});
+	loop.SetIdleHandler([&](bool idle)
+	{
+		idleChanges.push_back(idle);
+		if (!idle)
+		{
+			resumeTimes.push_back(clock.Now());
+		}
+	});
+	loop.Run();
+
+	const auto framesIn = [&](int64_t begin, int64_t end)
+	{
+		return std::count_if(frameTimes.begin(), frameTimes.end(), [=](int64_t time) { return time >= begin && time < end; });
+	};
+
+	// One frame per refresh while visible, nothing while minimized, and while occluded only
+	// the frame that found out.
+	const auto visibleFrames = framesIn(0, minimizedBegin);
+	const auto resumedFrames = framesIn(occludedEnd + probeInterval, quitTime);
+	if (visibleFrames < 59 || visibleFrames > 61 || framesIn(minimizedBegin, minimizedEnd) != 0 ||
+		framesIn(occludedBegin, occludedEnd) > 1 || resumedFrames < 14 || loop.GetStats().frameTimeouts != 0)
+	{
+		return false;
+	}
+
+	// Probes only while occluded, never closer together than the interval, and the first
+	// one after the window shows again brings the frames back.
+	for (size_t i = 0; i < probeTimes.size(); i++)
+	{
+		if (probeTimes[i] < occludedBegin || probeTimes[i] >= occludedEnd + probeInterval ||
+			(i > 0 && probeTimes[i] - probeTimes[i - 1] < probeInterval))
+		{
+			return false;
+		}
+	}
+	if (probeTimes.size() < 3 || probeTimes.size() > 5 || probeTimes.back() < occludedEnd)
+	{
+		return false;
+	}
+
+	// Minimized, restored, occluded, visible.
+	if (idleChanges != std::vector<bool>{ true, false, true, false } || presentState.GetHideCount() != 2)
+	{
+		return false;
+	}
+
+	// Every iteration was woken by a message, waited for a frame, ran one, probed or slept: the loop never spins.
+	const GameLoop::Stats& stats = loop.GetStats();
+	return drained && waitedBeforeFrame && resumedCleanly && stats.probes == probeTimes.size() &&
+		stats.iterations <= platform.messages.size() + 2 * stats.frames + stats.idleWaits + stats.probes + 2;
+}
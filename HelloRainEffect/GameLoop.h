@@ -0,0 +1,109 @@
+#pragma once
+
+// Main loop policy: when to pump messages, when to produce a frame and when to sleep.
+//
+// Every iteration drains the whole message queue, then produces at most one frame. With
+// a frame latency signal the loop sleeps on messages and the signal together, so input
+// keeps flowing while the display queue is full and a frame starts as soon as there is
+// room for it. Whether to render at all is up to a PresentStateMachine: minimized, the
+// loop sleeps until a message (WM_SIZE on restore) arrives; occluded, it only wakes to
+// probe the swap chain, which records and submits nothing. Frames stop between two
+// iterations, so the frame resources and fence are left exactly as the last frame left them.
+//
+// The platform side is behind LoopPlatform (Win32 in platform_win32, a scripted one in
+// VerifyGameLoop()) and time comes from a FrameClock. No Windows dependency.
+
+#include "FramePacer.h"
+#include "PresentStateMachine.h"
+
+#include <cstdint>
+#include <functional>
+
+enum class LoopWake
+{
+	Message,		// A message is waiting in the queue
+	FrameSignal,	// The display queue has room for another frame
+	Timeout
+};
+
+class LoopPlatform
+{
+public:
+	virtual ~LoopPlatform() = default;
+
+	// Dispatch every queued message. Returns false once the app was asked to quit.
+	virtual bool PumpMessages() = 0;
+
+	// Whether there is a frame latency signal to wait on. Without one, frames run back to
+	// back and Present() does the throttling.
+	virtual bool HasFrameSignal() const = 0;
+
+	// Sleep until a message arrives, the frame signal fires (if included) or the timeout expires.
+	virtual LoopWake Wait(bool includeFrameSignal, int64_t timeout) = 0;
+};
+
+struct GameLoopDesc
+{
+	int64_t frameTimeout = 100000000;	// Longest wait for the frame signal before rendering anyway
+	int64_t idleTimeout = 1000000000;	// Longest sleep while minimized; restoring wakes the loop anyway
+};
+
+class GameLoop
+{
+public:
+	// Produces one frame. waitBegin is when the loop started waiting for it, so that the
+	// wait shows up in the frame's timings. Returns false if the frame was not visible
+	// (e.g. the swap chain reported the window as occluded).
+	using FrameFunc = std::function<bool(int64_t waitBegin)>;
+
+	// Checks whether an occluded window is visible again without producing a frame, e.g.
+	// with a DXGI_PRESENT_TEST present. Returns true if it is.
+	using ProbeFunc = std::function<bool()>;
+
+	// Called with true when frames stop and with false right before they start again.
+	using IdleFunc = std::function<void(bool idle)>;
+
+	// Minimize and restore go to presentState directly from the window procedure.
+	GameLoop(LoopPlatform& platform, const FrameClock& clock, PresentStateMachine& presentState, FrameFunc frame, ProbeFunc probe, const GameLoopDesc& desc = GameLoopDesc());
+
+	void SetIdleHandler(IdleFunc idle) { m_idle = std::move(idle); }
+
+	// One iteration. Returns false once the app should quit.
+	bool RunOnce();
+	void Run() { while (RunOnce()) {} }
+
+	bool IsIdle() const { return !m_presentState.ShouldRender(); }
+
+	struct Stats
+	{
+		uint64_t iterations;
+		uint64_t frames;
+		uint64_t probes;		// Presents tested while occluded
+		uint64_t idleWaits;
+		uint64_t frameTimeouts;
+	};
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	void RunFrame();
+	void UpdateIdle();
+
+	LoopPlatform& m_platform;
+	const FrameClock& m_clock;
+	PresentStateMachine& m_presentState;
+	FrameFunc m_frame;
+	ProbeFunc m_probe;
+	IdleFunc m_idle;
+	GameLoopDesc m_desc;
+
+	bool m_frameReady;		// The frame signal fired and was consumed, the next frame may start
+	bool m_idleNotified;
+	int64_t m_waitBegin;	// Start of the wait for the next frame, -1 if not waiting yet
+	Stats m_stats;
+};
+
+// Run the loop against a scripted platform with a simulated display and check that messages
+// are drained before every frame, frames follow the signal one to one, minimized windows
+// sleep, occluded ones only probe at the state machine's cadence, and frames resume once
+// the window shows again.
+bool VerifyGameLoop();
@@ -17,6 +17,7 @@ public:
 
 	virtual void OnKeyDown(UINT8 key) = 0;
 	virtual void OnKeyUp(UINT8 key) = 0;
+	virtual void OnSizeChanged(UINT width, UINT height, bool minimized) = 0;
 
 	UINT m_width;
 	UINT m_height;
@@ -0,0 +1,227 @@
+#include "JobSystem.h"
+
+namespace
+{
+	// Identifies which deque belongs to the calling thread.
+	thread_local const JobSystem* t_jobSystem = nullptr;
+	thread_local unsigned int t_workerIndex = 0;
+	thread_local uint32_t t_stealSeed = 0x9E3779B9u;
+
+	uint32_t NextVictimSeed()
+	{
+		// xorshift32, only used to spread thieves over the victims.
+		uint32_t x = t_stealSeed;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		t_stealSeed = x;
+		return x;
+	}
+
+	// How many empty polls a worker makes before going to sleep.
+	const int c_spinCount = 64;
+}
+
+JobSystem::JobSystem(unsigned int threadCount) :
+	m_ownerThread(std::this_thread::get_id()),
+	m_queuedTasks(0),
+	m_sleepers(0),
+	m_quit(false)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+	}
+	if (threadCount == 0)
+	{
+		threadCount = 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		m_workers.emplace_back(new Worker());
+	}
+
+	// The constructing thread is worker 0; it only runs tasks while waiting on a group.
+	t_jobSystem = this;
+	t_workerIndex = 0;
+
+	for (unsigned int i = 1; i < threadCount; i++)
+	{
+		m_threads.emplace_back(&JobSystem::WorkerMain, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+		m_quit.store(true);
+	}
+	m_wake.notify_all();
+
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+
+	if (t_jobSystem == this)
+	{
+		t_jobSystem = nullptr;
+	}
+}
+
+void JobSystem::Spawn(TaskGroup& group, size_t begin, size_t end, size_t grain, RangeFunc func, void* context)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+
+	group.m_pending.fetch_add(1, std::memory_order_relaxed);
+	Push(CurrentWorkerIndex(), Task{ func, context, begin, end, grain > 0 ? grain : 1, &group });
+}
+
+void JobSystem::Wait(TaskGroup& group)
+{
+	const unsigned int workerIndex = CurrentWorkerIndex();
+
+	while (!group.IsDone())
+	{
+		Task task;
+		if (FindTask(workerIndex, task))
+		{
+			Execute(workerIndex, task);
+		}
+		else
+		{
+			// The remaining tasks of the group are running on other threads.
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::Push(unsigned int workerIndex, const Task& task)
+{
+	Worker& worker = *m_workers[workerIndex];
+	{
+		std::lock_guard<std::mutex> lock(worker.lock);
+		worker.tasks.push_back(task);
+	}
+
+	// Publish the task before looking for sleepers; a worker about to sleep checks the
+	// counter after registering itself, so one of the two always sees the other.
+	m_queuedTasks.fetch_add(1);
+	if (m_sleepers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+		m_wake.notify_one();
+	}
+}
+
+bool JobSystem::PopLocal(unsigned int workerIndex, Task& task)
+{
+	Worker& worker = *m_workers[workerIndex];
+	std::lock_guard<std::mutex> lock(worker.lock);
+	if (worker.tasks.empty())
+	{
+		return false;
+	}
+
+	// Newest first: it is the smallest piece and its data is still in this core's cache.
+	task = worker.tasks.back();
+	worker.tasks.pop_back();
+	m_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool JobSystem::Steal(unsigned int thiefIndex, Task& task)
+{
+	const unsigned int workerCount = GetThreadCount();
+	const unsigned int start = NextVictimSeed() % workerCount;
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		const unsigned int victimIndex = (start + i) % workerCount;
+		if (victimIndex == thiefIndex)
+		{
+			continue;
+		}
+
+		Worker& victim = *m_workers[victimIndex];
+		std::unique_lock<std::mutex> lock(victim.lock, std::try_to_lock);
+		if (!lock.owns_lock() || victim.tasks.empty())
+		{
+			continue;
+		}
+
+		// Oldest first: it is the largest remaining range of the victim.
+		task = victim.tasks.front();
+		victim.tasks.pop_front();
+		m_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	return false;
+}
+
+bool JobSystem::FindTask(unsigned int workerIndex, Task& task)
+{
+	return PopLocal(workerIndex, task) || Steal(workerIndex, task);
+}
+
+void JobSystem::Execute(unsigned int workerIndex, Task& task)
+{
+	// Split off the upper half until the range fits the grain, leaving the halves to thieves.
+	while (task.end - task.begin > task.grain)
+	{
+		const size_t mid = task.begin + (task.end - task.begin) / 2;
+
+		Task upper = task;
+		upper.begin = mid;
+		task.group->m_pending.fetch_add(1, std::memory_order_relaxed);
+		Push(workerIndex, upper);
+
+		task.end = mid;
+	}
+
+	task.func(task.context, task.begin, task.end);
+	task.group->m_pending.fetch_sub(1, std::memory_order_release);
+}
+
+unsigned int JobSystem::CurrentWorkerIndex() const
+{
+	// Threads that are not part of this job system share the owner's deque.
+	return t_jobSystem == this ? t_workerIndex : 0;
+}
+
+void JobSystem::WorkerMain(unsigned int workerIndex)
+{
+	t_jobSystem = this;
+	t_workerIndex = workerIndex;
+	t_stealSeed = 0x9E3779B9u * (workerIndex + 1);
+
+	int idlePolls = 0;
+	while (!m_quit.load(std::memory_order_relaxed))
+	{
+		Task task;
+		if (FindTask(workerIndex, task))
+		{
+			Execute(workerIndex, task);
+			idlePolls = 0;
+			continue;
+		}
+
+		if (++idlePolls < c_spinCount)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepLock);
+		m_sleepers.fetch_add(1);
+		m_wake.wait(lock, [this]() { return m_queuedTasks.load() > 0 || m_quit.load(); });
+		m_sleepers.fetch_sub(1);
+		idlePolls = 0;
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+// Work-stealing task scheduler used to spread the particle update over all cores.
+//
+// Every thread owns a deque of range tasks: it pushes and pops at the back of its own
+// deque, while idle threads steal from the front of other deques. A range task larger
+// than its grain size splits itself in half before running, pushing the upper half
+// for others to steal, so big ranges are distributed in O(log n) steps.
+//
+// Like ParticleSimulator, this has no Windows dependency and builds headless on Linux.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class JobSystem;
+
+// Fork/join counter for a set of tasks. A group can be reused once Wait() has returned,
+// which makes it convenient to keep one alive for the whole frame.
+class TaskGroup
+{
+public:
+	TaskGroup() : m_pending(0) {}
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+	bool IsDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<size_t> m_pending;
+};
+
+class JobSystem
+{
+public:
+	using RangeFunc = void (*)(void* context, size_t begin, size_t end);
+
+	// threadCount includes the thread that constructs the job system, which takes part
+	// in the work while waiting on a group. Zero means one thread per hardware thread.
+	explicit JobSystem(unsigned int threadCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	unsigned int GetThreadCount() const { return static_cast<unsigned int>(m_workers.size()); }
+
+	// Queue func over [begin, end) in chunks of at most grain elements. Returns immediately.
+	void Spawn(TaskGroup& group, size_t begin, size_t end, size_t grain, RangeFunc func, void* context);
+
+	// Run queued tasks (of any group) until every task of this group has finished.
+	void Wait(TaskGroup& group);
+
+	// Fork/join helper: body(begin, end) is called for disjoint sub-ranges covering [begin, end).
+	template <typename Body>
+	void ParallelFor(size_t begin, size_t end, size_t grain, Body&& body)
+	{
+		TaskGroup group;
+		Spawn(group, begin, end, grain, &InvokeBody<typename std::remove_reference<Body>::type>, &body);
+		Wait(group);
+	}
+
+	template <typename Body>
+	void Spawn(TaskGroup& group, size_t begin, size_t end, size_t grain, Body& body)
+	{
+		Spawn(group, begin, end, grain, &InvokeBody<Body>, &body);
+	}
+
+private:
+	struct Task
+	{
+		RangeFunc func;
+		void* context;
+		size_t begin;
+		size_t end;
+		size_t grain;
+		TaskGroup* group;
+	};
+
+	struct alignas(64) Worker
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	template <typename Body>
+	static void InvokeBody(void* context, size_t begin, size_t end)
+	{
+		(*static_cast<Body*>(context))(begin, end);
+	}
+
+	void Push(unsigned int workerIndex, const Task& task);
+	bool PopLocal(unsigned int workerIndex, Task& task);
+	bool Steal(unsigned int thiefIndex, Task& task);
+	bool FindTask(unsigned int workerIndex, Task& task);
+	void Execute(unsigned int workerIndex, Task& task);
+	unsigned int CurrentWorkerIndex() const;
+	void WorkerMain(unsigned int workerIndex);
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::vector<std::thread> m_threads;
+	std::thread::id m_ownerThread;
+
+	// Idle workers sleep here instead of spinning when there is nothing to steal.
+	std::mutex m_sleepLock;
+	std::condition_variable m_wake;
+	std::atomic<size_t> m_queuedTasks;
+	std::atomic<unsigned int> m_sleepers;
+	std::atomic<bool> m_quit;
+};
@@ -0,0 +1,481 @@
+#include "ParticleCompression.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PARTICLE_COMPRESSION_SSE 1
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define PARTICLE_COMPRESSION_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	const float c_positionSteps = 65535.f;
+	const float c_speedSteps = 255.f;
+
+	// Particles gathered at a time by the indexed encoder before they are encoded as a block.
+	const size_t c_gatherBlockSize = 64;
+
+	inline uint32_t FloatBits(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline float BitsToFloat(uint32_t bits)
+	{
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// Same operand order as _mm_max_ps/_mm_min_ps, so the scalar and vector paths agree.
+	inline float Saturate(float value, float maxValue)
+	{
+		value = value > 0.f ? value : 0.f;
+		return value < maxValue ? value : maxValue;
+	}
+
+	struct QuantizationScales
+	{
+		float positionScale[3];		// Position to UNORM16 steps
+		float positionStep[3];		// UNORM16 step to position
+		float speedScale;			// Speed to index
+		float speedStep;			// UNORM16 speed to speed
+	};
+
+	QuantizationScales ComputeScales(const ParticleQuantization& quantization)
+	{
+		QuantizationScales scales;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float extent = quantization.boundsMax[axis] - quantization.boundsMin[axis];
+			scales.positionScale[axis] = c_positionSteps / extent;
+			scales.positionStep[axis] = extent / c_positionSteps;
+		}
+		const float speedRange = quantization.speedMax - quantization.speedMin;
+		scales.speedScale = c_speedSteps / speedRange;
+		scales.speedStep = speedRange / c_positionSteps;
+		return scales;
+	}
+
+	inline uint16_t QuantizePosition(float value, float minValue, float scale)
+	{
+		return static_cast<uint16_t>(Saturate((value - minValue) * scale, c_positionSteps) + .5f);
+	}
+
+	inline uint16_t QuantizeSpeed(float value, float minValue, float scale)
+	{
+		return static_cast<uint16_t>(static_cast<uint32_t>(Saturate((value - minValue) * scale, c_speedSteps) + .5f) * 257u);
+	}
+
+	inline CompactParticleVertex EncodeScalar(float x, float y, float z, float sizeX, float sizeY, float speed,
+		const ParticleQuantization& quantization, const QuantizationScales& scales)
+	{
+		CompactParticleVertex v;
+		v.position[0] = QuantizePosition(x, quantization.boundsMin[0], scales.positionScale[0]);
+		v.position[1] = QuantizePosition(y, quantization.boundsMin[1], scales.positionScale[1]);
+		v.position[2] = QuantizePosition(z, quantization.boundsMin[2], scales.positionScale[2]);
+		v.speed = QuantizeSpeed(speed, quantization.speedMin, scales.speedScale);
+		v.size[0] = FloatToHalf(sizeX);
+		v.size[1] = FloatToHalf(sizeY);
+		return v;
+	}
+
+#if defined(PARTICLE_COMPRESSION_SSE)
+	inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+	{
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	// FloatToHalf on four lanes, the result in the low 16 bits of each.
+	inline __m128i FloatToHalfSSE(__m128 f)
+	{
+		const __m128i c_f16max = _mm_set1_epi32((127 + 16) << 23);
+		const __m128i c_nanbit = _mm_set1_epi32(0x200);
+		const __m128i c_infinity = _mm_set1_epi32(0x7c00);
+		const __m128i c_minNormal = _mm_set1_epi32((127 - 14) << 23);
+		const __m128i c_subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128i c_normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+		const __m128 sign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000u))));
+		const __m128 absolute = _mm_xor_ps(f, sign);
+		const __m128i absoluteBits = _mm_castps_si128(absolute);
+
+		const __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absolute, absolute));
+		const __m128i isRegular = _mm_cmpgt_epi32(c_f16max, absoluteBits);
+		const __m128i infOrNan = _mm_or_si128(_mm_and_si128(isNan, c_nanbit), c_infinity);
+
+		// Subnormal results: let the FPU shift the mantissa in place, rounding included.
+		const __m128i isSubnormal = _mm_cmpgt_epi32(c_minNormal, absoluteBits);
+		const __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absolute, _mm_castsi128_ps(c_subnormalMagic))), c_subnormalMagic);
+
+		// Normal results: rebias the exponent and round the mantissa to nearest even.
+		const __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absoluteBits, 31 - 13), 31);
+		const __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absoluteBits, c_normalBias), mantissaOdd), 13);
+
+		const __m128i magnitude = Select(isRegular, Select(isSubnormal, subnormal, normal), infOrNan);
+		return _mm_or_si128(magnitude, _mm_srli_epi32(_mm_castps_si128(sign), 16));
+	}
+
+	// HalfToFloat on the low 16 bits of four lanes.
+	inline __m128 HalfToFloatSSE(__m128i h)
+	{
+		const __m128i magnitude = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+		const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, magnitude), 16);
+
+		// Shift into place and fix the exponent bias with a multiply, which also normalizes subnormals.
+		const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+		const __m128i infNanExponent = _mm_and_si128(_mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7bff)), _mm_set1_epi32(255 << 23));
+
+		return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNanExponent)));
+	}
+
+	inline __m128i QuantizeSSE(__m128 value, __m128 minValue, __m128 scale, __m128 steps)
+	{
+		const __m128 t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(value, minValue), scale), _mm_setzero_ps()), steps);
+		return _mm_cvttps_epi32(_mm_add_ps(t, _mm_set1_ps(.5f)));
+	}
+#endif
+
+	// Encode count particles from SoA arrays, vectorized four at a time.
+	void EncodeBlock(const float* px, const float* py, const float* pz, const float* sx, const float* sy, const float* sp,
+		size_t count, const ParticleQuantization& quantization, const QuantizationScales& scales, CompactParticleVertex* pDest)
+	{
+		size_t i = 0;
+
+#if defined(PARTICLE_COMPRESSION_SSE)
+		const __m128 minX = _mm_set1_ps(quantization.boundsMin[0]);
+		const __m128 minY = _mm_set1_ps(quantization.boundsMin[1]);
+		const __m128 minZ = _mm_set1_ps(quantization.boundsMin[2]);
+		const __m128 minSpeed = _mm_set1_ps(quantization.speedMin);
+		const __m128 scaleX = _mm_set1_ps(scales.positionScale[0]);
+		const __m128 scaleY = _mm_set1_ps(scales.positionScale[1]);
+		const __m128 scaleZ = _mm_set1_ps(scales.positionScale[2]);
+		const __m128 scaleSpeed = _mm_set1_ps(scales.speedScale);
+		const __m128 positionSteps = _mm_set1_ps(c_positionSteps);
+		const __m128 speedSteps = _mm_set1_ps(c_speedSteps);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128i x = QuantizeSSE(_mm_loadu_ps(px + i), minX, scaleX, positionSteps);
+			const __m128i y = QuantizeSSE(_mm_loadu_ps(py + i), minY, scaleY, positionSteps);
+			const __m128i z = QuantizeSSE(_mm_loadu_ps(pz + i), minZ, scaleZ, positionSteps);
+
+			// index * 257 == (index << 8) | index
+			const __m128i speedIndex = QuantizeSSE(_mm_loadu_ps(sp + i), minSpeed, scaleSpeed, speedSteps);
+			const __m128i speed = _mm_or_si128(_mm_slli_epi32(speedIndex, 8), speedIndex);
+
+			const __m128i hx = FloatToHalfSSE(_mm_loadu_ps(sx + i));
+			const __m128i hy = FloatToHalfSSE(_mm_loadu_ps(sy + i));
+
+			// Each vertex is three dwords: (x, y), (z, speed), (size.x, size.y).
+			const __m128 a = _mm_castsi128_ps(_mm_or_si128(x, _mm_slli_epi32(y, 16)));
+			const __m128 b = _mm_castsi128_ps(_mm_or_si128(z, _mm_slli_epi32(speed, 16)));
+			const __m128 c = _mm_castsi128_ps(_mm_or_si128(hx, _mm_slli_epi32(hy, 16)));
+
+			// Interleave to a0 b0 c0 a1 | b1 c1 a2 b2 | c2 a3 b3 c3.
+			const __m128 abLow = _mm_unpacklo_ps(a, b);		// a0 b0 a1 b1
+			const __m128 abHigh = _mm_unpackhi_ps(a, b);	// a2 b2 a3 b3
+			const __m128 out0 = _mm_shuffle_ps(abLow, _mm_shuffle_ps(c, abLow, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+			const __m128 out1 = _mm_shuffle_ps(_mm_shuffle_ps(abLow, c, _MM_SHUFFLE(1, 1, 3, 3)), abHigh, _MM_SHUFFLE(1, 0, 2, 0));
+			const __m128 out2 = _mm_shuffle_ps(_mm_shuffle_ps(c, abHigh, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(abHigh, c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+			// Plain stores: pDest is usually write-combined memory, which wants full sequential writes.
+			float* pOut = reinterpret_cast<float*>(pDest + i);
+			_mm_storeu_ps(pOut, out0);
+			_mm_storeu_ps(pOut + 4, out1);
+			_mm_storeu_ps(pOut + 8, out2);
+		}
+#elif defined(PARTICLE_COMPRESSION_NEON)
+		const float32x4_t positionSteps = vdupq_n_f32(c_positionSteps);
+		const float32x4_t speedSteps = vdupq_n_f32(c_speedSteps);
+		const float32x4_t half = vdupq_n_f32(.5f);
+		const float32x4_t zero = vdupq_n_f32(0.f);
+
+		auto quantize = [&](const float* p, float minValue, float scale, float32x4_t steps)
+		{
+			const float32x4_t t = vmulq_n_f32(vsubq_f32(vld1q_f32(p), vdupq_n_f32(minValue)), scale);
+			return vcvtq_u32_f32(vaddq_f32(vminq_f32(vmaxq_f32(t, zero), steps), half));
+		};
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const uint32x4_t x = quantize(px + i, quantization.boundsMin[0], scales.positionScale[0], positionSteps);
+			const uint32x4_t y = quantize(py + i, quantization.boundsMin[1], scales.positionScale[1], positionSteps);
+			const uint32x4_t z = quantize(pz + i, quantization.boundsMin[2], scales.positionScale[2], positionSteps);
+			const uint32x4_t speed = vmulq_n_u32(quantize(sp + i, quantization.speedMin, scales.speedScale, speedSteps), 257u);
+			const uint32x4_t hx = vmovl_u16(vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(sx + i))));
+			const uint32x4_t hy = vmovl_u16(vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(sy + i))));
+
+			// Each vertex is three dwords, vst3 interleaves them.
+			uint32x4x3_t vertices;
+			vertices.val[0] = vorrq_u32(x, vshlq_n_u32(y, 16));
+			vertices.val[1] = vorrq_u32(z, vshlq_n_u32(speed, 16));
+			vertices.val[2] = vorrq_u32(hx, vshlq_n_u32(hy, 16));
+			vst3q_u32(reinterpret_cast<uint32_t*>(pDest + i), vertices);
+		}
+#endif
+
+		for (; i < count; i++)
+		{
+			pDest[i] = EncodeScalar(px[i], py[i], pz[i], sx[i], sy[i], sp[i], quantization, scales);
+		}
+	}
+}
+
+uint16_t FloatToHalf(float value)
+{
+	uint32_t bits = FloatBits(value);
+	const uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+
+	uint32_t result;
+	if (bits >= (127u + 16u) << 23)
+	{
+		// Too large for a half, infinity or NaN (made quiet).
+		result = bits > (255u << 23) ? 0x7e00u : 0x7c00u;
+	}
+	else if (bits < (127u - 14u) << 23)
+	{
+		// Subnormal half or zero: let the FPU shift the mantissa in place, rounding included.
+		const uint32_t subnormalMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+		result = FloatBits(BitsToFloat(bits) + BitsToFloat(subnormalMagic)) - subnormalMagic;
+	}
+	else
+	{
+		// Rebias the exponent and round the mantissa to nearest even.
+		const uint32_t mantissaOdd = (bits >> 13) & 1u;
+		bits += 0xfffu - ((127u - 15u) << 23);
+		bits += mantissaOdd;
+		result = bits >> 13;
+	}
+
+	return static_cast<uint16_t>(result | (sign >> 16));
+}
+
+float HalfToFloat(uint16_t value)
+{
+	const uint32_t magnitude = value & 0x7fffu;
+
+	uint32_t bits = FloatBits(BitsToFloat(magnitude << 13) * BitsToFloat((254u - 15u) << 23));
+	if (magnitude > 0x7bffu)
+	{
+		bits |= 255u << 23;
+	}
+	bits |= static_cast<uint32_t>(value & 0x8000u) << 16;
+
+	return BitsToFloat(bits);
+}
+
+CompactParticleVertex EncodeCompactVertex(const ParticleVertex& vertex, const ParticleQuantization& quantization)
+{
+	const QuantizationScales scales = ComputeScales(quantization);
+	return EncodeScalar(vertex.position[0], vertex.position[1], vertex.position[2], vertex.size[0], vertex.size[1], vertex.speed, quantization, scales);
+}
+
+ParticleVertex DecodeCompactVertex(const CompactParticleVertex& vertex, const ParticleQuantization& quantization)
+{
+	const QuantizationScales scales = ComputeScales(quantization);
+
+	ParticleVertex v;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		v.position[axis] = quantization.boundsMin[axis] + vertex.position[axis] * scales.positionStep[axis];
+	}
+	v.size[0] = HalfToFloat(vertex.size[0]);
+	v.size[1] = HalfToFloat(vertex.size[1]);
+	v.speed = quantization.speedMin + vertex.speed * scales.speedStep;
+	return v;
+}
+
+void EncodeCompactVertices(const ParticleStreams& streams, const ParticleQuantization& quantization,
+	size_t begin, size_t end, void* pDest)
+{
+	const QuantizationScales scales = ComputeScales(quantization);
+	EncodeBlock(streams.positionX.data() + begin, streams.positionY.data() + begin, streams.positionZ.data() + begin,
+		streams.sizeX.data() + begin, streams.sizeY.data() + begin, streams.speed.data() + begin,
+		end - begin, quantization, scales, static_cast<CompactParticleVertex*>(pDest));
+}
+
+void EncodeCompactVerticesIndexed(const ParticleStreams& streams, const uint32_t* indices,
+	const ParticleQuantization& quantization, size_t begin, size_t end, void* pDest)
+{
+	const QuantizationScales scales = ComputeScales(quantization);
+	CompactParticleVertex* pVertices = static_cast<CompactParticleVertex*>(pDest);
+
+	// Gather a block into SoA on the stack, then encode it like contiguous particles.
+	float px[c_gatherBlockSize], py[c_gatherBlockSize], pz[c_gatherBlockSize];
+	float sx[c_gatherBlockSize], sy[c_gatherBlockSize], sp[c_gatherBlockSize];
+
+	for (size_t blockBegin = begin; blockBegin < end; blockBegin += c_gatherBlockSize)
+	{
+		const size_t count = std::min(c_gatherBlockSize, end - blockBegin);
+		for (size_t i = 0; i < count; i++)
+		{
+			const uint32_t source = indices[blockBegin + i];
+			px[i] = streams.positionX[source];
+			py[i] = streams.positionY[source];
+			pz[i] = streams.positionZ[source];
+			sx[i] = streams.sizeX[source];
+			sy[i] = streams.sizeY[source];
+			sp[i] = streams.speed[source];
+		}
+
+		EncodeBlock(px, py, pz, sx, sy, sp, count, quantization, scales, pVertices + (blockBegin - begin));
+	}
+}
+
+void DecodeCompactVertices(const CompactParticleVertex* pSource, size_t count,
+	const ParticleQuantization& quantization, ParticleStreams& streams, size_t destBegin)
+{
+	const QuantizationScales scales = ComputeScales(quantization);
+
+	float* px = streams.positionX.data() + destBegin;
+	float* py = streams.positionY.data() + destBegin;
+	float* pz = streams.positionZ.data() + destBegin;
+	float* sx = streams.sizeX.data() + destBegin;
+	float* sy = streams.sizeY.data() + destBegin;
+	float* sp = streams.speed.data() + destBegin;
+
+	size_t i = 0;
+
+#if defined(PARTICLE_COMPRESSION_SSE)
+	const __m128i lowMask = _mm_set1_epi32(0xffff);
+	const __m128 minX = _mm_set1_ps(quantization.boundsMin[0]);
+	const __m128 minY = _mm_set1_ps(quantization.boundsMin[1]);
+	const __m128 minZ = _mm_set1_ps(quantization.boundsMin[2]);
+	const __m128 minSpeed = _mm_set1_ps(quantization.speedMin);
+	const __m128 stepX = _mm_set1_ps(scales.positionStep[0]);
+	const __m128 stepY = _mm_set1_ps(scales.positionStep[1]);
+	const __m128 stepZ = _mm_set1_ps(scales.positionStep[2]);
+	const __m128 stepSpeed = _mm_set1_ps(scales.speedStep);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		// De-interleave a0 b0 c0 a1 | b1 c1 a2 b2 | c2 a3 b3 c3.
+		const float* pIn = reinterpret_cast<const float*>(pSource + i);
+		const __m128 in0 = _mm_loadu_ps(pIn);
+		const __m128 in1 = _mm_loadu_ps(pIn + 4);
+		const __m128 in2 = _mm_loadu_ps(pIn + 8);
+		const __m128i a = _mm_castps_si128(_mm_shuffle_ps(in0, _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0)));
+		const __m128i b = _mm_castps_si128(_mm_shuffle_ps(_mm_shuffle_ps(in0, in1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+		const __m128i c = _mm_castps_si128(_mm_shuffle_ps(_mm_shuffle_ps(in0, in1, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(in2, in2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+
+		_mm_storeu_ps(px + i, _mm_add_ps(minX, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(a, lowMask)), stepX)));
+		_mm_storeu_ps(py + i, _mm_add_ps(minY, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(a, 16)), stepY)));
+		_mm_storeu_ps(pz + i, _mm_add_ps(minZ, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(b, lowMask)), stepZ)));
+		_mm_storeu_ps(sp + i, _mm_add_ps(minSpeed, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(b, 16)), stepSpeed)));
+		_mm_storeu_ps(sx + i, HalfToFloatSSE(_mm_and_si128(c, lowMask)));
+		_mm_storeu_ps(sy + i, HalfToFloatSSE(_mm_srli_epi32(c, 16)));
+	}
+#elif defined(PARTICLE_COMPRESSION_NEON)
+	for (; i + 4 <= count; i += 4)
+	{
+		const uint32x4x3_t vertices = vld3q_u32(reinterpret_cast<const uint32_t*>(pSource + i));
+		const uint32x4_t lowMask = vdupq_n_u32(0xffff);
+
+		vst1q_f32(px + i, vmlaq_n_f32(vdupq_n_f32(quantization.boundsMin[0]), vcvtq_f32_u32(vandq_u32(vertices.val[0], lowMask)), scales.positionStep[0]));
+		vst1q_f32(py + i, vmlaq_n_f32(vdupq_n_f32(quantization.boundsMin[1]), vcvtq_f32_u32(vshrq_n_u32(vertices.val[0], 16)), scales.positionStep[1]));
+		vst1q_f32(pz + i, vmlaq_n_f32(vdupq_n_f32(quantization.boundsMin[2]), vcvtq_f32_u32(vandq_u32(vertices.val[1], lowMask)), scales.positionStep[2]));
+		vst1q_f32(sp + i, vmlaq_n_f32(vdupq_n_f32(quantization.speedMin), vcvtq_f32_u32(vshrq_n_u32(vertices.val[1], 16)), scales.speedStep));
+		vst1q_f32(sx + i, vcvt_f32_f16(vreinterpret_f16_u16(vmovn_u32(vandq_u32(vertices.val[2], lowMask)))));
+		vst1q_f32(sy + i, vcvt_f32_f16(vreinterpret_f16_u16(vmovn_u32(vshrq_n_u32(vertices.val[2], 16)))));
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		const ParticleVertex v = DecodeCompactVertex(pSource[i], quantization);
+		px[i] = v.position[0];
+		py[i] = v.position[1];
+		pz[i] = v.position[2];
+		sx[i] = v.size[0];
+		sy[i] = v.size[1];
+		sp[i] = v.speed;
+	}
+}
+
+float VerifyCompactRoundTrip(size_t count)
+{
+	ParticleQuantization quantization;
+	quantization.boundsMin[0] = -20.f; quantization.boundsMin[1] = -50.f; quantization.boundsMin[2] = -20.f;
+	quantization.boundsMax[0] = 20.f;  quantization.boundsMax[1] = 50.f;  quantization.boundsMax[2] = 20.f;
+	quantization.speedMin = 100.f;
+	quantization.speedMax = 300.f;
+
+	// Deterministic pseudo-random particles, a few of them outside of the box to exercise the clamping.
+	uint32_t seed = 0x9E3779B9u;
+	auto next = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+	};
+
+	ParticleSimulator source;
+	source.Resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		ParticleVertex v;
+		v.position[0] = -22.f + 44.f * next();
+		v.position[1] = -55.f + 110.f * next();
+		v.position[2] = -22.f + 44.f * next();
+		v.size[0] = .01f + next();
+		v.size[1] = 1.f + 9.f * next();
+		v.speed = 90.f + 220.f * next();
+		source.SetParticle(i, v);
+	}
+
+	std::vector<CompactParticleVertex> encoded(count);
+	EncodeCompactVertices(source.Streams(), quantization, 0, count, encoded.data());
+
+	// The vectorized encoder has to produce the bits of the scalar one.
+	for (size_t i = 0; i < count; i++)
+	{
+		const CompactParticleVertex reference = EncodeCompactVertex(source.GetParticle(i), quantization);
+		if (memcmp(&reference, &encoded[i], sizeof(reference)) != 0)
+		{
+			return FLT_MAX;
+		}
+	}
+
+	ParticleSimulator decoded;
+	decoded.Resize(count);
+	DecodeCompactVertices(encoded.data(), count, quantization, decoded.Streams(), 0);
+
+	const QuantizationScales scales = ComputeScales(quantization);
+	const float speedStep = (quantization.speedMax - quantization.speedMin) / c_speedSteps;
+
+	float maxError = 0.f;
+	for (size_t i = 0; i < count; i++)
+	{
+		const ParticleVertex original = source.GetParticle(i);
+		const ParticleVertex roundTrip = decoded.GetParticle(i);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float clamped = std::min(std::max(original.position[axis], quantization.boundsMin[axis]), quantization.boundsMax[axis]);
+			// Plus the float rounding of the offset and scale arithmetic around the box.
+			const float magnitude = std::max(std::fabs(quantization.boundsMin[axis]), std::fabs(quantization.boundsMax[axis]));
+			const float allowed = .5f * scales.positionStep[axis] + 8.f * FLT_EPSILON * magnitude;
+			maxError = std::max(maxError, std::fabs(roundTrip.position[axis] - clamped) / allowed);
+		}
+		for (int axis = 0; axis < 2; axis++)
+		{
+			// Half a unit in the last place of an 11-bit significand.
+			const float allowed = std::fabs(original.size[axis]) * std::ldexp(1.f, -11) * 1.001f;
+			maxError = std::max(maxError, std::fabs(roundTrip.size[axis] - original.size[axis]) / allowed);
+		}
+
+		const float clampedSpeed = std::min(std::max(original.speed, quantization.speedMin), quantization.speedMax);
+		maxError = std::max(maxError, std::fabs(roundTrip.speed - clampedSpeed) / (.5f * speedStep + 8.f * FLT_EPSILON * quantization.speedMax));
+	}
+
+	return maxError;
+}
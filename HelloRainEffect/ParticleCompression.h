@@ -0,0 +1,60 @@
+#pragma once
+
+// Compact 12-byte particle vertex, half the size of the 24-byte ParticleVertex.
+//
+// The position is quantized to 16 bits per axis over a bounding box (the emitter's
+// fall range), the size is stored as two half floats and the speed as an 8-bit index
+// over [speedMin, speedMax]. The input assembler decodes the fields as
+// R16G16B16A16_UNORM + R16G16_FLOAT, see COMPACT_VERTICES in shaders.hlsl.
+//
+// The encoders and decoders are vectorized with SSE2 (x86) or NEON (ARM), with
+// scalar reference versions that produce the same bits. No Windows dependency.
+
+#include "ParticleSimulator.h"
+
+#include <cstddef>
+#include <cstdint>
+
+struct CompactParticleVertex
+{
+	uint16_t position[3];	// UNORM over [boundsMin, boundsMax]
+	uint16_t speed;			// 8-bit index stored as UNORM16 (index * 257), so it decodes to index / 255
+	uint16_t size[2];		// IEEE half floats
+};
+static_assert(sizeof(CompactParticleVertex) == 12, "CompactParticleVertex must match the 12-byte input layout");
+
+// Range the compact fields are quantized over. Values outside of it are clamped.
+// Must match boundsMin/boundsExtent in the constant buffer of shaders.hlsl.
+struct ParticleQuantization
+{
+	float boundsMin[3];
+	float boundsMax[3];
+	float speedMin;
+	float speedMax;
+};
+
+// IEEE 754 binary16 conversions, round to nearest even, with infinities and NaNs kept.
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+// Scalar reference of a single vertex.
+CompactParticleVertex EncodeCompactVertex(const ParticleVertex& vertex, const ParticleQuantization& quantization);
+ParticleVertex DecodeCompactVertex(const CompactParticleVertex& vertex, const ParticleQuantization& quantization);
+
+// Encode particles [begin, end) to pDest[i - begin], e.g. straight into a mapped upload buffer.
+void EncodeCompactVertices(const ParticleStreams& streams, const ParticleQuantization& quantization,
+	size_t begin, size_t end, void* pDest);
+
+// Same, but vertex i - begin comes from particle indices[i].
+void EncodeCompactVerticesIndexed(const ParticleStreams& streams, const uint32_t* indices,
+	const ParticleQuantization& quantization, size_t begin, size_t end, void* pDest);
+
+// Decode count vertices into streams [destBegin, destBegin + count); the streams must be large enough.
+void DecodeCompactVertices(const CompactParticleVertex* pSource, size_t count,
+	const ParticleQuantization& quantization, ParticleStreams& streams, size_t destBegin);
+
+// Round trip count pseudo-random particles through the vectorized encoder and decoder.
+// Returns the largest error in units of the allowed error (half a quantization step for
+// the position and speed, half a half-float ulp for the size), so anything above 1 is a
+// bug, and FLT_MAX if the vectorized and scalar encoders disagree.
+float VerifyCompactRoundTrip(size_t count);
@@ -0,0 +1,546 @@
+#include "ParticleCulling.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PARTICLE_CULL_SSE 1
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define PARTICLE_CULL_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	// Particles per job; also the granularity of the compaction afterwards.
+	const size_t c_cullChunkSize = 1u << 14;
+
+	// Share of the particles at this depth that survive the LOD thinning.
+	inline float LodKeepRatio(const ParticleCullParams& params, float depth)
+	{
+		if (depth <= params.lodStart)
+		{
+			return 1.f;
+		}
+		const float t = std::min((depth - params.lodStart) / (params.lodEnd - params.lodStart), 1.f);
+		return 1.f - t * (1.f - params.lodMinKeep);
+	}
+
+	// Uniform value in [0, 1) derived from the id, the same every frame.
+	inline float LodDraw(uint32_t id)
+	{
+		uint32_t h = id * 0x9E3779B1u;
+		h ^= h >> 15;
+		h *= 0x85EBCA77u;
+		h ^= h >> 13;
+		return static_cast<float>(h >> 8) / static_cast<float>(1u << 24);
+	}
+
+	// LOD test of a particle that is inside the frustum; appends it when kept.
+	inline void AppendIfKept(const ParticleStreams& streams, const uint32_t* ids, size_t i,
+		const ParticleCullParams& params, uint32_t* visible, size_t& visibleCount, size_t& lodCulled)
+	{
+		const float depth = streams.positionX[i] * params.depthAxis[0] + streams.positionY[i] * params.depthAxis[1] +
+			streams.positionZ[i] * params.depthAxis[2] + params.depthAxis[3];
+		const uint32_t id = ids ? ids[i] : static_cast<uint32_t>(i);
+
+		if (LodDraw(id) < LodKeepRatio(params, depth))
+		{
+			visible[visibleCount++] = static_cast<uint32_t>(i);
+		}
+		else
+		{
+			lodCulled++;
+		}
+	}
+}
+
+void ExtractFrustumPlanes(const float m[4][4], float planes[6][4])
+{
+	// clip = (p, 1) * m, so the clip coordinates are the dot products with the columns of m.
+	for (int j = 0; j < 4; j++)
+	{
+		planes[0][j] = m[j][3] + m[j][0];	// Left:   -w <= x
+		planes[1][j] = m[j][3] - m[j][0];	// Right:   x <= w
+		planes[2][j] = m[j][3] + m[j][1];	// Bottom: -w <= y
+		planes[3][j] = m[j][3] - m[j][1];	// Top:     y <= w
+		planes[4][j] = m[j][2];				// Near:    0 <= z
+		planes[5][j] = m[j][3] - m[j][2];	// Far:     z <= w
+	}
+
+	// Normalize so the plane distances compare against world-space radii.
+	for (int p = 0; p < 6; p++)
+	{
+		const float length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+		const float invLength = length > 0.f ? 1.f / length : 0.f;
+		for (int j = 0; j < 4; j++)
+		{
+			planes[p][j] *= invLength;
+		}
+	}
+}
+
+size_t CullParticles(const ParticleStreams& streams, const uint32_t* ids, size_t begin, size_t end,
+	const ParticleCullParams& params, uint32_t* visible, size_t& lodCulled)
+{
+	const float* px = streams.positionX.data();
+	const float* py = streams.positionY.data();
+	const float* pz = streams.positionZ.data();
+	const float* sx = streams.sizeX.data();
+	const float* sy = streams.sizeY.data();
+
+	size_t visibleCount = 0;
+	size_t i = begin;
+
+#if defined(PARTICLE_CULL_SSE)
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(px + i);
+		const __m128 y = _mm_loadu_ps(py + i);
+		const __m128 z = _mm_loadu_ps(pz + i);
+
+		// (w + h) / 2 bounds the half diagonal of the quad from above.
+		const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(sx + i), _mm_loadu_ps(sy + i)), half));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			const __m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(params.planes[p][0])), _mm_mul_ps(y, _mm_set1_ps(params.planes[p][1]))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(params.planes[p][2])), _mm_set1_ps(params.planes[p][3])));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+		if (mask == 0)
+		{
+			continue;
+		}
+		for (size_t lane = 0; lane < 4; lane++)
+		{
+			if (mask & (1 << lane))
+			{
+				AppendIfKept(streams, ids, i + lane, params, visible, visibleCount, lodCulled);
+			}
+		}
+	}
+#elif defined(PARTICLE_CULL_NEON)
+	for (; i + 4 <= end; i += 4)
+	{
+		const float32x4_t x = vld1q_f32(px + i);
+		const float32x4_t y = vld1q_f32(py + i);
+		const float32x4_t z = vld1q_f32(pz + i);
+		const float32x4_t negRadius = vnegq_f32(vmulq_n_f32(vaddq_f32(vld1q_f32(sx + i), vld1q_f32(sy + i)), 0.5f));
+
+		uint32x4_t inside = vdupq_n_u32(0xFFFFFFFFu);
+		for (int p = 0; p < 6; p++)
+		{
+			float32x4_t distance = vmulq_n_f32(x, params.planes[p][0]);
+			distance = vaddq_f32(distance, vmulq_n_f32(y, params.planes[p][1]));
+			distance = vaddq_f32(distance, vmulq_n_f32(z, params.planes[p][2]));
+			distance = vaddq_f32(distance, vdupq_n_f32(params.planes[p][3]));
+			inside = vandq_u32(inside, vcgeq_f32(distance, negRadius));
+		}
+
+		uint32_t lanes[4];
+		vst1q_u32(lanes, inside);
+		for (size_t lane = 0; lane < 4; lane++)
+		{
+			if (lanes[lane])
+			{
+				AppendIfKept(streams, ids, i + lane, params, visible, visibleCount, lodCulled);
+			}
+		}
+	}
+#endif
+
+	for (; i < end; i++)
+	{
+		const float negRadius = -0.5f * (sx[i] + sy[i]);
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			const float distance = px[i] * params.planes[p][0] + py[i] * params.planes[p][1] + pz[i] * params.planes[p][2] + params.planes[p][3];
+			inside = distance >= negRadius;
+		}
+
+		if (inside)
+		{
+			AppendIfKept(streams, ids, i, params, visible, visibleCount, lodCulled);
+		}
+	}
+
+	return visibleCount;
+}
+
+size_t ParticleCuller::Cull(const ParticleStreams& streams, const uint32_t* ids, size_t count,
+	const ParticleCullParams& params, JobSystem* pJobSystem)
+{
+	if (m_visible.size() < count)
+	{
+		m_visible.resize(count);
+	}
+
+	// Every chunk writes its survivors at the start of its own slice, then the slices
+	// are packed together.
+	const size_t chunkCount = (count + c_cullChunkSize - 1) / c_cullChunkSize;
+	m_chunkVisible.assign(chunkCount, 0);
+	m_chunkLodCulled.assign(chunkCount, 0);
+
+	auto cullChunks = [&](size_t firstChunk, size_t lastChunk)
+	{
+		for (size_t chunk = firstChunk; chunk < lastChunk; chunk++)
+		{
+			const size_t begin = chunk * c_cullChunkSize;
+			const size_t end = std::min(begin + c_cullChunkSize, count);
+			m_chunkVisible[chunk] = CullParticles(streams, ids, begin, end, params, m_visible.data() + begin, m_chunkLodCulled[chunk]);
+		}
+	};
+
+	if (pJobSystem && chunkCount > 1)
+	{
+		pJobSystem->ParallelFor(0, chunkCount, 1, cullChunks);
+	}
+	else
+	{
+		cullChunks(0, chunkCount);
+	}
+
+	size_t visibleCount = 0;
+	size_t lodCulled = 0;
+	for (size_t chunk = 0; chunk < chunkCount; chunk++)
+	{
+		// The destination never runs ahead of the source, but the ranges may overlap.
+		memmove(m_visible.data() + visibleCount, m_visible.data() + chunk * c_cullChunkSize, m_chunkVisible[chunk] * sizeof(uint32_t));
+		visibleCount += m_chunkVisible[chunk];
+		lodCulled += m_chunkLodCulled[chunk];
+	}
+
+	m_stats.visible = visibleCount;
+	m_stats.lodCulled = lodCulled;
+	m_stats.frustumCulled = count - visibleCount - lodCulled;
+	return visibleCount;
+}
+
+namespace
+{
+	uint32_t NextRandom(uint32_t& state)
+	{
+		state = state * 1664525u + 1013904223u;
+		return state;
+	}
+
+	// Uniform in [low, high).
+	float RandomFloat(uint32_t& state, float low, float high)
+	{
+		return low + (high - low) * static_cast<float>(NextRandom(state) >> 8) / static_cast<float>(1u << 24);
+	}
+
+	float PlaneDistance(const float plane[4], const float p[3])
+	{
+		return plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3];
+	}
+
+	void SetParticle(ParticleStreams& streams, size_t i, const float p[3], float sizeX, float sizeY)
+	{
+		streams.positionX[i] = p[0];
+		streams.positionY[i] = p[1];
+		streams.positionZ[i] = p[2];
+		streams.sizeX[i] = sizeX;
+		streams.sizeY[i] = sizeY;
+		streams.speed[i] = 0.f;
+	}
+
+	// Whether each particle in [0, count) made it into visible[0, visibleCount).
+	std::vector<bool> VisibleFlags(const uint32_t* visible, size_t visibleCount, size_t count)
+	{
+		std::vector<bool> flags(count, false);
+		for (size_t v = 0; v < visibleCount; v++)
+		{
+			flags[visible[v]] = true;
+		}
+		return flags;
+	}
+}
+
+bool VerifyParticleCulling()
+{
+	// A 90-degree perspective looking down +z, near 1 and far 100, as XMMatrixPerspectiveFovLH builds it.
+	const float nearZ = 1.f;
+	const float farZ = 100.f;
+	const float q = farZ / (farZ - nearZ);
+	const float viewProjection[4][4] =
+	{
+		{ 1.f, 0.f, 0.f, 0.f },
+		{ 0.f, 1.f, 0.f, 0.f },
+		{ 0.f, 0.f, q, 1.f },
+		{ 0.f, 0.f, -q * nearZ, 0.f }
+	};
+
+	ParticleCullParams params;
+	ExtractFrustumPlanes(viewProjection, params.planes);
+	params.depthAxis[0] = params.depthAxis[1] = params.depthAxis[3] = 0.f;
+	params.depthAxis[2] = 1.f;
+	params.lodStart = 2.f * farZ;	// No LOD until the LOD checks.
+	params.lodEnd = 4.f * farZ;
+	params.lodMinKeep = .35f;
+
+	// Unit normals through the edges and faces of the volume: left, right, bottom, top, near, far.
+	const float invSqrt2 = 1.f / std::sqrt(2.f);
+	const float normals[6][3] =
+	{
+		{ invSqrt2, 0.f, invSqrt2 }, { -invSqrt2, 0.f, invSqrt2 }, { 0.f, invSqrt2, invSqrt2 },
+		{ 0.f, -invSqrt2, invSqrt2 }, { 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f }
+	};
+	const float onPlane[6][3] =
+	{
+		{ -25.f, 0.f, 25.f }, { 25.f, 0.f, 25.f }, { 0.f, -25.f, 25.f },
+		{ 0.f, 25.f, 25.f }, { 0.f, 0.f, nearZ }, { 0.f, 0.f, farZ }
+	};
+	for (int p = 0; p < 6; p++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			if (std::fabs(params.planes[p][j] - normals[p][j]) > 1e-5f)
+			{
+				return false;
+			}
+		}
+		// The far plane comes out of 1 - q, which cancels, so it only holds to ~1e-5 of farZ.
+		if (std::fabs(PlaneDistance(params.planes[p], onPlane[p])) > 1e-5f * farZ)
+		{
+			return false;
+		}
+	}
+
+	// Points just inside and just outside each plane, bare and with a bounding sphere of
+	// radius (.25 + .75) / 2 = .5, whose slack lets the centre sit up to .5 outside. Plus
+	// one point in the middle so the count is not a multiple of four and the scalar tail runs.
+	struct BoundaryCase
+	{
+		float offset;	// Along the inward normal, from the plane
+		float size;		// sizeX + sizeY
+		bool inside;
+	};
+	const float epsilon = 1e-2f;
+	const BoundaryCase cases[] =
+	{
+		{ epsilon, 0.f, true }, { -epsilon, 0.f, false },
+		{ -.5f + epsilon, 1.f, true }, { -.5f - epsilon, 1.f, false },
+		{ -.25f, 1.f, true }, { -.75f, 1.f, false }
+	};
+	const size_t caseCount = sizeof(cases) / sizeof(cases[0]);
+
+	ParticleStreams streams;
+	const size_t boundaryCount = 6 * caseCount + 1;
+	streams.Resize(boundaryCount);
+	std::vector<bool> expectedInside(boundaryCount);
+	for (int p = 0; p < 6; p++)
+	{
+		for (size_t c = 0; c < caseCount; c++)
+		{
+			const size_t i = p * caseCount + c;
+			float position[3];
+			for (int j = 0; j < 3; j++)
+			{
+				position[j] = onPlane[p][j] + normals[p][j] * cases[c].offset;
+			}
+			SetParticle(streams, i, position, .25f * cases[c].size, .75f * cases[c].size);
+			expectedInside[i] = cases[c].inside;
+		}
+	}
+	const float middle[3] = { 0.f, 0.f, 50.f };
+	SetParticle(streams, boundaryCount - 1, middle, .1f, .1f);
+	expectedInside[boundaryCount - 1] = true;
+
+	std::vector<uint32_t> visible(boundaryCount);
+	size_t lodCulled = 0;
+	const size_t boundaryVisible = CullParticles(streams, nullptr, 0, boundaryCount, params, visible.data(), lodCulled);
+	if (VisibleFlags(visible.data(), boundaryVisible, boundaryCount) != expectedInside || lodCulled != 0)
+	{
+		return false;
+	}
+
+	// The SIMD lanes against the scalar loop, which is all a one-particle range runs. The
+	// lanes add the plane terms in another order, so only a particle within rounding of a
+	// plane may land on the other side.
+	uint32_t randomState = 2024;
+	const size_t randomCount = 4099;
+	streams.Resize(randomCount);
+	std::vector<uint32_t> ids(randomCount);
+	for (size_t i = 0; i < randomCount; i++)
+	{
+		const float position[3] = { RandomFloat(randomState, -120.f, 120.f), RandomFloat(randomState, -120.f, 120.f), RandomFloat(randomState, -10.f, 130.f) };
+		SetParticle(streams, i, position, RandomFloat(randomState, 0.f, 2.f), RandomFloat(randomState, 0.f, 2.f));
+		ids[i] = NextRandom(randomState);
+	}
+	params.lodStart = 30.f;
+	params.lodEnd = 90.f;
+
+	visible.resize(randomCount);
+	size_t simdLodCulled = 0;
+	const size_t simdVisible = CullParticles(streams, ids.data(), 0, randomCount, params, visible.data(), simdLodCulled);
+	const std::vector<bool> simdFlags = VisibleFlags(visible.data(), simdVisible, randomCount);
+
+	size_t scalarLodCulled = 0;
+	size_t mismatches = 0;
+	for (size_t i = 0; i < randomCount; i++)
+	{
+		uint32_t index = 0;
+		const bool scalarVisible = CullParticles(streams, ids.data(), i, i + 1, params, &index, scalarLodCulled) == 1;
+		if (scalarVisible && index != i)
+		{
+			return false;
+		}
+		if (scalarVisible != simdFlags[i])
+		{
+			const float position[3] = { streams.positionX[i], streams.positionY[i], streams.positionZ[i] };
+			const float radius = .5f * (streams.sizeX[i] + streams.sizeY[i]);
+			bool nearPlane = false;
+			for (int p = 0; p < 6; p++)
+			{
+				nearPlane = nearPlane || std::fabs(PlaneDistance(params.planes[p], position) + radius) < 1e-4f;
+			}
+			if (!nearPlane)
+			{
+				return false;
+			}
+			mismatches++;
+		}
+	}
+	if (simdLodCulled > scalarLodCulled + mismatches || scalarLodCulled > simdLodCulled + mismatches)
+	{
+		return false;
+	}
+
+	// LOD: every plane passes everything, the same ids at a series of depths. Each id has
+	// one draw, so the ids kept at a depth are a subset of those kept nearer; at lodStart and
+	// before all are kept, from lodEnd on about lodMinKeep of them.
+	for (int p = 0; p < 6; p++)
+	{
+		params.planes[p][0] = params.planes[p][1] = params.planes[p][2] = 0.f;
+		params.planes[p][3] = 1.f;
+	}
+	const float depths[] = { 10.f, 30.f, 40.f, 50.f, 60.f, 70.f, 80.f, 90.f, 120.f };
+	const size_t depthCount = sizeof(depths) / sizeof(depths[0]);
+	const size_t idCount = 8192;
+	const size_t lodCount = depthCount * idCount;
+	streams.Resize(lodCount);
+	ids.resize(lodCount);
+	for (size_t j = 0; j < idCount; j++)
+	{
+		ids[j] = NextRandom(randomState);
+	}
+	for (size_t k = 0; k < depthCount; k++)
+	{
+		for (size_t j = 0; j < idCount; j++)
+		{
+			const float position[3] = { 0.f, 0.f, depths[k] };
+			SetParticle(streams, k * idCount + j, position, .1f, .1f);
+			ids[k * idCount + j] = ids[j];
+		}
+	}
+
+	visible.resize(lodCount);
+	lodCulled = 0;
+	const size_t lodVisible = CullParticles(streams, ids.data(), 0, lodCount, params, visible.data(), lodCulled);
+	const std::vector<bool> kept = VisibleFlags(visible.data(), lodVisible, lodCount);
+	if (lodVisible + lodCulled != lodCount)
+	{
+		return false;
+	}
+	for (size_t k = 0; k < depthCount; k++)
+	{
+		size_t keptCount = 0;
+		for (size_t j = 0; j < idCount; j++)
+		{
+			if (kept[k * idCount + j] && k > 0 && !kept[(k - 1) * idCount + j])
+			{
+				return false;
+			}
+			keptCount += kept[k * idCount + j] ? 1 : 0;
+		}
+
+		const float t = std::min(std::max((depths[k] - params.lodStart) / (params.lodEnd - params.lodStart), 0.f), 1.f);
+		const float expectedRatio = 1.f - t * (1.f - params.lodMinKeep);
+		const float ratio = static_cast<float>(keptCount) / idCount;
+		if ((expectedRatio == 1.f && keptCount != idCount) || std::fabs(ratio - expectedRatio) > .03f)
+		{
+			return false;
+		}
+	}
+
+	// Next frame the pool has compacted and every particle sits at another index; the
+	// same ids are kept.
+	ParticleStreams moved;
+	moved.Resize(lodCount);
+	std::vector<uint32_t> movedIds(lodCount);
+	for (size_t i = 0; i < lodCount; i++)
+	{
+		const size_t from = lodCount - 1 - i;
+		const float position[3] = { streams.positionX[from], streams.positionY[from], streams.positionZ[from] };
+		SetParticle(moved, i, position, streams.sizeX[from], streams.sizeY[from]);
+		movedIds[i] = ids[from];
+	}
+	size_t movedLodCulled = 0;
+	const size_t movedVisible = CullParticles(moved, movedIds.data(), 0, lodCount, params, visible.data(), movedLodCulled);
+	const std::vector<bool> movedKept = VisibleFlags(visible.data(), movedVisible, lodCount);
+	for (size_t i = 0; i < lodCount; i++)
+	{
+		if (movedKept[i] != kept[lodCount - 1 - i])
+		{
+			return false;
+		}
+	}
+
+	// ParticleCuller over several chunks, with and without the job system, then over fewer
+	// particles with the same culler. The chunks start on multiples of four, so the lanes
+	// group the particles as one CullParticles call over the whole range does, and the
+	// compacted list must match it exactly.
+	ExtractFrustumPlanes(viewProjection, params.planes);
+	const size_t cullCount = 5 * c_cullChunkSize + 13;
+	streams.Resize(cullCount);
+	ids.resize(cullCount);
+	for (size_t i = 0; i < cullCount; i++)
+	{
+		const float position[3] = { RandomFloat(randomState, -120.f, 120.f), RandomFloat(randomState, -120.f, 120.f), RandomFloat(randomState, -10.f, 130.f) };
+		SetParticle(streams, i, position, RandomFloat(randomState, 0.f, 2.f), RandomFloat(randomState, 0.f, 2.f));
+		ids[i] = NextRandom(randomState);
+	}
+
+	JobSystem jobSystem(4);
+	ParticleCuller culler;
+	for (size_t count : { cullCount, cullCount, c_cullChunkSize + 5, size_t(3), size_t(0) })
+	{
+		for (JobSystem* pJobSystem : { static_cast<JobSystem*>(nullptr), &jobSystem })
+		{
+			visible.resize(std::max<size_t>(count, 1));
+			size_t expectedLodCulled = 0;
+			const size_t expectedVisible = CullParticles(streams, ids.data(), 0, count, params, visible.data(), expectedLodCulled);
+
+			const size_t visibleCount = culler.Cull(streams, ids.data(), count, params, pJobSystem);
+			const ParticleCuller::Stats& stats = culler.GetStats();
+			if (visibleCount != expectedVisible || stats.visible != visibleCount || stats.lodCulled != expectedLodCulled ||
+				stats.visible + stats.frustumCulled + stats.lodCulled != count)
+			{
+				return false;
+			}
+
+			const uint32_t* indices = culler.VisibleIndices();
+			for (size_t v = 0; v < visibleCount; v++)
+			{
+				if (indices[v] != visible[v] || (v > 0 && indices[v] <= indices[v - 1]))
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// CPU frustum culling and distance LOD of the rain particles, run before they are
+// written to the upload buffer so only the visible ones reach the GPU.
+//
+// Particles are tested four at a time (SSE/NEON) as bounding spheres against the six
+// planes of the clip volume. The survivors are thinned out with distance: past lodStart
+// a growing share of them is dropped, down to lodMinKeep at lodEnd. The drop decision
+// hashes a stable per-particle id so a given drop does not flicker from frame to frame.
+// No Windows dependency.
+
+#include "ParticleSimulator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+struct ParticleCullParams
+{
+	float planes[6][4];		// Normalized and facing inwards: a point p is inside when dot(plane, (p, 1)) >= 0
+	float depthAxis[4];		// View-space depth of (p, 1), i.e. the third column of world * view
+	float lodStart;			// Depth up to which every particle is kept
+	float lodEnd;			// Depth from which only lodMinKeep of them are
+	float lodMinKeep;
+};
+
+// Planes of the clip volume of a row-major world * view * projection matrix, applied to
+// row vectors as in DirectXMath, with the D3D depth range [0, w].
+void ExtractFrustumPlanes(const float viewProjection[4][4], float planes[6][4]);
+
+// Write the indices in [begin, end) of the particles that pass both tests to visible and
+// return how many there are. ids are stable per-particle ids (e.g. ParticleSystem
+// handles); when null the index is used, which is only stable while nothing dies.
+size_t CullParticles(const ParticleStreams& streams, const uint32_t* ids, size_t begin, size_t end,
+	const ParticleCullParams& params, uint32_t* visible, size_t& lodCulled);
+
+class ParticleCuller
+{
+public:
+	struct Stats
+	{
+		size_t visible;
+		size_t frustumCulled;
+		size_t lodCulled;
+	};
+
+	ParticleCuller() : m_stats{} {}
+
+	// Cull particles [0, count), in parallel chunks when a job system is given. The
+	// visible indices come out in increasing order.
+	size_t Cull(const ParticleStreams& streams, const uint32_t* ids, size_t count,
+		const ParticleCullParams& params, JobSystem* pJobSystem = nullptr);
+
+	// Valid until the next call to Cull().
+	const uint32_t* VisibleIndices() const { return m_visible.data(); }
+	const Stats& GetStats() const { return m_stats; }
+
+private:
+	std::vector<uint32_t> m_visible;
+	std::vector<size_t> m_chunkVisible;
+	std::vector<size_t> m_chunkLodCulled;
+	Stats m_stats;
+};
+
+// The planes of a known frustum, particles just inside and outside each of them, the SIMD
+// lanes against the scalar loop, the LOD draw across depths and frames, and the chunked
+// compaction of ParticleCuller.
+bool VerifyParticleCulling();
@@ -0,0 +1,260 @@
+#include "ParticleSimulationThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+void InterpolateParticles(const ParticleSnapshot& snapshot, float alpha, ParticleStreams& out, size_t begin, size_t end)
+{
+	const ParticleStreams& in = snapshot.streams;
+	const size_t count = end - begin;
+	memcpy(&out.positionX[begin], &in.positionX[begin], count * sizeof(float));
+	memcpy(&out.positionZ[begin], &in.positionZ[begin], count * sizeof(float));
+	memcpy(&out.sizeX[begin], &in.sizeX[begin], count * sizeof(float));
+	memcpy(&out.sizeY[begin], &in.sizeY[begin], count * sizeof(float));
+	memcpy(&out.speed[begin], &in.speed[begin], count * sizeof(float));
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const float previous = snapshot.previousY[i];
+		const float current = in.positionY[i];
+
+		// Rain only falls; a particle that went up wrapped around and must not sweep across the scene.
+		out.positionY[i] = current > previous ? current : previous + (current - previous) * alpha;
+	}
+}
+
+ParticleSimulationThread::ParticleSimulationThread(ParticleSystem& system, JobSystem* pJobSystem, const FrameClock& clock, double stepRate, size_t chunkSize) :
+	m_system(system),
+	m_pJobSystem(pJobSystem),
+	m_clock(clock),
+	m_stepLength(static_cast<int64_t>(std::llround(1e9 / stepRate))),
+	m_chunkSize(chunkSize),
+	m_pLatest(nullptr),
+	m_stepCount(0),
+	m_quit(false)
+{
+	const size_t capacity = m_system.Capacity();
+	for (uint32_t i = 0; i < m_snapshots.GetSlotCount(); i++)
+	{
+		ParticleSnapshot& snapshot = m_snapshots.GetSlot(i);
+		snapshot.step = 0;
+		snapshot.time = 0;
+		snapshot.count = 0;
+		snapshot.streams.Resize(capacity);
+		snapshot.previousY.resize(capacity);
+		snapshot.handles.resize(capacity);
+	}
+
+	// Publish the starting state, standing still, so the renderer has something to draw.
+	const ParticleStreams& streams = m_system.Simulator().Streams();
+	const size_t count = m_system.AliveCount();
+	ParticleSnapshot& snapshot = m_snapshots.GetWriteBuffer();
+	snapshot.time = m_clock.Now();
+	snapshot.count = count;
+	std::copy_n(streams.positionX.begin(), count, snapshot.streams.positionX.begin());
+	std::copy_n(streams.positionY.begin(), count, snapshot.streams.positionY.begin());
+	std::copy_n(streams.positionZ.begin(), count, snapshot.streams.positionZ.begin());
+	std::copy_n(streams.sizeX.begin(), count, snapshot.streams.sizeX.begin());
+	std::copy_n(streams.sizeY.begin(), count, snapshot.streams.sizeY.begin());
+	std::copy_n(streams.speed.begin(), count, snapshot.streams.speed.begin());
+	std::copy_n(streams.positionY.begin(), count, snapshot.previousY.begin());
+	std::copy_n(m_system.Handles(), count, snapshot.handles.begin());
+	m_snapshots.Publish();
+
+	m_nextStepTime = snapshot.time + m_stepLength;
+}
+
+ParticleSimulationThread::~ParticleSimulationThread()
+{
+	Stop();
+}
+
+void ParticleSimulationThread::Start()
+{
+	// Started again after Stop(): the time it was stopped for is skipped, not caught up on.
+	m_nextStepTime = std::max(m_nextStepTime, m_clock.Now());
+
+	m_quit = false;
+	m_thread = std::thread(&ParticleSimulationThread::ThreadMain, this);
+}
+
+void ParticleSimulationThread::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_quitLock);
+		m_quit = true;
+	}
+	m_quitSignal.notify_all();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+uint32_t ParticleSimulationThread::RunDueSteps()
+{
+	const int64_t now = m_clock.Now();
+
+	uint32_t steps = 0;
+	while (m_nextStepTime <= now && steps < MaxCatchUpSteps)
+	{
+		Step();
+		m_nextStepTime += m_stepLength;
+		steps++;
+	}
+
+	// Too far behind (e.g. stopped in the debugger): drop the time instead of spiralling.
+	if (m_nextStepTime <= now)
+	{
+		m_nextStepTime = now + m_stepLength;
+	}
+	return steps;
+}
+
+const ParticleSnapshot& ParticleSimulationThread::AcquireLatest()
+{
+	m_snapshots.Acquire(m_pLatest);
+	return *m_pLatest;
+}
+
+float ParticleSimulationThread::GetInterpolationAlpha(const ParticleSnapshot& snapshot) const
+{
+	// Drawing at now - step length puts the rendered time between the snapshot's two states.
+	const double alpha = static_cast<double>(m_clock.Now() - snapshot.time) / m_stepLength;
+	return static_cast<float>(std::min(std::max(alpha, 0.), 1.));
+}
+
+void ParticleSimulationThread::Step()
+{
+	if (m_preStep)
+	{
+		m_preStep(m_system);
+	}
+
+	const float deltaTime = static_cast<float>(m_stepLength * 1e-9);
+	m_system.Update(deltaTime);
+	const ParticleStepParams params = m_system.StepParams(deltaTime);
+	const size_t count = m_system.AliveCount();
+
+	ParticleSimulator& simulator = m_system.Simulator();
+	const ParticleStreams& streams = simulator.Streams();
+	const uint32_t* pHandles = m_system.Handles();
+	ParticleSnapshot& snapshot = m_snapshots.GetWriteBuffer();
+
+	// Each chunk keeps its heights from before the step, steps, and copies its particles out.
+	auto stepChunk = [&](size_t begin, size_t end)
+	{
+		const size_t size = (end - begin) * sizeof(float);
+		memcpy(&snapshot.previousY[begin], &streams.positionY[begin], size);
+		simulator.StepRange(params, begin, end);
+		memcpy(&snapshot.streams.positionX[begin], &streams.positionX[begin], size);
+		memcpy(&snapshot.streams.positionY[begin], &streams.positionY[begin], size);
+		memcpy(&snapshot.streams.positionZ[begin], &streams.positionZ[begin], size);
+		memcpy(&snapshot.streams.sizeX[begin], &streams.sizeX[begin], size);
+		memcpy(&snapshot.streams.sizeY[begin], &streams.sizeY[begin], size);
+		memcpy(&snapshot.streams.speed[begin], &streams.speed[begin], size);
+		memcpy(&snapshot.handles[begin], &pHandles[begin], (end - begin) * sizeof(uint32_t));
+	};
+
+	if (m_pJobSystem)
+	{
+		m_pJobSystem->ParallelFor(0, count, m_chunkSize, stepChunk);
+	}
+	else if (count > 0)
+	{
+		stepChunk(0, count);
+	}
+
+	snapshot.step = ++m_stepCount;
+	snapshot.time = m_nextStepTime;
+	snapshot.count = count;
+	m_snapshots.Publish();
+}
+
+void ParticleSimulationThread::ThreadMain()
+{
+	// Timed waits can oversleep by a scheduler quantum; the last stretch is spent yielding.
+	const int64_t spinTime = 2000000;
+
+	std::unique_lock<std::mutex> lock(m_quitLock);
+	while (!m_quit)
+	{
+		lock.unlock();
+		RunDueSteps();
+		lock.lock();
+
+		const int64_t remaining = m_nextStepTime - m_clock.Now();
+		if (remaining > spinTime)
+		{
+			m_quitSignal.wait_for(lock, std::chrono::nanoseconds(remaining - spinTime));
+		}
+		else if (remaining > 0)
+		{
+			lock.unlock();
+			std::this_thread::yield();
+			lock.lock();
+		}
+	}
+}
+
+bool VerifyParticleSimulationThread()
+{
+	ParticleSystem system(4096, 3);
+	EmitterDesc rain;
+	rain.spawnRate = 3000.f;
+	rain.spawnMin[0] = -40.f; rain.spawnMin[1] = 40.f; rain.spawnMin[2] = -40.f;
+	rain.spawnMax[0] = 40.f; rain.spawnMax[1] = 50.f; rain.spawnMax[2] = 40.f;
+	rain.lifetimeMin = 2.f;
+	rain.lifetimeMax = 4.f;
+	rain.speedMin = 10.f;
+	rain.speedMax = 30.f;
+	rain.size[0] = rain.size[1] = .1f;
+	rain.killBelow = -1000.f;
+	system.AddEmitter(rain);
+
+	ManualFrameClock clock;
+	const double stepRate = 60.;
+	ParticleSimulationThread simulation(system, nullptr, clock, stepRate, 1024);
+	const int64_t stepLength = simulation.GetStepLength();
+
+	ParticleStreams rendered;
+	rendered.Resize(system.Capacity());
+
+	// Faster, slower and unrelated to the step rate.
+	for (int64_t frameTime : { 4166667ll, 7000000ll, 16666667ll, 33333333ll })
+	{
+		for (int frame = 0; frame < 120; frame++)
+		{
+			clock.Advance(frameTime);
+			simulation.RunDueSteps();
+
+			const ParticleSnapshot& snapshot = simulation.AcquireLatest();
+			const int64_t now = clock.Now();
+			if (snapshot.time > now || now - snapshot.time >= stepLength || snapshot.count != system.AliveCount())
+			{
+				return false;
+			}
+
+			const float alpha = simulation.GetInterpolationAlpha(snapshot);
+			InterpolateParticles(snapshot, alpha, rendered, 0, snapshot.count);
+
+			// Falling at constant speed, the height at now - stepLength follows from the newest one.
+			const float timeBeforeNewest = static_cast<float>((snapshot.time + stepLength - now) * 1e-9);
+			for (size_t i = 0; i < snapshot.count; i++)
+			{
+				const float expected = snapshot.streams.positionY[i] + snapshot.streams.speed[i] * timeBeforeNewest;
+				if (std::abs(rendered.positionY[i] - expected) > 1e-3f || rendered.positionX[i] != snapshot.streams.positionX[i])
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	// A long stall runs a bounded number of steps and skips the rest.
+	clock.Advance(stepLength * 100);
+	return simulation.RunDueSteps() == ParticleSimulationThread::MaxCatchUpSteps && simulation.RunDueSteps() == 0;
+}
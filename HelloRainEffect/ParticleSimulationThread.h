@@ -0,0 +1,96 @@
+#pragma once
+
+// Fixed-step particle simulation on its own thread, decoupled from the frame rate.
+//
+// The thread owns the ParticleSystem while it runs. After every step it publishes an
+// immutable ParticleSnapshot through a TripleBuffer; each snapshot carries the state at
+// the end of the step and the heights at its start, i.e. the last two simulation states.
+// The renderer draws one step in the past and interpolates between the two, so motion
+// stays smooth whatever the ratio of frame rate to step rate, and neither side ever
+// waits for the other.
+//
+// Time comes from a FrameClock, so stepping and interpolation can be driven by hand,
+// see VerifyParticleSimulationThread(). No Windows dependency.
+
+#include "FramePacer.h"
+#include "JobSystem.h"
+#include "ParticleSystem.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ParticleSnapshot
+{
+	uint64_t step;					// Steps simulated up to this snapshot
+	int64_t time;					// Clock time the step ends at
+	size_t count;					// Alive particles, packed in [0, count)
+	ParticleStreams streams;		// State at time
+	FloatStream previousY;			// Heights at time - step length; only y moves
+	std::vector<uint32_t> handles;	// Stable particle handles, see ParticleSystem::Handles()
+};
+
+// Write the state of [begin, end) at alpha between the snapshot's two steps into out.
+void InterpolateParticles(const ParticleSnapshot& snapshot, float alpha, ParticleStreams& out, size_t begin, size_t end);
+
+class ParticleSimulationThread
+{
+public:
+	// pJobSystem may be null to step on the simulation thread alone.
+	ParticleSimulationThread(ParticleSystem& system, JobSystem* pJobSystem, const FrameClock& clock, double stepRate, size_t chunkSize);
+	~ParticleSimulationThread();
+
+	ParticleSimulationThread(const ParticleSimulationThread&) = delete;
+	ParticleSimulationThread& operator=(const ParticleSimulationThread&) = delete;
+
+	// Runs on the simulation thread before every step, e.g. to apply input to the emitters.
+	// Set it before Start().
+	void SetPreStep(std::function<void(ParticleSystem&)> preStep) { m_preStep = std::move(preStep); }
+
+	// Can be started again after Stop(), e.g. while the window is hidden.
+	void Start();
+	void Stop();
+
+	// Run every step that is due at the clock's current time, at most MaxCatchUpSteps; the
+	// simulation skips time rather than falling further behind. Called by the thread, or
+	// directly when it is not started.
+	static const uint32_t MaxCatchUpSteps = 4;
+	uint32_t RunDueSteps();
+
+	int64_t GetStepLength() const { return m_stepLength; }
+
+	// Render side: the newest snapshot, valid until the next call, and where the current
+	// time falls between its two states when drawing one step in the past.
+	const ParticleSnapshot& AcquireLatest();
+	float GetInterpolationAlpha(const ParticleSnapshot& snapshot) const;
+
+private:
+	void Step();
+	void ThreadMain();
+
+	ParticleSystem& m_system;
+	JobSystem* m_pJobSystem;
+	const FrameClock& m_clock;
+	int64_t m_stepLength;
+	size_t m_chunkSize;
+	std::function<void(ParticleSystem&)> m_preStep;
+
+	TripleBuffer<ParticleSnapshot> m_snapshots;
+	const ParticleSnapshot* m_pLatest;
+	uint64_t m_stepCount;
+	int64_t m_nextStepTime;
+
+	std::thread m_thread;
+	std::mutex m_quitLock;
+	std::condition_variable m_quitSignal;
+	bool m_quit;
+};
+
+// Step a pool of falling particles against a manual clock at a few frame rates and check
+// that every interpolated height matches the exact one at the rendered time.
+bool VerifyParticleSimulationThread();
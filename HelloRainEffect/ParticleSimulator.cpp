@@ -0,0 +1,318 @@
+#include "ParticleSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PARTICLE_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define PARTICLE_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC exposes every intrinsic regardless of /arch, GCC and Clang need the target
+// enabled per function so the rest of the file still runs on baseline CPUs.
+#if defined(__GNUC__) || defined(__clang__)
+#define PARTICLE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PARTICLE_TARGET_AVX2
+#endif
+
+void ParticleStreams::Resize(size_t count)
+{
+	positionX.resize(count);
+	positionY.resize(count);
+	positionZ.resize(count);
+	sizeX.resize(count);
+	sizeY.resize(count);
+	speed.resize(count);
+}
+
+namespace ParticleKernels
+{
+	void StepScalar(float* y, const float* speed, size_t count, const ParticleStepParams& params)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			// Same operations, in the same order, as MainGSSO.
+			float py = y[i] - speed[i] * params.deltaTime;
+			if (py < params.resetBelow)
+			{
+				py = params.resetHeight;
+			}
+			y[i] = py;
+		}
+	}
+
+	void StepSSE(float* y, const float* speed, size_t count, const ParticleStepParams& params)
+	{
+#if defined(PARTICLE_SIMD_X86)
+		const __m128 dt = _mm_set1_ps(params.deltaTime);
+		const __m128 below = _mm_set1_ps(params.resetBelow);
+		const __m128 height = _mm_set1_ps(params.resetHeight);
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 py = _mm_sub_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_loadu_ps(speed + i), dt));
+			__m128 wrap = _mm_cmplt_ps(py, below);
+			py = _mm_or_ps(_mm_and_ps(wrap, height), _mm_andnot_ps(wrap, py));
+			_mm_storeu_ps(y + i, py);
+		}
+		StepScalar(y + i, speed + i, count - i, params);
+#else
+		StepScalar(y, speed, count, params);
+#endif
+	}
+
+#if defined(PARTICLE_SIMD_X86)
+	PARTICLE_TARGET_AVX2
+	static void StepAVX2Impl(float* y, const float* speed, size_t count, const ParticleStepParams& params)
+	{
+		const __m256 dt = _mm256_set1_ps(params.deltaTime);
+		const __m256 below = _mm256_set1_ps(params.resetBelow);
+		const __m256 height = _mm256_set1_ps(params.resetHeight);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 py = _mm256_sub_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(_mm256_loadu_ps(speed + i), dt));
+			__m256 wrap = _mm256_cmp_ps(py, below, _CMP_LT_OQ);
+			_mm256_storeu_ps(y + i, _mm256_blendv_ps(py, height, wrap));
+		}
+		StepSSE(y + i, speed + i, count - i, params);
+	}
+#endif
+
+	void StepAVX2(float* y, const float* speed, size_t count, const ParticleStepParams& params)
+	{
+#if defined(PARTICLE_SIMD_X86)
+		StepAVX2Impl(y, speed, count, params);
+#else
+		StepScalar(y, speed, count, params);
+#endif
+	}
+
+	void StepNEON(float* y, const float* speed, size_t count, const ParticleStepParams& params)
+	{
+#if defined(PARTICLE_SIMD_NEON)
+		const float32x4_t dt = vdupq_n_f32(params.deltaTime);
+		const float32x4_t below = vdupq_n_f32(params.resetBelow);
+		const float32x4_t height = vdupq_n_f32(params.resetHeight);
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			// Keep the multiply and subtract separate (no vmlsq) so results match the scalar path bit for bit.
+			float32x4_t py = vsubq_f32(vld1q_f32(y + i), vmulq_f32(vld1q_f32(speed + i), dt));
+			uint32x4_t wrap = vcltq_f32(py, below);
+			vst1q_f32(y + i, vbslq_f32(wrap, height, py));
+		}
+		StepScalar(y + i, speed + i, count - i, params);
+#else
+		StepScalar(y, speed, count, params);
+#endif
+	}
+
+	StepFunc Select(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SimdLevel::SSE: return StepSSE;
+		case SimdLevel::AVX2: return StepAVX2;
+		case SimdLevel::NEON: return StepNEON;
+		default: return StepScalar;
+		}
+	}
+}
+
+ParticleSimulator::ParticleSimulator() :
+	m_simdLevel(DetectSimdLevel())
+{
+}
+
+void ParticleSimulator::Resize(size_t count)
+{
+	m_streams.Resize(count);
+}
+
+void ParticleSimulator::SetParticle(size_t index, const ParticleVertex& v)
+{
+	m_streams.positionX[index] = v.position[0];
+	m_streams.positionY[index] = v.position[1];
+	m_streams.positionZ[index] = v.position[2];
+	m_streams.sizeX[index] = v.size[0];
+	m_streams.sizeY[index] = v.size[1];
+	m_streams.speed[index] = v.speed;
+}
+
+ParticleVertex ParticleSimulator::GetParticle(size_t index) const
+{
+	ParticleVertex v;
+	v.position[0] = m_streams.positionX[index];
+	v.position[1] = m_streams.positionY[index];
+	v.position[2] = m_streams.positionZ[index];
+	v.size[0] = m_streams.sizeX[index];
+	v.size[1] = m_streams.sizeY[index];
+	v.speed = m_streams.speed[index];
+	return v;
+}
+
+void ParticleSimulator::SetSimdLevel(SimdLevel level)
+{
+	const SimdLevel detected = DetectSimdLevel();
+
+	bool supported = level == SimdLevel::Scalar || level == detected;
+	if (level == SimdLevel::SSE && detected == SimdLevel::AVX2)
+	{
+		supported = true;
+	}
+
+	m_simdLevel = supported ? level : detected;
+}
+
+void ParticleSimulator::Step(const ParticleStepParams& params)
+{
+	StepRange(params, 0, Size());
+}
+
+void ParticleSimulator::StepRange(const ParticleStepParams& params, size_t begin, size_t end)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+
+	// Only the height changes, the other streams are never touched by the update.
+	ParticleKernels::Select(m_simdLevel)(m_streams.positionY.data() + begin, m_streams.speed.data() + begin, end - begin, params);
+}
+
+void ParticleSimulator::WriteVertices(void* pDest, size_t begin, size_t end) const
+{
+	ParticleVertex* pVertices = static_cast<ParticleVertex*>(pDest);
+
+	for (size_t i = begin; i < end; i++)
+	{
+		// Build the vertex on the stack and write it out in one go, the destination
+		// is typically write-combined upload memory.
+		ParticleVertex v;
+		v.position[0] = m_streams.positionX[i];
+		v.position[1] = m_streams.positionY[i];
+		v.position[2] = m_streams.positionZ[i];
+		v.size[0] = m_streams.sizeX[i];
+		v.size[1] = m_streams.sizeY[i];
+		v.speed = m_streams.speed[i];
+		memcpy(&pVertices[i - begin], &v, sizeof(v));
+	}
+}
+
+void ParticleSimulator::WriteVerticesIndexed(void* pDest, const uint32_t* indices, size_t begin, size_t end) const
+{
+	ParticleVertex* pVertices = static_cast<ParticleVertex*>(pDest);
+
+	for (size_t i = begin; i < end; i++)
+	{
+		// Gathered reads, sequential writes: the write-combined destination is still filled in order.
+		const uint32_t source = indices[i];
+		ParticleVertex v;
+		v.position[0] = m_streams.positionX[source];
+		v.position[1] = m_streams.positionY[source];
+		v.position[2] = m_streams.positionZ[source];
+		v.size[0] = m_streams.sizeX[source];
+		v.size[1] = m_streams.sizeY[source];
+		v.speed = m_streams.speed[source];
+		memcpy(&pVertices[i - begin], &v, sizeof(v));
+	}
+}
+
+namespace
+{
+	// MainGSSO (shaders.hlsl) transcribed statement for statement, on the interleaved
+	// vertex it streams out and with its hard-coded constants, so it shares nothing with
+	// the kernels it checks.
+	ParticleVertex MainGSSO(ParticleVertex particle, float deltaTime)
+	{
+		// Decrease the height of the point\particle over time based on its speed
+		particle.position[1] -= particle.speed * deltaTime;
+
+		// Reset the height of the point\particle
+		if (particle.position[1] < -50.0f)
+		{
+			particle.position[1] = 50.0f;
+		}
+
+		// Emit the point\particle with the updated position
+		return particle;
+	}
+}
+
+float ParticleSimulator::VerifyKernels(size_t count, int steps)
+{
+	// Deterministic pseudo-random particles spread over the whole fall range.
+	uint32_t seed = 0x2545F491u;
+	auto next = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+	};
+
+	std::vector<ParticleVertex> initial(count);
+	for (ParticleVertex& v : initial)
+	{
+		v = { { next() * 40.f - 20.f, next() * 100.f - 50.f, next() * 40.f - 20.f }, { .05f, 5.f }, 100.f + next() * 200.f };
+	}
+
+	// What the shader streams out after every step.
+	std::vector<ParticleVertex> expected = initial;
+	std::vector<float> deltaTimes(steps);
+	for (int s = 0; s < steps; s++)
+	{
+		deltaTimes[s] = (s % 7 + 1) / 240.f;
+		for (ParticleVertex& v : expected)
+		{
+			v = MainGSSO(v, deltaTimes[s]);
+		}
+	}
+
+	const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE, SimdLevel::AVX2, SimdLevel::NEON };
+	float maxDeviation = 0.f;
+
+	for (SimdLevel level : levels)
+	{
+		ParticleSimulator candidate;
+		candidate.SetSimdLevel(level);
+		if (candidate.GetSimdLevel() != level)
+		{
+			continue;
+		}
+
+		candidate.Resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			candidate.SetParticle(i, initial[i]);
+		}
+
+		ParticleStepParams params;
+		for (int s = 0; s < steps; s++)
+		{
+			params.deltaTime = deltaTimes[s];
+			candidate.Step(params);
+		}
+
+		// Every attribute, although only the height should move.
+		for (size_t i = 0; i < count; i++)
+		{
+			const ParticleVertex v = candidate.GetParticle(i);
+			const float* pActual = &v.position[0];
+			const float* pExpected = &expected[i].position[0];
+			for (size_t c = 0; c < sizeof(ParticleVertex) / sizeof(float); c++)
+			{
+				maxDeviation = std::max(maxDeviation, std::fabs(pActual[c] - pExpected[c]));
+			}
+		}
+	}
+
+	return maxDeviation;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+// CPU particle simulation backend for the rain effect.
+//
+// This file and its implementation do not depend on Windows or D3D12 so the same
+// code can be built and run headless on Linux (e.g. for benchmarking and as a
+// reference for the GPU stream-output path in shaders.hlsl).
+
+#include "SimdLevel.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// Minimal aligned allocator so every attribute stream starts on a cache line and
+// the SIMD kernels can use full-width loads on the bulk of the data.
+template <typename T, size_t Alignment>
+struct AlignedAllocator
+{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+	AlignedAllocator() noexcept {}
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+	void deallocate(T* p, size_t) noexcept
+	{
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+using FloatStream = std::vector<float, AlignedAllocator<float, 64>>;
+
+// Interleaved layout of a particle as consumed by the input assembler.
+// Must match app::Vertex and VS_INPUT in shaders.hlsl.
+struct ParticleVertex
+{
+	float position[3];
+	float size[2];
+	float speed;
+};
+static_assert(sizeof(ParticleVertex) == 24, "ParticleVertex must match the 24-byte app::Vertex layout");
+
+// Structure-of-arrays particle storage, one stream per attribute of app::Vertex.
+struct ParticleStreams
+{
+	FloatStream positionX;
+	FloatStream positionY;
+	FloatStream positionZ;
+	FloatStream sizeX;
+	FloatStream sizeY;
+	FloatStream speed;
+
+	size_t Size() const { return positionY.size(); }
+	void Resize(size_t count);
+};
+
+// Parameters of one simulation step. The defaults mirror the constants hard-coded in MainGSSO.
+struct ParticleStepParams
+{
+	float deltaTime = 0.f;
+	float resetBelow = -50.f;
+	float resetHeight = 50.f;
+};
+
+class ParticleSimulator
+{
+public:
+	ParticleSimulator();
+
+	void Resize(size_t count);
+	size_t Size() const { return m_streams.Size(); }
+
+	void SetParticle(size_t index, const ParticleVertex& v);
+	ParticleVertex GetParticle(size_t index) const;
+
+	ParticleStreams& Streams() { return m_streams; }
+	const ParticleStreams& Streams() const { return m_streams; }
+
+	// Kernel selection happens once at construction; it can be overridden to compare
+	// kernels against each other. Requesting an unsupported level falls back to the detected one.
+	void SetSimdLevel(SimdLevel level);
+	SimdLevel GetSimdLevel() const { return m_simdLevel; }
+
+	// Fall-and-wrap step, the same as MainGSSO with the default parameters: y -= speed * dt,
+	// and y wraps to resetHeight once it drops below resetBelow.
+	void Step(const ParticleStepParams& params);
+	void StepRange(const ParticleStepParams& params, size_t begin, size_t end);
+
+	// Interleave the SoA streams into the 24-byte vertex layout, e.g. straight into a mapped upload buffer.
+	void WriteVertices(void* pDest, size_t begin, size_t end) const;
+
+	// Same as WriteVertices, but vertex i - begin comes from particle indices[i] (e.g. a depth-sorted order).
+	void WriteVerticesIndexed(void* pDest, const uint32_t* indices, size_t begin, size_t end) const;
+
+	// Run every kernel available on this machine, the scalar one included, against a
+	// transcription of MainGSSO and return the largest absolute deviation of the resulting
+	// particles.
+	static float VerifyKernels(size_t count, int steps);
+
+private:
+	ParticleStreams m_streams;
+	SimdLevel m_simdLevel;
+};
+
+// Range kernels, exposed so callers can dispatch them directly over arbitrary chunks.
+namespace ParticleKernels
+{
+	void StepScalar(float* y, const float* speed, size_t count, const ParticleStepParams& params);
+	void StepSSE(float* y, const float* speed, size_t count, const ParticleStepParams& params);
+	void StepAVX2(float* y, const float* speed, size_t count, const ParticleStepParams& params);
+	void StepNEON(float* y, const float* speed, size_t count, const ParticleStepParams& params);
+
+	using StepFunc = void (*)(float*, const float*, size_t, const ParticleStepParams&);
+	StepFunc Select(SimdLevel level);
+}
@@ -0,0 +1,466 @@
+#include "ParticleSort.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PARTICLE_SORT_SSE 1
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define PARTICLE_SORT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	const uint32_t c_radixBits = 8;
+	const uint32_t c_bucketCount = 1u << c_radixBits;
+
+	// Below this many pairs a single thread sorts faster than it takes to fan out.
+	const size_t c_parallelThreshold = 1u << 16;
+	const size_t c_minBlockSize = 1u << 14;
+
+	// Keys computed per job when the key pass runs on the job system.
+	const size_t c_keyChunkSize = 1u << 15;
+
+	struct RadixPass
+	{
+		uint32_t* srcKeys;
+		uint32_t* srcValues;
+		uint32_t* dstKeys;
+		uint32_t* dstValues;
+		size_t count;
+		size_t blockSize;
+		uint32_t shift;
+		uint32_t* histograms;	// c_bucketCount counters per block
+	};
+
+	void HistogramBlock(const RadixPass& pass, size_t block)
+	{
+		uint32_t* histogram = pass.histograms + block * c_bucketCount;
+		memset(histogram, 0, c_bucketCount * sizeof(uint32_t));
+
+		const size_t begin = block * pass.blockSize;
+		const size_t end = std::min(begin + pass.blockSize, pass.count);
+		for (size_t i = begin; i < end; i++)
+		{
+			histogram[(pass.srcKeys[i] >> pass.shift) & (c_bucketCount - 1)]++;
+		}
+	}
+
+	void ScatterBlock(const RadixPass& pass, size_t block)
+	{
+		// The histogram now holds the first destination of each digit for this block.
+		uint32_t offsets[c_bucketCount];
+		memcpy(offsets, pass.histograms + block * c_bucketCount, sizeof(offsets));
+
+		const size_t begin = block * pass.blockSize;
+		const size_t end = std::min(begin + pass.blockSize, pass.count);
+		for (size_t i = begin; i < end; i++)
+		{
+			const uint32_t key = pass.srcKeys[i];
+			const uint32_t destination = offsets[(key >> pass.shift) & (c_bucketCount - 1)]++;
+			pass.dstKeys[destination] = key;
+			pass.dstValues[destination] = pass.srcValues[i];
+		}
+	}
+}
+
+void RadixSortPairs(uint32_t* keys, uint32_t* values, uint32_t* scratchKeys, uint32_t* scratchValues,
+	size_t count, uint32_t keyBits, JobSystem* pJobSystem)
+{
+	if (count < 2)
+	{
+		return;
+	}
+
+	// Blocks are sorted independently, then merged through the prefix sum of their
+	// histograms, which keeps every pass stable.
+	size_t blockCount = 1;
+	if (pJobSystem && count >= c_parallelThreshold)
+	{
+		blockCount = std::min<size_t>(pJobSystem->GetThreadCount() * 4, count / c_minBlockSize);
+		blockCount = std::max<size_t>(blockCount, 1);
+	}
+
+	std::vector<uint32_t> histograms(blockCount * c_bucketCount);
+
+	RadixPass pass;
+	pass.srcKeys = keys;
+	pass.srcValues = values;
+	pass.dstKeys = scratchKeys;
+	pass.dstValues = scratchValues;
+	pass.count = count;
+	pass.blockSize = (count + blockCount - 1) / blockCount;
+	pass.histograms = histograms.data();
+
+	for (uint32_t shift = 0; shift < keyBits; shift += c_radixBits)
+	{
+		pass.shift = shift;
+
+		if (blockCount > 1)
+		{
+			pJobSystem->ParallelFor(0, blockCount, 1, [&pass](size_t begin, size_t end)
+			{
+				for (size_t block = begin; block < end; block++)
+				{
+					HistogramBlock(pass, block);
+				}
+			});
+		}
+		else
+		{
+			HistogramBlock(pass, 0);
+		}
+
+		// Exclusive prefix sum, digit major, so block b's digit d lands after every smaller
+		// digit and after the same digit of the blocks before b.
+		uint32_t running = 0;
+		bool singleDigit = false;
+		for (uint32_t digit = 0; digit < c_bucketCount; digit++)
+		{
+			uint32_t digitTotal = 0;
+			for (size_t block = 0; block < blockCount; block++)
+			{
+				uint32_t& counter = histograms[block * c_bucketCount + digit];
+				const uint32_t blockCountForDigit = counter;
+				counter = running + digitTotal;
+				digitTotal += blockCountForDigit;
+			}
+			singleDigit = singleDigit || digitTotal == count;
+			running += digitTotal;
+		}
+
+		// Every key shares this digit: the pass would not move anything.
+		if (singleDigit)
+		{
+			continue;
+		}
+
+		if (blockCount > 1)
+		{
+			pJobSystem->ParallelFor(0, blockCount, 1, [&pass](size_t begin, size_t end)
+			{
+				for (size_t block = begin; block < end; block++)
+				{
+					ScatterBlock(pass, block);
+				}
+			});
+		}
+		else
+		{
+			ScatterBlock(pass, 0);
+		}
+
+		std::swap(pass.srcKeys, pass.dstKeys);
+		std::swap(pass.srcValues, pass.dstValues);
+	}
+
+	if (pass.srcKeys != keys)
+	{
+		memcpy(keys, pass.srcKeys, count * sizeof(uint32_t));
+		memcpy(values, pass.srcValues, count * sizeof(uint32_t));
+	}
+}
+
+void ComputeDepthKeys(const ParticleStreams& streams, size_t begin, size_t end, const float view[4][4],
+	float nearZ, float farZ, uint32_t keyBits, uint32_t* keys, uint32_t* indices)
+{
+	// Quantize in float and convert with truncation; keys up to 24 bits are exact in a float.
+	const float maxKey = static_cast<float>((1u << std::min<uint32_t>(keyBits, 24)) - 1);
+	const float scale = maxKey / (farZ - nearZ);
+
+	const float* px = streams.positionX.data();
+	const float* py = streams.positionY.data();
+	const float* pz = streams.positionZ.data();
+
+	size_t i = begin;
+
+#if defined(PARTICLE_SORT_SSE)
+	const __m128 vx = _mm_set1_ps(view[0][2]);
+	const __m128 vy = _mm_set1_ps(view[1][2]);
+	const __m128 vz = _mm_set1_ps(view[2][2]);
+	const __m128 vw = _mm_set1_ps(view[3][2]);
+	const __m128 nearV = _mm_set1_ps(nearZ);
+	const __m128 scaleV = _mm_set1_ps(scale);
+	const __m128 maxKeyV = _mm_set1_ps(maxKey);
+	const __m128i maxKeyI = _mm_set1_epi32(static_cast<int>(maxKey));
+	__m128i index = _mm_setr_epi32(static_cast<int>(i), static_cast<int>(i + 1), static_cast<int>(i + 2), static_cast<int>(i + 3));
+	const __m128i four = _mm_set1_epi32(4);
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(px + i), vx), _mm_mul_ps(_mm_loadu_ps(py + i), vy)),
+			_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pz + i), vz), vw));
+		__m128 t = _mm_mul_ps(_mm_sub_ps(depth, nearV), scaleV);
+		t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), maxKeyV);
+
+		// Farther is smaller, so an ascending sort yields back-to-front order.
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(keys + i), _mm_sub_epi32(maxKeyI, _mm_cvttps_epi32(t)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), index);
+		index = _mm_add_epi32(index, four);
+	}
+#elif defined(PARTICLE_SORT_NEON)
+	const float32x4_t nearV = vdupq_n_f32(nearZ);
+	const float32x4_t scaleV = vdupq_n_f32(scale);
+	const float32x4_t maxKeyV = vdupq_n_f32(maxKey);
+	const uint32x4_t maxKeyI = vdupq_n_u32(static_cast<uint32_t>(maxKey));
+	const uint32_t firstIndices[4] = { static_cast<uint32_t>(i), static_cast<uint32_t>(i + 1), static_cast<uint32_t>(i + 2), static_cast<uint32_t>(i + 3) };
+	uint32x4_t index = vld1q_u32(firstIndices);
+	const uint32x4_t four = vdupq_n_u32(4);
+
+	for (; i + 4 <= end; i += 4)
+	{
+		float32x4_t depth = vmulq_n_f32(vld1q_f32(px + i), view[0][2]);
+		depth = vaddq_f32(depth, vmulq_n_f32(vld1q_f32(py + i), view[1][2]));
+		depth = vaddq_f32(depth, vmulq_n_f32(vld1q_f32(pz + i), view[2][2]));
+		depth = vaddq_f32(depth, vdupq_n_f32(view[3][2]));
+		float32x4_t t = vmulq_f32(vsubq_f32(depth, nearV), scaleV);
+		t = vminq_f32(vmaxq_f32(t, vdupq_n_f32(0.f)), maxKeyV);
+
+		vst1q_u32(keys + i, vsubq_u32(maxKeyI, vcvtq_u32_f32(t)));
+		vst1q_u32(indices + i, index);
+		index = vaddq_u32(index, four);
+	}
+#endif
+
+	for (; i < end; i++)
+	{
+		const float depth = px[i] * view[0][2] + py[i] * view[1][2] + pz[i] * view[2][2] + view[3][2];
+		const float t = std::min(std::max((depth - nearZ) * scale, 0.f), maxKey);
+		keys[i] = static_cast<uint32_t>(maxKey) - static_cast<uint32_t>(t);
+		indices[i] = static_cast<uint32_t>(i);
+	}
+}
+
+void ComputeDepthKeysIndexed(const ParticleStreams& streams, const uint32_t* subset, size_t begin, size_t end,
+	const float view[4][4], float nearZ, float farZ, uint32_t keyBits, uint32_t* keys, uint32_t* indices)
+{
+	const float maxKey = static_cast<float>((1u << std::min<uint32_t>(keyBits, 24)) - 1);
+	const float scale = maxKey / (farZ - nearZ);
+
+	// The reads are gathers, so there is nothing for the SIMD units to win here.
+	for (size_t i = begin; i < end; i++)
+	{
+		const uint32_t particle = subset[i];
+		const float depth = streams.positionX[particle] * view[0][2] + streams.positionY[particle] * view[1][2] +
+			streams.positionZ[particle] * view[2][2] + view[3][2];
+		const float t = std::min(std::max((depth - nearZ) * scale, 0.f), maxKey);
+		keys[i] = static_cast<uint32_t>(maxKey) - static_cast<uint32_t>(t);
+		indices[i] = particle;
+	}
+}
+
+const uint32_t* ParticleDepthSorter::Sort(const ParticleStreams& streams, const uint32_t* subset, size_t count, const float view[4][4],
+	float nearZ, float farZ, JobSystem* pJobSystem)
+{
+	if (m_keys.size() < count)
+	{
+		m_keys.resize(count);
+		m_indices.resize(count);
+		m_scratchKeys.resize(count);
+		m_scratchIndices.resize(count);
+	}
+
+	const uint32_t keyBits = std::min<uint32_t>(m_keyBits, 24);
+	auto computeKeys = [&](size_t begin, size_t end)
+	{
+		if (subset)
+		{
+			ComputeDepthKeysIndexed(streams, subset, begin, end, view, nearZ, farZ, keyBits, m_keys.data(), m_indices.data());
+		}
+		else
+		{
+			ComputeDepthKeys(streams, begin, end, view, nearZ, farZ, keyBits, m_keys.data(), m_indices.data());
+		}
+	};
+
+	if (pJobSystem && count >= c_parallelThreshold)
+	{
+		pJobSystem->ParallelFor(0, count, c_keyChunkSize, computeKeys);
+	}
+	else
+	{
+		computeKeys(0, count);
+	}
+
+	RadixSortPairs(m_keys.data(), m_indices.data(), m_scratchKeys.data(), m_scratchIndices.data(), count, keyBits, pJobSystem);
+
+	return m_indices.data();
+}
+
+namespace
+{
+	uint32_t NextRandom(uint32_t& state)
+	{
+		state = state * 1664525u + 1013904223u;
+		return state;
+	}
+
+	// Ascending keys, and equal keys in input order, the same as std::stable_sort. The values
+	// going in are the input positions, which makes stability visible.
+	bool CheckRadixSort(const std::vector<uint32_t>& input, uint32_t keyBits, JobSystem* pJobSystem)
+	{
+		const size_t count = input.size();
+		std::vector<uint32_t> keys = input;
+		std::vector<uint32_t> values(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			values[i] = static_cast<uint32_t>(i);
+		}
+		std::vector<uint32_t> scratchKeys(count);
+		std::vector<uint32_t> scratchValues(count);
+		RadixSortPairs(keys.data(), values.data(), scratchKeys.data(), scratchValues.data(), count, keyBits, pJobSystem);
+
+		const uint32_t sortedBits = (keyBits + c_radixBits - 1) / c_radixBits * c_radixBits;
+		const uint32_t mask = sortedBits >= 32 ? ~0u : (1u << sortedBits) - 1;
+		std::vector<uint32_t> expected(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			expected[i] = static_cast<uint32_t>(i);
+		}
+		std::stable_sort(expected.begin(), expected.end(), [&input, mask](uint32_t a, uint32_t b)
+		{
+			return (input[a] & mask) < (input[b] & mask);
+		});
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (values[i] != expected[i] || keys[i] != input[expected[i]])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	float ViewDepth(const ParticleStreams& streams, size_t i, const float view[4][4])
+	{
+		return streams.positionX[i] * view[0][2] + streams.positionY[i] * view[1][2] + streams.positionZ[i] * view[2][2] + view[3][2];
+	}
+
+	float ClampedDepth(const ParticleStreams& streams, size_t i, const float view[4][4], float nearZ, float farZ)
+	{
+		return std::min(std::max(ViewDepth(streams, i, view), nearZ), farZ);
+	}
+}
+
+bool VerifyParticleSort()
+{
+	JobSystem jobSystem(4);
+	uint32_t randomState = 12345;
+
+	// Counts on both sides of the single-block path and of the tail of the last block.
+	const size_t counts[] = { 0, 1, 2, 3, 1000, c_parallelThreshold - 1, c_parallelThreshold, 3 * c_parallelThreshold + 17 };
+	for (size_t count : counts)
+	{
+		for (uint32_t keyBits : { 8u, 12u, 24u, 32u })
+		{
+			// Few distinct values so equal keys are common, a digit every key shares (skipped
+			// pass) and bits above keyBits that must not take part.
+			std::vector<uint32_t> keys(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				const uint32_t r = NextRandom(randomState);
+				keys[i] = ((r >> 8) % 37) | 0x5500u | (r & 0xff000000u);
+			}
+
+			if (!CheckRadixSort(keys, keyBits, nullptr) || !CheckRadixSort(keys, keyBits, &jobSystem))
+			{
+				return false;
+			}
+		}
+	}
+
+	// A view looking down a tilted axis from 40 units away, so the depths cover the whole
+	// [nearZ, farZ] range and some clamp at either end.
+	float view[4][4] = {};
+	view[0][0] = view[1][1] = 1.f;
+	view[0][2] = .2f; view[1][2] = -.6f; view[2][2] = .774597f; view[3][2] = 40.f;
+	view[3][3] = 1.f;
+	const float nearZ = 1.f;
+	const float farZ = 101.f;
+
+	const size_t count = 2 * c_parallelThreshold + 5;
+	ParticleStreams streams;
+	streams.Resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		streams.positionX[i] = (NextRandom(randomState) >> 8) * (100.f / 16777216.f) - 50.f;
+		streams.positionY[i] = (NextRandom(randomState) >> 8) * (100.f / 16777216.f) - 50.f;
+		streams.positionZ[i] = (NextRandom(randomState) >> 8) * (100.f / 16777216.f) - 50.f;
+	}
+
+	for (uint32_t keyBits : { 8u, 16u, 24u })
+	{
+		// The SIMD lanes against the scalar formula, from an unaligned start. The lanes add
+		// in another order, which moves the depth by a few float ulps of the ~50-unit terms.
+		const float maxKey = static_cast<float>((1u << keyBits) - 1);
+		const float scale = maxKey / (farZ - nearZ);
+		const float depthTolerance = 3e-5f;
+		const uint32_t keyTolerance = 1 + static_cast<uint32_t>(depthTolerance * scale);
+		std::vector<uint32_t> keys(count);
+		std::vector<uint32_t> indices(count);
+		ComputeDepthKeys(streams, 3, count, view, nearZ, farZ, keyBits, keys.data(), indices.data());
+		for (size_t i = 3; i < count; i++)
+		{
+			const float t = std::min(std::max((ViewDepth(streams, i, view) - nearZ) * scale, 0.f), maxKey);
+			const uint32_t expected = static_cast<uint32_t>(maxKey) - static_cast<uint32_t>(t);
+			if (indices[i] != i || keys[i] > expected + keyTolerance || keys[i] + keyTolerance < expected)
+			{
+				return false;
+			}
+		}
+
+		// The whole range and the survivors of a cull, on one thread and on the job system.
+		std::vector<uint32_t> subset;
+		for (uint32_t i = 0; i < count; i += 1 + NextRandom(randomState) % 3)
+		{
+			subset.push_back(i);
+		}
+
+		for (bool useSubset : { false, true })
+		{
+			const size_t sortCount = useSubset ? subset.size() : count;
+			const uint32_t* pSubset = useSubset ? subset.data() : nullptr;
+			if (useSubset)
+			{
+				ComputeDepthKeysIndexed(streams, pSubset, 0, sortCount, view, nearZ, farZ, keyBits, keys.data(), indices.data());
+			}
+			else
+			{
+				ComputeDepthKeys(streams, 0, sortCount, view, nearZ, farZ, keyBits, keys.data(), indices.data());
+			}
+
+			std::vector<uint32_t> expected(sortCount);
+			for (size_t i = 0; i < sortCount; i++)
+			{
+				expected[i] = static_cast<uint32_t>(i);
+			}
+			std::stable_sort(expected.begin(), expected.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+			for (JobSystem* pJobSystem : { static_cast<JobSystem*>(nullptr), &jobSystem })
+			{
+				ParticleDepthSorter sorter(keyBits);
+				const uint32_t* order = sorter.Sort(streams, pSubset, sortCount, view, nearZ, farZ, pJobSystem);
+
+				for (size_t i = 0; i < sortCount; i++)
+				{
+					if (order[i] != indices[expected[i]])
+					{
+						return false;
+					}
+
+					// Back to front: nothing is nearer than what follows it by more than a key step.
+					if (i > 0 && ClampedDepth(streams, order[i - 1], view, nearZ, farZ) < ClampedDepth(streams, order[i], view, nearZ, farZ) - 1.f / scale - depthTolerance)
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Back-to-front depth sorting of the rain particles for correct alpha blending.
+//
+// View-space depths are quantized to integer keys (farther = smaller key) and sorted
+// with an LSD radix sort, 8 bits per pass. Both the key computation (SIMD) and the
+// radix passes (per-block histograms, then a stable scatter) are split over the job
+// system when one is given. No Windows dependency.
+
+#include "ParticleSimulator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+// Sort (keys, values) pairs by the low keyBits of the keys, rounded up to whole 8-bit
+// digits, ascending and stable.
+// The sorted pairs end up in keys/values; scratch buffers must hold count elements.
+void RadixSortPairs(uint32_t* keys, uint32_t* values, uint32_t* scratchKeys, uint32_t* scratchValues,
+	size_t count, uint32_t keyBits, JobSystem* pJobSystem = nullptr);
+
+// Depth key of each particle in [begin, end), with indices[i] = i. Depth is the view-space
+// z, clamped to [nearZ, farZ] and quantized to keyBits so that the farthest particle
+// gets key 0. view is row-major, applied to row vectors as in DirectXMath.
+void ComputeDepthKeys(const ParticleStreams& streams, size_t begin, size_t end, const float view[4][4],
+	float nearZ, float farZ, uint32_t keyBits, uint32_t* keys, uint32_t* indices);
+
+// Same for the particles subset[begin, end), e.g. the survivors of culling, with indices[i] = subset[i].
+void ComputeDepthKeysIndexed(const ParticleStreams& streams, const uint32_t* subset, size_t begin, size_t end,
+	const float view[4][4], float nearZ, float farZ, uint32_t keyBits, uint32_t* keys, uint32_t* indices);
+
+class ParticleDepthSorter
+{
+public:
+	// 24 bits resolve ~6 micro-units over a 100-unit depth range and need three passes.
+	explicit ParticleDepthSorter(uint32_t keyBits = 24) : m_keyBits(keyBits) {}
+
+	// Returns the indices of particles [0, count) ordered back to front. The array stays
+	// valid until the next call.
+	const uint32_t* Sort(const ParticleStreams& streams, size_t count, const float view[4][4],
+		float nearZ, float farZ, JobSystem* pJobSystem = nullptr)
+	{
+		return Sort(streams, nullptr, count, view, nearZ, farZ, pJobSystem);
+	}
+
+	// Order only the particles listed in subset[0, count); null means all of [0, count).
+	const uint32_t* Sort(const ParticleStreams& streams, const uint32_t* subset, size_t count, const float view[4][4],
+		float nearZ, float farZ, JobSystem* pJobSystem = nullptr);
+
+private:
+	uint32_t m_keyBits;
+	std::vector<uint32_t> m_keys;
+	std::vector<uint32_t> m_indices;
+	std::vector<uint32_t> m_scratchKeys;
+	std::vector<uint32_t> m_scratchIndices;
+};
+
+// RadixSortPairs and ParticleDepthSorter against std::stable_sort, single-threaded and
+// split over a job system, plus the SIMD depth keys against the scalar formula.
+bool VerifyParticleSort();
@@ -0,0 +1,335 @@
+#include "ParticleSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+ParticleSystem::ParticleSystem(size_t capacity, uint32_t seed) :
+	m_aliveCount(0),
+	m_randomState(seed ? seed : 1),
+	m_stats{}
+{
+	m_simulator.Resize(capacity);
+	m_remainingLife.resize(capacity);
+	m_emitterIndex.resize(capacity);
+	m_handleToIndex.resize(capacity, InvalidHandle);
+	m_indexToHandle.resize(capacity);
+
+	// Hand out the low handles first.
+	m_freeHandles.resize(capacity);
+	for (size_t i = 0; i < capacity; i++)
+	{
+		m_freeHandles[i] = static_cast<uint32_t>(capacity - 1 - i);
+	}
+}
+
+size_t ParticleSystem::AddEmitter(const EmitterDesc& desc)
+{
+	m_emitters.push_back(Emitter{ desc, 0.f });
+	return m_emitters.size() - 1;
+}
+
+void ParticleSystem::Update(float deltaTime)
+{
+	m_stats = {};
+
+	// Age the particles first so that the newly spawned ones get their full lifetime.
+	ParticleStreams& streams = m_simulator.Streams();
+	size_t i = 0;
+	while (i < m_aliveCount)
+	{
+		m_remainingLife[i] -= deltaTime;
+		if (m_remainingLife[i] <= 0.f || streams.positionY[i] < m_emitters[m_emitterIndex[i]].desc.killBelow)
+		{
+			// The last alive particle now sits at i and still has to be checked.
+			Kill(i);
+			m_stats.killed++;
+			continue;
+		}
+		i++;
+	}
+
+	for (size_t e = 0; e < m_emitters.size(); e++)
+	{
+		Emitter& emitter = m_emitters[e];
+		const EmitterDesc& desc = emitter.desc;
+		if (!desc.enabled)
+		{
+			emitter.spawnAccumulator = 0.f;
+			continue;
+		}
+
+		// Carry the fractional part over so low rates still spawn at the right average.
+		// Past 2^24 a float has no fractional part left to carry, so the whole spawns are
+		// taken out at once and only those the free list can hold are made; the others
+		// would be refused anyway.
+		emitter.spawnAccumulator += desc.spawnRate * deltaTime;
+		const double due = std::floor(static_cast<double>(emitter.spawnAccumulator));
+		if (!(due >= 1.))
+		{
+			continue;
+		}
+
+		const double maxDue = 1e15;
+		const size_t requested = static_cast<size_t>(std::min(due, maxDue));
+		emitter.spawnAccumulator = due < maxDue ? static_cast<float>(emitter.spawnAccumulator - due) : 0.f;
+
+		const size_t spawnCount = std::min(requested, m_freeHandles.size());
+		m_stats.dropped += requested - spawnCount;
+		m_stats.spawned += spawnCount;
+
+		for (size_t s = 0; s < spawnCount; s++)
+		{
+			ParticleVertex v;
+			v.position[0] = NextFloat(desc.spawnMin[0], desc.spawnMax[0]);
+			v.position[1] = NextFloat(desc.spawnMin[1], desc.spawnMax[1]);
+			v.position[2] = NextFloat(desc.spawnMin[2], desc.spawnMax[2]);
+			v.size[0] = desc.size[0];
+			v.size[1] = desc.size[1];
+			v.speed = NextFloat(desc.speedMin, desc.speedMax);
+
+			Spawn(v, NextFloat(desc.lifetimeMin, desc.lifetimeMax), static_cast<uint16_t>(e));
+		}
+	}
+}
+
+void ParticleSystem::Prewarm(float seconds, float deltaTime)
+{
+	for (float t = 0.f; t < seconds; t += deltaTime)
+	{
+		Update(deltaTime);
+		m_simulator.StepRange(StepParams(deltaTime), 0, m_aliveCount);
+	}
+}
+
+uint32_t ParticleSystem::Spawn(const ParticleVertex& particle, float lifetime, uint16_t emitter)
+{
+	if (m_freeHandles.empty())
+	{
+		return InvalidHandle;
+	}
+
+	const uint32_t handle = m_freeHandles.back();
+	m_freeHandles.pop_back();
+
+	const size_t index = m_aliveCount++;
+	m_simulator.SetParticle(index, particle);
+	m_remainingLife[index] = lifetime;
+	m_emitterIndex[index] = emitter;
+	m_handleToIndex[handle] = static_cast<uint32_t>(index);
+	m_indexToHandle[index] = handle;
+
+	return handle;
+}
+
+void ParticleSystem::Kill(size_t index)
+{
+	const uint32_t handle = m_indexToHandle[index];
+	const size_t last = --m_aliveCount;
+
+	if (index != last)
+	{
+		MoveParticle(last, index);
+	}
+
+	m_handleToIndex[handle] = InvalidHandle;
+	m_freeHandles.push_back(handle);
+}
+
+void ParticleSystem::KillHandle(uint32_t handle)
+{
+	const uint32_t index = m_handleToIndex[handle];
+	if (index != InvalidHandle)
+	{
+		Kill(index);
+	}
+}
+
+bool ParticleSystem::CheckConsistency() const
+{
+	const size_t capacity = Capacity();
+	if (m_aliveCount + m_freeHandles.size() != capacity)
+	{
+		return false;
+	}
+
+	std::vector<bool> seen(capacity, false);
+	for (size_t i = 0; i < m_aliveCount; i++)
+	{
+		const uint32_t handle = m_indexToHandle[i];
+		if (handle >= capacity || seen[handle] || m_handleToIndex[handle] != i)
+		{
+			return false;
+		}
+		seen[handle] = true;
+	}
+	for (uint32_t handle : m_freeHandles)
+	{
+		if (handle >= capacity || seen[handle] || m_handleToIndex[handle] != InvalidHandle)
+		{
+			return false;
+		}
+		seen[handle] = true;
+	}
+	return true;
+}
+
+ParticleStepParams ParticleSystem::StepParams(float deltaTime) const
+{
+	ParticleStepParams params;
+	params.deltaTime = deltaTime;
+	params.resetBelow = -FLT_MAX;
+	return params;
+}
+
+float ParticleSystem::NextFloat(float minValue, float maxValue)
+{
+	// xorshift32
+	uint32_t x = m_randomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	m_randomState = x;
+
+	return minValue + (maxValue - minValue) * (static_cast<float>(x >> 8) / static_cast<float>(1u << 24));
+}
+
+void ParticleSystem::MoveParticle(size_t from, size_t to)
+{
+	ParticleStreams& streams = m_simulator.Streams();
+	streams.positionX[to] = streams.positionX[from];
+	streams.positionY[to] = streams.positionY[from];
+	streams.positionZ[to] = streams.positionZ[from];
+	streams.sizeX[to] = streams.sizeX[from];
+	streams.sizeY[to] = streams.sizeY[from];
+	streams.speed[to] = streams.speed[from];
+	m_remainingLife[to] = m_remainingLife[from];
+	m_emitterIndex[to] = m_emitterIndex[from];
+
+	const uint32_t handle = m_indexToHandle[from];
+	m_indexToHandle[to] = handle;
+	m_handleToIndex[handle] = static_cast<uint32_t>(to);
+}
+
+bool VerifyParticleSystem()
+{
+	const size_t capacity = 64;
+	ParticleSystem system(capacity, 7);
+
+	// Nothing moves and nothing expires unless the test says so.
+	EmitterDesc rain;
+	rain.spawnRate = 2.5f;
+	rain.spawnMin[0] = -20.f; rain.spawnMax[0] = 20.f;
+	rain.lifetimeMin = rain.lifetimeMax = 1000.f;
+	rain.speedMin = 100.f;
+	rain.speedMax = 300.f;
+	rain.killBelow = -1000.f;
+	const size_t emitter = system.AddEmitter(rain);
+
+	// The fraction carries over: 2.5 then 2.5 + .5.
+	system.Update(1.f);
+	if (system.GetStats().spawned != 2 || system.AliveCount() != 2)
+	{
+		return false;
+	}
+	system.Update(1.f);
+	if (system.GetStats().spawned != 3 || system.AliveCount() != 5 || !system.CheckConsistency())
+	{
+		return false;
+	}
+
+	// Past capacity: the rest of a request is counted as dropped, at once.
+	system.GetEmitter(emitter).spawnRate = 100.f;
+	system.Update(1.f);
+	const ParticleSystem::Stats filled = system.GetStats();
+	if (filled.spawned != capacity - 5 || filled.dropped != 100 - (capacity - 5) || system.AliveCount() != capacity || !system.CheckConsistency())
+	{
+		return false;
+	}
+	system.Update(1.f);
+	if (system.GetStats().spawned != 0 || system.GetStats().dropped != 100 || system.AliveCount() != capacity)
+	{
+		return false;
+	}
+
+	// Kill and respawn on the full pool. The survivors keep their data through the compaction.
+	system.GetEmitter(emitter).spawnRate = 0.f;
+	std::vector<float> speedOfHandle(capacity);
+	for (size_t i = 0; i < capacity; i++)
+	{
+		speedOfHandle[system.Handles()[i]] = system.Simulator().Streams().speed[i];
+	}
+
+	uint32_t randomState = 12345;
+	std::vector<bool> killed(capacity, false);
+	for (int k = 0; k < 40; k++)
+	{
+		randomState = randomState * 1664525u + 1013904223u;
+		const uint32_t handle = (randomState >> 8) % capacity;
+		system.KillHandle(handle);	// Killing a dead handle does nothing.
+		killed[handle] = true;
+		if (!system.CheckConsistency())
+		{
+			return false;
+		}
+	}
+
+	size_t killedCount = 0;
+	for (uint32_t handle = 0; handle < capacity; handle++)
+	{
+		if (killed[handle])
+		{
+			killedCount++;
+			if (system.IndexOf(handle) != ParticleSystem::InvalidHandle)
+			{
+				return false;
+			}
+		}
+		else if (system.Simulator().Streams().speed[system.IndexOf(handle)] != speedOfHandle[handle])
+		{
+			return false;
+		}
+	}
+	if (system.AliveCount() != capacity - killedCount)
+	{
+		return false;
+	}
+
+	ParticleVertex v = {};
+	for (size_t s = 0; s < killedCount; s++)
+	{
+		const uint32_t handle = system.Spawn(v, 1000.f);
+		if (handle == ParticleSystem::InvalidHandle || !killed[handle])
+		{
+			return false;
+		}
+	}
+	if (system.Spawn(v, 1000.f) != ParticleSystem::InvalidHandle || !system.CheckConsistency())
+	{
+		return false;
+	}
+
+	// Rates whose per-update count a float cannot decrement must still return, full pool or not.
+	for (float rate : { 1e9f, 1e30f, FLT_MAX })
+	{
+		system.GetEmitter(emitter).spawnRate = rate;
+		system.Update(1.f / 60.f);
+		if (system.GetStats().spawned != 0 || system.GetStats().dropped == 0 || !system.CheckConsistency())
+		{
+			return false;
+		}
+	}
+
+	// Everything expires, then a large rate refills the emptied pool exactly.
+	system.Update(2000.f);
+	const ParticleSystem::Stats refilled = system.GetStats();
+	if (refilled.killed != capacity || refilled.spawned != capacity || system.AliveCount() != capacity || !system.CheckConsistency())
+	{
+		return false;
+	}
+
+	// Expiry with nothing spawning empties the pool.
+	system.GetEmitter(emitter).enabled = false;
+	system.Update(2000.f);
+	return system.GetStats().killed == capacity && system.AliveCount() == 0 && system.CheckConsistency();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// Emitter-driven particle pool for the rain effect.
+//
+// The pool has a fixed capacity allocated once. Alive particles are always packed in
+// [0, AliveCount()) of the ParticleSimulator streams so the update and the upload only
+// ever touch live data: killing a particle moves the last alive one into its slot.
+// Particles are also reachable through stable handles, recycled through a free list,
+// so spawn and kill are both O(1).
+
+#include "ParticleSimulator.h"
+
+#include <cstdint>
+#include <vector>
+
+// Describes how an emitter spawns particles. All ranges are sampled uniformly.
+struct EmitterDesc
+{
+	float spawnRate = 0.f;						// Particles per second
+	float spawnMin[3] = { 0.f, 0.f, 0.f };		// Spawn volume (axis-aligned box)
+	float spawnMax[3] = { 0.f, 0.f, 0.f };
+	float lifetimeMin = 1.f;					// Seconds
+	float lifetimeMax = 1.f;
+	float speedMin = 0.f;						// Falling speed, units per second
+	float speedMax = 0.f;
+	float size[2] = { 0.f, 0.f };
+	float killBelow = -50.f;					// Particles falling below this height die
+	bool enabled = true;
+};
+
+class ParticleSystem
+{
+public:
+	static constexpr uint32_t InvalidHandle = 0xFFFFFFFFu;
+
+	explicit ParticleSystem(size_t capacity, uint32_t seed = 1);
+
+	size_t Capacity() const { return m_handleToIndex.size(); }
+	size_t AliveCount() const { return m_aliveCount; }
+
+	size_t AddEmitter(const EmitterDesc& desc);
+	EmitterDesc& GetEmitter(size_t index) { return m_emitters[index].desc; }
+	size_t GetEmitterCount() const { return m_emitters.size(); }
+
+	// Spawn new particles from the emitters, then age the alive ones and kill those
+	// that expired or fell out of their emitter's range. The motion itself is done by
+	// stepping Simulator() over [0, AliveCount()), which can be split across threads.
+	void Update(float deltaTime);
+
+	// Step the emitters and the motion for a while so the scene starts in steady state.
+	void Prewarm(float seconds, float deltaTime);
+
+	// Returns InvalidHandle when the pool is full.
+	uint32_t Spawn(const ParticleVertex& particle, float lifetime, uint16_t emitter = 0);
+	void Kill(size_t index);
+	void KillHandle(uint32_t handle);
+	size_t IndexOf(uint32_t handle) const { return m_handleToIndex[handle]; }
+
+	// Handle of each alive particle in index order; it stays with the particle while the pool compacts.
+	const uint32_t* Handles() const { return m_indexToHandle.data(); }
+
+	ParticleSimulator& Simulator() { return m_simulator; }
+	const ParticleSimulator& Simulator() const { return m_simulator; }
+
+	// Step parameters suited to the pool: falling particles are killed by Update() instead of wrapping.
+	ParticleStepParams StepParams(float deltaTime) const;
+
+	// Counters of the last Update().
+	struct Stats
+	{
+		size_t spawned;
+		size_t killed;
+		size_t dropped;		// Spawns refused because the pool was full
+	};
+	const Stats& GetStats() const { return m_stats; }
+
+	// True if every handle is either free or maps to the alive particle that maps back to
+	// it, exactly once.
+	bool CheckConsistency() const;
+
+private:
+	struct Emitter
+	{
+		EmitterDesc desc;
+		float spawnAccumulator;
+	};
+
+	float NextFloat(float minValue, float maxValue);
+	void MoveParticle(size_t from, size_t to);
+
+	ParticleSimulator m_simulator;
+	size_t m_aliveCount;
+
+	// Per-particle data the GPU never sees, packed alongside the simulator streams.
+	FloatStream m_remainingLife;
+	std::vector<uint16_t> m_emitterIndex;
+
+	// Handle indirection. The free list is a plain stack of the unused handles.
+	std::vector<uint32_t> m_handleToIndex;
+	std::vector<uint32_t> m_indexToHandle;
+	std::vector<uint32_t> m_freeHandles;
+
+	std::vector<Emitter> m_emitters;
+	uint32_t m_randomState;
+	Stats m_stats;
+};
+
+// Fill a small pool past its capacity, kill and respawn on it full, drive an emitter at
+// rates no pool could take and check the counters and the handle bookkeeping after each.
+bool VerifyParticleSystem();
@@ -0,0 +1,76 @@
+#include "PresentStateMachine.h"
+
+PresentStateMachine::PresentStateMachine(int64_t probeInterval) :
+	m_probeInterval(probeInterval),
+	m_state(PresentState::Visible),
+	m_nextProbeTime(0),
+	m_hiddenSince(0),
+	m_hideCount(0),
+	m_hiddenTime(0)
+{
+}
+
+void PresentStateMachine::OnMinimized(int64_t now)
+{
+	SetState(PresentState::Minimized, now);
+}
+
+void PresentStateMachine::OnRestored(int64_t now)
+{
+	if (m_state == PresentState::Minimized)
+	{
+		SetState(PresentState::Visible, now);
+	}
+}
+
+void PresentStateMachine::OnPresent(bool occluded, int64_t now)
+{
+	// A frame that was already under way when the window got minimized does not change anything.
+	if (m_state == PresentState::Visible && occluded)
+	{
+		SetState(PresentState::Occluded, now);
+	}
+}
+
+void PresentStateMachine::OnProbe(bool occluded, int64_t now)
+{
+	if (m_state != PresentState::Occluded)
+	{
+		return;
+	}
+
+	if (occluded)
+	{
+		m_nextProbeTime = now + m_probeInterval;
+	}
+	else
+	{
+		SetState(PresentState::Visible, now);
+	}
+}
+
+void PresentStateMachine::SetState(PresentState state, int64_t now)
+{
+	if (state == m_state)
+	{
+		return;
+	}
+
+	const bool wasRendering = ShouldRender();
+	m_state = state;
+
+	if (wasRendering && !ShouldRender())
+	{
+		m_hideCount++;
+		m_hiddenSince = now;
+	}
+	else if (!wasRendering && ShouldRender())
+	{
+		m_hiddenTime += now - m_hiddenSince;
+	}
+
+	if (m_state == PresentState::Occluded)
+	{
+		m_nextProbeTime = now + m_probeInterval;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// Whether frames are worth producing, from what the window and the swap chain report.
+//
+// A minimized window (WM_SIZE) or a Present() that returns DXGI_STATUS_OCCLUDED stops
+// rendering altogether. While occluded, the swap chain is asked every probeInterval with a
+// DXGI_PRESENT_TEST present, which neither records nor queues anything, and rendering
+// resumes once the window shows again. Restoring a minimized window resumes right away;
+// the next Present() tells whether it is actually visible.
+//
+// Times are FrameClock nanoseconds. No Windows dependency.
+
+#include <cstdint>
+
+enum class PresentState
+{
+	Visible,
+	Occluded,
+	Minimized
+};
+
+class PresentStateMachine
+{
+public:
+	explicit PresentStateMachine(int64_t probeInterval = 250000000);
+
+	PresentState GetState() const { return m_state; }
+	bool ShouldRender() const { return m_state == PresentState::Visible; }
+
+	// Window events.
+	void OnMinimized(int64_t now);
+	void OnRestored(int64_t now);
+
+	// Outcome of a regular Present().
+	void OnPresent(bool occluded, int64_t now);
+
+	// Probing: only while occluded, at most once per probe interval.
+	bool ShouldProbe(int64_t now) const { return m_state == PresentState::Occluded && now >= m_nextProbeTime; }
+	int64_t GetNextProbeTime() const { return m_nextProbeTime; }
+	void OnProbe(bool occluded, int64_t now);
+
+	// Times rendering stopped, and total time spent not rendering up to the last transition.
+	uint32_t GetHideCount() const { return m_hideCount; }
+	int64_t GetHiddenTime() const { return m_hiddenTime; }
+
+private:
+	void SetState(PresentState state, int64_t now);
+
+	int64_t m_probeInterval;
+	PresentState m_state;
+	int64_t m_nextProbeTime;
+	int64_t m_hiddenSince;
+	uint32_t m_hideCount;
+	int64_t m_hiddenTime;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+// Bookkeeping for reading GPU-written values back without stalling.
+//
+// Each frame writes its value into its own readback slot and tags the slot with the
+// fence value the frame will signal. The CPU only looks at slots whose fence value
+// has completed, so the data it reads is a few frames old but never stale or racing
+// with the GPU. Frames complete in order, so the slots form a simple FIFO ring.
+//
+// The ring only hands out slot indices; where the slots live (e.g. consecutive
+// UINT64s of a D3D12 readback buffer) is up to the caller. No Windows dependency, so
+// VerifyReadbackRing() runs anywhere.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class ReadbackRing
+{
+public:
+	static const uint32_t InvalidSlot = 0xFFFFFFFFu;
+
+	explicit ReadbackRing(uint32_t slotCount) :
+		m_fenceValues(slotCount, 0),
+		m_head(0),
+		m_pendingCount(0),
+		m_latestFenceValue(0)
+	{
+	}
+
+	uint32_t GetSlotCount() const { return static_cast<uint32_t>(m_fenceValues.size()); }
+	uint32_t GetPendingCount() const { return m_pendingCount; }
+
+	// Fence value of the frame whose data Retire() returned last, 0 if none yet.
+	uint64_t GetLatestFenceValue() const { return m_latestFenceValue; }
+
+	// Reserve the slot a frame signalling fenceValue will write into. Returns InvalidSlot
+	// when every slot is still in flight; the frame must then skip its readback.
+	uint32_t Acquire(uint64_t fenceValue)
+	{
+		if (m_pendingCount == GetSlotCount())
+		{
+			return InvalidSlot;
+		}
+
+		const uint32_t slot = (m_head + m_pendingCount) % GetSlotCount();
+		m_fenceValues[slot] = fenceValue;
+		m_pendingCount++;
+		return slot;
+	}
+
+	// Release every slot whose frame has completed and return the newest of them, or
+	// InvalidSlot if none completed since the last call. The returned slot must be read
+	// before work that may write to it again is submitted.
+	uint32_t Retire(uint64_t completedFenceValue)
+	{
+		uint32_t newest = InvalidSlot;
+
+		while (m_pendingCount > 0 && m_fenceValues[m_head] <= completedFenceValue)
+		{
+			newest = m_head;
+			m_latestFenceValue = m_fenceValues[m_head];
+			m_head = (m_head + 1) % GetSlotCount();
+			m_pendingCount--;
+		}
+
+		return newest;
+	}
+
+private:
+	std::vector<uint64_t> m_fenceValues;
+	uint32_t m_head;
+	uint32_t m_pendingCount;
+	uint64_t m_latestFenceValue;
+};
+
+// Drive rings of 1 to framesInFlight + 1 slots the way HelloRainEffect does, over a
+// simulated fence: up to framesInFlight frames run on the "GPU", which completes them in
+// order at a pseudo-random pace, and Retire() is skipped on some frames so the ring fills
+// up. Returns false if a slot comes back before its frame completed, if Retire() misses
+// the newest completed slot, if Acquire() hands out a slot still pending, or if it
+// refuses a slot while one is free or grants one while all are pending.
+inline bool VerifyReadbackRing(uint32_t framesInFlight)
+{
+	for (uint32_t slotCount = 1; slotCount <= framesInFlight + 1; slotCount++)
+	{
+		ReadbackRing ring(slotCount);
+
+		// Frame whose readback each slot holds, 0 if free.
+		std::vector<uint64_t> slotFrames(slotCount, 0);
+		uint64_t completedFenceValue = 0;
+		uint32_t refusals = 0;
+		uint32_t seed = 1;
+
+		for (uint64_t frame = 1; frame <= 500; frame++)
+		{
+			// The CPU waits until at most framesInFlight - 1 frames are still running, and the
+			// GPU may have got further than that.
+			seed = seed * 1664525u + 1013904223u;
+			completedFenceValue = (std::max)(completedFenceValue, frame > framesInFlight ? frame - framesInFlight : 0);
+			completedFenceValue = (std::min)(frame - 1, completedFenceValue + (seed >> 16) % 3);
+
+			if ((seed >> 8) % 4 != 0)
+			{
+				// The slot of the newest frame that completed, if any did since the last call.
+				uint32_t expectedSlot = ReadbackRing::InvalidSlot;
+				uint64_t expectedFrame = 0;
+				for (uint32_t slot = 0; slot < slotCount; slot++)
+				{
+					if (slotFrames[slot] != 0 && slotFrames[slot] <= completedFenceValue && slotFrames[slot] > expectedFrame)
+					{
+						expectedSlot = slot;
+						expectedFrame = slotFrames[slot];
+					}
+				}
+
+				const uint32_t retired = ring.Retire(completedFenceValue);
+				if (retired != expectedSlot || (retired != ReadbackRing::InvalidSlot && ring.GetLatestFenceValue() != expectedFrame))
+				{
+					return false;
+				}
+				for (uint64_t& slotFrame : slotFrames)
+				{
+					if (slotFrame <= completedFenceValue)
+					{
+						slotFrame = 0;
+					}
+				}
+			}
+
+			const uint32_t pendingCount = static_cast<uint32_t>(std::count_if(slotFrames.begin(), slotFrames.end(), [](uint64_t slotFrame) { return slotFrame != 0; }));
+			if (ring.GetPendingCount() != pendingCount)
+			{
+				return false;
+			}
+
+			const uint32_t slot = ring.Acquire(frame);
+			if (pendingCount == slotCount)
+			{
+				if (slot != ReadbackRing::InvalidSlot)
+				{
+					return false;
+				}
+				refusals++;
+			}
+			else
+			{
+				if (slot >= slotCount || slotFrames[slot] != 0)
+				{
+					return false;
+				}
+				slotFrames[slot] = frame;
+			}
+		}
+
+		// A ring with fewer slots than frames in flight must have had to refuse some.
+		if (slotCount < framesInFlight && refusals == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,108 @@
+#include "StepTimer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+FrameTimeStats StepTimer::GetFrameTimeStats() const
+{
+    FrameTimeStats stats = {};
+
+    const uint32_t tickCount = m_windowTickCount.load(std::memory_order_acquire);
+    const uint32_t count = std::min(tickCount, WindowSize);
+    if (count == 0)
+    {
+        return stats;
+    }
+
+    // Oldest first, so that consecutive samples are consecutive frames.
+    uint64_t samples[WindowSize];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        samples[i] = m_window[(tickCount - count + i) & (WindowSize - 1)].load(std::memory_order_relaxed);
+    }
+
+    double sum = 0., sumSquares = 0., sumChanges = 0.;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const double seconds = TicksToSeconds(samples[i]);
+        sum += seconds;
+        sumSquares += seconds * seconds;
+        if (i > 0)
+        {
+            sumChanges += std::abs(seconds - TicksToSeconds(samples[i - 1]));
+        }
+    }
+
+    stats.count = count;
+    stats.mean = sum / count;
+    stats.stdDev = std::sqrt(std::max(sumSquares / count - stats.mean * stats.mean, 0.));
+    stats.jitter = count > 1 ? sumChanges / (count - 1) : 0.;
+
+    // Nearest rank percentiles.
+    std::sort(samples, samples + count);
+    const auto percentile = [&](double p)
+    {
+        const uint32_t rank = std::max(static_cast<uint32_t>(std::ceil(p / 100. * count)), 1u);
+        return TicksToSeconds(samples[rank - 1]);
+    };
+    stats.min = TicksToSeconds(samples[0]);
+    stats.max = TicksToSeconds(samples[count - 1]);
+    stats.p50 = percentile(50.);
+    stats.p90 = percentile(90.);
+    stats.p99 = percentile(99.);
+    return stats;
+}
+
+bool VerifyStepTimer()
+{
+    const auto toClock = [](double seconds)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<StepTimer::Clock::duration>(std::chrono::duration<double>(seconds)).count());
+    };
+    const auto near = [](double a, double b) { return std::abs(a - b) <= 1e-6; };
+
+    StepTimer timer;
+    if (timer.GetFrameTimeStats().count != 0)
+    {
+        return false;
+    }
+
+    // Steady 60 Hz with one 250ms hitch in the window: the average hides it, max and p99 do not.
+    std::vector<double> frameTimes;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> noise(-.0005, .0005);
+    for (uint32_t i = 0; i < 3 * StepTimer::WindowSize; i++)
+    {
+        frameTimes.push_back(i == 2 * StepTimer::WindowSize + 100 ? .25 : 1. / 60. + noise(rng));
+    }
+    for (double frameTime : frameTimes)
+    {
+        timer.Tick(toClock(frameTime), nullptr);
+    }
+
+    // Elapsed time is still clamped for the simulation, the statistics are not.
+    if (timer.GetFrameCount() != frameTimes.size() || timer.GetElapsedSeconds() > .1 + 1e-6)
+    {
+        return false;
+    }
+
+    std::vector<double> window(frameTimes.end() - StepTimer::WindowSize, frameTimes.end());
+    double mean = 0., jitter = 0.;
+    for (size_t i = 0; i < window.size(); i++)
+    {
+        mean += window[i] / window.size();
+        jitter += i > 0 ? std::abs(window[i] - window[i - 1]) / (window.size() - 1) : 0.;
+    }
+    std::vector<double> sorted = window;
+    std::sort(sorted.begin(), sorted.end());
+
+    const FrameTimeStats stats = timer.GetFrameTimeStats();
+    return stats.count == StepTimer::WindowSize &&
+        near(stats.min, sorted.front()) && near(stats.max, .25) &&
+        near(stats.mean, mean) && near(stats.jitter, jitter) &&
+        near(stats.p50, sorted[StepTimer::WindowSize / 2 - 1]) &&
+        near(stats.p99, sorted[static_cast<size_t>(std::ceil(.99 * StepTimer::WindowSize)) - 1]) &&
+        stats.p90 < .02 && stats.stdDev > .01;
+}
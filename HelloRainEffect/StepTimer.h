@@ -11,54 +11,85 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+// Frame time statistics over the rolling window of a StepTimer, in seconds.
+struct FrameTimeStats
+{
+    uint32_t count;
+    double min;
+    double mean;
+    double max;
+    double p50;
+    double p90;
+    double p99;
+    double stdDev;
+    double jitter;      // Mean absolute change between consecutive frame times
+};
+
 // Helper class for animation and simulation timing.
+// Time comes from std::chrono::steady_clock, which is QPC on Windows and
+// clock_gettime(CLOCK_MONOTONIC) on Linux.
 class StepTimer
 {
 public:
+    // Frame times of the last WindowSize Tick() calls are kept for GetFrameTimeStats().
+    static constexpr uint32_t WindowSize = 256;
+    static_assert((WindowSize & (WindowSize - 1)) == 0, "WindowSize must be a power of two");
+
+    using Clock = std::chrono::steady_clock;
+
     StepTimer() :
+        m_clockLastTime(Clock::now()),
+        m_clockMaxDelta(std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(100)).count()),
         m_elapsedTicks(0),
         m_totalTicks(0),
         m_leftOverTicks(0),
         m_frameCount(0),
         m_framesPerSecond(0),
         m_framesThisSecond(0),
-        m_qpcSecondCounter(0),
+        m_clockSecondCounter(0),
         m_isFixedTimeStep(false),
-        m_targetElapsedTicks(TicksPerSecond / 60)
+        m_targetElapsedTicks(TicksPerSecond / 60),
+        m_window{},
+        m_windowTickCount(0)
     {
-        QueryPerformanceFrequency(&m_qpcFrequency);
-        QueryPerformanceCounter(&m_qpcLastTime);
-
-        // Initialize max delta to 1/10 of a second.
-        m_qpcMaxDelta = m_qpcFrequency.QuadPart / 10;
     }
 
     // Get elapsed time since the previous Update call.
-    UINT64 GetElapsedTicks() const { return m_elapsedTicks; }
+    uint64_t GetElapsedTicks() const { return m_elapsedTicks; }
     double GetElapsedSeconds() const { return TicksToSeconds(m_elapsedTicks); }
 
     // Get total time since the start of the program.
-    UINT64 GetTotalTicks() const { return m_totalTicks; }
+    uint64_t GetTotalTicks() const { return m_totalTicks; }
     double GetTotalSeconds() const { return TicksToSeconds(m_totalTicks); }
 
     // Get total number of updates since start of the program.
-    UINT32 GetFrameCount() const { return m_frameCount; }
+    uint32_t GetFrameCount() const { return m_frameCount; }
 
     // Get the current framerate.
-    UINT32 GetFramesPerSecond() const { return m_framesPerSecond; }
+    uint32_t GetFramesPerSecond() const { return m_framesPerSecond; }
+
+    // Get min/mean/max, percentiles and jitter of the unclamped time between the last
+    // WindowSize Tick() calls. Safe to call from another thread than the one ticking; the
+    // window is copied without locking, so a concurrent Tick() may replace a sample or two.
+    FrameTimeStats GetFrameTimeStats() const;
 
     // Set whether to use fixed or variable timestep mode.
     void SetFixedTimeStep(bool isFixedTimestep) { m_isFixedTimeStep = isFixedTimestep; }
 
     // Set how often to call Update when in fixed timestep mode.
-    void SetTargetElapsedTicks(UINT64 targetElapsed) { m_targetElapsedTicks = targetElapsed; }
+    void SetTargetElapsedTicks(uint64_t targetElapsed) { m_targetElapsedTicks = targetElapsed; }
     void SetTargetElapsedSeconds(double targetElapsed) { m_targetElapsedTicks = SecondsToTicks(targetElapsed); }
 
     // Integer format represents time using 10,000,000 ticks per second.
-    static const UINT64 TicksPerSecond = 10000000;
+    static constexpr uint64_t TicksPerSecond = 10000000;
 
-    static double TicksToSeconds(UINT64 ticks) { return static_cast<double>(ticks) / TicksPerSecond; }
-    static UINT64 SecondsToTicks(double seconds) { return static_cast<UINT64>(seconds * TicksPerSecond); }
+    static double TicksToSeconds(uint64_t ticks) { return static_cast<double>(ticks) / TicksPerSecond; }
+    static uint64_t SecondsToTicks(double seconds) { return static_cast<uint64_t>(seconds * TicksPerSecond); }
 
     // After an intentional timing discontinuity (for instance a blocking IO operation)
     // call this to avoid having the fixed timestep logic attempt a set of catch-up 
@@ -66,12 +97,12 @@ public:
 
     void ResetElapsedTime()
     {
-        QueryPerformanceCounter(&m_qpcLastTime);
+        m_clockLastTime = Clock::now();
 
         m_leftOverTicks = 0;
         m_framesPerSecond = 0;
         m_framesThisSecond = 0;
-        m_qpcSecondCounter = 0;
+        m_clockSecondCounter = 0;
     }
 
     typedef void(*LPUPDATEFUNC) (void);
@@ -80,29 +111,34 @@ public:
     void Tick(LPUPDATEFUNC update = nullptr)
     {
         // Query the current time.
-        LARGE_INTEGER currentTime;
+        const Clock::time_point currentTime = Clock::now();
+        const uint64_t timeDelta = static_cast<uint64_t>((currentTime - m_clockLastTime).count());
+        m_clockLastTime = currentTime;
 
-        QueryPerformanceCounter(&currentTime);
+        Tick(timeDelta, update);
+    }
 
-        UINT64 timeDelta = currentTime.QuadPart - m_qpcLastTime.QuadPart;
+    // Same as Tick(), with the time since the previous call measured by the caller, in
+    // Clock::duration units. Lets simulations drive the timer deterministically.
+    void Tick(uint64_t timeDelta, LPUPDATEFUNC update)
+    {
+        m_clockSecondCounter += timeDelta;
 
-        m_qpcLastTime = currentTime;
-        m_qpcSecondCounter += timeDelta;
+        // Record the frame time before the clamp below; the long frames are the interesting ones.
+        const uint32_t windowTickCount = m_windowTickCount.load(std::memory_order_relaxed);
+        m_window[windowTickCount & (WindowSize - 1)].store(ClockToTicks(timeDelta), std::memory_order_relaxed);
+        m_windowTickCount.store(windowTickCount + 1, std::memory_order_release);
 
         // Clamp excessively large time deltas (e.g. after paused in the debugger).
-        if (timeDelta > m_qpcMaxDelta)
+        if (timeDelta > m_clockMaxDelta)
         {
-            timeDelta = m_qpcMaxDelta;
+            timeDelta = m_clockMaxDelta;
         }
 
-        // We now have the elapsed number of ticks, along with the number of ticks-per-second. 
-        // We use these values to convert to the number of elapsed microseconds.
-        // To guard against loss-of-precision, we convert to microseconds *before* dividing by ticks-per-second.
-        // This cannot overflow due to the previous clamp.
-        timeDelta *= TicksPerSecond;
-        timeDelta /= m_qpcFrequency.QuadPart;
+        // Convert to the canonical tick format. This cannot overflow due to the previous clamp.
+        timeDelta = ClockToTicks(timeDelta);
 
-        UINT32 lastFrameCount = m_frameCount;
+        uint32_t lastFrameCount = m_frameCount;
 
         if (m_isFixedTimeStep)
         {
@@ -115,7 +151,7 @@ public:
             // accumulate enough tiny errors that it would drop a frame. It is better to just round 
             // small deviations down to zero to leave things running smoothly.
 
-            if (abs(static_cast<int>(timeDelta - m_targetElapsedTicks)) < TicksPerSecond / 4000)
+            if (std::abs(static_cast<int64_t>(timeDelta - m_targetElapsedTicks)) < static_cast<int64_t>(TicksPerSecond / 4000))
             {
                 timeDelta = m_targetElapsedTicks;
             }
@@ -155,32 +191,48 @@ public:
             m_framesThisSecond++;
         }
 
-        if (m_qpcSecondCounter >= static_cast<UINT64>(m_qpcFrequency.QuadPart))
+        const uint64_t clockFrequency = static_cast<uint64_t>(Clock::period::den / Clock::period::num);
+        if (m_clockSecondCounter >= clockFrequency)
         {
             m_framesPerSecond = m_framesThisSecond;
             m_framesThisSecond = 0;
-            m_qpcSecondCounter %= m_qpcFrequency.QuadPart;
+            m_clockSecondCounter %= clockFrequency;
         }
     }
 
 private:
-    // Source timing data uses QPC units.
-    LARGE_INTEGER m_qpcFrequency;
-    LARGE_INTEGER m_qpcLastTime;
-    UINT64 m_qpcMaxDelta;
+    static uint64_t ClockToTicks(uint64_t clockDelta)
+    {
+        // Clock::period is a ratio of seconds. Whole seconds and the remainder are converted
+        // separately so that long pauses cannot overflow.
+        const uint64_t den = static_cast<uint64_t>(Clock::period::den);
+        const uint64_t num = static_cast<uint64_t>(Clock::period::num);
+        return clockDelta / den * num * TicksPerSecond + clockDelta % den * num * TicksPerSecond / den;
+    }
+
+    // Source timing data uses Clock units.
+    Clock::time_point m_clockLastTime;
+    uint64_t m_clockMaxDelta;
 
     // Derived timing data uses a canonical tick format.
-    UINT64 m_elapsedTicks;
-    UINT64 m_totalTicks;
-    UINT64 m_leftOverTicks;
+    uint64_t m_elapsedTicks;
+    uint64_t m_totalTicks;
+    uint64_t m_leftOverTicks;
 
     // Members for tracking the framerate.
-    UINT32 m_frameCount;
-    UINT32 m_framesPerSecond;
-    UINT32 m_framesThisSecond;
-    UINT64 m_qpcSecondCounter;
+    uint32_t m_frameCount;
+    uint32_t m_framesPerSecond;
+    uint32_t m_framesThisSecond;
+    uint64_t m_clockSecondCounter;
 
     // Members for configuring fixed timestep mode.
     bool m_isFixedTimeStep;
-    UINT64 m_targetElapsedTicks;
+    uint64_t m_targetElapsedTicks;
+
+    // Rolling window of frame times in ticks, written by Tick() only.
+    std::atomic<uint64_t> m_window[WindowSize];
+    std::atomic<uint32_t> m_windowTickCount;
 };
+
+// Drive a StepTimer with synthetic frame times and check its statistics against exact ones.
+bool VerifyStepTimer();
@@ -0,0 +1,64 @@
+#pragma once
+
+// Lock-free single-producer, single-consumer triple buffer.
+//
+// The producer fills its back slot and publishes it, the consumer takes the newest
+// published slot. Neither side ever waits: the third slot sits between them and is
+// swapped with an atomic exchange, so the consumer always reads a complete value and
+// the producer can run ahead and overwrite values nobody looked at. Slots are reused,
+// so a T holding vectors sized once never allocates after warm-up.
+// No Windows dependency.
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() :
+		m_back(0),
+		m_middle(1),
+		m_front(2)
+	{
+	}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// Every slot, e.g. to size them up front. Only before the producer and consumer start.
+	T& GetSlot(uint32_t index) { return m_slots[index]; }
+	static constexpr uint32_t GetSlotCount() { return 3; }
+
+	// Producer: the slot to fill next. Its content is whatever was published there before.
+	T& GetWriteBuffer() { return m_slots[m_back]; }
+
+	// Producer: make the write buffer the newest value and get another one to fill.
+	void Publish()
+	{
+		m_back = m_middle.exchange(m_back | FreshBit, std::memory_order_acq_rel) & IndexMask;
+	}
+
+	// Consumer: the newest published value. It stays untouched until the next call.
+	// Returns false, along with the previous value, if nothing was published since.
+	bool Acquire(const T*& pValue)
+	{
+		bool fresh = false;
+		if (m_middle.load(std::memory_order_relaxed) & FreshBit)
+		{
+			m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+			fresh = true;
+		}
+		pValue = &m_slots[m_front];
+		return fresh;
+	}
+
+private:
+	static const uint32_t IndexMask = 3;
+	static const uint32_t FreshBit = 4;
+
+	T m_slots[3];
+	uint32_t m_back;					// Owned by the producer
+	std::atomic<uint32_t> m_middle;		// Slot index, plus FreshBit while unread
+	uint32_t m_front;					// Owned by the consumer
+};
@@ -0,0 +1,221 @@
+#include "UploadService.h"
+#include "UploadCopy.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+
+UploadService::UploadService(CopyQueue& queue) :
+	m_queue(queue),
+	m_staging(queue.GetStagingData(), 0, queue.GetStagingCapacity()),
+	m_maxPieceSize((std::max)(queue.GetStagingCapacity() / 4 & ~(StagingAlignment - 1), StagingAlignment)),
+	m_nextFenceValue(queue.GetFence().GetCompletedValue() + 1),
+	m_pendingCopies(0),
+	m_batchCount(0),
+	m_uploadedBytes(0)
+{
+}
+
+uint64_t UploadService::Upload(void* pDestination, uint64_t destinationOffset, const void* pData, uint64_t size)
+{
+	// Nothing to copy: complete as soon as everything before it.
+	if (size == 0)
+	{
+		return GetSubmittedValue();
+	}
+
+	TimelineFence& fence = m_queue.GetFence();
+	const uint8_t* pSource = static_cast<const uint8_t*>(pData);
+
+	while (size > 0)
+	{
+		const uint64_t pieceSize = (std::min)(size, m_maxPieceSize);
+
+		m_staging.Reclaim(fence.GetCompletedValue());
+		UploadAllocation allocation;
+		while (!m_staging.TryAllocate(pieceSize, StagingAlignment, allocation))
+		{
+			// Out of staging memory: submit what is staged so far and wait for the oldest batch.
+			Flush();
+			if (m_staging.GetOldestFenceValue() == 0)
+			{
+				throw std::exception();
+			}
+			fence.WaitCPU(m_staging.GetOldestFenceValue());
+			m_staging.Reclaim(fence.GetCompletedValue());
+		}
+
+		UploadCopy(allocation.cpuAddress, pSource, static_cast<size_t>(pieceSize));
+		m_queue.CopyBuffer(pDestination, destinationOffset, allocation.offset, pieceSize);
+		m_pendingCopies++;
+		m_uploadedBytes += pieceSize;
+
+		pSource += pieceSize;
+		destinationOffset += pieceSize;
+		size -= pieceSize;
+	}
+
+	// The last piece goes with the batch being recorded, and batches complete in order.
+	return m_nextFenceValue;
+}
+
+uint64_t UploadService::Flush()
+{
+	if (m_pendingCopies > 0)
+	{
+		m_queue.Execute(m_nextFenceValue);
+		m_staging.EndFrame(m_nextFenceValue);
+
+		m_nextFenceValue++;
+		m_pendingCopies = 0;
+		m_batchCount++;
+	}
+	return GetSubmittedValue();
+}
+
+void UploadService::WaitCPU(uint64_t ticket)
+{
+	if (ticket > GetSubmittedValue())
+	{
+		Flush();
+	}
+	m_queue.GetFence().WaitCPU(ticket);
+	m_staging.Reclaim(m_queue.GetFence().GetCompletedValue());
+}
+
+CpuCopyQueue::CpuCopyQueue(uint64_t stagingCapacity, uint32_t maxDelay) :
+	m_staging(stagingCapacity),
+	m_maxDelay(maxDelay),
+	m_stop(false),
+	m_thread(&CpuCopyQueue::Run, this)
+{
+}
+
+CpuCopyQueue::~CpuCopyQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_condition.notify_all();
+	m_thread.join();
+}
+
+void CpuCopyQueue::CopyBuffer(void* pDestination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size)
+{
+	m_recording.push_back({ static_cast<uint8_t*>(pDestination) + destinationOffset, stagingOffset, size });
+}
+
+void CpuCopyQueue::Execute(uint64_t fenceValue)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_batches.push_back({ std::move(m_recording), fenceValue });
+	}
+	m_recording.clear();
+	m_condition.notify_all();
+}
+
+void CpuCopyQueue::Run()
+{
+	uint32_t random = 0x2545F491u;
+	for (;;)
+	{
+		Batch batch;
+		{
+			// Batches submitted before the destructor still execute.
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this] { return m_stop || !m_batches.empty(); });
+			if (m_batches.empty())
+			{
+				return;
+			}
+			batch = std::move(m_batches.front());
+			m_batches.pop_front();
+		}
+
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		for (uint32_t spin = m_maxDelay ? random % m_maxDelay : 0; spin > 0; spin--)
+		{
+			std::this_thread::yield();
+		}
+
+		for (const Copy& copy : batch.copies)
+		{
+			memcpy(copy.pDestination, m_staging.data() + copy.stagingOffset, static_cast<size_t>(copy.size));
+		}
+		m_fence.Signal(batch.fenceValue);
+	}
+}
+
+bool VerifyUploadService()
+{
+	// A quarter of the ring is 1 KB, so every fifth buffer goes in pieces and some do not
+	// fit in the ring at all.
+	CpuCopyQueue queue(4096, 64);
+	UploadService service(queue);
+
+	struct Buffer
+	{
+		std::vector<uint8_t> source;
+		std::vector<uint8_t> destination;
+		uint64_t offset;
+		uint64_t ticket;
+	};
+
+	// Data in place, and the bytes in front of it untouched.
+	auto holdsData = [](const Buffer& buffer)
+	{
+		return std::all_of(buffer.destination.begin(), buffer.destination.begin() + buffer.offset, [](uint8_t value) { return value == 0; }) &&
+			std::equal(buffer.source.begin(), buffer.source.end(), buffer.destination.begin() + buffer.offset);
+	};
+
+	std::vector<Buffer> buffers(300);
+	uint64_t totalBytes = 0;
+	uint32_t seed = 1;
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		const size_t size = i % 5 == 4 ? 1000 + (seed >> 8) % 9000 : (seed >> 8) % 600;
+
+		Buffer& buffer = buffers[i];
+		buffer.offset = (seed >> 4) % 64;
+		buffer.source.resize(size);
+		for (size_t j = 0; j < size; j++)
+		{
+			buffer.source[j] = static_cast<uint8_t>(i * 31 + j * 7 + 1);
+		}
+		buffer.destination.assign(buffer.offset + size, 0);
+
+		buffer.ticket = service.Upload(buffer.destination.data(), buffer.offset, buffer.source.data(), size);
+		totalBytes += size;
+
+		// Load batches of a dozen or so buffers, as a level would.
+		if (i % 13 == 12)
+		{
+			service.Flush();
+		}
+
+		// Whatever a ticket reports complete must already be there.
+		const Buffer& earlier = buffers[(seed >> 12) % (i + 1)];
+		if (service.IsComplete(earlier.ticket) && !holdsData(earlier))
+		{
+			return false;
+		}
+	}
+
+	// Batches complete in order, so the last ticket covers every buffer.
+	service.WaitCPU(buffers.back().ticket);
+	for (const Buffer& buffer : buffers)
+	{
+		if (!service.IsComplete(buffer.ticket) || !holdsData(buffer))
+		{
+			return false;
+		}
+	}
+
+	return service.GetUploadedBytes() == totalBytes && service.GetBatchCount() > 1 && service.GetBatchCount() < buffers.size() &&
+		service.Flush() == service.GetSubmittedValue();
+}
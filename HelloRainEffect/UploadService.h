@@ -0,0 +1,138 @@
+#pragma once
+
+// Uploads of static buffers to GPU-local memory through a dedicated copy queue.
+//
+// Upload heaps are read over the bus on every access, so data that does not change
+// belongs in a DEFAULT heap, which the CPU cannot write. UploadService stages the data
+// in a ring of upload memory and records a copy into the destination; copies are
+// batched and go out together on Flush(), or earlier when the staging ring runs out.
+// Every batch signals the copy queue's fence with its own value, and the staging
+// memory of a batch returns to the ring once the fence passes it.
+//
+// Upload() returns that fence value as a ticket: the data is in place once the fence
+// reaches it. On D3D12 the graphics queue waits for it on the GPU
+// (D3D12CopyQueue::WaitGPU()), so the CPU never blocks on a load. Buffers are created
+// in the COMMON state: the copy queue promotes them to COPY_DEST, they decay back once
+// the batch completes, and the graphics queue promotes them to whatever read state it
+// uses them in, so no barrier is needed on either queue.
+//
+// The service only talks to a CopyQueue. D3D12CopyQueue executes the copies with
+// CopyBufferRegion(), CpuCopyQueue below with memcpy on a thread standing in for the
+// GPU, so the batching and the staging reuse run headless on Linux. Not thread safe:
+// one thread uploads.
+
+#include "TimelineFence.h"
+#include "UploadRing.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CopyQueue
+{
+public:
+	virtual ~CopyQueue() = default;
+
+	// Staging memory the service writes the data to, persistently mapped.
+	virtual uint8_t* GetStagingData() = 0;
+	virtual uint64_t GetStagingCapacity() const = 0;
+
+	// Record a copy of size bytes at stagingOffset into the destination. What
+	// pDestination points to is up to the backend: an ID3D12Resource for
+	// D3D12CopyQueue, the first byte of the destination for CpuCopyQueue.
+	virtual void CopyBuffer(void* pDestination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size) = 0;
+
+	// Submit the copies recorded since the last call, then signal the fence to fenceValue.
+	virtual void Execute(uint64_t fenceValue) = 0;
+
+	virtual TimelineFence& GetFence() = 0;
+};
+
+class UploadService
+{
+public:
+	// Staging offsets stay aligned for the vector stores of UploadCopy().
+	static constexpr uint64_t StagingAlignment = 16;
+
+	explicit UploadService(CopyQueue& queue);
+
+	// Stage size bytes for the destination at destinationOffset and return the fence value
+	// that marks them copied. Data larger than a quarter of the staging ring goes in
+	// pieces, so one piece can be written while the previous ones are copied.
+	uint64_t Upload(void* pDestination, uint64_t destinationOffset, const void* pData, uint64_t size);
+
+	// Submit the copies staged since the last call, if any. Returns the fence value of the
+	// last batch submitted, 0 if there was none yet.
+	uint64_t Flush();
+
+	bool IsComplete(uint64_t ticket) const { return m_queue.GetFence().IsComplete(ticket); }
+
+	// Block until the copies of ticket are done, submitting them first if needed.
+	void WaitCPU(uint64_t ticket);
+
+	uint64_t GetSubmittedValue() const { return m_nextFenceValue - 1; }
+	uint32_t GetBatchCount() const { return m_batchCount; }
+	uint64_t GetUploadedBytes() const { return m_uploadedBytes; }
+
+private:
+	CopyQueue& m_queue;
+	UploadRing m_staging;
+	uint64_t m_maxPieceSize;
+	uint64_t m_nextFenceValue;		// Value the batch being recorded will signal
+	uint32_t m_pendingCopies;
+	uint32_t m_batchCount;
+	uint64_t m_uploadedBytes;
+};
+
+// CopyQueue whose copies a worker thread executes in submission order, waiting a
+// pseudo-random while before each batch so the uploading thread runs ahead of it.
+class CpuCopyQueue : public CopyQueue
+{
+public:
+	CpuCopyQueue(uint64_t stagingCapacity, uint32_t maxDelay);
+	~CpuCopyQueue() override;
+
+	CpuCopyQueue(const CpuCopyQueue&) = delete;
+	CpuCopyQueue& operator=(const CpuCopyQueue&) = delete;
+
+	uint8_t* GetStagingData() override { return m_staging.data(); }
+	uint64_t GetStagingCapacity() const override { return m_staging.size(); }
+	void CopyBuffer(void* pDestination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size) override;
+	void Execute(uint64_t fenceValue) override;
+	TimelineFence& GetFence() override { return m_fence; }
+
+private:
+	struct Copy
+	{
+		uint8_t* pDestination;
+		uint64_t stagingOffset;
+		uint64_t size;
+	};
+
+	struct Batch
+	{
+		std::vector<Copy> copies;
+		uint64_t fenceValue;
+	};
+
+	void Run();
+
+	std::vector<uint8_t> m_staging;
+	uint32_t m_maxDelay;
+	CpuTimelineFence m_fence;
+	std::vector<Copy> m_recording;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::deque<Batch> m_batches;
+	bool m_stop;
+	std::thread m_thread;
+};
+
+// Upload a few hundred buffers of mixed sizes, some larger than the staging ring,
+// through a small CpuCopyQueue. Returns false if a destination does not end up with its
+// data, if a ticket reports a copy complete before it is, or if nothing was batched.
+bool VerifyUploadService();
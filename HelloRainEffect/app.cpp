@@ -3,6 +3,12 @@
 #include "app.h"
 #include "platform_win32.h"
 #include "DXSampleHelper.h"
+#include "BillboardMath.h"
+#include "UploadCopy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 
 platform plat;
 
@@ -14,24 +20,53 @@ app::app(UINT width, UINT height, std::wstring name, HINSTANCE hInstance, int nC
 	m_constantDataGpuAddr(0),
 	m_mappedConstantData(nullptr),
 	m_rtvDescriptorSize(0),
-	m_frameIndex(0),
+	m_billboardMode(BillboardMode::GeometryShader),
+	m_vertexFormat(VertexFormat::Full),
+	m_particleStride(sizeof(Vertex)),
+	m_particleQuantization{},
+	m_backBufferIndex(0),
 	m_frameCounter(0),
-	m_fenceEvent(nullptr),
-	m_fenceValues{},
+	m_framesInFlight(c_defaultFramesInFlight),
 	m_curRotationAngRad(0),
 	m_worldMatrix{},
 	m_viewMatrix{},
 	m_projectionMatrix{},
 	m_outputColor{},
 	m_cameraWPos{},
-	m_streamOutputBufferView{},
-	m_pFilledSize(nullptr)
+	m_streamOutputBufferViews{},
+	m_streamVertexBufferViews{},
+	m_streamReadIndex(0),
+	m_filledSizeReadback(c_filledSizeReadbackSlots),
+	m_streamVertexCount(0),
+	m_simulationBackend(SimulationBackend::GpuStreamOutput),
+	m_pCpuVertexData(nullptr),
+	m_particleCapacity(c_defaultParticleCapacity),
+	m_frameParticleCount(0),
+	m_jobThreadCount(0),
+	m_pCpuFrameVertices(nullptr),
+	m_cullParticles(false),
+	m_sortParticles(false),
+	m_pDrawParticles(nullptr),
+	m_useSimulationThread(false),
+	m_simulationRate(c_defaultSimulationRate),
+	m_pSnapshot(nullptr),
+	m_interpolationAlpha(0.f),
+	m_pDrawSimulator(nullptr),
+	m_pDrawHandles(nullptr),
+	m_spawnRateSteps(0),
+	m_benchmark(false),
+	m_syncInterval(1),
+	m_presentFlags(0),
+	m_lastPresentTime(0),
+	m_frameWaitBegin(0),
+	m_occluded(false)
 {
 	plat = platform(width, height, name, hInstance, nCmdShow, this);
 
 	WCHAR assetsPath[512];
 	GetAssetsPath(assetsPath, _countof(assetsPath));
 	m_assetsPath = assetsPath;
+	m_frameTimesPath = GetAssetFullPath(L"frametimes.txt");
 
 	m_aspectRatio = static_cast<float>(width) / static_cast<float>(height);
 
@@ -41,8 +76,9 @@ app::app(UINT width, UINT height, std::wstring name, HINSTANCE hInstance, int nC
 	static const XMVECTOR c_at = {0.f, 0.f, 0.f, 0.f};
 	static const XMVECTOR c_up = {0.f, 1.f, 0.f, 0.f};
 	m_viewMatrix = XMMatrixLookAtLH(c_eye, c_at, c_up);
+	m_cameraWPos = c_eye;
 	
-	m_projectionMatrix = XMMatrixPerspectiveFovLH(XM_PIDIV4, m_aspectRatio, .01f, 100.f);
+	m_projectionMatrix = XMMatrixPerspectiveFovLH(XM_PIDIV4, m_aspectRatio, c_nearPlane, c_farPlane);
 
 	m_outputColor = XMVectorSet(0.f, 0.f, 0.f, 0.f);
 }
@@ -51,6 +87,93 @@ app::~app()
 
 }
 
+_Use_decl_annotations_
+void app::ParseCommandLineArgs(WCHAR* argv[], int argc)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (_wcsnicmp(argv[i], L"-cpu", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/cpu", wcslen(argv[i])) == 0)
+		{
+			m_simulationBackend = SimulationBackend::Cpu;
+		}
+		else if (_wcsnicmp(argv[i], L"-simthread", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/simthread", wcslen(argv[i])) == 0)
+		{
+			// Only the CPU backend has a simulation to move off the main thread.
+			m_simulationBackend = SimulationBackend::Cpu;
+			m_useSimulationThread = true;
+		}
+		else if ((_wcsnicmp(argv[i], L"-simrate", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/simrate", wcslen(argv[i])) == 0) && i + 1 < argc)
+		{
+			const double rate = _wtof(argv[++i]);
+			m_simulationRate = rate > 0. ? rate : c_defaultSimulationRate;
+		}
+		else if (_wcsnicmp(argv[i], L"-vsbillboard", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/vsbillboard", wcslen(argv[i])) == 0)
+		{
+			m_billboardMode = BillboardMode::VertexShader;
+		}
+		else if (_wcsnicmp(argv[i], L"-sort", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/sort", wcslen(argv[i])) == 0)
+		{
+			m_sortParticles = true;
+		}
+		else if (_wcsnicmp(argv[i], L"-cull", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/cull", wcslen(argv[i])) == 0)
+		{
+			m_cullParticles = true;
+		}
+		else if (_wcsnicmp(argv[i], L"-compact", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/compact", wcslen(argv[i])) == 0)
+		{
+			m_vertexFormat = VertexFormat::Compact;
+			m_particleStride = sizeof(CompactParticleVertex);
+		}
+		else if ((_wcsnicmp(argv[i], L"-threads", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/threads", wcslen(argv[i])) == 0) && i + 1 < argc)
+		{
+			m_jobThreadCount = static_cast<unsigned int>(_wtoi(argv[++i]));
+		}
+		else if ((_wcsnicmp(argv[i], L"-particles", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/particles", wcslen(argv[i])) == 0) && i + 1 < argc)
+		{
+			const __int64 capacity = _wtoi64(argv[++i]);
+			m_particleCapacity = capacity > 0 ? static_cast<size_t>(capacity) : c_defaultParticleCapacity;
+		}
+		else if ((_wcsnicmp(argv[i], L"-framesinflight", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/framesinflight", wcslen(argv[i])) == 0) && i + 1 < argc)
+		{
+			// Clamped to [1, FrameContextRing::MaxFrameCount] when the frame contexts are created.
+			const int framesInFlight = _wtoi(argv[++i]);
+			m_framesInFlight = framesInFlight > 0 ? static_cast<UINT>(framesInFlight) : c_defaultFramesInFlight;
+		}
+		else if ((_wcsnicmp(argv[i], L"-latency", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/latency", wcslen(argv[i])) == 0) && i + 1 < argc)
+		{
+			// SetMaximumFrameLatency accepts 1 to DXGI_MAX_SWAP_CHAIN_BUFFERS.
+			const int latency = _wtoi(argv[++i]);
+			m_framePacerDesc.maxFrameLatency = static_cast<uint32_t>((std::min)((std::max)(latency, 1), DXGI_MAX_SWAP_CHAIN_BUFFERS));
+		}
+		else if (_wcsnicmp(argv[i], L"-waitinpresent", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/waitinpresent", wcslen(argv[i])) == 0)
+		{
+			m_framePacerDesc.mode = FramePacingMode::BlockInPresent;
+		}
+		else if (_wcsnicmp(argv[i], L"-benchmark", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/benchmark", wcslen(argv[i])) == 0)
+		{
+			m_benchmark = true;
+		}
+		else if ((_wcsnicmp(argv[i], L"-frametimes", wcslen(argv[i])) == 0 ||
+			_wcsnicmp(argv[i], L"/frametimes", wcslen(argv[i])) == 0) && i + 1 < argc)
+		{
+			m_frameTimesPath = argv[++i];
+		}
+	}
+}
+
 void app::OnInit() 
 {
 	app::LoadPipeline();
@@ -60,57 +183,306 @@ void app::OnInit()
 
 void app::Run() 
 {
-	MSG msg = { 0 };
-
-	while (msg.message != WM_QUIT)
+	Win32LoopPlatform loopPlatform(m_frameLatencySignal ? m_frameLatencySignal->GetHandle() : nullptr);
+	GameLoop loop(loopPlatform, m_frameClock, m_presentState, [this](int64_t waitBegin)
 	{
-		int wParam = plat.PlatMessageDispatch(msg);
-	}
+		m_frameWaitBegin = waitBegin;
+		OnUpdate();
+		OnRender();
+		return !m_occluded;
+	},
+	[this]()
+	{
+		// Asks whether a present would be visible without presenting anything.
+		const HRESULT testResult = m_swapChain->Present(0, DXGI_PRESENT_TEST);
+		ThrowIfFailed(testResult);
+		return testResult != DXGI_STATUS_OCCLUDED;
+	});
+	loop.SetIdleHandler([this](bool idle)
+	{
+		if (idle)
+		{
+			// Frames stopped after MoveToNextFrame(), so the frame contexts, fence and back
+			// buffer index are simply picked up again later. The simulation has no one to show
+			// its steps to meanwhile.
+			if (m_simulationThread)
+			{
+				m_simulationThread->Stop();
+			}
+			return;
+		}
+
+		// Neither the simulation nor the statistics catch up on the time spent hidden.
+		m_timer.ResetElapsedTime();
+		m_lastPresentTime = 0;
+		if (m_simulationThread)
+		{
+			m_simulationThread->Start();
+		}
+	});
+	loop.Run();
 }
 
 void app::OnUpdate() 
 {
+	// The game loop already waited for room in the display queue; nothing of this frame was sampled before.
+	m_framePacer->BeginFrame(m_frameWaitBegin);
+
 	m_timer.Tick(NULL);
 
 	if (m_frameCounter++ % 30 == 0)
 	{
 		// Update window text with FPS value.
-		wchar_t fps[64];
-		swprintf_s(fps, L"%ufps", m_timer.GetFramesPerSecond());
+		wchar_t fps[384];
+		if (m_simulationBackend == SimulationBackend::Cpu)
+		{
+			swprintf_s(fps, L"%ufps (cpu %hs, %u/%zu particles)", m_timer.GetFramesPerSecond(), SimdLevelName(m_particleSystem->Simulator().GetSimdLevel()),
+				m_frameParticleCount, m_particleSystem->Capacity());
+			if (m_cullParticles)
+			{
+				const ParticleCuller::Stats& cullStats = m_particleCuller.GetStats();
+				const size_t length = wcslen(fps);
+				swprintf_s(fps + length, _countof(fps) - length, L" visible %zu, frustum culled %zu, lod culled %zu",
+					cullStats.visible, cullStats.frustumCulled, cullStats.lodCulled);
+			}
+		}
+		else
+		{
+			swprintf_s(fps, L"%ufps", m_timer.GetFramesPerSecond());
+		}
+
+		// Average FPS hides stutters; show the spread of the recent frame times as well.
+		const FrameTimeStats frameTimeStats = m_timer.GetFrameTimeStats();
+		size_t length = wcslen(fps);
+		swprintf_s(fps + length, _countof(fps) - length, L" frame %.1f/%.1f/%.1fms p99 %.1fms jitter %.2fms",
+			frameTimeStats.min * 1e3, frameTimeStats.mean * 1e3, frameTimeStats.max * 1e3, frameTimeStats.p99 * 1e3, frameTimeStats.jitter * 1e3);
+
+		const FramePacer::Stats pacerStats = m_framePacer->GetStats();
+		length = wcslen(fps);
+		swprintf_s(fps + length, _countof(fps) - length, L" [latency %u: wait %.1fms, input->present %.1fms]",
+			m_framePacerDesc.maxFrameLatency, pacerStats.waitMs, pacerStats.inputToPresentMs);
+		if (m_benchmark)
+		{
+			const size_t benchmarkLength = wcslen(fps);
+			swprintf_s(fps + benchmarkLength, _countof(fps) - benchmarkLength, L" run p99 %.2fms",
+				m_frameTimes.GetValueAtPercentile(99.) * 1e-6);
+		}
 		plat.SetCustomWindowText(fps);
 	}
+
+	if (m_simulationBackend == SimulationBackend::Cpu)
+	{
+		if (m_simulationThread)
+		{
+			// The simulation thread owns the pool; draw its newest snapshot, one step in the past.
+			m_pSnapshot = &m_simulationThread->AcquireLatest();
+			m_interpolationAlpha = m_simulationThread->GetInterpolationAlpha(*m_pSnapshot);
+			m_frameParticleCount = static_cast<UINT>(m_pSnapshot->count);
+			m_pDrawSimulator = &m_renderParticles;
+			m_pDrawHandles = m_pSnapshot->handles.data();
+		}
+		else
+		{
+			const float deltaTime = static_cast<float>(m_timer.GetElapsedSeconds());
+
+			// Spawning and killing compacts the alive particles, so it runs before the parallel part.
+			ApplySpawnRateSteps(*m_particleSystem);
+			m_particleSystem->Update(deltaTime);
+			m_particleStepParams = m_particleSystem->StepParams(deltaTime);
+			m_frameParticleCount = static_cast<UINT>(m_particleSystem->AliveCount());
+			m_pDrawSimulator = &m_particleSystem->Simulator();
+			m_pDrawHandles = m_particleSystem->Handles();
+		}
+
+		// MoveToNextFrame() already waited for the GPU to release this frame's slice of the upload buffer.
+		const size_t sliceSize = m_particleSystem->Capacity() * m_particleStride;
+		m_pCpuFrameVertices = m_pCpuVertexData + m_frameContexts.GetCurrent().UploadOffset(sliceSize);
+
+		if (m_cullParticles || m_sortParticles)
+		{
+			// Culling and sorting look at the new positions, so only the gather overlaps the recording.
+			const ParticleSimulator& simulator = *m_pDrawSimulator;
+			m_jobSystem->ParallelFor(0, m_frameParticleCount, c_particleChunkSize, [this](size_t begin, size_t end)
+			{
+				AdvanceParticles(begin, end);
+			});
+
+			const XMMATRIX worldView = XMMatrixMultiply(m_worldMatrix, m_viewMatrix);
+			XMFLOAT4X4 worldViewRows;
+			XMStoreFloat4x4(&worldViewRows, worldView);
+
+			// Null until culled: the sorter then takes every alive particle.
+			const uint32_t* pDrawParticles = nullptr;
+			size_t drawCount = m_frameParticleCount;
+
+			if (m_cullParticles)
+			{
+				XMFLOAT4X4 worldViewProjection;
+				XMStoreFloat4x4(&worldViewProjection, XMMatrixMultiply(worldView, m_projectionMatrix));
+
+				ParticleCullParams cullParams;
+				ExtractFrustumPlanes(worldViewProjection.m, cullParams.planes);
+				for (int i = 0; i < 4; i++)
+				{
+					cullParams.depthAxis[i] = worldViewRows.m[i][2];
+				}
+				cullParams.lodStart = c_lodStartDepth;
+				cullParams.lodEnd = c_lodEndDepth;
+				cullParams.lodMinKeep = c_lodMinKeep;
+
+				drawCount = m_particleCuller.Cull(simulator.Streams(), m_pDrawHandles, drawCount, cullParams, m_jobSystem.get());
+				pDrawParticles = m_particleCuller.VisibleIndices();
+			}
+
+			if (m_sortParticles)
+			{
+				pDrawParticles = m_particleSorter.Sort(simulator.Streams(), pDrawParticles, drawCount, worldViewRows.m, c_nearPlane, c_farPlane, m_jobSystem.get());
+			}
+
+			m_frameParticleCount = static_cast<UINT>(drawCount);
+			m_pDrawParticles = pDrawParticles;
+			m_jobSystem->Spawn(m_frameTasks, 0, m_frameParticleCount, c_particleChunkSize, &app::WriteGatheredParticleChunk, this);
+		}
+		else
+		{
+			// Kick off the update of the alive range; it completes in OnRender() before the command list is submitted.
+			m_jobSystem->Spawn(m_frameTasks, 0, m_frameParticleCount, c_particleChunkSize, &app::SimulateParticleChunk, this);
+		}
+	}
+}
+
+void app::AdvanceParticles(size_t begin, size_t end)
+{
+	if (m_simulationThread)
+	{
+		InterpolateParticles(*m_pSnapshot, m_interpolationAlpha, m_renderParticles.Streams(), begin, end);
+	}
+	else
+	{
+		m_particleSystem->Simulator().StepRange(m_particleStepParams, begin, end);
+	}
+}
+
+void app::ApplySpawnRateSteps(ParticleSystem& system)
+{
+	const int steps = m_spawnRateSteps.exchange(0);
+	if (steps != 0)
+	{
+		EmitterDesc& rain = system.GetEmitter(0);
+		const float maxSpawnRate = c_maxSpawnRateScale * system.Capacity() / c_meanRainFallTime;
+		rain.spawnRate = (std::min)(rain.spawnRate * std::pow(1.25f, static_cast<float>(steps)), maxSpawnRate);
+	}
+}
+
+void app::SimulateParticleChunk(void* context, size_t begin, size_t end)
+{
+	app* pApp = static_cast<app*>(context);
+
+	// Each chunk moves its particles and writes them straight to their final place in the upload buffer.
+	pApp->AdvanceParticles(begin, end);
+	const ParticleSimulator& simulator = *pApp->m_pDrawSimulator;
+	UINT8* pDest = pApp->m_pCpuFrameVertices + begin * pApp->m_particleStride;
+	if (pApp->m_vertexFormat == VertexFormat::Compact)
+	{
+		EncodeCompactVertices(simulator.Streams(), pApp->m_particleQuantization, begin, end, pDest);
+	}
+	else
+	{
+		simulator.WriteVertices(pDest, begin, end);
+	}
+}
+
+void app::WriteGatheredParticleChunk(void* context, size_t begin, size_t end)
+{
+	app* pApp = static_cast<app*>(context);
+
+	// Draw slot i receives the i-th particle of the draw order, compacted from the front of the upload slice.
+	const ParticleSimulator& simulator = *pApp->m_pDrawSimulator;
+	UINT8* pDest = pApp->m_pCpuFrameVertices + begin * pApp->m_particleStride;
+	if (pApp->m_vertexFormat == VertexFormat::Compact)
+	{
+		EncodeCompactVerticesIndexed(simulator.Streams(), pApp->m_pDrawParticles, pApp->m_particleQuantization, begin, end, pDest);
+	}
+	else
+	{
+		simulator.WriteVerticesIndexed(pDest, pApp->m_pDrawParticles, begin, end);
+	}
 }
 void app::OnRender() 
 {
 	// Record all the commands we need to render the scene into the command list.
 	PopulateCommandList();
 
+	// The particle chunks spawned in OnUpdate() must have landed in the upload buffer before the GPU reads it.
+	if (m_jobSystem)
+	{
+		m_jobSystem->Wait(m_frameTasks);
+	}
+
 	// Execute the command list.
 	ID3D12CommandList* ppCommandList[] = { m_commandList.Get() };
 	m_commandQueue->ExecuteCommandLists(_countof(ppCommandList), ppCommandList);
+	m_framePacer->MarkSubmit();
 
 	// Present the frame.
-	ThrowIfFailed(m_swapChain->Present(1, 0));
+	const HRESULT presentResult = m_swapChain->Present(m_syncInterval, m_presentFlags);
+	ThrowIfFailed(presentResult);
+	m_framePacer->MarkPresent();
+
+	// Nothing of the window is visible; the game loop stops producing frames until it is.
+	m_occluded = (presentResult == DXGI_STATUS_OCCLUDED);
+
+	const int64_t presentTime = m_framePacer->GetLastFrame().present;
+	if (m_lastPresentTime != 0)
+	{
+		m_frameTimes.Record(presentTime - m_lastPresentTime);
+	}
+	m_lastPresentTime = presentTime;
 
 	MoveToNextFrame();
 }
 void app::OnDestroy() 
 {
+	if (m_jobSystem)
+	{
+		m_jobSystem->Wait(m_frameTasks);
+	}
+
+	if (m_simulationThread)
+	{
+		m_simulationThread->Stop();
+	}
+
 	WaitForGPU();
 
-	CloseHandle(m_fenceEvent);
+	UnregisterWriteCombined(m_mappedConstantData);
+	UnregisterWriteCombined(m_pCpuVertexData);
+
+	if (m_benchmark)
+	{
+		const std::string report = FormatFrameTimeReport(m_frameTimes);
+		OutputDebugStringA(report.c_str());
+
+		FILE* pFile = nullptr;
+		if (_wfopen_s(&pFile, m_frameTimesPath.c_str(), L"w") == 0 && pFile)
+		{
+			fputs(report.c_str(), pFile);
+			fclose(pFile);
+		}
+	}
 }
 void app::PopulateCommandList() 
 {
 	// Command list allocators can only be reset when the associated 
 	// command lists have finished execution on the GPU; apps should use 
 	// fences to determine GPU execution progress.
-	ThrowIfFailed(m_commandAllocators[m_frameIndex]->Reset());
+	FrameContext& frame = m_frameContexts.GetCurrent();
+	ThrowIfFailed(frame.commandAllocator->Reset());
 
 	// However, when ExecuteCommandList() is called on a particular command 
 	// list, that command list can then be reset at any time and must be before re-recording.
 	// Set PSO for the streaming pass.
-	ThrowIfFailed(m_commandList->Reset(m_commandAllocators[m_frameIndex].Get(), m_streamPipelineState.Get()));
+	ThrowIfFailed(m_commandList->Reset(frame.commandAllocator.Get(), m_streamPipelineState.Get()));
 
 	// Set necessary state.
 	m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
@@ -119,18 +491,18 @@ void app::PopulateCommandList()
 
 	// Index into the available constant buffers based on the number
 	// of draw calls. We've allocated enough for a known number of
-	// draw calls per frame times the number of back buffers
-	unsigned int constantBufferIndex = c_numDrawCalls * (m_frameIndex % FrameCount);
+	// draw calls per frame times the number of frames in flight
+	unsigned int constantBufferIndex = c_numDrawCalls * frame.index;
 
 	// Bind the constants to the shader
-	auto baseGpuAddress = m_constantDataGpuAddr + sizeof(PaddedConstantBuffer) * constantBufferIndex;
+	auto baseGpuAddress = m_constantDataGpuAddr + ConstantBuffer::PlacementSize * constantBufferIndex;
 	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
 
 	// Indicate that the back buffer will be used as a render target.
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_backBufferIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
 
 	// Set render target and depth buffer in OM stage
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart(), m_frameIndex, m_rtvDescriptorSize);
+	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart(), m_backBufferIndex, m_rtvDescriptorSize);
 	CD3DX12_CPU_DESCRIPTOR_HANDLE dsvHandle(m_dsvHeap->GetCPUDescriptorHandleForHeapStart());
 	m_commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, &dsvHandle);
 
@@ -145,90 +517,141 @@ void app::PopulateCommandList()
 	m_commandList->IASetIndexBuffer(&m_indexBufferView);
 
 	// Set the per-frame constants
-	ConstantBuffer cbParameters = {};
+	ConstantBuffer cbParameters;
 
 	// Shaders compiled with default row-major matrices
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(m_worldMatrix));
-	XMStoreFloat4x4(&cbParameters.viewMatrix, XMMatrixTranspose(m_viewMatrix));
-	XMStoreFloat4x4(&cbParameters.projectionMatrix, XMMatrixTranspose(m_projectionMatrix));
-	XMStoreFloat4(&cbParameters.outputColor, m_outputColor);
-	XMStoreFloat3(&cbParameters.cameraWPos, m_cameraWPos);
-	cbParameters.deltaTime = (FLOAT)m_timer.GetElapsedSeconds();
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(m_worldMatrix));
+	XMStoreFloat4x4(&cbParameters.Field<ViewMatrix>(), XMMatrixTranspose(m_viewMatrix));
+	XMStoreFloat4x4(&cbParameters.Field<ProjectionMatrix>(), XMMatrixTranspose(m_projectionMatrix));
+	XMStoreFloat4(&cbParameters.Field<OutputColor>(), m_outputColor);
+	XMStoreFloat3(&cbParameters.Field<CameraWPos>(), m_cameraWPos);
+	cbParameters.Field<DeltaTime>() = (FLOAT)m_timer.GetElapsedSeconds();
+	cbParameters.Field<BoundsMin>() = XMFLOAT4(m_particleQuantization.boundsMin[0], m_particleQuantization.boundsMin[1], m_particleQuantization.boundsMin[2], m_particleQuantization.speedMin);
+	cbParameters.Field<BoundsExtent>() = XMFLOAT4(
+		m_particleQuantization.boundsMax[0] - m_particleQuantization.boundsMin[0],
+		m_particleQuantization.boundsMax[1] - m_particleQuantization.boundsMin[1],
+		m_particleQuantization.boundsMax[2] - m_particleQuantization.boundsMin[2],
+		m_particleQuantization.speedMax - m_particleQuantization.speedMin);
 
 	// Set the constants for the first draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+	UploadCopy(m_mappedConstantData + ConstantBuffer::PlacementSize * constantBufferIndex, cbParameters.GetData(), ConstantBuffer::Size);
 
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamFilledSizeBuffer.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_STREAM_OUT));
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamOutputBuffer.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_STREAM_OUT));
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_updatedVertexBuffer.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER));
+	UINT nVertices = 0;
+	if (m_simulationBackend == SimulationBackend::GpuStreamOutput)
+	{
+		// Read back how much data (in bytes) the SO wrote in the newest streaming pass the GPU has
+		// finished, without waiting for it. The value lags a frame or two behind, which is fine
+		// since the streaming pass emits every particle it is given.
+		const UINT completedSlot = m_filledSizeReadback.Retire(m_fence->GetCompletedValue());
+		if (completedSlot != ReadbackRing::InvalidSlot)
+		{
+			CD3DX12_RANGE readRange(completedSlot * sizeof(UINT64), (completedSlot + 1) * sizeof(UINT64));
+			CD3DX12_RANGE writeRange(0, 0);
+			UINT64* pFilledSizes = nullptr;
+			ThrowIfFailed(m_streamFilledSizeReadBackBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pFilledSizes)));
+			m_streamVertexCount = UINT(pFilledSizes[completedSlot] / m_particleStride);
+			m_streamFilledSizeReadBackBuffer->Unmap(0, &writeRange);
+		}
 
-	// Initialize the filled size buffer to zero
-	*m_pFilledSize = 0;
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamFilledSizeBuffer.Get(), D3D12_RESOURCE_STATE_STREAM_OUT, D3D12_RESOURCE_STATE_COPY_DEST));
-	m_commandList->CopyResource(m_streamFilledSizeBuffer.Get(), m_streamFilledSizeUploadBuffer.Get());
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamFilledSizeBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_STREAM_OUT));
+		// Ping-pong between the two stream output buffers: the one written last frame is the input
+		// of this frame's streaming pass, and the other one receives the result, which is then
+		// drawn directly. Each buffer carries its own filled size counter.
+		const UINT readIndex = m_streamReadIndex;
+		const UINT writeIndex = 1 - readIndex;
+		ID3D12Resource* pStreamBuffer = m_streamOutputBuffers[writeIndex].Get();
+		ID3D12Resource* pFilledSizeBuffer = m_streamFilledSizeBuffers[writeIndex].Get();
 
-	// Set the stream output buffer view
-	D3D12_STREAM_OUTPUT_BUFFER_VIEW streamOutputBufferViews[]{ m_streamOutputBufferView };
-	m_commandList->SOSetTargets(0, _countof(streamOutputBufferViews), streamOutputBufferViews);
+		// Between uses the buffers sit in c_particleReadState and their counters in COPY_SOURCE.
+		D3D12_RESOURCE_BARRIER preStreamBarriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(pStreamBuffer, c_particleReadState, D3D12_RESOURCE_STATE_STREAM_OUT),
+			CD3DX12_RESOURCE_BARRIER::Transition(pFilledSizeBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COPY_DEST)
+		};
+		m_commandList->ResourceBarrier(_countof(preStreamBarriers), preStreamBarriers);
 
-	// Streaming pass
-	// "Draw" the particles to modify their y-coordinate with the help of GS and SO stages
-	m_commandList->DrawInstanced((UINT)particleVertices.size(), 1, 0, 0);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
-	++constantBufferIndex;
+		// Initialize the filled size buffer to zero
+		m_commandList->CopyBufferRegion(pFilledSizeBuffer, 0, m_streamFilledSizeUploadBuffer.Get(), 0, sizeof(UINT64));
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pFilledSizeBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_STREAM_OUT));
 
-	// Copy from the filled size buffer to the read-back buffer, which is CPU-visible.
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamFilledSizeBuffer.Get(), D3D12_RESOURCE_STATE_STREAM_OUT, D3D12_RESOURCE_STATE_COPY_SOURCE));
-	m_commandList->CopyResource(m_streamFilledSizeReadBackBuffer.Get(), m_streamFilledSizeBuffer.Get());
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamFilledSizeBuffer.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_STREAM_OUT));
+		// Set the stream output buffer view
+		m_commandList->SOSetTargets(0, 1, &m_streamOutputBufferViews[writeIndex]);
+		m_commandList->IASetVertexBuffers(0, 1, &m_streamVertexBufferViews[readIndex]);
 
-	// Read from the read-back buffer how much data (in bytes) the SO written to the stream output buffer,
-	// and use this info to compute the number of vertices stored in the stream output buffer.
-	UINT64* pFilledSize = NULL;
-	m_streamFilledSizeReadBackBuffer->Map(0, NULL, reinterpret_cast<void**>(&pFilledSize));
-	UINT nVertices = UINT(*pFilledSize) / sizeof(Vertex);
-	m_streamFilledSizeReadBackBuffer->Unmap(0, NULL);
+		// Streaming pass
+		// "Draw" the particles to modify their y-coordinate with the help of GS and SO stages
+		m_commandList->DrawInstanced((UINT)particleVertices.size(), 1, 0, 0);
+		baseGpuAddress += ConstantBuffer::PlacementSize;
+		++constantBufferIndex;
 
-	// Copy from the stream output buffer to the updated vertex buffer, which contains the particles with the new positions.
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_updatedVertexBuffer.Get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_COPY_DEST));
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamOutputBuffer.Get(), D3D12_RESOURCE_STATE_STREAM_OUT, D3D12_RESOURCE_STATE_COPY_SOURCE));
-	m_commandList->CopyResource(m_updatedVertexBuffer.Get(), m_streamOutputBuffer.Get());
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_updatedVertexBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER));
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamOutputBuffer.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_STREAM_OUT));
+		// Unbind the stream output buffer from the SO
+		m_commandList->SOSetTargets(0, 1, NULL);
 
+		D3D12_RESOURCE_BARRIER postStreamBarriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(pStreamBuffer, D3D12_RESOURCE_STATE_STREAM_OUT, c_particleReadState),
+			CD3DX12_RESOURCE_BARRIER::Transition(pFilledSizeBuffer, D3D12_RESOURCE_STATE_STREAM_OUT, D3D12_RESOURCE_STATE_COPY_SOURCE)
+		};
+		m_commandList->ResourceBarrier(_countof(postStreamBarriers), postStreamBarriers);
 
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamFilledSizeBuffer.Get(), D3D12_RESOURCE_STATE_STREAM_OUT, D3D12_RESOURCE_STATE_COMMON));
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamOutputBuffer.Get(), D3D12_RESOURCE_STATE_STREAM_OUT, D3D12_RESOURCE_STATE_COMMON));
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_updatedVertexBuffer.Get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_COMMON));
+		// Copy from the filled size buffer to this frame's slot of the read-back buffer, which is CPU-visible.
+		// It is only read once this frame's fence has completed, see the top of the streaming pass.
+		const UINT readbackSlot = m_filledSizeReadback.Acquire(m_frameContexts.GetCurrentFenceValue());
+		if (readbackSlot != ReadbackRing::InvalidSlot)
+		{
+			m_commandList->CopyBufferRegion(m_streamFilledSizeReadBackBuffer.Get(), readbackSlot * sizeof(UINT64), pFilledSizeBuffer, 0, sizeof(UINT64));
+		}
 
+		// The rendering pass draws as many vertices as the newest completed streaming pass wrote,
+		// straight from the buffer that was just streamed into.
+		nVertices = m_streamVertexCount;
+		m_vertexBufferView = m_streamVertexBufferViews[writeIndex];
+		m_streamReadIndex = writeIndex;
+	}
+	else
+	{
+		// The particles are moved and written into this frame's slice of the upload buffer by the job system.
+		nVertices = m_frameParticleCount;
+		m_vertexBufferView.BufferLocation = m_cpuVertexBuffer->GetGPUVirtualAddress() + frame.UploadOffset(m_particleSystem->Capacity() * m_particleStride);
+		m_vertexBufferView.SizeInBytes = static_cast<UINT>(m_particleSystem->Capacity() * m_particleStride);
+		++constantBufferIndex;
+	}
 
 	// Set the PSO for drawing points with the help of the GS
 	m_commandList->SetPipelineState(m_pipelineState.Get());
 
 	// Set a half-transparent white color
 	m_outputColor = XMVectorSet(1, 1, 1, 0.5);
-	XMStoreFloat4(&cbParameters.outputColor, m_outputColor);
+	XMStoreFloat4(&cbParameters.Field<OutputColor>(), m_outputColor);
 
 	// Set the constants for the second draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+	UploadCopy(m_mappedConstantData + ConstantBuffer::PlacementSize * constantBufferIndex, cbParameters.GetData(), ConstantBuffer::Size);
 
 	// Bind the constants to the shader
-	baseGpuAddress = m_constantDataGpuAddr + sizeof(PaddedConstantBuffer) * constantBufferIndex;
+	baseGpuAddress = m_constantDataGpuAddr + ConstantBuffer::PlacementSize * constantBufferIndex;
 	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
 
-	// Update the vertex buffer view with the address of the updated vertex buffer
-	m_vertexBufferView.BufferLocation = m_updatedVertexBuffer->GetGPUVirtualAddress();
+	if (m_billboardMode == BillboardMode::GeometryShader)
+	{
+		// Bind the particles to draw
+		m_commandList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
 
-	// Unbind the stream output buffer from the SO
-	m_commandList->SOSetTargets(0, 1, NULL);
+		// Rendering pass
+		// "Draw" the particles with the help of the GS in order to amplify the geometry to a set of quads.
+		m_commandList->DrawInstanced(nVertices, 1, 0, 0);
+	}
+	else
+	{
+		// The vertex shader fetches the particles itself, from the same buffer
+		m_commandList->SetGraphicsRootShaderResourceView(1, m_vertexBufferView.BufferLocation);
 
-	// Rendering pass
-	// "Draw" the particles with the help of the GS in order to amplify the geometry to a set of quads.
-	m_commandList->DrawInstanced(nVertices, 1, 0, 0);
+		// Rendering pass
+		// One 4-vertex strip per particle, expanded to a quad in the vertex shader.
+		m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+		m_commandList->DrawInstanced(4, nVertices, 0, 0);
+	}
 
 	// Indicate that the back buffer will now be used to present.
-	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_backBufferIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
 	ThrowIfFailed(m_commandList->Close());
 }
@@ -282,7 +705,7 @@ void app::LoadPipeline() {
 
 	// Describe and create the swap chain.
 	DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-	swapChainDesc.BufferCount = FrameCount;
+	swapChainDesc.BufferCount = BackBufferCount;
 	swapChainDesc.Width = m_width;
 	swapChainDesc.Height = m_height;
 	swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
@@ -290,6 +713,26 @@ void app::LoadPipeline() {
 	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
 	swapChainDesc.SampleDesc.Count = 1;
 
+	if (m_benchmark)
+	{
+		// Measure throughput: never wait for vsync or for room in the display queue.
+		m_framePacerDesc.mode = FramePacingMode::BlockInPresent;
+		m_syncInterval = 0;
+
+		// Without tearing support a flip model swap chain still caps at the refresh rate in windowed mode.
+		BOOL allowTearing = FALSE;
+		if (SUCCEEDED(factory->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))) && allowTearing)
+		{
+			swapChainDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+			m_presentFlags = DXGI_PRESENT_ALLOW_TEARING;
+		}
+	}
+
+	if (m_framePacerDesc.mode == FramePacingMode::WaitBeforeInput)
+	{
+		swapChainDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	}
+
 	ComPtr<IDXGISwapChain1> swapChain;
 	ThrowIfFailed(factory->CreateSwapChainForHwnd(
 		m_commandQueue.Get(),        // Swap chain needs the queue so that it can force a flush on it.
@@ -304,13 +747,20 @@ void app::LoadPipeline() {
 	ThrowIfFailed(factory->MakeWindowAssociation(plat.GetHwnd(), DXGI_MWA_NO_ALT_ENTER));
 
 	ThrowIfFailed(swapChain.As(&m_swapChain));
-	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+	m_backBufferIndex = m_swapChain->GetCurrentBackBufferIndex();
+
+	// Without the waitable object the queue depth stays at the DXGI default and Present() does the blocking.
+	if (m_framePacerDesc.mode == FramePacingMode::WaitBeforeInput)
+	{
+		m_frameLatencySignal = std::make_unique<DXGIFrameLatencySignal>(m_swapChain.Get(), m_framePacerDesc.maxFrameLatency);
+	}
+	m_framePacer = std::make_unique<FramePacer>(m_frameClock, m_frameLatencySignal.get(), m_framePacerDesc);
 
 	// Create descriptor heaps.
 	{
 		// Describe and create a render target view (RTV) descriptor heap.
 		D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
-		rtvHeapDesc.NumDescriptors = FrameCount;
+		rtvHeapDesc.NumDescriptors = BackBufferCount;
 		rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 		rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 		ThrowIfFailed(m_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvHeap)));
@@ -329,15 +779,16 @@ void app::LoadPipeline() {
 	{
 		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
 
-		// Create a RTV and a command allocator for each frame.
-		for (UINT n = 0; n < FrameCount; n++)
+		// Create a RTV for each back buffer.
+		for (UINT n = 0; n < BackBufferCount; n++)
 		{
 			ThrowIfFailed(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])));
 			m_device->CreateRenderTargetView(m_renderTargets[n].Get(), nullptr, rtvHandle);
 			rtvHandle.Offset(1, m_rtvDescriptorSize);
-
-			ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocators[n])));
 		}
+
+		// And a command allocator for each frame in flight.
+		m_frameContexts.Create(m_device.Get(), m_framesInFlight);
 	}
 
 	// Create the depth stencil view.
@@ -375,8 +826,9 @@ void app::LoadAssets()
 
 	// Root signature
 	{
-		CD3DX12_ROOT_PARAMETER1 rp[1]{};
+		CD3DX12_ROOT_PARAMETER1 rp[2]{};
 		rp[0].InitAsConstantBufferView(0, 0);
+		rp[1].InitAsShaderResourceView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_NONE, D3D12_SHADER_VISIBILITY_VERTEX);
 
 		// Allow input layout and stream output, and deny uneccessary access to certain pipeline stages.
 		D3D12_ROOT_SIGNATURE_FLAGS descFlags =
@@ -397,7 +849,7 @@ void app::LoadAssets()
 	// Create the constant buffer memory and map the resource
 	{
 		const D3D12_HEAP_PROPERTIES uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		size_t cbSize = c_numDrawCalls * FrameCount * sizeof(PaddedConstantBuffer);
+		size_t cbSize = c_numDrawCalls * m_frameContexts.GetFrameCount() * ConstantBuffer::PlacementSize;
 
 		const D3D12_RESOURCE_DESC constantBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(cbSize);
 		ThrowIfFailed(m_device->CreateCommittedResource(
@@ -409,19 +861,28 @@ void app::LoadAssets()
 			IID_PPV_ARGS(m_perFrameConstants.ReleaseAndGetAddressOf())
 		));
 		ThrowIfFailed(m_perFrameConstants->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedConstantData)));
+		RegisterWriteCombined(m_mappedConstantData, cbSize);
 
 		m_constantDataGpuAddr = m_perFrameConstants->GetGPUVirtualAddress();
 	}
 
 	// Create the pipeline state, which includes compiling and loading shaders.
 	{
-		ComPtr<ID3D10Blob> vertexShader, geometryShader, streamGeometryShader, pixelShader;
+		ComPtr<ID3D10Blob> vertexShader, billboardVertexShader, geometryShader, streamGeometryShader, pixelShader;
 		UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 
-		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "MainVS", "vs_5_0", compileFlags, 0, &vertexShader, nullptr));
-		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "MainGS", "gs_5_0", compileFlags, 0, &geometryShader, nullptr));
-		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "MainGSSO", "gs_5_0", compileFlags, 0, &streamGeometryShader, nullptr));
-		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), nullptr, nullptr, "MainPS", "ps_5_0", compileFlags, 0, &pixelShader, nullptr));
+		// The compact layout switches the vertex input, stream output and structured buffer declarations.
+		const D3D_SHADER_MACRO compactDefines[] = { { "COMPACT_VERTICES", "1" }, { nullptr, nullptr } };
+		const D3D_SHADER_MACRO* pDefines = m_vertexFormat == VertexFormat::Compact ? compactDefines : nullptr;
+
+		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), pDefines, nullptr, "MainVS", "vs_5_0", compileFlags, 0, &vertexShader, nullptr));
+		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), pDefines, nullptr, "MainGS", "gs_5_0", compileFlags, 0, &geometryShader, nullptr));
+		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), pDefines, nullptr, "MainGSSO", "gs_5_0", compileFlags, 0, &streamGeometryShader, nullptr));
+		ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), pDefines, nullptr, "MainPS", "ps_5_0", compileFlags, 0, &pixelShader, nullptr));
+		if (m_billboardMode == BillboardMode::VertexShader)
+		{
+			ThrowIfFailed(D3DCompileFromFile(GetAssetFullPath(L"shaders.hlsl").c_str(), pDefines, nullptr, "MainVSBillboard", "vs_5_0", compileFlags, 0, &billboardVertexShader, nullptr));
+		}
 
 		D3D12_INPUT_ELEMENT_DESC inputElementDescs[] = 
 		{
@@ -430,6 +891,19 @@ void app::LoadAssets()
 			{ "SPEED", 0, DXGI_FORMAT_R32_FLOAT, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
 		};
 
+		// CompactParticleVertex: the speed rides in the w of the position.
+		D3D12_INPUT_ELEMENT_DESC compactInputElementDescs[] =
+		{
+			{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+			{ "SIZE", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		};
+
+		D3D12_INPUT_LAYOUT_DESC inputLayout = { inputElementDescs, _countof(inputElementDescs) };
+		if (m_vertexFormat == VertexFormat::Compact)
+		{
+			inputLayout = { compactInputElementDescs, _countof(compactInputElementDescs) };
+		}
+
 		// Create the Pipeline State Objects
 		{
 			D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
@@ -444,13 +918,27 @@ void app::LoadAssets()
 				{ 0, "SPEED", 0, 0, 1, 0}
 			};
 
-			UINT vertexStride = sizeof(Vertex);
+			// The compact vertex is packed into three dwords by MainGSSO.
+			D3D12_SO_DECLARATION_ENTRY compactSODeclarationEntries[] =
+			{
+				{ 0, "PACKED", 0, 0, 3, 0}
+			};
+
+			UINT vertexStride = m_particleStride;
 			UINT SOBufferStrides[] = { vertexStride };
 
 			// Specify to write all the vertex attributes from the input buffer 0 to the stream output buffer 0
 			D3D12_STREAM_OUTPUT_DESC SODesc{};
-			SODesc.NumEntries = 3;
-			SODesc.pSODeclaration = SODeclarationEntries;
+			if (m_vertexFormat == VertexFormat::Compact)
+			{
+				SODesc.NumEntries = _countof(compactSODeclarationEntries);
+				SODesc.pSODeclaration = compactSODeclarationEntries;
+			}
+			else
+			{
+				SODesc.NumEntries = _countof(SODeclarationEntries);
+				SODesc.pSODeclaration = SODeclarationEntries;
+			}
 			SODesc.NumStrides = 1;
 			SODesc.pBufferStrides = SOBufferStrides;
 			SODesc.RasterizedStream = D3D12_SO_NO_RASTERIZED_STREAM;
@@ -463,7 +951,7 @@ void app::LoadAssets()
 			blendDesc.RenderTarget[0].BlendOp = D3D12_BLEND_OP_ADD;
 
 			// Create a PSO that uses the SO stage
-			psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
+			psoDesc.InputLayout = inputLayout;
 			psoDesc.pRootSignature = m_rootSignature.Get();
 			psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.Get());
 			psoDesc.GS = CD3DX12_SHADER_BYTECODE(streamGeometryShader.Get());
@@ -487,12 +975,21 @@ void app::LoadAssets()
 			psoDesc.StreamOutput = {};
 			psoDesc.NumRenderTargets = 1;
 			psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+			if (m_billboardMode == BillboardMode::VertexShader)
+			{
+				// The billboard vertex shader reads the particles from a structured buffer and
+				// outputs the quad corners directly, so there is no input layout nor GS.
+				psoDesc.InputLayout = {};
+				psoDesc.VS = CD3DX12_SHADER_BYTECODE(billboardVertexShader.Get());
+				psoDesc.GS = {};
+				psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+			}
 			ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
 		}
 	}
 
 	// Create the command list.
-	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocators[m_frameIndex].Get(), nullptr, IID_PPV_ARGS(&m_commandList)));
+	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_frameContexts.GetCurrent().commandAllocator.Get(), nullptr, IID_PPV_ARGS(&m_commandList)));
 
 	// Command lists are created in the recording state, but there is nothing
 	// to record yet. The main loop expects it to be closed, so close it now.
@@ -514,103 +1011,202 @@ void app::LoadAssets()
 			particleVertices.push_back(v);
 		}
 
-		// Note: using upload heaps to transfer static data like vert buffers is not 
-		// recommended. Every time the GPU needs it, the upload heap will be marshalled 
-		// over. Please read up on Default Heap usage. An upload heap is used here for 
-		// code simplicity and because there are very few verts to actually transfer.
+		// Every particle of both backends stays in the wrap range above the grid, at the speeds of the grid.
+		m_particleQuantization = { { -20.f, -50.f, -20.f }, { 20.f, 50.f, 20.f }, 100.f, 300.f };
+
+		m_copyQueue = std::make_unique<D3D12CopyQueue>(m_device.Get(), c_uploadStagingSize);
+		m_uploadService = std::make_unique<UploadService>(*m_copyQueue);
+
+		// The particles never change, so they live in GPU memory rather than in an upload
+		// heap read over the bus on every draw. Created in the COMMON state, which the copy
+		// queue writes to and every read state is promoted from.
+		const size_t vertexBufferSize = particleVertices.size() * m_particleStride;
 		ThrowIfFailed(m_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
 			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(particleVertices.size() * sizeof(Vertex)),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
+			&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize),
+			D3D12_RESOURCE_STATE_COMMON,
 			nullptr,
 			IID_PPV_ARGS(&m_vertexBuffer)
 		));
 
-		// Copy the data to the vertex buffer.
-		UINT8* pVertexDataBegin = nullptr;
-		CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
-		ThrowIfFailed(m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, particleVertices.data(), particleVertices.size() * sizeof(Vertex));
-		m_vertexBuffer->Unmap(0, nullptr);
+		// Copy the data to the vertex buffer, encoded first if the format is compact.
+		std::vector<CompactParticleVertex> compactVertices;
+		const void* pVertexData = particleVertices.data();
+		if (m_vertexFormat == VertexFormat::Compact)
+		{
+			compactVertices.resize(particleVertices.size());
+			for (size_t i = 0; i < particleVertices.size(); i++)
+			{
+				compactVertices[i] = EncodeCompactVertex(reinterpret_cast<const ParticleVertex&>(particleVertices[i]), m_particleQuantization);
+			}
+			pVertexData = compactVertices.data();
+		}
+		const uint64_t vertexUpload = m_uploadService->Upload(m_vertexBuffer.Get(), 0, pVertexData, vertexBufferSize);
+
+		// Everything the graphics queue executes from now on waits for the copy on the GPU.
+		m_uploadService->Flush();
+		m_copyQueue->WaitGPU(m_commandQueue.Get(), vertexUpload);
+
+#if defined(_DEBUG)
+		// Both billboard paths have to build the same quads.
+		{
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world, m_worldMatrix);
+			XMFLOAT3 cameraPos;
+			XMStoreFloat3(&cameraPos, m_cameraWPos);	// What the shaders get as cameraWPos
+			if (CompareBillboardExpansion(world.m, &cameraPos.x, reinterpret_cast<const ParticleVertex*>(particleVertices.data()), particleVertices.size()) > 1e-4f)
+			{
+				throw std::exception();
+			}
+		}
+#endif
 
 		// Initialize the vertex buffer view.
 		m_vertexBufferView.BufferLocation = m_vertexBuffer->GetGPUVirtualAddress();
-		m_vertexBufferView.StrideInBytes = sizeof(Vertex);
-		m_vertexBufferView.SizeInBytes = (UINT)(particleVertices.size() * sizeof(Vertex));
+		m_vertexBufferView.StrideInBytes = m_particleStride;
+		m_vertexBufferView.SizeInBytes = (UINT)(particleVertices.size() * m_particleStride);
 	}
 
-	// Create the buffers required to use the stream output stage
+	// Create the resources of the CPU simulation backend
+	if (m_simulationBackend == SimulationBackend::Cpu)
 	{
-		// Stream output buffer
+		m_particleSystem = std::make_unique<ParticleSystem>(m_particleCapacity);
+
+		// Rain falling over the same [-20, 20] x [-20, 20] square as the grid, from the top of the
+		// wrap range, with the speed distribution of the grid particles.
+		EmitterDesc rain;
+		rain.spawnMin[0] = -20.f; rain.spawnMin[1] = 50.f; rain.spawnMin[2] = -20.f;
+		rain.spawnMax[0] = 20.f;  rain.spawnMax[1] = 50.f; rain.spawnMax[2] = 20.f;
+		rain.speedMin = 100.f;
+		rain.speedMax = 300.f;
+		rain.size[0] = .05f;
+		rain.size[1] = 5.f;
+		rain.killBelow = -50.f;
+		rain.lifetimeMin = rain.lifetimeMax = 2.f;
+
+		// A drop needs 100 / speed seconds to fall through, on average 0.55s for this speed range.
+		// Spawn just fast enough for the steady state to fill the pool.
+		rain.spawnRate = m_particleCapacity / c_meanRainFallTime;
+
+		m_particleSystem->AddEmitter(rain);
+		m_particleSystem->Prewarm(1.f, 1.f / 60.f);
+
+		// One slice per frame in flight, rewritten by OnUpdate() once the GPU is done with it.
+		const size_t sliceSize = m_particleCapacity * m_particleStride;
 		ThrowIfFailed(m_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
 			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(particleVertices.size() * sizeof(Vertex)),
-			D3D12_RESOURCE_STATE_COMMON,
+			&CD3DX12_RESOURCE_DESC::Buffer(m_frameContexts.GetFrameCount() * sliceSize),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
 			nullptr,
-			IID_PPV_ARGS(&m_streamOutputBuffer)
+			IID_PPV_ARGS(&m_cpuVertexBuffer)
 		));
 
-		// Filled size buffer
-		ThrowIfFailed(m_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(sizeof(PUINT_PTR)),
-			D3D12_RESOURCE_STATE_COMMON,
-			nullptr,
-			IID_PPV_ARGS(&m_streamFilledSizeBuffer)
-		));
+		CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
+		ThrowIfFailed(m_cpuVertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&m_pCpuVertexData)));
+		RegisterWriteCombined(m_pCpuVertexData, m_frameContexts.GetFrameCount() * sliceSize);
+
+		m_jobSystem = std::make_unique<JobSystem>(m_jobThreadCount);
+
+		if (m_useSimulationThread)
+		{
+			m_renderParticles.Resize(m_particleSystem->Capacity());
+			m_simulationThread = std::make_unique<ParticleSimulationThread>(*m_particleSystem, m_jobSystem.get(), m_frameClock, m_simulationRate, c_particleChunkSize);
+			m_simulationThread->SetPreStep([this](ParticleSystem& system) { ApplySpawnRateSteps(system); });
+			m_simulationThread->Start();
+		}
+	}
+
+	// Create the buffers required to use the stream output stage
+	{
+		const UINT64 particleBufferSize = particleVertices.size() * m_particleStride;
 
-		// Upload buffer to clear the filled size buffer
+		for (UINT n = 0; n < _countof(m_streamOutputBuffers); n++)
+		{
+			// Stream output buffer, also used as vertex buffer by the next passes
+			ThrowIfFailed(m_device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&CD3DX12_RESOURCE_DESC::Buffer(particleBufferSize),
+				D3D12_RESOURCE_STATE_COMMON,
+				nullptr,
+				IID_PPV_ARGS(&m_streamOutputBuffers[n])
+			));
+
+			// Filled size buffer
+			ThrowIfFailed(m_device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64)),
+				D3D12_RESOURCE_STATE_COMMON,
+				nullptr,
+				IID_PPV_ARGS(&m_streamFilledSizeBuffers[n])
+			));
+
+			// Stream output buffer view
+			m_streamOutputBufferViews[n].BufferLocation = m_streamOutputBuffers[n]->GetGPUVirtualAddress();
+			m_streamOutputBufferViews[n].SizeInBytes = particleBufferSize;
+			m_streamOutputBufferViews[n].BufferFilledSizeLocation = m_streamFilledSizeBuffers[n]->GetGPUVirtualAddress();
+
+			// Vertex buffer view of the same memory
+			m_streamVertexBufferViews[n].BufferLocation = m_streamOutputBuffers[n]->GetGPUVirtualAddress();
+			m_streamVertexBufferViews[n].StrideInBytes = m_particleStride;
+			m_streamVertexBufferViews[n].SizeInBytes = static_cast<UINT>(particleBufferSize);
+		}
+
+		// Upload buffer to clear the filled size buffers. It always holds zero.
 		ThrowIfFailed(m_device->CreateCommittedResource(
 			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
 			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(sizeof(PUINT_PTR)),
+			&CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64)),
 			D3D12_RESOURCE_STATE_GENERIC_READ,
 			nullptr,
 			IID_PPV_ARGS(&m_streamFilledSizeUploadBuffer)
 		));
-		m_streamFilledSizeUploadBuffer->Map(0, NULL, reinterpret_cast<void**>(&m_pFilledSize));
+		UINT64* pFilledSize = nullptr;
+		ThrowIfFailed(m_streamFilledSizeUploadBuffer->Map(0, NULL, reinterpret_cast<void**>(&pFilledSize)));
+		*pFilledSize = 0;
+		m_streamFilledSizeUploadBuffer->Unmap(0, nullptr);
 
-		// Stream output buffer view
-		m_streamOutputBufferView.BufferLocation = m_streamOutputBuffer->GetGPUVirtualAddress();
-		m_streamOutputBufferView.SizeInBytes = particleVertices.size() * sizeof(Vertex);
-		m_streamOutputBufferView.BufferFilledSizeLocation = m_streamFilledSizeBuffer->GetGPUVirtualAddress();
+		// Until the first readback completes, draw every particle the streaming pass is given.
+		m_streamVertexCount = static_cast<UINT>(particleVertices.size());
 
 		// Readback buffer to read (from the CPU) the size of the data written to the stream output buffer by the GPU,
-		// which writes that size in the filled size buffer.
+		// which writes that size in the filled size buffer. One slot per frame that can be in flight.
 		ThrowIfFailed(m_device->CreateCommittedResource(
 			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
 			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(sizeof(PUINT_PTR)),
+			&CD3DX12_RESOURCE_DESC::Buffer(m_filledSizeReadback.GetSlotCount() * sizeof(UINT64)),
 			D3D12_RESOURCE_STATE_COPY_DEST,
 			nullptr,
 			IID_PPV_ARGS(&m_streamFilledSizeReadBackBuffer)
 		));
 
-		// Buffer used as vertex buffer in the rendering pass
-		ThrowIfFailed(m_device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(particleVertices.size() * sizeof(Vertex)),	
-			D3D12_RESOURCE_STATE_COMMON,
-			nullptr,
-			IID_PPV_ARGS(&m_updatedVertexBuffer)
-		));
+		// Seed the first buffer with the initial particles and put every stream resource in the
+		// state PopulateCommandList() expects to find it in between frames.
+		ThrowIfFailed(m_commandList->Reset(m_frameContexts.GetCurrent().commandAllocator.Get(), nullptr));
+
+		D3D12_RESOURCE_BARRIER initBarriers[] =
+		{
+			CD3DX12_RESOURCE_BARRIER::Transition(m_streamOutputBuffers[0].Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST),
+			CD3DX12_RESOURCE_BARRIER::Transition(m_streamOutputBuffers[1].Get(), D3D12_RESOURCE_STATE_COMMON, c_particleReadState),
+			CD3DX12_RESOURCE_BARRIER::Transition(m_streamFilledSizeBuffers[0].Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE),
+			CD3DX12_RESOURCE_BARRIER::Transition(m_streamFilledSizeBuffers[1].Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE)
+		};
+		m_commandList->ResourceBarrier(_countof(initBarriers), initBarriers);
+		m_commandList->CopyBufferRegion(m_streamOutputBuffers[0].Get(), 0, m_vertexBuffer.Get(), 0, particleBufferSize);
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_streamOutputBuffers[0].Get(), D3D12_RESOURCE_STATE_COPY_DEST, c_particleReadState));
+
+		ThrowIfFailed(m_commandList->Close());
+		ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+		m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+		m_streamReadIndex = 0;
 	}
 
 	// Create synchronization objects and wait until assets have been uploaded to the GPU.
 	{
-		ThrowIfFailed(m_device->CreateFence(m_fenceValues[m_frameIndex], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-		m_fenceValues[m_frameIndex]++;
-
-		// Create an event handle to use for frame synchronization.
-		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-		if (m_fenceEvent == nullptr)
-		{
-			ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
-		}
+		m_fence = std::make_unique<D3D12TimelineFence>(m_device.Get(), m_commandQueue.Get());
 
 		// Wait for the command list to execute; we are reusing the same command 
 		// list in our main loop but for now, we just want to wait for setup to 
@@ -621,7 +1217,11 @@ void app::LoadAssets()
 
 void app::OnKeyDown(UINT8 key) 
 {
-
+	// Drive the rain density of the CPU backend; the pool capacity bounds it.
+	if (m_particleSystem && (key == VK_UP || key == VK_DOWN))
+	{
+		m_spawnRateSteps += (key == VK_UP) ? 1 : -1;
+	}
 }
 void app::OnKeyUp(UINT8 key) 
 {
@@ -630,30 +1230,28 @@ void app::OnKeyUp(UINT8 key)
 		PostQuitMessage(0);
 	}
 }
+void app::OnSizeChanged(UINT /*width*/, UINT /*height*/, bool minimized)
+{
+	// The swap chain keeps its size; only whether there is anything to show matters.
+	if (minimized)
+	{
+		m_presentState.OnMinimized(m_frameClock.Now());
+	}
+	else
+	{
+		m_presentState.OnRestored(m_frameClock.Now());
+	}
+}
 
 
 void app::MoveToNextFrame() 
 {
-	const UINT64 currentfenceValue = m_fenceValues[m_frameIndex];
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), currentfenceValue));
-	
-	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+	m_frameContexts.MoveToNextFrame(*m_fence);
 
-	// Wait until the previous frame is finished.
-	if (m_fence->GetCompletedValue() < m_fenceValues[m_frameIndex])
-	{
-		ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex], m_fenceEvent));
-		WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
-	}
-
-	m_fenceValues[m_frameIndex] = currentfenceValue + 1;
+	// The next back buffer comes from the swap chain, independently of the frame context.
+	m_backBufferIndex = m_swapChain->GetCurrentBackBufferIndex();
 }
 void app::WaitForGPU() 
 {
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_fenceValues[m_frameIndex]));
-
-	ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex], m_fenceEvent));
-	WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
-
-	m_fenceValues[m_frameIndex]++;
+	m_frameContexts.WaitForGpu(*m_fence);
 }
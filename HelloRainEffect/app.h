@@ -2,6 +2,22 @@
 
 #include "IApp.h"
 #include "StepTimer.h"
+#include "ParticleSystem.h"
+#include "JobSystem.h"
+#include "ReadbackRing.h"
+#include "FrameContext.h"
+#include "D3D12TimelineFence.h"
+#include "D3D12CopyQueue.h"
+#include "DXGIFrameLatencySignal.h"
+#include "PresentStateMachine.h"
+#include "FrameTimeHistogram.h"
+#include "ParticleSort.h"
+#include "ParticleCulling.h"
+#include "ParticleCompression.h"
+#include "ParticleSimulationThread.h"
+#include "CbufferLayout.h"
+#include <atomic>
+#include <memory>
 #include <vector>
 
 using namespace DirectX;
@@ -28,64 +44,91 @@ public:
 
 	void OnKeyDown(UINT8 key) override;
 	void OnKeyUp(UINT8 key) override;
+	void OnSizeChanged(UINT width, UINT height, bool minimized) override;
+
+	void ParseCommandLineArgs(_In_reads_(argc) WCHAR* argv[], int argc);
 
 private:
-	// In this sample we overload the meaning of FrameCount to mean both the maximum
-	// number of frames that will be queued to the GPU at a time, as well as the number
-	// of back buffers in the DXGI swap chain. For the majority of applications, this
-	// is convenient and works well. However, there will be certain cases where an
-	// application may want to queue up more frames than there are back buffers
-	// available.
+	// The number of back buffers in the DXGI swap chain. The number of frames queued to
+	// the GPU at a time is separate, see m_frameContexts, and can be raised with
+	// -framesinflight to keep the GPU fed under load.
 	// It should be noted that excessive buffering of frames dependent on user input
 	// may result in noticeable latency in your app.
-	static const UINT FrameCount = 2;
+	static const UINT BackBufferCount = 2;
+	static const UINT c_defaultFramesInFlight = 2;
 
-	struct Vertex
+	// Where the fall-and-wrap step of the particles runs.
+	enum class SimulationBackend
 	{
-		XMFLOAT3 position;
-		XMFLOAT2 size;
-		FLOAT speed;
+		GpuStreamOutput,	// MainGSSO through the stream output stage
+		Cpu					// ParticleSimulator, uploaded every frame
 	};
 
-	struct ConstantBuffer {
-		XMFLOAT4X4 worldMatrix;
-		XMFLOAT4X4 viewMatrix;
-		XMFLOAT4X4 projectionMatrix;
-		XMFLOAT4 outputColor;
-		XMFLOAT3 cameraWPos;
-		FLOAT deltaTime;
+	// How the rendering pass turns particles into quads.
+	enum class BillboardMode
+	{
+		GeometryShader,		// MainGS expands each point
+		VertexShader		// MainVSBillboard expands instanced 4-vertex strips
 	};
 
-	// We'll allocate space for several of these and they will need to be padded for alignment.
-	static_assert(sizeof(ConstantBuffer) == 224);
+	// Layout of the particles in the vertex, stream output and upload buffers.
+	enum class VertexFormat
+	{
+		Full,				// Vertex, 24 bytes of floats
+		Compact				// CompactParticleVertex, 12 bytes quantized over m_particleQuantization
+	};
 
-	// D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT < 272 < 2 * D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
-	// Create a union with the correct size and enough room for one ConstantBuffer
-	union PaddedConstantBuffer
+	// Read state of the particle buffers: vertex input, and structured buffer for MainVSBillboard.
+	static constexpr D3D12_RESOURCE_STATES c_particleReadState = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+	struct Vertex
 	{
-		ConstantBuffer constants;
-		uint8_t bytes[D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT];
+		XMFLOAT3 position;
+		XMFLOAT2 size;
+		FLOAT speed;
 	};
-	
-	// Check the exact size of the PaddedConstantBuffer to make sure it will align properly
-	static_assert(sizeof(PaddedConstantBuffer) == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	static_assert(sizeof(Vertex) == sizeof(ParticleVertex));
+
+	// cbuffer Constants in shaders.hlsl, field by field and in the same order. The offsets
+	// and the size follow the HLSL packing rules, see CbufferLayout.h.
+	struct WorldMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ViewMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ProjectionMatrix : CbufferField<XMFLOAT4X4> {};
+	struct OutputColor : CbufferField<XMFLOAT4> {};
+	struct CameraWPos : CbufferField<XMFLOAT3> {};
+	struct DeltaTime : CbufferField<FLOAT> {};
+	struct BoundsMin : CbufferField<XMFLOAT4> {};		// Decoding of VertexFormat::Compact, see ParticleQuantization
+	struct BoundsExtent : CbufferField<XMFLOAT4> {};
+	using ConstantBuffer = CbufferStruct<WorldMatrix, ViewMatrix, ProjectionMatrix, OutputColor, CameraWPos, DeltaTime, BoundsMin, BoundsExtent>;
+
+	// One block per draw call fills a constant buffer placement exactly.
+	static_assert(ConstantBuffer::PlacementSize == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT && ConstantBuffer::Size == ConstantBuffer::PlacementSize);
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
 	CD3DX12_RECT m_scissorRect;
 	ComPtr<IDXGISwapChain4> m_swapChain;
 	ComPtr<ID3D12Device> m_device;
-	ComPtr<ID3D12Resource> m_renderTargets[FrameCount];
+	ComPtr<ID3D12Resource> m_renderTargets[BackBufferCount];
 	ComPtr<ID3D12Resource> m_depthStencil;
-	ComPtr<ID3D12CommandAllocator> m_commandAllocators[FrameCount];
 	ComPtr<ID3D12CommandQueue> m_commandQueue;
 	ComPtr<ID3D12RootSignature> m_rootSignature;
 	ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
 	ComPtr<ID3D12DescriptorHeap> m_dsvHeap;
 	ComPtr<ID3D12PipelineState> m_streamPipelineState;
 	ComPtr<ID3D12PipelineState> m_pipelineState;
+	BillboardMode m_billboardMode;
+	VertexFormat m_vertexFormat;
+	UINT m_particleStride;
+	ParticleQuantization m_particleQuantization;
 	ComPtr<ID3D12GraphicsCommandList> m_commandList;
 
+	// Static buffers go to DEFAULT heaps through the copy queue. The service holds on to
+	// the queue, so it is declared after it.
+	static constexpr uint64_t c_uploadStagingSize = 256 * 1024;
+	std::unique_ptr<D3D12CopyQueue> m_copyQueue;
+	std::unique_ptr<UploadService> m_uploadService;
+
 	// App resources.
 	ComPtr<ID3D12Resource> m_vertexBuffer;
 	ComPtr<ID3D12Resource> m_indexBuffer;
@@ -93,17 +136,42 @@ private:
 	D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 	D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
 	D3D12_GPU_VIRTUAL_ADDRESS m_constantDataGpuAddr;
-	PaddedConstantBuffer* m_mappedConstantData;
+	UINT8* m_mappedConstantData;
 	UINT m_rtvDescriptorSize;
 
 	StepTimer m_timer;
 
 	// Synchronization objects.
-	UINT m_frameIndex;
+	UINT m_backBufferIndex;
 	UINT m_frameCounter;
-	HANDLE m_fenceEvent;
-	ComPtr<ID3D12Fence> m_fence;
-	UINT64 m_fenceValues[FrameCount];
+	std::unique_ptr<D3D12TimelineFence> m_fence;
+	UINT m_framesInFlight;
+	FrameContextRing m_frameContexts;
+
+	// Frame pacing. By default the swap chain is latency waitable and each frame waits for
+	// room in the display queue before sampling input; -latency sets the queue depth and
+	// -waitinpresent falls back to letting Present() block.
+	FramePacerDesc m_framePacerDesc;
+	SteadyFrameClock m_frameClock;
+	std::unique_ptr<DXGIFrameLatencySignal> m_frameLatencySignal;
+	std::unique_ptr<FramePacer> m_framePacer;
+
+	// Run() drives the frames through a GameLoop, which waits for the latency signal
+	// together with the message queue. Minimized (WM_SIZE) or occluded (Present() returned
+	// DXGI_STATUS_OCCLUDED), nothing is recorded or submitted: the loop sleeps and only tests
+	// presents at m_presentState's probe cadence until the window shows again.
+	int64_t m_frameWaitBegin;
+	bool m_occluded;
+	PresentStateMachine m_presentState;
+
+	// Benchmark mode presents without vsync, tearing where supported, and records every
+	// frame time; the percentiles are written to m_frameTimesPath on exit.
+	bool m_benchmark;
+	UINT m_syncInterval;
+	UINT m_presentFlags;
+	FrameTimeHistogram m_frameTimes;
+	int64_t m_lastPresentTime;
+	std::wstring m_frameTimesPath;
 
 	// Scene constants, updated per-frame
 	float m_curRotationAngRad;
@@ -112,6 +180,9 @@ private:
 	// and we will update the scene constants for each draw call.
 	static const unsigned int c_numDrawCalls = 2;
 
+	static constexpr float c_nearPlane = .01f;
+	static constexpr float c_farPlane = 100.f;
+
 	// These computed values will be loaded into a ConstantBuffer
 	XMMATRIX m_worldMatrix;
 	XMMATRIX m_viewMatrix;
@@ -128,14 +199,82 @@ private:
 	// Particle collection
 	std::vector<Vertex> particleVertices;
 
+	// CPU simulation resources
+	SimulationBackend m_simulationBackend;
+	static const size_t c_defaultParticleCapacity = 81;
+	static constexpr float c_meanRainFallTime = 0.55f;
+	// VK_UP raises the spawn rate at most this far above the one that keeps the pool full.
+	static constexpr float c_maxSpawnRateScale = 16.f;
+	std::unique_ptr<ParticleSystem> m_particleSystem;
+	size_t m_particleCapacity;
+	UINT m_frameParticleCount;
+	ComPtr<ID3D12Resource> m_cpuVertexBuffer;
+	UINT8* m_pCpuVertexData;
+
+	// The particle update is split into chunks that run on every core while the main
+	// thread records the command list; the group is waited on before submission.
+	static const size_t c_particleChunkSize = 8192;
+	std::unique_ptr<JobSystem> m_jobSystem;
+	unsigned int m_jobThreadCount;
+	TaskGroup m_frameTasks;
+	ParticleStepParams m_particleStepParams;
+	UINT8* m_pCpuFrameVertices;
+
+	static void SimulateParticleChunk(void* context, size_t begin, size_t end);
+
+	// With -simthread the pool is stepped at a fixed rate on its own thread, see
+	// ParticleSimulationThread, and each frame draws its newest snapshot interpolated into
+	// m_renderParticles. Otherwise the pool is stepped once per frame on the main thread.
+	static constexpr double c_defaultSimulationRate = 60.;
+	bool m_useSimulationThread;
+	double m_simulationRate;
+	std::unique_ptr<ParticleSimulationThread> m_simulationThread;
+	ParticleSimulator m_renderParticles;
+	const ParticleSnapshot* m_pSnapshot;
+	float m_interpolationAlpha;
+
+	// Particles drawn this frame, and their handles.
+	ParticleSimulator* m_pDrawSimulator;
+	const uint32_t* m_pDrawHandles;
+
+	// Step the particles of [begin, end) to this frame: a simulation step, or interpolation of the snapshot.
+	void AdvanceParticles(size_t begin, size_t end);
+
+	// Spawn rate changes from the keyboard, applied by whichever thread steps the pool.
+	std::atomic<int> m_spawnRateSteps;
+	void ApplySpawnRateSteps(ParticleSystem& system);
+
+	// With culling on, only the particles inside the view frustum that survive the distance
+	// LOD are drawn. With sorting on, the drawn particles are ordered back to front so the
+	// alpha blending composes correctly. Either way they are gathered into the upload buffer
+	// through m_pDrawParticles once the step is done.
+	bool m_cullParticles;
+	bool m_sortParticles;
+	static constexpr float c_lodStartDepth = 60.f;
+	static constexpr float c_lodEndDepth = 100.f;
+	static constexpr float c_lodMinKeep = .35f;
+	ParticleCuller m_particleCuller;
+	ParticleDepthSorter m_particleSorter;
+	const uint32_t* m_pDrawParticles;
+
+	static void WriteGatheredParticleChunk(void* context, size_t begin, size_t end);
+
 	// Streaming resources
-	ComPtr<ID3D12Resource>			m_streamOutputBuffer;
-	D3D12_STREAM_OUTPUT_BUFFER_VIEW m_streamOutputBufferView;
-	ComPtr<ID3D12Resource>			m_streamFilledSizeBuffer;
+	// Frame N streams into one buffer and draws it, frame N+1 reads that buffer back as the
+	// input of its streaming pass and writes into the other one.
+	ComPtr<ID3D12Resource>			m_streamOutputBuffers[2];
+	ComPtr<ID3D12Resource>			m_streamFilledSizeBuffers[2];
+	D3D12_STREAM_OUTPUT_BUFFER_VIEW m_streamOutputBufferViews[2];
+	D3D12_VERTEX_BUFFER_VIEW		m_streamVertexBufferViews[2];
+	UINT							m_streamReadIndex;
 	ComPtr<ID3D12Resource>			m_streamFilledSizeUploadBuffer;
 	ComPtr<ID3D12Resource>			m_streamFilledSizeReadBackBuffer;
-	ComPtr<ID3D12Resource>			m_updatedVertexBuffer;
-	UINT* m_pFilledSize;	
+
+	// Filled sizes are read back through a ring of slots keyed by fence value, so the CPU
+	// never maps a value the GPU has not written yet and never waits for it either.
+	static const UINT c_filledSizeReadbackSlots = FrameContextRing::MaxFrameCount + 1;
+	ReadbackRing m_filledSizeReadback;
+	UINT m_streamVertexCount;
 
 	UINT m_width;
 	UINT m_height;
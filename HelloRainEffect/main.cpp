@@ -7,9 +7,17 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 {
 	app app(1280, 720, L"Hello Rain Effect", hInstance, nCmdShow);
 
+	int argc;
+	LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	app.ParseCommandLineArgs(argv, argc);
+	LocalFree(argv);
+
 	app.OnInit();
 
 	app.Run();
 
+	// Let the GPU drain and write out what the run measured.
+	app.OnDestroy();
+
 	return 0;
 }
@@ -42,17 +42,6 @@ void platform::PlatShowWindow()
 {
 	ShowWindow(platform::m_hwnd, platform::nCmdShow);
 }
-int platform::PlatMessageDispatch(MSG& msg)
-{
-	// Process any messages in the queue.
-	if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
-	{
-		TranslateMessage(&msg);
-		DispatchMessage(&msg);
-	}
-
-	return static_cast<char>(msg.wParam);
-}
 
 // Main message handler for the sample.
 LRESULT CALLBACK platform::WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
@@ -82,14 +71,19 @@ LRESULT CALLBACK platform::WindowProc(HWND hWnd, UINT message, WPARAM wParam, LP
 		}
 		return 0;
 
-	case WM_PAINT:
+	case WM_SIZE:
 		if (iapp)
 		{
-			iapp->OnUpdate();
-			iapp->OnRender();
+			iapp->OnSizeChanged(LOWORD(lParam), HIWORD(lParam), wParam == SIZE_MINIMIZED);
 		}
 		return 0;
 
+	case WM_PAINT:
+		// Frames come from the game loop, see app::Run(); only mark the window as painted so
+		// that WM_PAINT does not keep coming.
+		ValidateRect(hWnd, nullptr);
+		return 0;
+
 	case WM_DESTROY:
 		PostQuitMessage(0);
 		return 0;
@@ -98,6 +92,41 @@ LRESULT CALLBACK platform::WindowProc(HWND hWnd, UINT message, WPARAM wParam, LP
 	return DefWindowProc(hWnd, message, wParam, lParam);
 }
 
+bool Win32LoopPlatform::PumpMessages()
+{
+	// Drain the whole queue so the frame always sees the latest input.
+	MSG msg = {};
+	while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+	{
+		if (msg.message == WM_QUIT)
+		{
+			return false;
+		}
+
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+	}
+	return true;
+}
+
+LoopWake Win32LoopPlatform::Wait(bool includeFrameSignal, int64_t timeout)
+{
+	const DWORD handleCount = (includeFrameSignal && m_frameSignal) ? 1 : 0;
+	const DWORD timeoutMs = static_cast<DWORD>((timeout + 999999) / 1000000);
+
+	// MWMO_INPUTAVAILABLE also wakes for input that was already in the queue but seen by an earlier peek.
+	const DWORD result = MsgWaitForMultipleObjectsEx(handleCount, &m_frameSignal, timeoutMs, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+	if (handleCount == 1 && result == WAIT_OBJECT_0)
+	{
+		return LoopWake::FrameSignal;
+	}
+	if (result == WAIT_OBJECT_0 + handleCount)
+	{
+		return LoopWake::Message;
+	}
+	return LoopWake::Timeout;
+}
+
 void platform::SetCustomWindowText(LPCWSTR text)
 {
 	SetWindowText(m_hwnd, std::wstring(platform::m_windowtext + L": " + text).c_str());
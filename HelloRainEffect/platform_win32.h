@@ -3,6 +3,7 @@
 
 #include "dxgi1_6.h"
 #include "IApp.h"
+#include "GameLoop.h"
 
 class platform
 {
@@ -11,7 +12,6 @@ public:
 	platform(UINT width, UINT height, std::wstring title, HINSTANCE hInstance, int nCmdShow, IApp* iapp);
 
 	static void PlatShowWindow();
-	static int PlatMessageDispatch(MSG& msg);
 
 	static int GetCmdShow() { return nCmdShow; }
 	static HWND GetHwnd() { return m_hwnd; }
@@ -31,3 +31,19 @@ private:
 	static HINSTANCE hInstance;
 	static std::wstring m_windowtext;
 };
+
+// GameLoop's view of the Win32 message queue, sleeping in MsgWaitForMultipleObjectsEx on
+// the messages and the swap chain's frame latency waitable object.
+class Win32LoopPlatform : public LoopPlatform
+{
+public:
+	// frameSignal may be null when the swap chain has no frame latency waitable object.
+	explicit Win32LoopPlatform(HANDLE frameSignal) : m_frameSignal(frameSignal) {}
+
+	bool PumpMessages() override;
+	bool HasFrameSignal() const override { return m_frameSignal != nullptr; }
+	LoopWake Wait(bool includeFrameSignal, int64_t timeout) override;
+
+private:
+	HANDLE m_frameSignal;
+};
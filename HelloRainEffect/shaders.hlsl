@@ -15,6 +15,8 @@ cbuffer Constants : register(b0)
 	float4 outputColor;
 	float3 cameraWPos;
 	float deltaTime;
+	float4 boundsMin;		// xyz: position quantization box, w: lowest speed (COMPACT_VERTICES only)
+	float4 boundsExtent;	// xyz: size of the box, w: speed range
 };
 
  
@@ -31,23 +33,103 @@ struct GS_OUTPUT
 	float4 Pos : SV_POSITION;
 };
 
+#if COMPACT_VERTICES
+// CompactParticleVertex (ParticleCompression.h): 16-bit UNORM position and speed over the
+// quantization box, half float size, 12 bytes per particle.
+struct VS_COMPACT_INPUT
+{
+	float4 PosSpeed : POSITION;		// R16G16B16A16_UNORM
+	float2 Size : SIZE;				// R16G16_FLOAT
+};
+
+// Stream output only writes 32-bit components, so MainGSSO packs the 16-bit fields itself.
+struct SO_OUTPUT
+{
+	uint3 Packed : PACKED;
+};
+
+VS_INPUT DecodeParticle(float4 posSpeed, float2 size)
+{
+	VS_INPUT particle;
+	particle.Pos = boundsMin.xyz + posSpeed.xyz * boundsExtent.xyz;
+	particle.Size = size;
+	particle.Speed = boundsMin.w + posSpeed.w * boundsExtent.w;
+	return particle;
+}
+
+// Same rounding as EncodeCompactVertex: clamp to the box, round to nearest.
+SO_OUTPUT EncodeParticle(VS_INPUT particle)
+{
+	uint3 position = (uint3)(clamp((particle.Pos - boundsMin.xyz) * (65535.0f / boundsExtent.xyz), 0.0f, 65535.0f) + 0.5f);
+	uint speed = (uint)(clamp((particle.Speed - boundsMin.w) * (255.0f / boundsExtent.w), 0.0f, 255.0f) + 0.5f) * 257;
+
+	SO_OUTPUT output;
+	output.Packed.x = position.x | (position.y << 16);
+	output.Packed.y = position.z | (speed << 16);
+	output.Packed.z = f32tof16(particle.Size.x) | (f32tof16(particle.Size.y) << 16);
+	return output;
+}
+
+// The vertex shader billboard path reads the packed dwords directly.
+StructuredBuffer<uint3> particles : register(t0);
+
+VS_INPUT LoadParticle(uint index)
+{
+	uint3 packed = particles[index];
+	float4 posSpeed = float4(packed.x & 0xffff, packed.x >> 16, packed.y & 0xffff, packed.y >> 16) / 65535.0f;
+	return DecodeParticle(posSpeed, float2(f16tof32(packed.z), f16tof32(packed.z >> 16)));
+}
+#else
+typedef VS_INPUT SO_OUTPUT;
+
+// Same layout as VS_INPUT, read as a structured buffer by the vertex shader billboard path
+struct Particle
+{
+	float3 Pos;
+	float2 Size;
+	float Speed;
+};
+
+StructuredBuffer<Particle> particles : register(t0);
+
+VS_INPUT LoadParticle(uint index)
+{
+	Particle particle = particles[index];
+
+	VS_INPUT output;
+	output.Pos = particle.Pos;
+	output.Size = particle.Size;
+	output.Speed = particle.Speed;
+	return output;
+}
+#endif
+
 
 //--------------------------------------------------------------------------------------
 // Name: MainVS
-// Desc: Pass-through Vertex shader
+// Desc: Pass-through Vertex shader, decoding the compact layout if used
 //--------------------------------------------------------------------------------------
+#if COMPACT_VERTICES
+VS_INPUT MainVS(VS_COMPACT_INPUT In)
+{
+	return DecodeParticle(In.PosSpeed, In.Size);
+}
+#else
 VS_INPUT MainVS(VS_INPUT In)
 {
 	return In;
 }
+#endif
 
 
 //--------------------------------------------------------------------------------------
 // Name: MainGSSO
 // Desc: Geometry shader for moving particles
+//       ParticleKernels::StepScalar (ParticleSimulator.cpp) mirrors this on the CPU, and
+//       ParticleSimulator::VerifyKernels() checks every CPU kernel against a transcription.
 //--------------------------------------------------------------------------------------
 [maxvertexcount(1)]
-void MainGSSO(point VS_INPUT input[1], inout PointStream<VS_INPUT> output)
+void MainGSSO(point VS_INPUT input[1], inout PointStream<SO_OUTPUT> output)
 {
 	VS_INPUT particle = input[0];
     
@@ -61,7 +143,30 @@ void MainGSSO(point VS_INPUT input[1], inout PointStream<VS_INPUT> output)
 	}
 	
 	// Emit the point\particle with the updated position
+#if COMPACT_VERTICES
+	output.Append(EncodeParticle(particle));
+#else
 	output.Append(particle);
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+// Name: BillboardLeft
+// Desc: Left direction of a quad: cross(up, front), with front the direction to the
+//       camera projected onto the xz-plane. Directly below or above the camera that
+//       projection vanishes, and the quad faces -z instead of normalizing a zero vector
+//       into NaN corners. BillboardLeft (BillboardMath.h) mirrors this on the CPU.
+//--------------------------------------------------------------------------------------
+float3 BillboardLeft(float3 positionW)
+{
+	float3 front = cameraWPos - positionW;
+	front.y = 0.0f;
+
+	float lengthSq = dot(front, front);
+	front = lengthSq > 1e-6f ? front * rsqrt(lengthSq) : float3(0.0f, 0.0f, -1.0f);
+
+	return cross(float3(0.0f, 1.0f, 0.0f), front);
 }
 
 
@@ -76,12 +181,8 @@ void MainGS(point VS_INPUT input[1], inout TriangleStream<GS_OUTPUT> outputStrea
 	float3 positionW = mul(float4(input[0].Pos, 1.0f), mWorld).xyz;
     
 	// We need the up direction of the world space, and left direction with respect to the quad.
-	// We can use the projection of the front vector onto the xz-plane to calculate the left direction.
 	float3 up = float3(0.0f, 1.0f, 0.0f);
-	float3 front = cameraWPos - positionW;
-	front.y = 0.0f;
-	front = normalize(front);
-	float3 left = cross(up, front);
+	float3 left = BillboardLeft(positionW);
     
 	// Half-size of the input point\particle
 	float hw = 0.5f * input[0].Size.x;
@@ -109,6 +210,32 @@ void MainGS(point VS_INPUT input[1], inout TriangleStream<GS_OUTPUT> outputStrea
 }
 
 
+//--------------------------------------------------------------------------------------
+// Name: MainVSBillboard
+// Desc: Vertex shader expanding points\particles to quads without a geometry shader.
+//       Drawn as a 4-vertex triangle strip per instance, one instance per particle.
+//       Builds the same corners, in the same order, as MainGS (see BillboardMath.h).
+//--------------------------------------------------------------------------------------
+GS_OUTPUT MainVSBillboard(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+	VS_INPUT particle = LoadParticle(instanceID);
+
+	float3 positionW = mul(float4(particle.Pos, 1.0f), mWorld).xyz;
+
+	float3 up = float3(0.0f, 1.0f, 0.0f);
+	float3 left = BillboardLeft(positionW);
+
+	// Vertex 0: Left-Bottom, 1: Left-Top, 2: Right-Bottom, 3: Right-Top
+	float hw = ((vertexID & 2) ? -0.5f : 0.5f) * particle.Size.x;
+	float hh = ((vertexID & 1) ? 0.5f : -0.5f) * particle.Size.y;
+
+	GS_OUTPUT output;
+	output.Pos = mul(float4(positionW + (hw * left) + (hh * up), 1.0f), mView);
+	output.Pos = mul(output.Pos, mProjection);
+	return output;
+}
+
+
 //--------------------------------------------------------------------------------------
 // Name: SolidColorPS
 // Desc: Pixel shader applying solid color
@@ -0,0 +1,40 @@
+#include "stdafx.h"
+#include "D3D12TimelineFence.h"
+#include "DXSampleHelper.h"
+
+D3D12TimelineFence::D3D12TimelineFence(ID3D12Device* pDevice, ID3D12CommandQueue* pQueue, uint64_t initialValue) :
+	m_queue(pQueue),
+	m_event(nullptr)
+{
+	ThrowIfFailed(pDevice->CreateFence(initialValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+
+	m_event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (m_event == nullptr)
+	{
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+	}
+}
+
+D3D12TimelineFence::~D3D12TimelineFence()
+{
+	if (m_event)
+	{
+		CloseHandle(m_event);
+	}
+}
+
+void D3D12TimelineFence::Signal(uint64_t value)
+{
+	ThrowIfFailed(m_queue->Signal(m_fence.Get(), value));
+}
+
+void D3D12TimelineFence::WaitCPU(uint64_t value)
+{
+	if (m_fence->GetCompletedValue() < value)
+	{
+		ThrowIfFailed(m_fence->SetEventOnCompletion(value, m_event));
+		WaitForSingleObjectEx(m_event, INFINITE, FALSE);
+	}
+
+	Poll();
+}
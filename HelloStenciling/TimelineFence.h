@@ -0,0 +1,86 @@
+#pragma once
+
+// A monotonically increasing 64-bit fence, the synchronization primitive every frame
+// resource ring is built on.
+//
+// Signal(v) moves the fence to v once the work submitted before it is done; WaitCPU(v)
+// blocks the calling thread until then and IsComplete(v) checks without blocking.
+// OnComplete(v, callback) defers work (recycling an allocator, releasing a resource)
+// until the fence reaches v.
+//
+// Two backends implement it: D3D12TimelineFence wraps an ID3D12Fence signalled by a
+// command queue, and CpuTimelineFence below is plain C++, so code written against
+// TimelineFence runs headless on Linux with a thread standing in for the GPU.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class TimelineFence
+{
+public:
+	using Callback = std::function<void()>;
+
+	virtual ~TimelineFence() = default;
+
+	// Have the fence reach value once all the work submitted so far has completed.
+	virtual void Signal(uint64_t value) = 0;
+
+	virtual uint64_t GetCompletedValue() const = 0;
+	bool IsComplete(uint64_t value) const { return GetCompletedValue() >= value; }
+
+	// Block until the fence reaches value, then run the callbacks that became due.
+	virtual void WaitCPU(uint64_t value) = 0;
+
+	// Run callback once the fence reaches value; right away if it already has. Callbacks
+	// run in order of their values, from whichever thread calls Poll() (WaitCPU() and
+	// the CPU backend's Signal() do), and must not wait on the fence themselves.
+	void OnComplete(uint64_t value, Callback callback);
+
+	// Run the callbacks whose value has been reached. Returns how many ran.
+	size_t Poll();
+
+	size_t GetPendingCallbackCount() const;
+
+private:
+	struct PendingCallback
+	{
+		uint64_t value;
+		uint64_t sequence;	// Keeps callbacks of the same value in registration order
+		Callback callback;
+	};
+
+	mutable std::mutex m_callbackMutex;
+	std::vector<PendingCallback> m_callbacks;
+	uint64_t m_nextSequence = 0;
+
+	// Held while callbacks run so two threads polling at once cannot reorder them.
+	std::recursive_mutex m_pollMutex;
+};
+
+// Fence signalled from CPU threads. Signal() is typically called by a thread that plays
+// the GPU, e.g. a worker that "executes" submitted frames after a simulated delay.
+class CpuTimelineFence : public TimelineFence
+{
+public:
+	explicit CpuTimelineFence(uint64_t initialValue = 0);
+
+	// Values lower than the current one are ignored: the timeline never goes back.
+	void Signal(uint64_t value) override;
+	uint64_t GetCompletedValue() const override { return m_value.load(std::memory_order_acquire); }
+	void WaitCPU(uint64_t value) override;
+
+private:
+	std::atomic<uint64_t> m_value;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+};
+
+// Push frameCount frames through a ring of framesInFlight slots guarded by a
+// CpuTimelineFence, with a second thread executing the frames at a jittery pace.
+// Returns false if a slot was written while its previous frame still ran, a wait
+// returned early, or a completion callback was skipped, repeated or out of order.
+bool StressTimelineFence(uint32_t frameCount, uint32_t framesInFlight);
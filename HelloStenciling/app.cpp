@@ -10,9 +10,8 @@ app::app(UINT width, UINT height, std::wstring name, HINSTANCE hInstance, int nC
 	: IApp(width, height, name), m_width(width), m_height(height),
 	m_viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
 	m_scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
-	m_constantDataGpuAddr(0),
-	m_mappedConstantData(nullptr),
 	m_rtvDescriptorSize(0),
+	m_reportedUploadBytes(0),
 	m_frameIndex(0),
 	m_fenceValues{},
 	m_curRotationAngleRad(0.f)
@@ -109,28 +108,25 @@ void app::PopulateCommandList()
 	m_commandList->RSSetViewports(1, &m_viewport);
 	m_commandList->RSSetScissorRects(1, &m_scissorRect);
 
-	// Index into the available constant buffers based on the number
-	// of draw calls. We've allocated enough for a known number of
-	// draw calls per frame times the number of back buffers
-	unsigned int constantBufferIndex = c_numDrawCalls * (m_frameIndex % FrameCount);
-
-	ConstantBuffer cbParameters{};
+	// Set the per-frame constants, shared by every draw
+	PassConstants passParameters;
 
 	// Shaders compiled with default row-major matrices
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(m_cubeWorldMatrix));
-	XMStoreFloat4x4(&cbParameters.viewMatrix, XMMatrixTranspose(m_viewMatrix));
-	XMStoreFloat4x4(&cbParameters.projectionMatrix, XMMatrixTranspose(m_projectionMatrix));
+	XMStoreFloat4x4(&passParameters.Field<ViewMatrix>(), XMMatrixTranspose(m_viewMatrix));
+	XMStoreFloat4x4(&passParameters.Field<ProjectionMatrix>(), XMMatrixTranspose(m_projectionMatrix));
+
+	XMStoreFloat4(&passParameters.Field<LightDir>(), m_lightDir);
+	XMStoreFloat4(&passParameters.Field<LightColor>(), m_lightColor);
 
-	XMStoreFloat4(&cbParameters.lightDir, m_lightDir);
-	XMStoreFloat4(&cbParameters.lightColor, m_lightColor);
-	XMStoreFloat4(&cbParameters.outputColor, m_outputColor);
+	m_commandList->SetGraphicsRootConstantBufferView(c_passConstantsRootParameter, UploadConstants(passParameters));
 
-	// Set the constants for the first draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(cbParameters));
+	ObjectConstants cbParameters;
 
-	// Bind the constants to the shader
-	auto baseGpuAddress = m_constantDataGpuAddr + sizeof(PaddedConstantBuffer) * constantBufferIndex;
-	m_commandList->SetGraphicsRootConstantBufferView(0, m_constantDataGpuAddr);
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(m_cubeWorldMatrix));
+	XMStoreFloat4(&cbParameters.Field<OutputColor>(), m_outputColor);
+
+	// Set the constants for the first draw call and bind them to the shader
+	m_commandList->SetGraphicsRootConstantBufferView(c_objectConstantsRootParameter, UploadConstants(cbParameters));
 
 	// Indicate that the back buffer will be used as a render target.
 	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
@@ -152,8 +148,6 @@ void app::PopulateCommandList()
 
 	// Draw the Lambert lit cube
 	m_commandList->DrawIndexedInstanced(36, 1, 0, 0, 0);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
-	++constantBufferIndex;
 
 	// Set PSO for opaque objects
 	m_commandList->SetPipelineState(m_solidColorPipelineState.Get());
@@ -162,20 +156,14 @@ void app::PopulateCommandList()
 	for (int m = 0; m < 2; m++)
 	{
 		// Update world matrix and output color
-		XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixIdentity());
-		cbParameters.outputColor = m ? XMFLOAT4(.6f, .3f, 0.f, 1.f) : XMFLOAT4(1.0f, 0.9f, 0.7f, 1.0f);
-
-		// Set the constants for the draw call
-		memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+		XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixIdentity());
+		cbParameters.Field<OutputColor>() = m ? XMFLOAT4(.6f, .3f, 0.f, 1.f) : XMFLOAT4(1.0f, 0.9f, 0.7f, 1.0f);
 
-		// Bind the constants to the shader
-		m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
+		// Set the constants for the draw call and bind them to the shader
+		m_commandList->SetGraphicsRootConstantBufferView(c_objectConstantsRootParameter, UploadConstants(cbParameters));
 
 		if (m) m_commandList->DrawIndexedInstanced(18, 1, 42, 28, 0);
 		else m_commandList->DrawIndexedInstanced(6, 1, 36, 24, 0);
-
-		baseGpuAddress += sizeof(PaddedConstantBuffer);
-		++constantBufferIndex;
 	}
 
 	// Set PSO for drawing on the stencil buffer
@@ -187,8 +175,6 @@ void app::PopulateCommandList()
 	// Draw on the stencil buffer to mark the mirror
 	// We can re-use the constant buffer already bound to the pipeline
 	m_commandList->DrawIndexedInstanced(6, 1, 60, 38, 1);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
-	constantBufferIndex++;
 
 	// Set PSO for reflected, lit objects (the cube)
 	m_commandList->SetPipelineState(m_reflectedLambertianPipelineState.Get());
@@ -196,36 +182,26 @@ void app::PopulateCommandList()
 	// Update the world matrix of the cube to reflect it with respect to the mirror
 	XMVECTOR mirrorPlane = XMVectorSet(0.f, 0.f, 1.f, 0.f);
 	XMMATRIX R = XMMatrixReflect(mirrorPlane);
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(m_cubeWorldMatrix * R));
-
-	// Set the constants for the draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(m_cubeWorldMatrix * R));
 
-	// Bind the constants to the shader
-	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
+	// Set the constants for the draw call and bind them to the shader
+	m_commandList->SetGraphicsRootConstantBufferView(c_objectConstantsRootParameter, UploadConstants(cbParameters));
 
 	// Draw the reflected, lit cube
 	m_commandList->DrawIndexedInstanced(36, 1, 0, 0, 0);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
-	constantBufferIndex++;
 
 	// Set PSO for reflected, non-illuminated objects (floor and shadow)
 	m_commandList->SetPipelineState(m_reflectedSolidColorPipelineState.Get());
 
 	// Update world matrix and output color of the floor to reflect it with respect to the mirror
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(XMMatrixIdentity() * R));
-	cbParameters.outputColor = XMFLOAT4(1.f, .9f, .7f, 1.f);
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(XMMatrixIdentity() * R));
+	cbParameters.Field<OutputColor>() = XMFLOAT4(1.f, .9f, .7f, 1.f);
 
-	// Set the constants for the draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
-
-	// Bind the constants to the shader
-	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
+	// Set the constants for the draw call and bind them to the shader
+	m_commandList->SetGraphicsRootConstantBufferView(c_objectConstantsRootParameter, UploadConstants(cbParameters));
 
 	// Draw the reflected floor
 	m_commandList->DrawIndexedInstanced(6, 1, 36, 24, 0);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
-	constantBufferIndex++;
 
 	// Set PSO for transparent object projected on other surfaces (planar shadow of the cube)
 	m_commandList->SetPipelineState(m_projectedPipelineState.Get());
@@ -238,51 +214,38 @@ void app::PopulateCommandList()
 	XMVECTOR shadowPlane = XMVectorSet(0.f, 1.f, 0.f, 0.f);
 	XMMATRIX S = XMMatrixShadow(shadowPlane, m_lightDir);
 	XMMATRIX shadowOffsetY = XMMatrixTranslation(0.f, .003f, 0.f);
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(m_cubeWorldMatrix * S * shadowOffsetY));
-	cbParameters.outputColor = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.2f);
-
-	// Set the constants for the draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(m_cubeWorldMatrix * S * shadowOffsetY));
+	cbParameters.Field<OutputColor>() = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.2f);
 
-	// Bind the constants to the shader
-	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
+	// Set the constants for the draw call and bind them to the shader
+	m_commandList->SetGraphicsRootConstantBufferView(c_objectConstantsRootParameter, UploadConstants(cbParameters));
 
 	// Draw the shadow of the cube
 	m_commandList->DrawIndexedInstanced(36, 1, 0, 0, 0);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
-	constantBufferIndex++;
 
 	// Set stencil ref. value to 1
 	m_commandList->OMSetStencilRef(1);
 
 	// Update world matrix and output color to draw the shadow of the cube
 	// reflected into the mirror.
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixTranspose(m_cubeWorldMatrix * S * shadowOffsetY * R));
-	cbParameters.outputColor = XMFLOAT4(0.f, 0.f, 0.f, 0.2f);
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixTranspose(m_cubeWorldMatrix * S * shadowOffsetY * R));
+	cbParameters.Field<OutputColor>() = XMFLOAT4(0.f, 0.f, 0.f, 0.2f);
 
-	// Set the constants for the draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
-
-	// Bind the constants to the shader
-	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
+	// Set the constants for the draw call and bind them to the shader
+	m_commandList->SetGraphicsRootConstantBufferView(c_objectConstantsRootParameter, UploadConstants(cbParameters));
 
 	// Draw the shadow of the cube reflected into the mirror
 	m_commandList->DrawIndexedInstanced(36, 1, 0, 0, 0);
-	baseGpuAddress += sizeof(PaddedConstantBuffer);
-	constantBufferIndex++;
 
 	// Set PSO for transparent objects (mirror)
 	m_commandList->SetPipelineState(m_blendingPipelineState.Get());
 
 	// Update world matrix and output color.
-	XMStoreFloat4x4(&cbParameters.worldMatrix, XMMatrixIdentity());
-	cbParameters.outputColor = XMFLOAT4(0.5f, 1.0f, 1.0f, 0.15f);
-
-	// Set the constants for the draw call
-	memcpy(&m_mappedConstantData[constantBufferIndex], &cbParameters, sizeof(ConstantBuffer));
+	XMStoreFloat4x4(&cbParameters.Field<WorldMatrix>(), XMMatrixIdentity());
+	cbParameters.Field<OutputColor>() = XMFLOAT4(0.5f, 1.0f, 1.0f, 0.15f);
 
-	// Bind the constants to the shader
-	m_commandList->SetGraphicsRootConstantBufferView(0, baseGpuAddress);
+	// Set the constants for the draw call and bind them to the shader
+	m_commandList->SetGraphicsRootConstantBufferView(c_objectConstantsRootParameter, UploadConstants(cbParameters));
 
 	// Draw the mirror
 	m_commandList->DrawIndexedInstanced(6, 1, 60, 38, 0);
@@ -427,10 +390,11 @@ void app::LoadAssets() {
 		featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
 	}
 
-	// Create a root signature with one constant buffer view.
+	// Create a root signature with a constant buffer view for the pass and one for the object.
 	{
-		CD3DX12_ROOT_PARAMETER1 rp[1]{};
-		rp[0].InitAsConstantBufferView(0, 0);
+		CD3DX12_ROOT_PARAMETER1 rp[2]{};
+		rp[c_passConstantsRootParameter].InitAsConstantBufferView(0, 0);
+		rp[c_objectConstantsRootParameter].InitAsConstantBufferView(1, 0);
 
 		D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags =
 			D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
@@ -447,24 +411,25 @@ void app::LoadAssets() {
 		ThrowIfFailed(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_rootSignature)));
 	}
 
-	// Create the constant buffer memory and map the resource
+	// Create the upload ring and leave it mapped; the constants of every draw are allocated from it.
 	{
 		const D3D12_HEAP_PROPERTIES uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		size_t cbSize = c_numDrawCalls * FrameCount * sizeof(PaddedConstantBuffer);
 
-		const D3D12_RESOURCE_DESC constantBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(cbSize);
+		const D3D12_RESOURCE_DESC uploadBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(c_uploadRingSize);
 		ThrowIfFailed(m_device->CreateCommittedResource(
 			&uploadHeapProperties, 
 			D3D12_HEAP_FLAG_NONE, 
-			&constantBufferDesc, 
+			&uploadBufferDesc, 
 			D3D12_RESOURCE_STATE_GENERIC_READ, 
 			nullptr, 
-			IID_PPV_ARGS(m_perFrameConstants.ReleaseAndGetAddressOf())
+			IID_PPV_ARGS(m_uploadBuffer.ReleaseAndGetAddressOf())
 		));
-		ThrowIfFailed(m_perFrameConstants->Map(0, nullptr, reinterpret_cast<void**>(&m_mappedConstantData)));
 
-
-		m_constantDataGpuAddr = m_perFrameConstants->GetGPUVirtualAddress();
+		void* pUploadData = nullptr;
+		CD3DX12_RANGE readRange(0, 0);	// We do not intend to read from this resource on the CPU.
+		ThrowIfFailed(m_uploadBuffer->Map(0, &readRange, &pUploadData));
+		RegisterWriteCombined(pUploadData, static_cast<size_t>(c_uploadRingSize));	// Mapped, and registered, for the life of the app.
+		m_uploadRing = std::make_unique<UploadRing>(pUploadData, m_uploadBuffer->GetGPUVirtualAddress(), c_uploadRingSize);
 	}
 
 	// Create the pipeline state, which includes compiling and loading shaders.
@@ -685,7 +650,7 @@ void app::LoadAssets() {
 		UINT8* pVertexDataBegin = nullptr;
 		CD3DX12_RANGE readRange(0, 0);	// We do not intend to read from this resource on the CPU.
 		ThrowIfFailed(m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, vertices, sizeof(vertices));
+		UploadCopy(pVertexDataBegin, vertices, sizeof(vertices));
 		m_vertexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view.
@@ -753,7 +718,7 @@ void app::LoadAssets() {
 		));
 		// Copy the geometry data to the index buffer.
 		ThrowIfFailed(m_indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, indices, sizeof(indices));
+		UploadCopy(pVertexDataBegin, indices, sizeof(indices));
 		m_indexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view.
@@ -764,16 +729,9 @@ void app::LoadAssets() {
 
 	// Create synchronization objects and wait until assets have been uploaded to the GPU.
 	{
-		ThrowIfFailed(m_device->CreateFence(m_fenceValues[m_frameIndex], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+		m_fence = std::make_unique<D3D12TimelineFence>(m_device.Get(), m_commandQueue.Get(), m_fenceValues[m_frameIndex]);
 		m_fenceValues[m_frameIndex]++;
 
-		// Create an event handle to use for frame synchronization.
-		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-		if (m_fenceEvent == nullptr)
-		{
-			ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
-		}
-
 		// Wait for the command list to execute; we are reusing the same command 
 		// list in our main loop but for now, we just want to wait for setup to 
 		// complete before continuing.
@@ -796,24 +754,58 @@ void app::OnKeyUp(UINT8 key)
 void app::MoveToNextFrame() 
 {
 	const UINT64 currentFenceValue = m_fenceValues[m_frameIndex];
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), currentFenceValue));
-	
-	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+	m_fence->Signal(currentFenceValue);
+	m_uploadRing->EndFrame(currentFenceValue);
 
-	if (m_fence->GetCompletedValue() < m_fenceValues[m_frameIndex])
+	// Report the constant data a frame uploads whenever it changes.
+	const UINT64 uploadBytes = m_uploadRing->GetLastFrameUploadBytes();
+	if (uploadBytes != m_reportedUploadBytes)
 	{
-		ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex], m_fenceEvent));
-		WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+		wchar_t text[64];
+		swprintf_s(text, L"Upload: %llu bytes per frame\n", uploadBytes);
+		OutputDebugStringW(text);
+		m_reportedUploadBytes = uploadBytes;
 	}
+	
+	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+
+	m_fence->WaitCPU(m_fenceValues[m_frameIndex]);
 
 	m_fenceValues[m_frameIndex] = currentFenceValue + 1;
+	m_uploadRing->Reclaim(m_fence->GetCompletedValue());
 }
 void app::WaitForGPU() 
 {
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_fenceValues[m_frameIndex]));
+	m_fence->Signal(m_fenceValues[m_frameIndex]);
 
-	ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_frameIndex], m_fenceEvent));
-	WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
+	m_fence->WaitCPU(m_fenceValues[m_frameIndex]);
 	
 	m_fenceValues[m_frameIndex]++;
+	m_uploadRing->Reclaim(m_fence->GetCompletedValue());
+}
+
+UploadAllocation app::AllocateUpload(UINT64 size, UINT64 alignment)
+{
+	UploadAllocation allocation;
+	while (!m_uploadRing->TryAllocate(size, alignment, allocation))
+	{
+		// The frames still in flight hold the rest of the ring; wait for the oldest one.
+		const UINT64 fenceValue = m_uploadRing->GetOldestFenceValue();
+		if (fenceValue == 0)
+		{
+			// A single frame needs more than c_uploadRingSize.
+			throw std::exception();
+		}
+
+		m_fence->WaitCPU(fenceValue);
+		m_uploadRing->Reclaim(m_fence->GetCompletedValue());
+	}
+	return allocation;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS app::UploadConstants(const void* pData, UINT64 size)
+{
+	const UploadAllocation allocation = AllocateUpload(size, UploadRing::ConstantBufferAlignment);
+	UploadCopy(allocation.cpuAddress, pData, static_cast<size_t>(size));
+	return allocation.gpuAddress;
 }
\ No newline at end of file
@@ -1,6 +1,12 @@
 #pragma once
 
 #include "IApp.h"
+#include "UploadRing.h"
+#include "CbufferLayout.h"
+#include "UploadCopy.h"
+#include "D3D12TimelineFence.h"
+
+#include <memory>
 
 using namespace DirectX;
 
@@ -45,26 +51,23 @@ private:
 		XMFLOAT3 normal;
 	};
 
-	struct ConstantBuffer
-	{
-		XMFLOAT4X4 worldMatrix;			// 64 bytes
-		XMFLOAT4X4 viewMatrix;			// 64 bytes
-		XMFLOAT4X4 projectionMatrix;	// 64 bytes
-		XMFLOAT4 lightDir;				// 16 bytes
-		XMFLOAT4 lightColor;			// 16 bytes
-		XMFLOAT4 outputColor;			// 16 bytes
-	};
-	// We'll allocate space for several of these and they will need to be padded for alignment.
-	static_assert(sizeof(ConstantBuffer) == 240);
-
-	// 240 < D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
-	// Create a union with the correct size and enough room for one ConstantBuffer
-	union PaddedConstantBuffer {
-		ConstantBuffer constant;
-		uint8_t bytes[D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT];
-	};
-	// Check the exact size of the PaddedConstantBuffer to make sure it will align properly
-	static_assert(sizeof(PaddedConstantBuffer) == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	// cbuffer PassConstants in shaders.hlsl: camera and light, uploaded once per frame.
+	struct ViewMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ProjectionMatrix : CbufferField<XMFLOAT4X4> {};
+	struct LightDir : CbufferField<XMFLOAT4> {};
+	struct LightColor : CbufferField<XMFLOAT4> {};
+	using PassConstants = CbufferStruct<ViewMatrix, ProjectionMatrix, LightDir, LightColor>;
+	static_assert(PassConstants::Size == 160);
+
+	// cbuffer ObjectConstants in shaders.hlsl: uploaded for every draw.
+	struct WorldMatrix : CbufferField<XMFLOAT4X4> {};
+	struct OutputColor : CbufferField<XMFLOAT4> {};
+	using ObjectConstants = CbufferStruct<WorldMatrix, OutputColor>;
+	static_assert(ObjectConstants::Size == 80);
+
+	// Root signature slots of the two blocks, registers b0 and b1.
+	static const UINT c_passConstantsRootParameter = 0;
+	static const UINT c_objectConstantsRootParameter = 1;
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
@@ -90,26 +93,26 @@ private:
 	// App resources.
 	ComPtr<ID3D12Resource> m_vertexBuffer;
 	ComPtr<ID3D12Resource> m_indexBuffer;
-	ComPtr<ID3D12Resource> m_perFrameConstants;
 	D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 	D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
-	D3D12_GPU_VIRTUAL_ADDRESS m_constantDataGpuAddr;
-	PaddedConstantBuffer* m_mappedConstantData;
 	UINT m_rtvDescriptorSize;
 
+	// Per-frame upload memory: one persistently mapped buffer that every frame allocates
+	// its constants from, released a frame at a time as the fence passes it.
+	static const UINT64 c_uploadRingSize = 1024 * 1024;
+	ComPtr<ID3D12Resource> m_uploadBuffer;
+	std::unique_ptr<UploadRing> m_uploadRing;
+	UINT64 m_reportedUploadBytes;
+
 	// Synchronization objects.
 	UINT m_frameIndex;
-	HANDLE m_fenceEvent;
-	ComPtr<ID3D12Fence> m_fence;
+	std::unique_ptr<D3D12TimelineFence> m_fence;
 	UINT64 m_fenceValues[FrameCount];
 
 	// Scene constants, updated per-frame
 	float m_curRotationAngleRad;
 
-	// In this sample we have nine draw calls.
-	static const unsigned int c_numDrawCalls = 9;
-
-	// These computed values will be loaded into a ConstantBuffer
+	// These computed values will be loaded into PassConstants and ObjectConstants
 	// during Render
 	XMMATRIX m_cubeWorldMatrix;
 	XMMATRIX m_viewMatrix;
@@ -124,6 +127,17 @@ private:
 	void MoveToNextFrame();
 	void WaitForGPU();
 
+	// Allocate from m_uploadRing, waiting for the GPU to release older frames if it is full.
+	UploadAllocation AllocateUpload(UINT64 size, UINT64 alignment);
+	D3D12_GPU_VIRTUAL_ADDRESS UploadConstants(const void* pData, UINT64 size);
+
+	// Copy one cbuffer block to m_uploadRing and return the address to bind it at.
+	template<typename Constants>
+	D3D12_GPU_VIRTUAL_ADDRESS UploadConstants(const Constants& constants)
+	{
+		return UploadConstants(constants.GetData(), Constants::Size);
+	}
+
 	inline std::wstring GetAssetFullPath(LPCWSTR assetName) {
 		return m_assetsPath + assetName;
 	}
@@ -9,13 +9,17 @@
 //--------------------------------------------------------------------------------------
 // Constant Buffer Variables
 //--------------------------------------------------------------------------------------
-cbuffer Constants : register(b0)
+cbuffer PassConstants : register(b0)
 {
-	float4x4 mWorld;
 	float4x4 mView;
 	float4x4 mProjection;
 	float4 lightDir;
 	float4 lightColor;
+};
+
+cbuffer ObjectConstants : register(b1)
+{
+	float4x4 mWorld;
 	float4 outputColor;
 };
 
@@ -0,0 +1,78 @@
+#pragma once
+
+// Copies into write-combined memory: the CPU mappings of D3D12 upload heaps.
+//
+// Write-combined memory is not cached. Stores gather in a few 64-byte line buffers that
+// go out over the bus once full, so partial or out of order lines cost extra
+// transactions, and reads stall until the data comes back from the device. The kernels
+// here write the destination strictly front to back: a few bytes up to the first aligned
+// address, then aligned 16- or 32-byte stores a whole cache line per loop iteration, then
+// the tail. The copies the samples make (256-byte constant blocks, vertex and index
+// buffers of a few kilobytes, UploadService staging pieces of at most a quarter of its
+// ring) stay below StreamingThreshold, so they take ordinary stores throughout. Only copies from StreamingThreshold up make the aligned
+// stores non-temporal, with a store fence at the end to make them visible before the
+// caller signals the GPU.
+//
+// AArch64 has no streaming store intrinsic; the NEON kernel keeps the same aligned,
+// in-order line writes with regular stores. UploadCopy() picks the kernel for
+// DetectSimdLevel() on first use. No Windows dependency.
+//
+// Debug guard: mappings registered with RegisterWriteCombined() must never be read by
+// the CPU. UploadCopy() throws if its source overlaps one, and code that reads memory of
+// unknown origin can check it with CheckNotWriteCombined(). Both checks compile to
+// nothing unless _DEBUG or UPLOAD_COPY_GUARD is defined.
+
+#include "SimdLevel.h"
+
+#include <cstddef>
+#include <exception>
+
+#if defined(_DEBUG) || defined(UPLOAD_COPY_GUARD)
+#define UPLOAD_COPY_GUARD_ENABLED 1
+#endif
+
+// Copy size bytes from ordinary memory to a write-combined mapping.
+void UploadCopy(void* pDest, const void* pSrc, size_t size);
+
+// Kernels, exposed so they can be benchmarked and checked against each other.
+namespace UploadCopyKernels
+{
+	// Smaller copies use ordinary aligned stores, in the same order and without the fence:
+	// they fill whole lines just the same, and on a cached mapping (UMA) streaming a copy
+	// that fits in the cache costs more than it saves. See ParticleBenchmark -upload.
+	constexpr size_t StreamingThreshold = 1024 * 1024;
+
+	void CopyScalar(void* pDest, const void* pSrc, size_t size);
+	void CopySSE2(void* pDest, const void* pSrc, size_t size);
+	void CopyAVX2(void* pDest, const void* pSrc, size_t size);
+	void CopyNEON(void* pDest, const void* pSrc, size_t size);
+
+	using CopyFunc = void (*)(void*, const void*, size_t);
+
+	// Kernel for a level, the scalar one if this build does not have it.
+	CopyFunc Select(SimdLevel level);
+}
+
+// Write-combined ranges, kept whatever the build so IsWriteCombined() always answers.
+void RegisterWriteCombined(const void* pBegin, size_t size);
+void UnregisterWriteCombined(const void* pBegin);
+bool IsWriteCombined(const void* p, size_t size);
+
+// Throws if [p, p + size) overlaps a registered mapping, in guarded builds only.
+inline void CheckNotWriteCombined(const void* p, size_t size)
+{
+#if defined(UPLOAD_COPY_GUARD_ENABLED)
+	if (IsWriteCombined(p, size))
+	{
+		throw std::exception();
+	}
+#else
+	(void)p;
+	(void)size;
+#endif
+}
+
+// Run every kernel this machine supports over all head and tail alignments and a few
+// large sizes. Returns false if a copy differs from memcpy or writes outside its
+// destination, or if the write-combined registry misses an overlap.
+bool VerifyUploadCopy();
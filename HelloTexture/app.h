@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "IApp.h"
+#include "UploadCopy.h"
 
 using namespace DirectX;
 
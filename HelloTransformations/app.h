@@ -1,6 +1,8 @@
 #pragma once
 
 #include "IApp.h"
+#include "CbufferLayout.h"
+#include "UploadCopy.h"
 
 using namespace DirectX;
 
@@ -44,13 +46,15 @@ private:
 		XMFLOAT4 color;
 	};
 
-	struct ConstantBuffer {
-		XMFLOAT4X4 worldMatrix;			// 64
-		XMFLOAT4X4 viewMatrix;			// 64
-		XMFLOAT4X4 projectionMatrix;	// 64
-		XMFLOAT4 padding[4];			// To align 256-byte
-	};
-	static_assert((sizeof(ConstantBuffer) % 256) == 0, "");
+	// cbuffer in shaders.hlsl, field by field and in the same order. The offsets and the
+	// size follow the HLSL packing rules, see CbufferLayout.h.
+	struct WorldMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ViewMatrix : CbufferField<XMFLOAT4X4> {};
+	struct ProjectionMatrix : CbufferField<XMFLOAT4X4> {};
+	using ConstantBuffer = CbufferStruct<WorldMatrix, ViewMatrix, ProjectionMatrix>;
+
+	// Each draw call gets its own constant buffer placement.
+	static_assert(ConstantBuffer::PlacementSize == D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
@@ -74,7 +78,7 @@ private:
 	D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
 	D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
 	D3D12_GPU_VIRTUAL_ADDRESS m_constantDataGPUAddr;
-	ConstantBuffer* m_mappedConstantData;
+	UINT8* m_mappedConstantData;
 	UINT m_rtvDescriptorSize;
 
 	// Synchronization objects.
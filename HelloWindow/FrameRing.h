@@ -0,0 +1,155 @@
+#pragma once
+
+// Fence bookkeeping for a ring of per-frame resources (command allocators, upload slices).
+//
+// Every frame records into the slot at GetCurrentIndex() and signals the value EndFrame()
+// returns once its commands are submitted. A slot may only be reused once the frame that
+// used it last has completed, i.e. once the fence reached GetReuseFenceValue(). With two
+// slots the CPU records frame N+1 while the GPU still executes frame N, and only blocks
+// when it gets a whole ring ahead.
+//
+// The ring only hands out slot indices and fence values; signalling and waiting is up to
+// the caller. No Windows dependency, so SimulateFrameRing() runs anywhere.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class FrameRing
+{
+public:
+	explicit FrameRing(uint32_t frameCount) :
+		m_fenceValues(frameCount, 0),
+		m_current(0),
+		m_nextFenceValue(1)
+	{
+	}
+
+	uint32_t GetFrameCount() const { return static_cast<uint32_t>(m_fenceValues.size()); }
+	uint32_t GetCurrentIndex() const { return m_current; }
+
+	// Fence value the frame being recorded will signal.
+	uint64_t GetCurrentFenceValue() const { return m_nextFenceValue; }
+
+	// Value the fence must reach before the current slot may be written, 0 if it was never used.
+	uint64_t GetReuseFenceValue() const { return m_fenceValues[m_current]; }
+
+	// Close the current frame and move to the next slot. Returns the value to signal
+	// after the frame's commands.
+	uint64_t EndFrame()
+	{
+		const uint64_t fenceValue = m_nextFenceValue++;
+		m_fenceValues[m_current] = fenceValue;
+		m_current = (m_current + 1) % GetFrameCount();
+		return fenceValue;
+	}
+
+	// Value to signal and wait for to drain the GPU, e.g. at startup or before destruction.
+	// Once it completed, every slot is free.
+	uint64_t Flush()
+	{
+		return m_nextFenceValue++;
+	}
+
+private:
+	std::vector<uint64_t> m_fenceValues;
+	uint32_t m_current;
+	uint64_t m_nextFenceValue;
+};
+
+// Outcome of pushing a sequence of frames through a FrameRing against a simulated GPU.
+struct FrameRingSimulation
+{
+	uint32_t overlappedFrames;	// Frames recorded while the GPU was still executing the previous one
+	uint32_t reuseViolations;	// Frames that wrote a slot the GPU had not finished reading
+	double cpuWaitTime;			// Time the CPU spent blocked on the fence
+	double totalTime;			// Until the GPU completed the last frame
+};
+
+// Replay frameCount frames: frame i takes cpuCosts[i] to record and gpuCosts[i] to execute.
+// The GPU runs frames in submission order; the simulated fence reaches a frame's value
+// when its execution ends. The CPU waits exactly as an app driving the ring would.
+inline FrameRingSimulation SimulateFrameRing(uint32_t ringSize, uint32_t frameCount, const double* cpuCosts, const double* gpuCosts)
+{
+	FrameRing ring(ringSize);
+	FrameRingSimulation result = {};
+
+	// completionTimes[v]: when the fence reaches value v. Value 0 is reached from the start.
+	std::vector<double> completionTimes(1, 0.);
+	std::vector<double> slotReleaseTimes(ringSize, 0.);
+	double cpuTime = 0.;
+	double gpuTime = 0.;
+
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		// Block until the fence reaches the value the ring gates the slot on.
+		const double readyTime = completionTimes[static_cast<size_t>(ring.GetReuseFenceValue())];
+		if (readyTime > cpuTime)
+		{
+			result.cpuWaitTime += readyTime - cpuTime;
+			cpuTime = readyTime;
+		}
+
+		const uint32_t slot = ring.GetCurrentIndex();
+		if (cpuTime < slotReleaseTimes[slot])
+		{
+			result.reuseViolations++;
+		}
+		if (cpuTime < gpuTime)
+		{
+			result.overlappedFrames++;
+		}
+
+		cpuTime += cpuCosts[frame];
+
+		const uint64_t fenceValue = ring.EndFrame();
+		gpuTime = (std::max)(gpuTime, cpuTime) + gpuCosts[frame];
+		completionTimes.resize(static_cast<size_t>(fenceValue) + 1, gpuTime);
+		completionTimes[static_cast<size_t>(fenceValue)] = gpuTime;
+		slotReleaseTimes[slot] = gpuTime;
+	}
+
+	result.totalTime = gpuTime;
+	return result;
+}
+
+// Run SimulateFrameRing() over steady, GPU-bound, CPU-bound and spiky workloads. Returns
+// false if a slot was ever reused too early, or if a GPU-bound workload failed to overlap
+// CPU recording with GPU execution.
+inline bool VerifyFrameRing(uint32_t ringSize)
+{
+	const uint32_t frameCount = 64;
+	std::vector<double> cpuCosts(frameCount), gpuCosts(frameCount);
+
+	for (int workload = 0; workload < 4; workload++)
+	{
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			switch (workload)
+			{
+			case 0: cpuCosts[frame] = 1.; gpuCosts[frame] = 1.; break;
+			case 1: cpuCosts[frame] = 1.; gpuCosts[frame] = 3.; break;
+			case 2: cpuCosts[frame] = 3.; gpuCosts[frame] = 1.; break;
+			default:
+				cpuCosts[frame] = 1. + (frame % 7 == 0 ? 5. : 0.);
+				gpuCosts[frame] = 1. + (frame % 5 == 0 ? 8. : 0.);
+				break;
+			}
+		}
+
+		const FrameRingSimulation simulation = SimulateFrameRing(ringSize, frameCount, cpuCosts.data(), gpuCosts.data());
+		if (simulation.reuseViolations != 0)
+		{
+			return false;
+		}
+
+		// While the GPU is the bottleneck, every frame after the first should be recorded
+		// while the previous one executes.
+		if (workload == 1 && ringSize > 1 && simulation.overlappedFrames < frameCount - 1)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Instruction set levels the CPU kernels are written for, and detection of the highest
+// one the build and the running CPU both support. Shared by the particle kernels and the
+// upload copies. No Windows dependency.
+
+enum class SimdLevel
+{
+	Scalar,
+	SSE,
+	AVX2,
+	NEON
+};
+
+const char* SimdLevelName(SimdLevel level);
+
+// Highest kernel level supported by both the build and the CPU we are running on.
+SimdLevel DetectSimdLevel();
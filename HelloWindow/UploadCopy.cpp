@@ -0,0 +1,335 @@
+#include "UploadCopy.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define UPLOAD_COPY_X86 1
+#include <immintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define UPLOAD_COPY_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Same as in ParticleSimulator.cpp: GCC and Clang need AVX2 enabled per function.
+#if defined(__GNUC__) || defined(__clang__)
+#define UPLOAD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define UPLOAD_TARGET_AVX2
+#endif
+
+namespace
+{
+	// Bytes to write with ordinary stores before the destination reaches the alignment.
+	size_t HeadSize(const void* pDest, size_t size, size_t alignment)
+	{
+		const size_t misalignment = reinterpret_cast<uintptr_t>(pDest) & (alignment - 1);
+		return std::min(size, misalignment ? alignment - misalignment : 0);
+	}
+
+	struct WriteCombinedRange
+	{
+		uintptr_t begin;
+		uintptr_t end;
+	};
+
+	std::mutex s_writeCombinedMutex;
+	std::vector<WriteCombinedRange> s_writeCombinedRanges;
+}
+
+namespace UploadCopyKernels
+{
+	void CopyScalar(void* pDest, const void* pSrc, size_t size)
+	{
+		memcpy(pDest, pSrc, size);
+	}
+
+#if defined(UPLOAD_COPY_X86)
+	template<bool Stream>
+	inline void Store(__m128i* p, __m128i value)
+	{
+		if (Stream)
+		{
+			_mm_stream_si128(p, value);
+		}
+		else
+		{
+			_mm_store_si128(p, value);
+		}
+	}
+
+	template<bool Stream>
+	UPLOAD_TARGET_AVX2 inline void Store(__m256i* p, __m256i value)
+	{
+		if (Stream)
+		{
+			_mm256_stream_si256(p, value);
+		}
+		else
+		{
+			_mm256_store_si256(p, value);
+		}
+	}
+
+	template<bool Stream>
+	void CopySSE2Impl(void* pDest, const void* pSrc, size_t size)
+	{
+		uint8_t* d = static_cast<uint8_t*>(pDest);
+		const uint8_t* s = static_cast<const uint8_t*>(pSrc);
+
+		const size_t head = HeadSize(d, size, 16);
+		memcpy(d, s, head);
+		d += head;
+		s += head;
+		size -= head;
+
+		// A cache line per iteration, so every line buffer fills completely.
+		for (; size >= 64; size -= 64, d += 64, s += 64)
+		{
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+			const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+			const __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+			Store<Stream>(reinterpret_cast<__m128i*>(d), a);
+			Store<Stream>(reinterpret_cast<__m128i*>(d + 16), b);
+			Store<Stream>(reinterpret_cast<__m128i*>(d + 32), c);
+			Store<Stream>(reinterpret_cast<__m128i*>(d + 48), e);
+		}
+		for (; size >= 16; size -= 16, d += 16, s += 16)
+		{
+			Store<Stream>(reinterpret_cast<__m128i*>(d), _mm_loadu_si128(reinterpret_cast<const __m128i*>(s)));
+		}
+
+		memcpy(d, s, size);
+		if (Stream)
+		{
+			_mm_sfence();
+		}
+	}
+
+	template<bool Stream>
+	UPLOAD_TARGET_AVX2 void CopyAVX2Impl(void* pDest, const void* pSrc, size_t size)
+	{
+		uint8_t* d = static_cast<uint8_t*>(pDest);
+		const uint8_t* s = static_cast<const uint8_t*>(pSrc);
+
+		const size_t head = HeadSize(d, size, 32);
+		memcpy(d, s, head);
+		d += head;
+		s += head;
+		size -= head;
+
+		// Two cache lines per iteration.
+		for (; size >= 128; size -= 128, d += 128, s += 128)
+		{
+			const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+			const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 32));
+			const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 64));
+			const __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 96));
+			Store<Stream>(reinterpret_cast<__m256i*>(d), a);
+			Store<Stream>(reinterpret_cast<__m256i*>(d + 32), b);
+			Store<Stream>(reinterpret_cast<__m256i*>(d + 64), c);
+			Store<Stream>(reinterpret_cast<__m256i*>(d + 96), e);
+		}
+		for (; size >= 32; size -= 32, d += 32, s += 32)
+		{
+			Store<Stream>(reinterpret_cast<__m256i*>(d), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s)));
+		}
+
+		memcpy(d, s, size);
+		if (Stream)
+		{
+			_mm_sfence();
+		}
+	}
+
+	void CopySSE2(void* pDest, const void* pSrc, size_t size)
+	{
+		if (size >= StreamingThreshold)
+		{
+			CopySSE2Impl<true>(pDest, pSrc, size);
+		}
+		else
+		{
+			CopySSE2Impl<false>(pDest, pSrc, size);
+		}
+	}
+
+	void CopyAVX2(void* pDest, const void* pSrc, size_t size)
+	{
+		if (size >= StreamingThreshold)
+		{
+			CopyAVX2Impl<true>(pDest, pSrc, size);
+		}
+		else
+		{
+			CopyAVX2Impl<false>(pDest, pSrc, size);
+		}
+	}
+#else
+	void CopySSE2(void* pDest, const void* pSrc, size_t size) { CopyScalar(pDest, pSrc, size); }
+	void CopyAVX2(void* pDest, const void* pSrc, size_t size) { CopyScalar(pDest, pSrc, size); }
+#endif
+
+#if defined(UPLOAD_COPY_NEON)
+	void CopyNEON(void* pDest, const void* pSrc, size_t size)
+	{
+		uint8_t* d = static_cast<uint8_t*>(pDest);
+		const uint8_t* s = static_cast<const uint8_t*>(pSrc);
+
+		const size_t head = HeadSize(d, size, 16);
+		memcpy(d, s, head);
+		d += head;
+		s += head;
+		size -= head;
+
+		for (; size >= 64; size -= 64, d += 64, s += 64)
+		{
+			const uint8x16_t a = vld1q_u8(s);
+			const uint8x16_t b = vld1q_u8(s + 16);
+			const uint8x16_t c = vld1q_u8(s + 32);
+			const uint8x16_t e = vld1q_u8(s + 48);
+			vst1q_u8(d, a);
+			vst1q_u8(d + 16, b);
+			vst1q_u8(d + 32, c);
+			vst1q_u8(d + 48, e);
+		}
+		for (; size >= 16; size -= 16, d += 16, s += 16)
+		{
+			vst1q_u8(d, vld1q_u8(s));
+		}
+
+		memcpy(d, s, size);
+	}
+#else
+	void CopyNEON(void* pDest, const void* pSrc, size_t size) { CopyScalar(pDest, pSrc, size); }
+#endif
+
+	CopyFunc Select(SimdLevel level)
+	{
+		switch (level)
+		{
+#if defined(UPLOAD_COPY_X86)
+		case SimdLevel::SSE: return CopySSE2;
+		case SimdLevel::AVX2: return CopyAVX2;
+#endif
+#if defined(UPLOAD_COPY_NEON)
+		case SimdLevel::NEON: return CopyNEON;
+#endif
+		default: return CopyScalar;
+		}
+	}
+}
+
+void UploadCopy(void* pDest, const void* pSrc, size_t size)
+{
+	static const UploadCopyKernels::CopyFunc copy = UploadCopyKernels::Select(DetectSimdLevel());
+
+	CheckNotWriteCombined(pSrc, size);
+	copy(pDest, pSrc, size);
+}
+
+void RegisterWriteCombined(const void* pBegin, size_t size)
+{
+	const uintptr_t begin = reinterpret_cast<uintptr_t>(pBegin);
+
+	std::lock_guard<std::mutex> lock(s_writeCombinedMutex);
+	s_writeCombinedRanges.push_back({ begin, begin + size });
+}
+
+void UnregisterWriteCombined(const void* pBegin)
+{
+	const uintptr_t begin = reinterpret_cast<uintptr_t>(pBegin);
+
+	std::lock_guard<std::mutex> lock(s_writeCombinedMutex);
+	s_writeCombinedRanges.erase(std::remove_if(s_writeCombinedRanges.begin(), s_writeCombinedRanges.end(),
+		[begin](const WriteCombinedRange& range) { return range.begin == begin; }), s_writeCombinedRanges.end());
+}
+
+bool IsWriteCombined(const void* p, size_t size)
+{
+	const uintptr_t begin = reinterpret_cast<uintptr_t>(p);
+	const uintptr_t end = begin + size;
+
+	std::lock_guard<std::mutex> lock(s_writeCombinedMutex);
+	for (const WriteCombinedRange& range : s_writeCombinedRanges)
+	{
+		if (begin < range.end && range.begin < end)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool VerifyUploadCopy()
+{
+	const SimdLevel detected = DetectSimdLevel();
+	std::vector<SimdLevel> levels = { SimdLevel::Scalar };
+	if (detected == SimdLevel::SSE || detected == SimdLevel::AVX2)
+	{
+		levels.push_back(SimdLevel::SSE);
+	}
+	if (detected != SimdLevel::Scalar && detected != SimdLevel::SSE)
+	{
+		levels.push_back(detected);
+	}
+
+	// Every head and tail combination up to a few lines, then constant, vertex and texture-like sizes.
+	std::vector<size_t> sizes;
+	for (size_t size = 0; size <= 300; size++)
+	{
+		sizes.push_back(size);
+	}
+	sizes.push_back(4096 + 7);
+	sizes.push_back(65536 + 33);
+	sizes.push_back(UploadCopyKernels::StreamingThreshold + 33);
+
+	const size_t guard = 64;
+	const size_t maxOffset = 32;
+	const size_t maxSize = sizes.back();
+	std::vector<uint8_t> source(maxSize + guard);
+	std::vector<uint8_t> dest(maxOffset + maxSize + 2 * guard);
+	for (size_t i = 0; i < source.size(); i++)
+	{
+		source[i] = static_cast<uint8_t>(i * 7 + 3);
+	}
+
+	for (SimdLevel level : levels)
+	{
+		const UploadCopyKernels::CopyFunc copy = UploadCopyKernels::Select(level);
+		for (size_t size : sizes)
+		{
+			// Larger copies only at a few offsets to keep this fast.
+			const size_t offsets = size <= 300 ? maxOffset + 1 : 3;
+			for (size_t destOffset = 0; destOffset < offsets; destOffset++)
+			{
+				const size_t srcOffset = (destOffset * 5) % 17;
+				const size_t checked = guard + destOffset + size + guard;
+				std::fill(dest.begin(), dest.begin() + checked, uint8_t(0xcd));
+				copy(dest.data() + guard + destOffset, source.data() + srcOffset, size);
+
+				for (size_t i = 0; i < checked; i++)
+				{
+					const bool inside = i >= guard + destOffset && i < guard + destOffset + size;
+					const uint8_t expected = inside ? source[srcOffset + i - guard - destOffset] : uint8_t(0xcd);
+					if (dest[i] != expected)
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	// Overlap tests of the registry, on a range no real mapping can be at.
+	static const uint8_t mapping[256] = {};
+	RegisterWriteCombined(mapping + 64, 128);
+	const bool overlaps = IsWriteCombined(mapping + 190, 4) && IsWriteCombined(mapping, 65) && IsWriteCombined(mapping + 100, 1);
+	const bool separate = !IsWriteCombined(mapping, 64) && !IsWriteCombined(mapping + 192, 64);
+	UnregisterWriteCombined(mapping + 64);
+	return overlaps && separate && !IsWriteCombined(mapping + 100, 1);
+}
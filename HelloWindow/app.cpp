@@ -9,6 +9,8 @@ platform plat;
 app::app(UINT width, UINT height, std::wstring name, HINSTANCE hInstance, int nCmdShow) 
 	: IApp(width, height, name), m_width(width), m_height(height),
 	m_frameIndex(0),
+	m_fenceEvent(nullptr),
+	m_frameRing(FrameCount),
 	m_viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
 	m_scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
 	m_rtvDescriptorSize(0)
@@ -60,23 +62,29 @@ void app::OnRender()
 	// Present the frame.
 	ThrowIfFailed(m_swapChain->Present(1, 0));
 
-	WaitForPreviousFrame();
+	MoveToNextFrame();
 }
 void app::OnDestroy() 
 {
+	// Ensure that the GPU is no longer referencing resources that are about to be
+	// cleaned up by the destructor.
+	WaitForGpu();
 
+	CloseHandle(m_fenceEvent);
 }
 void app::PopulateCommandList() 
 {
 	// Command list allocators can only be reset when the associated 
 	// command lists have finished execution on the GPU; apps should use 
-	// fences to determine GPU execution progress.
-	ThrowIfFailed(m_commandAllocator->Reset());
+	// fences to determine GPU execution progress. MoveToNextFrame() waited for
+	// the frame that last used this allocator.
+	ID3D12CommandAllocator* pCommandAllocator = m_commandAllocators[m_frameRing.GetCurrentIndex()].Get();
+	ThrowIfFailed(pCommandAllocator->Reset());
 
 	// However, when ExecuteCommandList() is called on a particular command 
 	// list, that command list can then be reset at any time and must be before 
 	// re-recording.
-	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
+	ThrowIfFailed(m_commandList->Reset(pCommandAllocator, m_pipelineState.Get()));
 
 	m_commandList->SetGraphicsRootSignature(m_rootSignature.Get());
 	m_commandList->RSSetViewports(1, &m_viewport);
@@ -101,26 +109,32 @@ void app::PopulateCommandList()
 	ThrowIfFailed(m_commandList->Close());
 }
 
-void app::WaitForPreviousFrame() 
+void app::MoveToNextFrame() 
 {
-	// WAITING FOR THE FRAME TO COMPLETE BEFORE CONTINUING IS NOT BEST PRACTICE.
-	// This is code implemented as such for simplicity. The D3D12HelloFrameBuffering
-	// sample illustrates how to use fences for efficient resource usage and to
-	// maximize GPU utilization.
-
-	// Signal and increment the fence value.
-	const UINT64 fence = m_fenceValue;
-	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fence));
-	m_fenceValue++;
-
-	// Wait until the previous frame is finished.
-	if (m_fence->GetCompletedValue() < fence) 
+	// Mark the end of this frame; the fence reaches the value once the GPU has executed it.
+	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), m_frameRing.EndFrame()));
+
+	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+
+	// Only block if the GPU still executes the frame that last recorded with the next
+	// allocator. The frame submitted just now keeps running while we record the next one.
+	WaitForFenceValue(m_frameRing.GetReuseFenceValue());
+}
+
+void app::WaitForGpu() 
+{
+	const UINT64 fenceValue = m_frameRing.Flush();
+	ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), fenceValue));
+	WaitForFenceValue(fenceValue);
+}
+
+void app::WaitForFenceValue(UINT64 fenceValue) 
+{
+	if (m_fence->GetCompletedValue() < fenceValue)
 	{
-		ThrowIfFailed(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
+		ThrowIfFailed(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent));
 		WaitForSingleObject(m_fenceEvent, INFINITE);
 	}
-
-	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 }
 
 void app::LoadPipeline() {
@@ -211,15 +225,16 @@ void app::LoadPipeline() {
 	{
 		CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(m_rtvHeap->GetCPUDescriptorHandleForHeapStart());
 
+		// Create a RTV and a command allocator for each frame.
 		for (UINT n = 0; n < FrameCount; n++)
 		{
 			ThrowIfFailed(m_swapChain->GetBuffer(n, IID_PPV_ARGS(&m_renderTargets[n])));
 			m_device->CreateRenderTargetView(m_renderTargets[n].Get(), nullptr, rtvHandle);
 			rtvHandle.Offset(1, m_rtvDescriptorSize);
+
+			ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocators[n])));
 		}
 	}
-
-	ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator)));
 }
 
 void app::LoadAssets() {
@@ -269,7 +284,7 @@ void app::LoadAssets() {
 	}
 
 	// Create the command list.
-	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList)));
+	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocators[m_frameRing.GetCurrentIndex()].Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList)));
 
 	// Command lists are created in the recording state, but there is nothing
 	// to record yet. The main loop expects it to be closed, so close it now.
@@ -302,7 +317,7 @@ void app::LoadAssets() {
 		UINT8* pVertexDataBegin;
 		CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
 		ThrowIfFailed(m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-		memcpy(pVertexDataBegin, triangleVertices, sizeof(triangleVertices));
+		UploadCopy(pVertexDataBegin, triangleVertices, sizeof(triangleVertices));
 		m_vertexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view.
@@ -312,7 +327,6 @@ void app::LoadAssets() {
 
 		// Create synchronization objects and wait until assets have been uploaded to the GPU.
 		ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-		m_fenceValue = 1;
 
 		// Create an event handle to use for frame synchronization.
 		m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
@@ -324,7 +338,7 @@ void app::LoadAssets() {
 		// Wait for the command list to execute; we are reusing the same command 
 		// list in our main loop but for now, we just want to wait for setup to 
 		// complete before continuing.
-		WaitForPreviousFrame();
+		WaitForGpu();
 	}
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "IApp.h"
+#include "UploadCopy.h"
+#include "FrameRing.h"
 
 using namespace DirectX;
 
@@ -28,6 +30,7 @@ public:
 	void OnKeyUp(UINT8 key) override;
 
 private:
+	// Both the number of back buffers and of frames the CPU may record ahead of the GPU.
 	static const UINT FrameCount = 2;
 
 	struct Vertex
@@ -42,7 +45,7 @@ private:
 	ComPtr<IDXGISwapChain4> m_swapChain;
 	ComPtr<ID3D12Device> m_device;
 	ComPtr<ID3D12Resource> m_renderTargets[FrameCount];
-	ComPtr<ID3D12CommandAllocator> m_commandAllocator;
+	ComPtr<ID3D12CommandAllocator> m_commandAllocators[FrameCount];
 	ComPtr<ID3D12CommandQueue> m_commandQueue;
 	ComPtr<ID3D12RootSignature> m_rootSignature;
 	ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
@@ -58,10 +61,12 @@ private:
 	UINT m_frameIndex;
 	HANDLE m_fenceEvent;
 	ComPtr<ID3D12Fence> m_fence;
-	UINT64 m_fenceValue;
+	FrameRing m_frameRing;
 
 	void PopulateCommandList();
-	void WaitForPreviousFrame();
+	void MoveToNextFrame();
+	void WaitForGpu();
+	void WaitForFenceValue(UINT64 fenceValue);
 	void LoadPipeline();
 	void LoadAssets();
 
@@ -0,0 +1,133 @@
+#include "UploadCopyBenchmark.h"
+#include "UploadCopy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	struct Payload
+	{
+		const char* name;
+		size_t size;
+	};
+
+	// Sizes of what the samples write into upload heaps.
+	const Payload c_payloads[] =
+	{
+		{ "constant_block", 256 },					// One CbufferStruct at its placement size
+		{ "mesh_vertices", 64 * 1024 },
+		{ "particle_vertices_100k", 100000 * 24 },	// ParticleVertex, VertexFormat::Full
+		{ "texture_1024_rgba8", 1024 * 1024 * 4 },
+		{ "particle_vertices_1m", 1000000 * 24 }
+	};
+
+	struct Kernel
+	{
+		const char* name;
+		UploadCopyKernels::CopyFunc copy;
+	};
+
+	void CopyMemcpy(void* pDest, const void* pSrc, size_t size)
+	{
+		memcpy(pDest, pSrc, size);
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	// Median time of one copy, in ns. Copies go to consecutive slots of a destination ring
+	// of at least 1 MB at placement alignment, the way UploadRing hands them out, so small
+	// payloads do not keep rewriting the same cache lines.
+	double MeasureCopy(UploadCopyKernels::CopyFunc copy, const std::vector<uint8_t>& source, size_t size, std::vector<uint8_t>& dest, int samples)
+	{
+		const size_t slotSize = (size + 255) & ~size_t(255);
+		const size_t slotCount = std::max<size_t>(dest.size() / slotSize, 1);
+		const size_t copiesPerSample = std::max<size_t>((4 * 1024 * 1024) / size, 1);
+
+		std::vector<double> times;
+		size_t slot = 0;
+		for (int sample = -1; sample < samples; sample++)
+		{
+			const Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < copiesPerSample; i++)
+			{
+				copy(dest.data() + slot * slotSize, source.data(), size);
+				slot = (slot + 1) % slotCount;
+			}
+			const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+			// The first round only warms up.
+			if (sample >= 0)
+			{
+				times.push_back(ns / copiesPerSample);
+			}
+		}
+
+		std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+		return times[times.size() / 2];
+	}
+}
+
+void RunUploadCopyBenchmark(FILE* pFile, int samples)
+{
+	const SimdLevel detected = DetectSimdLevel();
+	std::vector<Kernel> kernels = { { "memcpy", CopyMemcpy } };
+	if (detected == SimdLevel::SSE || detected == SimdLevel::AVX2)
+	{
+		kernels.push_back({ "sse2", UploadCopyKernels::CopySSE2 });
+	}
+	if (detected == SimdLevel::AVX2)
+	{
+		kernels.push_back({ "avx2", UploadCopyKernels::CopyAVX2 });
+	}
+	if (detected == SimdLevel::NEON)
+	{
+		kernels.push_back({ "neon", UploadCopyKernels::CopyNEON });
+	}
+
+	size_t maxSize = 0;
+	for (const Payload& payload : c_payloads)
+	{
+		maxSize = std::max(maxSize, payload.size);
+	}
+
+	std::vector<uint8_t> source(maxSize);
+	for (size_t i = 0; i < source.size(); i++)
+	{
+		source[i] = static_cast<uint8_t>(i * 13 + 1);
+	}
+
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "  \"benchmark\": \"HelloRainEffect upload copies\",\n");
+	fprintf(pFile, "  \"simd\": \"%s\",\n", SimdLevelName(detected));
+	fprintf(pFile, "  \"payloads\": [\n");
+
+	const size_t payloadCount = sizeof(c_payloads) / sizeof(c_payloads[0]);
+	for (size_t p = 0; p < payloadCount; p++)
+	{
+		const Payload& payload = c_payloads[p];
+		std::vector<uint8_t> dest(std::max<size_t>(payload.size, 1024 * 1024) + 256);
+
+		fprintf(stderr, "%s, %zu bytes\n", payload.name, payload.size);
+		fprintf(pFile, "    { \"name\": \"%s\", \"bytes\": %zu, \"kernels\": {", payload.name, payload.size);
+
+		double memcpyNs = 0.;
+		for (size_t k = 0; k < kernels.size(); k++)
+		{
+			const double ns = MeasureCopy(kernels[k].copy, source, payload.size, dest, samples);
+			if (k == 0)
+			{
+				memcpyNs = ns;
+			}
+			fprintf(pFile, "%s \"%s\": { \"ns\": %.1f, \"gb_per_s\": %.2f, \"vs_memcpy\": %.2f }",
+				k ? "," : "", kernels[k].name, ns, ns > 0. ? payload.size / ns : 0., ns > 0. ? memcpyNs / ns : 0.);
+		}
+		fprintf(pFile, " } }%s\n", p + 1 < payloadCount ? "," : "");
+	}
+
+	fprintf(pFile, "  ]\n");
+	fprintf(pFile, "}\n");
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// ParticleBenchmark -upload: the UploadCopy kernels of HelloRainEffect against memcpy,
+// on synthetic payloads sized like a constant block, mesh and particle vertices and a
+// texture, written as JSON to pFile.
+//
+// On Linux the destination is ordinary write-back memory rather than a write-combined
+// mapping: the numbers show what bypassing the cache costs or saves against memcpy for
+// each size, not the penalty of partial lines on an upload heap, which only shows on the
+// real thing.
+
+#include <cstdio>
+
+void RunUploadCopyBenchmark(FILE* pFile, int samples);
@@ -0,0 +1,574 @@
+// Headless benchmark of the HelloRainEffect CPU particle pipeline.
+//
+// Runs the same stages as the -cpu -cull -sort path of HelloRainEffect (emit, step,
+// cull, sort, then packing into a draw buffer in the full and compact vertex formats)
+// over a range of particle and thread counts, without a window or a D3D12 device, and
+// prints the results as JSON. The sort is also timed alone over every alive particle,
+// without culling (sort_all), which is not counted in the frame. Each stage also reports
+// its speedup over the one-thread run with the same particle count (ms at 1 thread / ms at
+// N threads) and its parallel efficiency (speedup / N); the one-thread run is always made
+// for that. With -upload, it benchmarks the upload copy kernels (UploadCopy.h) against
+// memcpy instead.
+//
+// Only the portable sources of HelloRainEffect are used, so it also builds on Linux:
+//
+//   g++ -std=c++17 -O2 -pthread -I../HelloRainEffect main.cpp ../HelloRainEffect/ParticleSimulator.cpp
+//       ../HelloRainEffect/ParticleSystem.cpp ../HelloRainEffect/JobSystem.cpp ../HelloRainEffect/ParticleSort.cpp
+//       ../HelloRainEffect/ParticleCulling.cpp ../HelloRainEffect/ParticleCompression.cpp
+//       ../HelloRainEffect/SimdLevel.cpp ../HelloRainEffect/UploadCopy.cpp UploadCopyBenchmark.cpp -o ParticleBenchmark
+//
+// Usage: ParticleBenchmark [-particles 100,1000,...] [-threads 1,2,...] [-frames N] [-out file.json]
+//        ParticleBenchmark -upload [-frames N] [-out file.json]
+
+#include "ParticleSystem.h"
+#include "ParticleSort.h"
+#include "ParticleCulling.h"
+#include "ParticleCompression.h"
+#include "JobSystem.h"
+#include "UploadCopyBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Same scene as HelloRainEffect: camera, projection and rain emitter.
+	const float c_eye[3] = { 0.f, 50.f, -50.f };
+	const float c_at[3] = { 0.f, 0.f, 0.f };
+	const float c_nearPlane = .01f;
+	const float c_farPlane = 100.f;
+	const float c_aspectRatio = 1280.f / 720.f;
+	const float c_meanRainFallTime = .55f;
+	const float c_deltaTime = 1.f / 60.f;
+	const size_t c_particleChunkSize = 8192;
+
+	enum Stage
+	{
+		StageEmit,			// ParticleSystem::Update: aging, kills and spawns (serial)
+		StageStep,			// Fall step over the alive particles
+		StageCull,			// Frustum and distance LOD
+		StageSort,			// Back-to-front radix sort of the visible particles
+		StagePackFull,		// Gather into 24-byte vertices
+		StagePackCompact,	// Gather and quantize into 12-byte vertices
+		StageSortAll,		// The same sort over every alive particle, without culling (not part of a frame)
+		StageCount
+	};
+
+	const char* const c_stageNames[StageCount] = { "emit", "step", "cull", "sort", "pack_full", "pack_compact", "sort_all" };
+
+	struct Options
+	{
+		std::vector<size_t> particleCounts = { 100, 1000, 10000, 100000, 1000000, 10000000 };
+		std::vector<unsigned int> threadCounts;
+		int frames = 0;			// 0: enough frames for ~30M particle updates, within [5, 200]
+		std::string outPath;
+		bool upload = false;	// Benchmark the upload copies instead
+	};
+
+	struct StageResult
+	{
+		double nsPerFrame;		// Median over the measured frames
+		size_t items;			// Particles the stage works on
+		size_t bytes;			// Estimated memory traffic per frame
+	};
+
+	struct RunResult
+	{
+		size_t capacity;
+		unsigned int threads;
+		int frames;
+		size_t alive;
+		size_t visible;
+		size_t workingSetBytes;
+		StageResult stages[StageCount];
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	double ElapsedNs(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	}
+
+	// Row-major matrices applied to row vectors, as XMMatrixLookAtLH and XMMatrixPerspectiveFovLH build them.
+	void LookAtLH(const float eye[3], const float at[3], float m[4][4])
+	{
+		float z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+		const float zLength = std::sqrt(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+		for (float& c : z) c /= zLength;
+
+		// x = normalize(cross(up, z)) with up = (0, 1, 0)
+		float x[3] = { z[2], 0.f, -z[0] };
+		const float xLength = std::sqrt(x[0] * x[0] + x[2] * x[2]);
+		for (float& c : x) c /= xLength;
+
+		const float y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+		for (int i = 0; i < 3; i++)
+		{
+			m[i][0] = x[i];
+			m[i][1] = y[i];
+			m[i][2] = z[i];
+			m[i][3] = 0.f;
+		}
+		m[3][0] = -(x[0] * eye[0] + x[1] * eye[1] + x[2] * eye[2]);
+		m[3][1] = -(y[0] * eye[0] + y[1] * eye[1] + y[2] * eye[2]);
+		m[3][2] = -(z[0] * eye[0] + z[1] * eye[1] + z[2] * eye[2]);
+		m[3][3] = 1.f;
+	}
+
+	void PerspectiveFovLH(float fovY, float aspectRatio, float nearZ, float farZ, float m[4][4])
+	{
+		const float height = 1.f / std::tan(.5f * fovY);
+		const float range = farZ / (farZ - nearZ);
+		memset(m, 0, 16 * sizeof(float));
+		m[0][0] = height / aspectRatio;
+		m[1][1] = height;
+		m[2][2] = range;
+		m[2][3] = 1.f;
+		m[3][2] = -range * nearZ;
+	}
+
+	void Multiply(const float a[4][4], const float b[4][4], float m[4][4])
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				m[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j] + a[i][3] * b[3][j];
+			}
+		}
+	}
+
+	// Frames measured for a given particle count.
+	int FrameCount(const Options& options, size_t capacity)
+	{
+		if (options.frames > 0)
+		{
+			return options.frames;
+		}
+		return static_cast<int>(std::min<size_t>(std::max<size_t>(30000000 / capacity, 5), 200));
+	}
+
+	RunResult Run(size_t capacity, unsigned int threads, int frames)
+	{
+		JobSystem jobSystem(threads);
+
+		// The rain emitter of HelloRainEffect, prewarmed to its steady state.
+		ParticleSystem particleSystem(capacity);
+		EmitterDesc rain;
+		rain.spawnMin[0] = -20.f; rain.spawnMin[1] = 50.f; rain.spawnMin[2] = -20.f;
+		rain.spawnMax[0] = 20.f;  rain.spawnMax[1] = 50.f; rain.spawnMax[2] = 20.f;
+		rain.speedMin = 100.f;
+		rain.speedMax = 300.f;
+		rain.size[0] = .05f;
+		rain.size[1] = 5.f;
+		rain.killBelow = -50.f;
+		rain.lifetimeMin = rain.lifetimeMax = 2.f;
+		rain.spawnRate = capacity / c_meanRainFallTime;
+		particleSystem.AddEmitter(rain);
+		particleSystem.Prewarm(1.f, c_deltaTime);
+
+		const ParticleQuantization quantization = { { -20.f, -50.f, -20.f }, { 20.f, 50.f, 20.f }, 100.f, 300.f };
+
+		float view[4][4], projection[4][4], viewProjection[4][4];
+		LookAtLH(c_eye, c_at, view);
+		PerspectiveFovLH(3.14159265f / 4.f, c_aspectRatio, c_nearPlane, c_farPlane, projection);
+		Multiply(view, projection, viewProjection);
+
+		ParticleCullParams cullParams;
+		ExtractFrustumPlanes(viewProjection, cullParams.planes);
+		for (int i = 0; i < 4; i++)
+		{
+			cullParams.depthAxis[i] = view[i][2];
+		}
+		cullParams.lodStart = 60.f;
+		cullParams.lodEnd = 100.f;
+		cullParams.lodMinKeep = .35f;
+
+		ParticleCuller culler;
+		ParticleDepthSorter sorter;
+		ParticleDepthSorter sorterAll;
+		std::vector<ParticleVertex> fullVertices(capacity);
+		std::vector<CompactParticleVertex> compactVertices(capacity);
+
+		std::vector<double> samples[StageCount];
+		size_t aliveSum = 0;
+		size_t visibleSum = 0;
+
+		// One extra frame up front to warm the caches and grow the scratch buffers.
+		for (int frame = -1; frame < frames; frame++)
+		{
+			double ns[StageCount];
+			ParticleSimulator& simulator = particleSystem.Simulator();
+
+			Clock::time_point start = Clock::now();
+			particleSystem.Update(c_deltaTime);
+			ns[StageEmit] = ElapsedNs(start);
+
+			const size_t alive = particleSystem.AliveCount();
+			const ParticleStepParams stepParams = particleSystem.StepParams(c_deltaTime);
+			start = Clock::now();
+			jobSystem.ParallelFor(0, alive, c_particleChunkSize, [&](size_t begin, size_t end)
+			{
+				simulator.StepRange(stepParams, begin, end);
+			});
+			ns[StageStep] = ElapsedNs(start);
+
+			start = Clock::now();
+			const size_t visible = culler.Cull(simulator.Streams(), particleSystem.Handles(), alive, cullParams, &jobSystem);
+			ns[StageCull] = ElapsedNs(start);
+
+			start = Clock::now();
+			const uint32_t* order = sorter.Sort(simulator.Streams(), culler.VisibleIndices(), visible, view, c_nearPlane, c_farPlane, &jobSystem);
+			ns[StageSort] = ElapsedNs(start);
+
+			start = Clock::now();
+			jobSystem.ParallelFor(0, visible, c_particleChunkSize, [&](size_t begin, size_t end)
+			{
+				simulator.WriteVerticesIndexed(fullVertices.data() + begin, order, begin, end);
+			});
+			ns[StagePackFull] = ElapsedNs(start);
+
+			start = Clock::now();
+			jobSystem.ParallelFor(0, visible, c_particleChunkSize, [&](size_t begin, size_t end)
+			{
+				EncodeCompactVerticesIndexed(simulator.Streams(), order, quantization, begin, end, compactVertices.data() + begin);
+			});
+			ns[StagePackCompact] = ElapsedNs(start);
+
+			start = Clock::now();
+			sorterAll.Sort(simulator.Streams(), alive, view, c_nearPlane, c_farPlane, &jobSystem);
+			ns[StageSortAll] = ElapsedNs(start);
+
+			if (frame >= 0)
+			{
+				for (int stage = 0; stage < StageCount; stage++)
+				{
+					samples[stage].push_back(ns[stage]);
+				}
+				aliveSum += alive;
+				visibleSum += visible;
+			}
+		}
+
+		RunResult result;
+		result.capacity = capacity;
+		result.threads = jobSystem.GetThreadCount();
+		result.frames = frames;
+		result.alive = aliveSum / frames;
+		result.visible = visibleSum / frames;
+
+		// Traffic estimates from the data each stage has to read and write, ignoring the
+		// reuse of cache lines between stages.
+		const size_t a = result.alive;
+		const size_t v = result.visible;
+		const size_t keyPasses = 3;
+		const size_t bytes[StageCount] =
+		{
+			a * (sizeof(float) + sizeof(float)),								// Remaining life read/write, height read
+			a * 3 * sizeof(float),												// Height read/write, speed read
+			a * 5 * sizeof(float) + v * sizeof(uint32_t) + a * sizeof(uint32_t),	// Position and size, handles, visible list
+			v * (3 * sizeof(float) + 3 * sizeof(uint32_t)) + keyPasses * v * 4 * sizeof(uint32_t),	// Key pass, then read and scatter pairs
+			v * (sizeof(uint32_t) + 6 * sizeof(float) + sizeof(ParticleVertex)),
+			v * (sizeof(uint32_t) + 6 * sizeof(float) + sizeof(CompactParticleVertex)),
+			a * (3 * sizeof(float) + 2 * sizeof(uint32_t)) + keyPasses * a * 4 * sizeof(uint32_t)	// Streamed key pass, then the pairs
+		};
+		const size_t items[StageCount] = { a, a, a, v, v, v, a };
+
+		for (int stage = 0; stage < StageCount; stage++)
+		{
+			std::vector<double>& s = samples[stage];
+			std::nth_element(s.begin(), s.begin() + s.size() / 2, s.end());
+			result.stages[stage].nsPerFrame = s[s.size() / 2];
+			result.stages[stage].items = items[stage];
+			result.stages[stage].bytes = bytes[stage];
+		}
+
+		// Particle streams plus the per-particle pool data, the cull/sort arrays (both sorters) and both draw buffers.
+		result.workingSetBytes = capacity * (6 * sizeof(float) + sizeof(float) + sizeof(uint16_t) + 3 * sizeof(uint32_t)) +
+			capacity * 9 * sizeof(uint32_t) + capacity * (sizeof(ParticleVertex) + sizeof(CompactParticleVertex));
+
+		return result;
+	}
+
+	// Size of a cache level in bytes as reported by the OS, 0 if unknown.
+	size_t CacheSize(int level, bool data)
+	{
+#if defined(__linux__)
+		for (int index = 0; index < 8; index++)
+		{
+			char path[128];
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+			FILE* pFile = fopen(path, "r");
+			if (!pFile)
+			{
+				break;
+			}
+			int fileLevel = 0;
+			const bool hasLevel = fscanf(pFile, "%d", &fileLevel) == 1;
+			fclose(pFile);
+			if (!hasLevel || fileLevel != level)
+			{
+				continue;
+			}
+
+			char type[32] = {};
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+			if ((pFile = fopen(path, "r")) != nullptr)
+			{
+				if (fscanf(pFile, "%31s", type) != 1)
+				{
+					type[0] = '\0';
+				}
+				fclose(pFile);
+			}
+			if (data && strcmp(type, "Instruction") == 0)
+			{
+				continue;
+			}
+
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+			if ((pFile = fopen(path, "r")) != nullptr)
+			{
+				size_t size = 0;
+				char unit = 0;
+				const int fields = fscanf(pFile, "%zu%c", &size, &unit);
+				fclose(pFile);
+				if (fields >= 1)
+				{
+					return unit == 'K' ? size * 1024 : unit == 'M' ? size * 1024 * 1024 : size;
+				}
+			}
+		}
+#else
+		(void)level;
+		(void)data;
+#endif
+		return 0;
+	}
+
+	template <typename T>
+	bool ParseList(const char* text, std::vector<T>& values)
+	{
+		values.clear();
+		while (*text)
+		{
+			char* end = nullptr;
+			const double value = strtod(text, &end);
+			if (end == text || value < 1.)
+			{
+				return false;
+			}
+			values.push_back(static_cast<T>(value));
+			text = *end == ',' ? end + 1 : end;
+		}
+		return !values.empty();
+	}
+
+	bool ParseCommandLineArgs(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const bool hasValue = i + 1 < argc;
+			if ((strcmp(argv[i], "-particles") == 0 || strcmp(argv[i], "/particles") == 0) && hasValue)
+			{
+				if (!ParseList(argv[++i], options.particleCounts)) return false;
+			}
+			else if ((strcmp(argv[i], "-threads") == 0 || strcmp(argv[i], "/threads") == 0) && hasValue)
+			{
+				if (!ParseList(argv[++i], options.threadCounts)) return false;
+			}
+			else if ((strcmp(argv[i], "-frames") == 0 || strcmp(argv[i], "/frames") == 0) && hasValue)
+			{
+				options.frames = atoi(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "-out") == 0 || strcmp(argv[i], "/out") == 0) && hasValue)
+			{
+				options.outPath = argv[++i];
+			}
+			else if (strcmp(argv[i], "-upload") == 0 || strcmp(argv[i], "/upload") == 0)
+			{
+				options.upload = true;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		if (!options.threadCounts.empty())
+		{
+			// The baseline of the speedups.
+			if (std::find(options.threadCounts.begin(), options.threadCounts.end(), 1u) == options.threadCounts.end())
+			{
+				options.threadCounts.insert(options.threadCounts.begin(), 1u);
+			}
+		}
+		else
+		{
+			// Powers of two up to the hardware thread count, which is always included.
+			const unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+			for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2)
+			{
+				options.threadCounts.push_back(threads);
+			}
+			options.threadCounts.push_back(hardwareThreads);
+		}
+		return true;
+	}
+
+	// Smallest cache level the working set fits in, so the scaling curves can be read against it.
+	const char* FittingCache(size_t bytes, const size_t cacheBytes[3])
+	{
+		const char* const names[3] = { "l1d", "l2", "l3" };
+		for (int level = 0; level < 3; level++)
+		{
+			if (cacheBytes[level] && bytes <= cacheBytes[level])
+			{
+				return names[level];
+			}
+		}
+		return "dram";
+	}
+
+	// Time of a frame, or of a stage, at 1 thread over its time at run.threads, and that
+	// speedup per thread. Zero when there is no one-thread run to compare with.
+	struct Scaling
+	{
+		double speedup;
+		double efficiency;
+	};
+
+	Scaling ComputeScaling(const RunResult* pBaseline, const RunResult& run, double baselineNs, double ns)
+	{
+		if (!pBaseline || baselineNs <= 0. || ns <= 0.)
+		{
+			return { 0., 0. };
+		}
+		const double speedup = baselineNs / ns;
+		return { speedup, speedup / run.threads };
+	}
+
+	const RunResult* FindBaseline(const std::vector<RunResult>& results, size_t capacity)
+	{
+		for (const RunResult& run : results)
+		{
+			if (run.capacity == capacity && run.threads == 1)
+			{
+				return &run;
+			}
+		}
+		return nullptr;
+	}
+
+	// A frame packs in one of the two formats; count the full one like the app's default.
+	// sort_all only measures the sort on its own.
+	double FrameNs(const RunResult& run)
+	{
+		double frameNs = 0.;
+		for (int stage = 0; stage < StageCount; stage++)
+		{
+			frameNs += stage == StagePackCompact || stage == StageSortAll ? 0. : run.stages[stage].nsPerFrame;
+		}
+		return frameNs;
+	}
+
+	void WriteJson(FILE* pFile, const std::vector<RunResult>& results)
+	{
+		const size_t cacheBytes[3] = { CacheSize(1, true), CacheSize(2, true), CacheSize(3, true) };
+
+		fprintf(pFile, "{\n");
+		fprintf(pFile, "  \"benchmark\": \"HelloRainEffect particle pipeline\",\n");
+		fprintf(pFile, "  \"simd\": \"%s\",\n", SimdLevelName(DetectSimdLevel()));
+		fprintf(pFile, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+		fprintf(pFile, "  \"cache_bytes\": { \"l1d\": %zu, \"l2\": %zu, \"l3\": %zu },\n", cacheBytes[0], cacheBytes[1], cacheBytes[2]);
+		fprintf(pFile, "  \"vertex_bytes\": { \"full\": %zu, \"compact\": %zu },\n", sizeof(ParticleVertex), sizeof(CompactParticleVertex));
+		fprintf(pFile, "  \"runs\": [\n");
+
+		for (size_t r = 0; r < results.size(); r++)
+		{
+			const RunResult& run = results[r];
+			const RunResult* pBaseline = FindBaseline(results, run.capacity);
+
+			const double frameNs = FrameNs(run);
+			const Scaling frameScaling = ComputeScaling(pBaseline, run, pBaseline ? FrameNs(*pBaseline) : 0., frameNs);
+
+			fprintf(pFile, "    {\n");
+			fprintf(pFile, "      \"particles\": %zu, \"threads\": %u, \"frames\": %d, \"alive\": %zu, \"visible\": %zu,\n",
+				run.capacity, run.threads, run.frames, run.alive, run.visible);
+			fprintf(pFile, "      \"working_set_bytes\": %zu, \"working_set_fits_in\": \"%s\", \"frame_ms\": %.4f, \"ns_per_particle\": %.3f,\n",
+				run.workingSetBytes, FittingCache(run.workingSetBytes, cacheBytes), frameNs * 1e-6, run.alive ? frameNs / run.alive : 0.);
+			fprintf(pFile, "      \"speedup\": %.3f, \"efficiency\": %.3f,\n", frameScaling.speedup, frameScaling.efficiency);
+			fprintf(pFile, "      \"stages\": {\n");
+			for (int stage = 0; stage < StageCount; stage++)
+			{
+				const StageResult& s = run.stages[stage];
+				const double nsPerParticle = s.items ? s.nsPerFrame / s.items : 0.;
+				const double gbPerSecond = s.nsPerFrame > 0. ? s.bytes / s.nsPerFrame : 0.;
+				const double bytesPerParticle = s.items ? static_cast<double>(s.bytes) / s.items : 0.;
+				const Scaling scaling = ComputeScaling(pBaseline, run, pBaseline ? pBaseline->stages[stage].nsPerFrame : 0., s.nsPerFrame);
+				fprintf(pFile, "        \"%s\": { \"ms_per_frame\": %.4f, \"ns_per_particle\": %.3f, \"bytes_per_frame\": %zu, \"bytes_per_particle\": %.1f, \"gb_per_s\": %.2f, \"speedup\": %.3f, \"efficiency\": %.3f }%s\n",
+					c_stageNames[stage], s.nsPerFrame * 1e-6, nsPerParticle, s.bytes, bytesPerParticle, gbPerSecond, scaling.speedup, scaling.efficiency, stage + 1 < StageCount ? "," : "");
+			}
+			fprintf(pFile, "      }\n");
+			fprintf(pFile, "    }%s\n", r + 1 < results.size() ? "," : "");
+		}
+
+		fprintf(pFile, "  ]\n");
+		fprintf(pFile, "}\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseCommandLineArgs(argc, argv, options))
+	{
+		fprintf(stderr, "usage: %s [-particles 100,1000,...] [-threads 1,2,...] [-frames N] [-out file.json]\n", argv[0]);
+		fprintf(stderr, "       %s -upload [-frames N] [-out file.json]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<RunResult> results;
+	if (!options.upload)
+	{
+		for (size_t capacity : options.particleCounts)
+		{
+			for (unsigned int threads : options.threadCounts)
+			{
+				fprintf(stderr, "%zu particles, %u threads\n", capacity, threads);
+				results.push_back(Run(capacity, threads, FrameCount(options, capacity)));
+			}
+		}
+	}
+
+	FILE* pFile = options.outPath.empty() ? stdout : fopen(options.outPath.c_str(), "w");
+	if (!pFile)
+	{
+		fprintf(stderr, "cannot open %s\n", options.outPath.c_str());
+		return 1;
+	}
+	if (options.upload)
+	{
+		// Frames are the samples of each copy here.
+		RunUploadCopyBenchmark(pFile, options.frames > 0 ? options.frames : 21);
+	}
+	else
+	{
+		WriteJson(pFile, results);
+	}
+	if (pFile != stdout)
+	{
+		fclose(pFile);
+	}
+
+	return 0;
+}
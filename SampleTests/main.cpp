@@ -0,0 +1,150 @@
+// Headless tests of the portable code the samples share.
+//
+// Runs every Verify*() and Stress*() check of the samples without a window or a D3D12
+// device, prints one line per check and exits with 1 if any failed. The checks used to
+// run at the startup of the Debug builds of the samples; they live here so a Debug
+// launch does not pay for them and so they run on Linux.
+//
+// Headers copied from one sample to the next (FrameRing.h, UploadRing.h, CbufferLayout.h)
+// are the same file in every sample, so each is checked through one copy.
+//
+//   g++ -std=c++17 -O2 -pthread -I../HelloRainEffect main.cpp ../HelloRainEffect/FramePacer.cpp
+//       ../HelloRainEffect/FrameTimeHistogram.cpp ../HelloRainEffect/GameLoop.cpp
+//       ../HelloRainEffect/JobSystem.cpp ../HelloRainEffect/ParticleCompression.cpp
+//       ../HelloRainEffect/ParticleCulling.cpp ../HelloRainEffect/ParticleSimulationThread.cpp
+//       ../HelloRainEffect/ParticleSimulator.cpp ../HelloRainEffect/ParticleSort.cpp
+//       ../HelloRainEffect/ParticleSystem.cpp ../HelloRainEffect/PresentStateMachine.cpp
+//       ../HelloRainEffect/SimdLevel.cpp ../HelloRainEffect/StepTimer.cpp
+//       ../HelloRainEffect/TimelineFence.cpp ../HelloRainEffect/UploadCopy.cpp
+//       ../HelloRainEffect/UploadService.cpp -o SampleTests
+//
+// Usage: SampleTests [name ...]    Only run the checks whose name contains one of the arguments.
+
+#include "../HelloWindow/FrameRing.h"
+#include "../HelloLighting/RootSignatureBuilder.h"
+#include "BillboardMath.h"
+#include "CbufferLayout.h"
+#include "FramePacer.h"
+#include "FrameTimeHistogram.h"
+#include "GameLoop.h"
+#include "ParticleCompression.h"
+#include "ParticleCulling.h"
+#include "ParticleSimulationThread.h"
+#include "ParticleSimulator.h"
+#include "ParticleSort.h"
+#include "ParticleSystem.h"
+#include "ReadbackRing.h"
+#include "StepTimer.h"
+#include "TimelineFence.h"
+#include "UploadCopy.h"
+#include "UploadRing.h"
+#include "UploadService.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Frames in flight of the samples: 2 in HelloWindow and HelloConstantBuffer, up to
+	// FrameContextRing::MaxFrameCount in HelloRainEffect.
+	const uint32_t c_maxFramesInFlight = 4;
+
+	struct Check
+	{
+		std::string name;
+		std::function<bool()> run;
+	};
+
+	std::vector<Check> GetChecks()
+	{
+		std::vector<Check> checks;
+
+		for (uint32_t framesInFlight = 2; framesInFlight <= c_maxFramesInFlight; framesInFlight++)
+		{
+			checks.push_back({ "FrameRing/" + std::to_string(framesInFlight), [framesInFlight] { return VerifyFrameRing(framesInFlight); } });
+		}
+		for (uint32_t framesInFlight = 1; framesInFlight <= c_maxFramesInFlight; framesInFlight++)
+		{
+			checks.push_back({ "TimelineFence/" + std::to_string(framesInFlight), [framesInFlight] { return StressTimelineFence(1000, framesInFlight); } });
+		}
+
+		for (uint32_t framesInFlight = 1; framesInFlight <= c_maxFramesInFlight; framesInFlight++)
+		{
+			checks.push_back({ "ReadbackRing/" + std::to_string(framesInFlight), [framesInFlight] { return VerifyReadbackRing(framesInFlight); } });
+		}
+
+		checks.push_back({ "UploadRing", [] { return VerifyUploadRing(); } });
+		checks.push_back({ "RootSignatureBuilder", [] { return VerifyRootSignatureBuilder(); } });
+		checks.push_back({ "FramePacer", [] { return VerifyFramePacer(); } });
+		checks.push_back({ "FrameTimeHistogram", [] { return VerifyFrameTimeHistogram(); } });
+		checks.push_back({ "StepTimer", [] { return VerifyStepTimer(); } });
+		checks.push_back({ "GameLoop", [] { return VerifyGameLoop(); } });
+		checks.push_back({ "ParticleSystem", [] { return VerifyParticleSystem(); } });
+		checks.push_back({ "ParticleSort", [] { return VerifyParticleSort(); } });
+		checks.push_back({ "ParticleCulling", [] { return VerifyParticleCulling(); } });
+		checks.push_back({ "ParticleSimulationThread", [] { return VerifyParticleSimulationThread(); } });
+		checks.push_back({ "UploadCopy", [] { return VerifyUploadCopy(); } });
+		checks.push_back({ "UploadService", [] { return VerifyUploadService(); } });
+
+		// The CPU kernels against MainGSSO, and the compact encoders within half a quantization step.
+		checks.push_back({ "ParticleSimulatorKernels", [] { return ParticleSimulator::VerifyKernels(1024, 256) <= 1e-4f; } });
+		checks.push_back({ "CompactRoundTrip", [] { return VerifyCompactRoundTrip(1027) <= 1.f; } });
+		checks.push_back({ "BillboardExpansion", [] { return VerifyBillboardExpansion(); } });
+
+		return checks;
+	}
+
+	bool IsSelected(const std::string& name, int argc, char** argv)
+	{
+		if (argc < 2)
+		{
+			return true;
+		}
+		for (int i = 1; i < argc; i++)
+		{
+			if (name.find(argv[i]) != std::string::npos)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int failures = 0;
+	int count = 0;
+
+	for (const Check& check : GetChecks())
+	{
+		if (!IsSelected(check.name, argc, argv))
+		{
+			continue;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		bool passed = false;
+		try
+		{
+			passed = check.run();
+		}
+		catch (const std::exception&)
+		{
+			passed = false;
+		}
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		printf("%s %-28s %9.1f ms\n", passed ? "ok  " : "FAIL", check.name.c_str(), ms);
+		failures += passed ? 0 : 1;
+		count++;
+	}
+
+	printf("%d of %d checks passed\n", count - failures, count);
+	return failures == 0 ? 0 : 1;
+}